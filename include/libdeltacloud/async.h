@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+#ifndef LIBDELTACLOUD_ASYNC_H
+#define LIBDELTACLOUD_ASYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct deltacloud_api;
+
+/**
+ * The completion callback of an asynchronous request, started by one of the
+ * deltacloud_async_* functions and run from within deltacloud_async_perform().
+ * When status is -1, deltacloud_get_last_error() describes the failure for
+ * the duration of the callback.  For a collection request, result is the
+ * head of a newly allocated list that the callback owns and must free with
+ * the matching deltacloud_free_*_list() function.  For a by-id request,
+ * result is the structure that was passed in to be filled.  For actions,
+ * result is NULL.
+ */
+typedef void (*deltacloud_async_cb)(struct deltacloud_api *api, int status,
+				    void *result, void *userdata);
+
+#define DELTACLOUD_LOOP_IN 1 /**< Wait for the descriptor to become readable */
+#define DELTACLOUD_LOOP_OUT 2 /**< Wait for the descriptor to become writable */
+
+/**
+ * A descriptor that an external event loop should watch on behalf of the
+ * asynchronous engine.
+ */
+struct deltacloud_loop_fd {
+  int fd; /**< The socket to watch */
+  int events; /**< A mask of DELTACLOUD_LOOP_IN and DELTACLOUD_LOOP_OUT */
+};
+
+/**
+ * Called whenever the engine wants a socket watched differently.  events is
+ * a mask of DELTACLOUD_LOOP_IN and DELTACLOUD_LOOP_OUT, or 0 when the socket
+ * should no longer be watched at all.  The callback must not call back into
+ * the library.
+ */
+typedef void (*deltacloud_loop_fd_cb)(struct deltacloud_api *api, int fd,
+				      int events, void *userdata);
+
+/**
+ * Called whenever the engine wants deltacloud_loop_on_timeout() called after
+ * timeout_ms milliseconds, replacing any earlier request.  A timeout_ms of
+ * -1 cancels the timer.  The callback must not call back into the library.
+ */
+typedef void (*deltacloud_loop_timer_cb)(struct deltacloud_api *api,
+					 long timeout_ms, void *userdata);
+
+int deltacloud_async_perform(struct deltacloud_api *api, int timeout_ms);
+int deltacloud_async_pending(struct deltacloud_api *api);
+int deltacloud_loop_set_hooks(struct deltacloud_api *api,
+			      deltacloud_loop_fd_cb fd_cb,
+			      deltacloud_loop_timer_cb timer_cb,
+			      void *userdata);
+int deltacloud_loop_get_fds(struct deltacloud_api *api,
+			    struct deltacloud_loop_fd *fds, int nfds,
+			    long *timeout_ms);
+int deltacloud_loop_on_readable(struct deltacloud_api *api, int fd);
+int deltacloud_loop_on_writable(struct deltacloud_api *api, int fd);
+int deltacloud_loop_on_timeout(struct deltacloud_api *api);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -79,6 +79,9 @@ int deltacloud_bucket_create_blob_from_file(struct deltacloud_api *api,
 					    const char *filename,
 					    struct deltacloud_create_parameter *params,
 					    int params_length);
+int deltacloud_bucket_foreach_blob(struct deltacloud_api *api,
+				   struct deltacloud_bucket *bucket,
+				   deltacloud_visit_cb visitor, void *userdata);
 int deltacloud_bucket_get_blob_by_id(struct deltacloud_api *api,
 				     struct deltacloud_bucket *bucket,
 				     const char *name,
@@ -99,6 +102,12 @@ int deltacloud_bucket_delete_blob(struct deltacloud_api *api,
 void deltacloud_free_bucket_blob(struct deltacloud_bucket_blob *blob);
 int deltacloud_bucket_destroy(struct deltacloud_api *api,
 			      struct deltacloud_bucket *bucket);
+int deltacloud_async_get_buckets(struct deltacloud_api *api,
+				 deltacloud_async_cb cb, void *userdata);
+int deltacloud_async_get_bucket_by_id(struct deltacloud_api *api,
+				      const char *id,
+				      struct deltacloud_bucket *bucket,
+				      deltacloud_async_cb cb, void *userdata);
 void deltacloud_free_bucket(struct deltacloud_bucket *bucket);
 void deltacloud_free_bucket_list(struct deltacloud_bucket **buckets);
 
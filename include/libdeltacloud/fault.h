@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#ifndef LIBDELTACLOUD_FAULT_H
+#define LIBDELTACLOUD_FAULT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/** The injected latency is always latency_ms */
+#define DELTACLOUD_LATENCY_FIXED 0
+/** The injected latency is drawn evenly from latency_ms to latency_ms + spread_ms */
+#define DELTACLOUD_LATENCY_UNIFORM 1
+/** The injected latency is drawn from an exponential distribution with a mean of latency_ms */
+#define DELTACLOUD_LATENCY_EXPONENTIAL 2
+/** The injected latency is drawn from a Pareto distribution that starts at latency_ms, with a tail index of shape */
+#define DELTACLOUD_LATENCY_PARETO 3
+
+/**
+ * A fault to inject into the requests of a deltacloud_api structure with
+ * deltacloud_add_fault(), to see how the library and its callers cope with
+ * a slow or failing server.  Fields that are 0 leave that aspect of the
+ * request alone.
+ */
+struct deltacloud_fault {
+  const char *pattern; /**< An fnmatch(3) pattern for the URLs to affect, or NULL for all of them */
+  double probability; /**< The share of matching requests to affect, above 0 and up to 1 */
+  int distribution; /**< How latency_ms is applied; one of the DELTACLOUD_LATENCY_* values */
+  long latency_ms; /**< Extra time before the response starts to arrive */
+  long spread_ms; /**< The width of DELTACLOUD_LATENCY_UNIFORM */
+  double shape; /**< The tail index of DELTACLOUD_LATENCY_PARETO; 0 means 1.5 */
+  long bandwidth; /**< The most response body bytes to receive per second */
+  size_t stall_after; /**< How many body bytes arrive before the stall */
+  long stall_ms; /**< How long the body stops arriving for */
+  long status; /**< An HTTP status to answer with in place of the server's response */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
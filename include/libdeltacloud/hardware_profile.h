@@ -95,6 +95,14 @@ int deltacloud_get_hardware_profiles(struct deltacloud_api *api,
 int deltacloud_get_hardware_profile_by_id(struct deltacloud_api *api,
 					  const char *id,
 					  struct deltacloud_hardware_profile *profile);
+int deltacloud_async_get_hardware_profiles(struct deltacloud_api *api,
+					   deltacloud_async_cb cb,
+					   void *userdata);
+int deltacloud_async_get_hardware_profile_by_id(struct deltacloud_api *api,
+						const char *id,
+						struct deltacloud_hardware_profile *profile,
+						deltacloud_async_cb cb,
+						void *userdata);
 void deltacloud_free_hardware_profile(struct deltacloud_hardware_profile *profile);
 void deltacloud_free_hardware_profile_list(struct deltacloud_hardware_profile **profiles);
 
@@ -43,12 +43,25 @@ struct deltacloud_image {
 #define deltacloud_supports_images(api) deltacloud_has_link(api, "images")
 int deltacloud_get_images(struct deltacloud_api *api,
 			  struct deltacloud_image **images);
+int deltacloud_foreach_image(struct deltacloud_api *api,
+			     deltacloud_visit_cb visitor, void *userdata);
 int deltacloud_get_image_by_id(struct deltacloud_api *api, const char *id,
 			       struct deltacloud_image *image);
+int deltacloud_get_image_by_name(struct deltacloud_api *api, const char *name,
+				 struct deltacloud_image *image);
+int deltacloud_get_images_by_ids(struct deltacloud_api *api, const char **ids,
+				 int n, struct deltacloud_image *images,
+				 int *errors);
 int deltacloud_create_image(struct deltacloud_api *api, const char *name,
 			    struct deltacloud_instance *instance,
 			    struct deltacloud_create_parameter *params,
 			    int params_length, char **image_id);
+int deltacloud_async_get_images(struct deltacloud_api *api,
+				deltacloud_async_cb cb, void *userdata);
+int deltacloud_async_get_image_by_id(struct deltacloud_api *api,
+				     const char *id,
+				     struct deltacloud_image *image,
+				     deltacloud_async_cb cb, void *userdata);
 void deltacloud_free_image(struct deltacloud_image *image);
 void deltacloud_free_image_list(struct deltacloud_image **images);
 
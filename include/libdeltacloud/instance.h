@@ -69,8 +69,14 @@ struct deltacloud_instance {
 #define deltacloud_supports_instances(api) deltacloud_has_link(api, "instances")
 int deltacloud_get_instances(struct deltacloud_api *api,
 			     struct deltacloud_instance **instances);
+int deltacloud_foreach_instance(struct deltacloud_api *api,
+				deltacloud_visit_cb visitor, void *userdata);
 int deltacloud_get_instance_by_id(struct deltacloud_api *api, const char *id,
 				  struct deltacloud_instance *instance);
+int deltacloud_get_instances_by_ids(struct deltacloud_api *api,
+				    const char **ids, int n,
+				    struct deltacloud_instance *instances,
+				    int *errors);
 int deltacloud_get_instance_by_name(struct deltacloud_api *api,
 				    const char *name,
 				    struct deltacloud_instance *instance);
@@ -85,6 +91,24 @@ int deltacloud_instance_start(struct deltacloud_api *api,
 			      struct deltacloud_instance *instance);
 int deltacloud_instance_destroy(struct deltacloud_api *api,
 				struct deltacloud_instance *instance);
+int deltacloud_async_get_instances(struct deltacloud_api *api,
+				   deltacloud_async_cb cb, void *userdata);
+int deltacloud_async_get_instance_by_id(struct deltacloud_api *api,
+					const char *id,
+					struct deltacloud_instance *instance,
+					deltacloud_async_cb cb, void *userdata);
+int deltacloud_async_instance_stop(struct deltacloud_api *api,
+				   struct deltacloud_instance *instance,
+				   deltacloud_async_cb cb, void *userdata);
+int deltacloud_async_instance_reboot(struct deltacloud_api *api,
+				     struct deltacloud_instance *instance,
+				     deltacloud_async_cb cb, void *userdata);
+int deltacloud_async_instance_start(struct deltacloud_api *api,
+				    struct deltacloud_instance *instance,
+				    deltacloud_async_cb cb, void *userdata);
+int deltacloud_async_instance_destroy(struct deltacloud_api *api,
+				      struct deltacloud_instance *instance,
+				      deltacloud_async_cb cb, void *userdata);
 void deltacloud_free_instance(struct deltacloud_instance *instance);
 void deltacloud_free_instance_list(struct deltacloud_instance **instances);
 
@@ -41,6 +41,8 @@ struct deltacloud_key {
 #define deltacloud_supports_keys(api) deltacloud_has_link(api, "keys")
 int deltacloud_get_keys(struct deltacloud_api *api,
 			struct deltacloud_key **keys);
+int deltacloud_foreach_key(struct deltacloud_api *api,
+			   deltacloud_visit_cb visitor, void *userdata);
 int deltacloud_get_key_by_id(struct deltacloud_api *api, const char *id,
 			     struct deltacloud_key *key);
 int deltacloud_create_key(struct deltacloud_api *api, const char *name,
@@ -48,6 +50,14 @@ int deltacloud_create_key(struct deltacloud_api *api, const char *name,
 			  int params_length);
 int deltacloud_key_destroy(struct deltacloud_api *api,
 			   struct deltacloud_key *key);
+int deltacloud_async_get_keys(struct deltacloud_api *api,
+			      deltacloud_async_cb cb, void *userdata);
+int deltacloud_async_get_key_by_id(struct deltacloud_api *api, const char *id,
+				   struct deltacloud_key *key,
+				   deltacloud_async_cb cb, void *userdata);
+int deltacloud_async_key_destroy(struct deltacloud_api *api,
+				 struct deltacloud_key *key,
+				 deltacloud_async_cb cb, void *userdata);
 void deltacloud_free_key(struct deltacloud_key *key);
 void deltacloud_free_key_list(struct deltacloud_key **keys);
 
@@ -41,6 +41,8 @@ struct deltacloud_api {
   int initialized; /**< An internal field used to determine if the deltacloud_api structure has been properly initialized */
 
   struct deltacloud_link *links; /**< A list of links pointing to the various components (instances, images, etc) available */
+
+  struct deltacloud_private *priv; /**< An internal field holding per-connection state such as the pool of reusable connections */
 };
 
 /**
@@ -64,6 +66,34 @@ struct deltacloud_create_parameter {
   char *value; /**< The value to use for this parameter */
 };
 
+/**
+ * A structure holding the transfer counters of a deltacloud_api structure,
+ * as returned by deltacloud_get_transfer_stats().  Comparing the two byte
+ * counts shows how much response compression is saving.
+ */
+struct deltacloud_transfer_stats {
+  unsigned long long wire_bytes; /**< Body bytes received over the network, before decompression */
+  unsigned long long decoded_bytes; /**< Body bytes after decompression */
+  unsigned long long retries; /**< Requests sent again after a transient failure */
+  unsigned long long retries_denied; /**< Retries not made because the retry budget was spent */
+  unsigned long long hedges; /**< Slow GETs that were sent a second time */
+  unsigned long long hedges_won; /**< Hedges that were answered before the original GET */
+};
+
+/**
+ * Called by the deltacloud_*foreach_* functions with each element of a
+ * collection, as soon as it has been downloaded.  element points to a
+ * structure of the type being listed, which belongs to the library and is
+ * reused for the next element, so anything needed after the callback
+ * returns must be copied out of it.  Returning non-zero stops the
+ * iteration, and the rest of the collection is not downloaded.
+ */
+typedef int (*deltacloud_visit_cb)(const void *element, void *userdata);
+
+#include "async.h"
+#include "transport.h"
+#include "trace.h"
+#include "fault.h"
 #include "link.h"
 #include "instance.h"
 #include "realm.h"
@@ -82,6 +112,11 @@ struct deltacloud_create_parameter {
 
 int deltacloud_initialize(struct deltacloud_api *api, char *url, char *user,
 			  char *password, char *driver, char *provider);
+int deltacloud_initialize_transport(struct deltacloud_api *api, char *url,
+				    char *user, char *password, char *driver,
+				    char *provider,
+				    const struct deltacloud_transport *transport,
+				    void *ctx);
 
 int deltacloud_prepare_parameter(struct deltacloud_create_parameter *param,
 				 const char *name, const char *value);
@@ -95,10 +130,49 @@ const char *deltacloud_get_last_error_string(void);
 
 int deltacloud_has_link(struct deltacloud_api *api, const char *name);
 
+int deltacloud_set_pool_size(struct deltacloud_api *api, int size);
+int deltacloud_set_pool_idle_timeout(struct deltacloud_api *api, int seconds);
+int deltacloud_set_batch_window(struct deltacloud_api *api, int window);
+int deltacloud_set_compression(struct deltacloud_api *api, int enabled);
+int deltacloud_set_http2(struct deltacloud_api *api, int mode);
+int deltacloud_set_shared_caches(struct deltacloud_api *api, int enabled);
+int deltacloud_set_retries(struct deltacloud_api *api, int max_retries,
+			   long base_ms, long max_ms);
+int deltacloud_set_retry_budget(struct deltacloud_api *api, int percent,
+				int reserve);
+int deltacloud_set_rate_limit(struct deltacloud_api *api, int kind,
+			      double per_second, int burst);
+int deltacloud_set_rate_limit_wait(struct deltacloud_api *api,
+				   long max_wait_ms);
+int deltacloud_set_hedging(struct deltacloud_api *api, int percentile,
+			   long min_delay_ms);
+int deltacloud_add_fault(struct deltacloud_api *api,
+			 const struct deltacloud_fault *fault);
+int deltacloud_clear_faults(struct deltacloud_api *api);
+int deltacloud_set_cache_ttl(struct deltacloud_api *api, const char *type,
+			     int seconds);
+int deltacloud_set_cache_stale(struct deltacloud_api *api, const char *type,
+			       int seconds);
+int deltacloud_set_cache_refreshers(struct deltacloud_api *api, int max);
+int deltacloud_invalidate_cache(struct deltacloud_api *api, const char *type);
+int deltacloud_get_transfer_stats(struct deltacloud_api *api,
+				  struct deltacloud_transfer_stats *stats);
+int deltacloud_reset_transfer_stats(struct deltacloud_api *api);
+
 void deltacloud_free(struct deltacloud_api *api);
 
 #define deltacloud_for_each(curr, list) for (curr = list; curr != NULL; curr = curr->next)
 
+/* HTTP/2 modes for deltacloud_set_http2() */
+#define DELTACLOUD_HTTP2_OFF 0 /**< Leave the HTTP version to libcurl (the default) */
+#define DELTACLOUD_HTTP2_NEGOTIATE 1 /**< Try HTTP/2 (ALPN for https, an h2c upgrade for http), falling back to HTTP/1.1 */
+#define DELTACLOUD_HTTP2_TLS 2 /**< Try HTTP/2 over https only, and use HTTP/1.1 for http */
+#define DELTACLOUD_HTTP2_PRIOR_KNOWLEDGE 3 /**< Speak h2c straight away over http; there is no fallback */
+
+/* Request kinds for deltacloud_set_rate_limit() */
+#define DELTACLOUD_RATE_READ 0 /**< GET and HEAD requests */
+#define DELTACLOUD_RATE_WRITE 1 /**< Requests that create, change or delete something */
+
 /* Error codes */
 #define DELTACLOUD_UNKNOWN_ERROR -1
 /* ERROR codes -2, -3, and -4 are reserved for future use */
@@ -112,6 +186,7 @@ void deltacloud_free(struct deltacloud_api *api);
 #define DELTACLOUD_DELETE_URL_ERROR -12
 #define DELTACLOUD_MULTIPART_POST_URL_ERROR -13
 #define DELTACLOUD_INTERNAL_ERROR -14
+#define DELTACLOUD_RATE_LIMITED_ERROR -15
 
 #ifdef __cplusplus
 }
@@ -43,6 +43,12 @@ int deltacloud_get_realms(struct deltacloud_api *api,
 			  struct deltacloud_realm **realms);
 int deltacloud_get_realm_by_id(struct deltacloud_api *api, const char *id,
 			       struct deltacloud_realm *realm);
+int deltacloud_async_get_realms(struct deltacloud_api *api,
+				deltacloud_async_cb cb, void *userdata);
+int deltacloud_async_get_realm_by_id(struct deltacloud_api *api,
+				     const char *id,
+				     struct deltacloud_realm *realm,
+				     deltacloud_async_cb cb, void *userdata);
 void deltacloud_free_realm(struct deltacloud_realm *realm);
 void deltacloud_free_realm_list(struct deltacloud_realm **realms);
 
@@ -42,9 +42,16 @@ struct deltacloud_storage_snapshot {
 #define deltacloud_supports_storage_snapshots(api) deltacloud_has_link(api, "storage_snapshots")
 int deltacloud_get_storage_snapshots(struct deltacloud_api *api,
 				     struct deltacloud_storage_snapshot **storage_snapshots);
+int deltacloud_foreach_storage_snapshot(struct deltacloud_api *api,
+					deltacloud_visit_cb visitor,
+					void *userdata);
 int deltacloud_get_storage_snapshot_by_id(struct deltacloud_api *api,
 					  const char *id,
 					  struct deltacloud_storage_snapshot *storage_snapshot);
+int deltacloud_get_storage_snapshots_by_ids(struct deltacloud_api *api,
+					    const char **ids, int n,
+					    struct deltacloud_storage_snapshot *storage_snapshots,
+					    int *errors);
 int deltacloud_create_storage_snapshot(struct deltacloud_api *api,
 				       struct deltacloud_storage_volume *volume,
 				       struct deltacloud_create_parameter *params,
@@ -52,6 +59,18 @@ int deltacloud_create_storage_snapshot(struct deltacloud_api *api,
 				       char **snap_id);
 int deltacloud_storage_snapshot_destroy(struct deltacloud_api *api,
 					struct deltacloud_storage_snapshot *storage_snapshot);
+int deltacloud_async_get_storage_snapshots(struct deltacloud_api *api,
+					   deltacloud_async_cb cb,
+					   void *userdata);
+int deltacloud_async_get_storage_snapshot_by_id(struct deltacloud_api *api,
+						const char *id,
+						struct deltacloud_storage_snapshot *storage_snapshot,
+						deltacloud_async_cb cb,
+						void *userdata);
+int deltacloud_async_storage_snapshot_destroy(struct deltacloud_api *api,
+					      struct deltacloud_storage_snapshot *storage_snapshot,
+					      deltacloud_async_cb cb,
+					      void *userdata);
 void deltacloud_free_storage_snapshot(struct deltacloud_storage_snapshot *storage_snapshot);
 void deltacloud_free_storage_snapshot_list(struct deltacloud_storage_snapshot **storage_snapshots);
 
@@ -62,9 +62,16 @@ struct deltacloud_storage_volume {
 #define deltacloud_supports_storage_volumes(api) deltacloud_has_link(api, "storage_volumes")
 int deltacloud_get_storage_volumes(struct deltacloud_api *api,
 				   struct deltacloud_storage_volume **storage_volumes);
+int deltacloud_foreach_storage_volume(struct deltacloud_api *api,
+				      deltacloud_visit_cb visitor,
+				      void *userdata);
 int deltacloud_get_storage_volume_by_id(struct deltacloud_api *api,
 					const char *id,
 					struct deltacloud_storage_volume *storage_volume);
+int deltacloud_get_storage_volumes_by_ids(struct deltacloud_api *api,
+					  const char **ids, int n,
+					  struct deltacloud_storage_volume *storage_volumes,
+					  int *errors);
 int deltacloud_create_storage_volume(struct deltacloud_api *api,
 				     struct deltacloud_create_parameter *params,
 				     int params_length);
@@ -80,6 +87,18 @@ int deltacloud_storage_volume_detach(struct deltacloud_api *api,
 				     struct deltacloud_storage_volume *storage_volume,
 				     struct deltacloud_create_parameter *params,
 				     int params_length);
+int deltacloud_async_get_storage_volumes(struct deltacloud_api *api,
+					 deltacloud_async_cb cb,
+					 void *userdata);
+int deltacloud_async_get_storage_volume_by_id(struct deltacloud_api *api,
+					      const char *id,
+					      struct deltacloud_storage_volume *storage_volume,
+					      deltacloud_async_cb cb,
+					      void *userdata);
+int deltacloud_async_storage_volume_destroy(struct deltacloud_api *api,
+					    struct deltacloud_storage_volume *storage_volume,
+					    deltacloud_async_cb cb,
+					    void *userdata);
 void deltacloud_free_storage_volume(struct deltacloud_storage_volume *storage_volume);
 void deltacloud_free_storage_volume_list(struct deltacloud_storage_volume **storage_volumes);
 
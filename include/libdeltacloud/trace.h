@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#ifndef LIBDELTACLOUD_TRACE_H
+#define LIBDELTACLOUD_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct deltacloud_api;
+struct deltacloud_transport;
+
+/**
+ * A trace file loaded for replay by deltacloud_replay_open().  It is used as
+ * the ctx of deltacloud_initialize_transport(), with
+ * deltacloud_replay_transport() as the transport.
+ */
+struct deltacloud_replay;
+
+int deltacloud_trace_record(struct deltacloud_api *api, const char *filename);
+int deltacloud_replay_open(const char *filename, double speed,
+			   struct deltacloud_replay **replay);
+const struct deltacloud_transport *deltacloud_replay_transport(void);
+void deltacloud_replay_close(struct deltacloud_replay *replay);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
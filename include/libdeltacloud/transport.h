@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#ifndef LIBDELTACLOUD_TRANSPORT_H
+#define LIBDELTACLOUD_TRANSPORT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/**
+ * One part of a multipart/form-data POST.  Exactly one of contents and
+ * filename is set; when filename is set, the contents of that file are the
+ * value of the part.
+ */
+struct deltacloud_transport_part {
+  const char *name; /**< The name of the form field */
+  const char *contents; /**< The value of the field, or NULL */
+  const char *filename; /**< A file holding the value of the field, or NULL */
+};
+
+/**
+ * The response a transport hands back for a request.  The library copies
+ * what it needs out of it before calling the release function of the
+ * transport, so the transport may point into memory of its own, such as
+ * canned responses, rather than allocating.
+ */
+struct deltacloud_transport_response {
+  long status; /**< The HTTP status code */
+  const char *headers; /**< The response headers, one "Name: value" per line, or NULL */
+  const char *body; /**< The response body, or NULL if there is none */
+  size_t body_length; /**< The length of body */
+  void *cookie; /**< For the transport to keep track of the response until it is released */
+};
+
+/**
+ * The functions a deltacloud_api structure sends its HTTP requests through,
+ * in place of libcurl.  Each request function gets the context that was
+ * given to deltacloud_initialize_transport(), the full URL, and a
+ * NULL-terminated list of request headers in "Name: value" form.  It
+ * returns 0 once it has filled in the response, whatever its status, or -1
+ * if no response could be had at all, which the library treats like a
+ * failed connection.  A request function may be NULL if the transport
+ * cannot handle that kind of request.  Request functions may be called
+ * from several threads at once if the deltacloud_api structure is used
+ * from several threads.  Asynchronous requests are not supported on a
+ * deltacloud_api structure with a transport of its own.
+ */
+struct deltacloud_transport {
+  /** Perform a GET */
+  int (*get)(void *ctx, const char *url, const char *const *headers,
+	     struct deltacloud_transport_response *response);
+  /** Perform a HEAD; any body in the response is ignored */
+  int (*head)(void *ctx, const char *url, const char *const *headers,
+	      struct deltacloud_transport_response *response);
+  /** Perform a DELETE */
+  int (*del)(void *ctx, const char *url, const char *const *headers,
+	     struct deltacloud_transport_response *response);
+  /** Perform a POST of body, which may be NULL for an empty POST */
+  int (*post)(void *ctx, const char *url, const char *const *headers,
+	      const char *body,
+	      struct deltacloud_transport_response *response);
+  /** Perform a multipart/form-data POST of nparts parts */
+  int (*multipart)(void *ctx, const char *url, const char *const *headers,
+		   const struct deltacloud_transport_part *parts, int nparts,
+		   struct deltacloud_transport_response *response);
+  /** Called once the library is done with a response; may be NULL */
+  void (*release)(void *ctx, struct deltacloud_transport_response *response);
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
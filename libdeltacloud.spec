@@ -66,6 +66,7 @@ rm -rf $RPM_BUILD_ROOT
 %defattr(-,root,root,-)
 %attr(0644,root,root) %{_includedir}/libdeltacloud/action.h
 %attr(0644,root,root) %{_includedir}/libdeltacloud/address.h
+%attr(0644,root,root) %{_includedir}/libdeltacloud/async.h
 %attr(0644,root,root) %{_includedir}/libdeltacloud/bucket.h
 %attr(0644,root,root) %{_includedir}/libdeltacloud/driver.h
 %attr(0644,root,root) %{_includedir}/libdeltacloud/firewall.h
@@ -82,6 +83,9 @@ rm -rf $RPM_BUILD_ROOT
 %attr(0644,root,root) %{_includedir}/libdeltacloud/storage_volume.h
 %attr(0644,root,root) %{_includedir}/libdeltacloud/metric.h
 %attr(0644,root,root) %{_includedir}/libdeltacloud/metric_value.h
+%attr(0644,root,root) %{_includedir}/libdeltacloud/transport.h
+%attr(0644,root,root) %{_includedir}/libdeltacloud/trace.h
+%attr(0644,root,root) %{_includedir}/libdeltacloud/fault.h
 %attr(0755,root,root) %{_libdir}/libdeltacloud.so
 %{_libdir}/pkgconfig/libdeltacloud.pc
 
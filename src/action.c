@@ -24,8 +24,9 @@
 #include "common.h"
 #include "action.h"
 
-int parse_actions_xml(xmlNodePtr root, struct deltacloud_action **actions)
+int parse_actions_xml(xmlNodePtr root, xmlXPathContextPtr ctxt, void *data)
 {
+  struct deltacloud_action **actions = (struct deltacloud_action **)data;
   struct deltacloud_action *thisaction;
   xmlNodePtr cur;
   int ret = -1;
@@ -71,3 +72,23 @@ void free_action_list(struct deltacloud_action **actions)
 {
   free_list(actions, struct deltacloud_action, free_action);
 }
+
+static int copy_action(struct deltacloud_action *dst,
+		       const struct deltacloud_action *src)
+{
+  if (copy_string(&dst->rel, src->rel) < 0 ||
+      copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->method, src->method) < 0)
+    return -1;
+
+  return 0;
+}
+
+int copy_action_list(struct deltacloud_action **dst,
+		     const struct deltacloud_action *src)
+{
+  copy_list(dst, src, struct deltacloud_action, copy_action,
+	    free_action_list);
+
+  return 0;
+}
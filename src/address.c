@@ -23,26 +23,25 @@
 #include <memory.h>
 #include "common.h"
 #include "address.h"
+#include "decoder.h"
 
 int parse_addresses_xml(xmlNodePtr root, xmlXPathContextPtr ctxt,
-			struct deltacloud_address **addresses)
+			void *data)
 {
+  struct deltacloud_address **addresses = (struct deltacloud_address **)data;
   struct deltacloud_address *thisaddr;
   char *address;
-  xmlNodePtr oldnode, cur;
+  xmlNodePtr cur;
   int ret = -1;
 
   *addresses = NULL;
 
-  oldnode = ctxt->node;
-
-  ctxt->node = root;
   cur = root->children;
   while (cur != NULL) {
     if (cur->type == XML_ELEMENT_NODE &&
 	STREQ((const char *)cur->name, "address")) {
 
-      address = getXPathString("string(./address)", ctxt);
+      address = decode_text(cur);
       if (address != NULL) {
 	thisaddr = calloc(1, sizeof(struct deltacloud_address));
 	if (thisaddr == NULL) {
@@ -64,7 +63,6 @@ int parse_addresses_xml(xmlNodePtr root, xmlXPathContextPtr ctxt,
   ret = 0;
 
  cleanup:
-  ctxt->node = oldnode;
   if (ret < 0)
     free_address_list(addresses);
 
@@ -81,3 +79,18 @@ void free_address_list(struct deltacloud_address **addresses)
   free_list(addresses, struct deltacloud_address, free_address);
 }
 
+static int copy_address(struct deltacloud_address *dst,
+			const struct deltacloud_address *src)
+{
+  return copy_string(&dst->address, src->address);
+}
+
+int copy_address_list(struct deltacloud_address **dst,
+		      const struct deltacloud_address *src)
+{
+  copy_list(dst, src, struct deltacloud_address, copy_address,
+	    free_address_list);
+
+  return 0;
+}
+
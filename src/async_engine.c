@@ -0,0 +1,809 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common.h"
+#include "async_engine.h"
+
+/** @file */
+
+static struct async_socket **find_socket(struct async_engine *engine,
+					 curl_socket_t fd)
+{
+  struct async_socket **curr;
+
+  for (curr = &engine->sockets; *curr != NULL; curr = &(*curr)->next) {
+    if ((*curr)->fd == fd)
+      break;
+  }
+
+  return curr;
+}
+
+/* CURLMOPT_SOCKETFUNCTION; keeps our table of watched sockets up-to-date and
+ * passes the change on to the caller's event loop, if it asked for that
+ */
+static int socket_cb(CURL *curl, curl_socket_t fd, int what, void *userp,
+		     void *socketp)
+{
+  struct async_engine *engine = (struct async_engine *)userp;
+  struct async_socket **curr;
+  struct async_socket *sock;
+  int events = 0;
+
+  if (what == CURL_POLL_IN || what == CURL_POLL_INOUT)
+    events |= DELTACLOUD_LOOP_IN;
+  if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT)
+    events |= DELTACLOUD_LOOP_OUT;
+
+  curr = find_socket(engine, fd);
+  if (what == CURL_POLL_REMOVE) {
+    sock = *curr;
+    if (sock != NULL) {
+      *curr = sock->next;
+      SAFE_FREE(sock);
+    }
+  }
+  else {
+    sock = *curr;
+    if (sock == NULL) {
+      sock = calloc(1, sizeof(struct async_socket));
+      if (sock == NULL)
+	/* curl gives us no way to report this; the timeout will still drive
+	 * the transfer along, just less efficiently
+	 */
+	return 0;
+      sock->fd = fd;
+      sock->next = engine->sockets;
+      engine->sockets = sock;
+    }
+    sock->events = events;
+  }
+
+  if (engine->fd_cb != NULL)
+    engine->fd_cb(engine->hook_api, fd, events, engine->hook_userdata);
+
+  return 0;
+}
+
+/* CURLMOPT_TIMERFUNCTION; a timeout_ms of -1 means that curl no longer needs
+ * a timer at all
+ */
+static int timer_cb(CURLM *multi, long timeout_ms, void *userp)
+{
+  struct async_engine *engine = (struct async_engine *)userp;
+
+  if (timeout_ms < 0) {
+    engine->have_curl_deadline = 0;
+    engine->have_deadline = 0;
+  }
+  else {
+    engine->curl_deadline = now_ms() + timeout_ms;
+    engine->have_curl_deadline = 1;
+    engine->deadline = engine->curl_deadline;
+    engine->have_deadline = 1;
+  }
+
+  if (engine->timer_cb != NULL)
+    engine->timer_cb(engine->hook_api, timeout_ms, engine->hook_userdata);
+
+  return 0;
+}
+
+/* the earlier of two waits in milliseconds, either of which may be -1 for
+ * none
+ */
+static long earliest(long a, long b)
+{
+  if (a < 0)
+    return b;
+  if (b < 0 || a < b)
+    return a;
+  return b;
+}
+
+/* transfers held up by an injected fault (see fault.c) and requests queued
+ * for the rate limiter are not on curl's clock, so the loop has to be woken
+ * for them separately: wake_ms is how long it is until the next of them is
+ * due, or -1 if there are none
+ */
+static void engine_wake_timer(struct async_engine *engine, long wake_ms)
+{
+  long timeout_ms = -1;
+
+  if (wake_ms < 0 && !engine->wake_timer)
+    return;
+
+  if (engine->have_curl_deadline) {
+    timeout_ms = (long)ceil(engine->curl_deadline - now_ms());
+    if (timeout_ms < 0)
+      timeout_ms = 0;
+  }
+  timeout_ms = earliest(timeout_ms, wake_ms);
+  engine->wake_timer = wake_ms >= 0;
+
+  engine->have_deadline = timeout_ms >= 0;
+  if (timeout_ms >= 0)
+    engine->deadline = now_ms() + timeout_ms;
+
+  if (engine->timer_cb != NULL)
+    engine->timer_cb(engine->hook_api, timeout_ms, engine->hook_userdata);
+}
+
+int async_engine_init(struct async_engine *engine)
+{
+  memset(engine, 0, sizeof(struct async_engine));
+
+  engine->multi = curl_multi_init();
+  if (engine->multi == NULL) {
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to initialize curl multi");
+    return -1;
+  }
+
+  transfer_multi_setup(engine->multi);
+  curl_multi_setopt(engine->multi, CURLMOPT_SOCKETFUNCTION, socket_cb);
+  curl_multi_setopt(engine->multi, CURLMOPT_SOCKETDATA, engine);
+  curl_multi_setopt(engine->multi, CURLMOPT_TIMERFUNCTION, timer_cb);
+  curl_multi_setopt(engine->multi, CURLMOPT_TIMERDATA, engine);
+
+  return 0;
+}
+
+static void free_request(struct async_request *req)
+{
+  transfer_cleanup(&req->xfer);
+  SAFE_FREE(req->url);
+  SAFE_FREE(req);
+}
+
+/* any requests still in flight or queued are dropped without running their
+ * callbacks
+ */
+void async_engine_destroy(struct async_engine *engine)
+{
+  struct async_request *req, *next;
+  struct async_socket *sock, *nextsock;
+
+  /* the caller's event loop is going away along with us */
+  engine->fd_cb = NULL;
+  engine->timer_cb = NULL;
+
+  req = engine->requests;
+  while (req != NULL) {
+    next = req->next;
+    curl_multi_remove_handle(engine->multi, req->xfer.curl);
+    free_request(req);
+    req = next;
+  }
+  engine->requests = NULL;
+
+  req = engine->queued;
+  while (req != NULL) {
+    next = req->next;
+    free_request(req);
+    req = next;
+  }
+  engine->queued = NULL;
+  engine->pending = 0;
+
+  if (engine->multi != NULL)
+    curl_multi_cleanup(engine->multi);
+  engine->multi = NULL;
+
+  sock = engine->sockets;
+  while (sock != NULL) {
+    nextsock = sock->next;
+    SAFE_FREE(sock);
+    sock = nextsock;
+  }
+  engine->sockets = NULL;
+}
+
+/* put req on the multi handle; the caller has taken its rate limiter token.
+ * On failure req is left to the caller to free.
+ */
+static int engine_start(struct deltacloud_api *api, struct async_request *req)
+{
+  struct async_engine *engine = &api->priv->async;
+  CURLMcode mres;
+
+  if (transfer_setup_with_token(&req->xfer, api, req->method, req->url, NULL,
+				NULL, NULL) < 0)
+    /* transfer_setup_with_token set the error */
+    return -1;
+  if (req->kind != ASYNC_ACTION)
+    transfer_stream_xml(&req->xfer, req->rootname);
+
+  mres = curl_multi_add_handle(engine->multi, req->xfer.curl);
+  if (mres != CURLM_OK) {
+    set_error(req->xfer.errcode, curl_multi_strerror(mres));
+    return -1;
+  }
+
+  req->next = engine->requests;
+  engine->requests = req;
+
+  return 0;
+}
+
+/* start as many of the queued requests as the rate limiter lets through
+ * right now, keeping to the order they were made in for each kind of
+ * request.  A request that fails to start has its callback run with an
+ * error.  Returns how many milliseconds it is until the next queued request
+ * can go, or -1 if none are left.
+ */
+static long engine_start_queued(struct deltacloud_api *api)
+{
+  struct async_engine *engine = &api->priv->async;
+  struct async_request **curr;
+  struct async_request *req;
+  int blocked[2] = { 0, 0 };
+  long wait_ms = -1;
+  long rate_ms;
+  int kind;
+
+  curr = &engine->queued;
+  while (*curr != NULL) {
+    req = *curr;
+    kind = transfer_rate_kind(req->method);
+    if (!blocked[kind]) {
+      rate_ms = rate_limiter_try(api->priv->limiter, kind);
+      if (rate_ms > 0) {
+	blocked[kind] = 1;
+	wait_ms = earliest(wait_ms, rate_ms);
+      }
+    }
+    if (blocked[kind]) {
+      curr = &req->next;
+      continue;
+    }
+
+    *curr = req->next;
+    if (engine_start(api, req) < 0) {
+      /* engine_start set the error.  Any request the callback makes is
+       * added at the end of the queue, so curr stays valid.
+       */
+      engine->pending--;
+      req->cb(api, -1, NULL, req->userdata);
+      free_request(req);
+    }
+  }
+
+  return wait_ms;
+}
+
+/* a request is started straight away if the rate limiter has a token for
+ * it; otherwise it is queued, and started by whatever drives the engine
+ * once there is one, so that neither this nor the event loop ever sleeps
+ */
+static int engine_submit(struct deltacloud_api *api, struct async_request *req,
+			 int method)
+{
+  struct async_engine *engine = &api->priv->async;
+  struct async_request **curr;
+  long rate_ms = 0;
+  int kind;
+
+  if (api->priv->transport != NULL) {
+    invalid_argument_error("asynchronous requests need the libcurl transport");
+    goto error;
+  }
+
+  req->method = method;
+  kind = transfer_rate_kind(method);
+
+  /* do not jump ahead of a request of the same kind that is already queued */
+  for (curr = &engine->queued; *curr != NULL; curr = &(*curr)->next) {
+    if (transfer_rate_kind((*curr)->method) == kind)
+      rate_ms = -1;
+  }
+  if (rate_ms == 0)
+    rate_ms = rate_limiter_try(api->priv->limiter, kind);
+
+  if (rate_ms == 0) {
+    if (engine_start(api, req) < 0)
+      /* engine_start set the error */
+      goto error;
+  }
+  else {
+    req->next = NULL;
+    *curr = req;
+    if (rate_ms > 0)
+      engine_wake_timer(engine, earliest(fault_resume(&api->priv->faults),
+					 rate_ms));
+  }
+  engine->pending++;
+
+  return 0;
+
+ error:
+  free_request(req);
+  return -1;
+}
+
+static struct async_request *new_request(deltacloud_async_cb cb,
+					 void *userdata)
+{
+  struct async_request *req;
+
+  if (!valid_arg(cb))
+    return NULL;
+
+  req = calloc(1, sizeof(struct async_request));
+  if (req == NULL) {
+    oom_error();
+    return NULL;
+  }
+
+  req->cb = cb;
+  req->userdata = userdata;
+
+  return req;
+}
+
+/*
+ * The asynchronous equivalent of internal_get().  The transfer is only
+ * started; the parse callback runs from deltacloud_async_perform() once the
+ * whole response has arrived.
+ */
+int internal_async_get(struct deltacloud_api *api, const char *relname,
+		       const char *rootname,
+		       int (*xml_cb)(xmlNodePtr, xmlXPathContextPtr, void **),
+		       deltacloud_async_cb cb, void *userdata)
+{
+  struct deltacloud_link *thislink;
+  struct async_request *req;
+
+  if (!valid_api(api))
+    return -1;
+
+  thislink = api_find_link(api, relname);
+  if (thislink == NULL)
+    /* api_find_link set the error */
+    return -1;
+
+  req = new_request(cb, userdata);
+  if (req == NULL)
+    /* new_request set the error */
+    return -1;
+
+  req->kind = ASYNC_COLLECTION;
+  req->relname = relname;
+  req->rootname = rootname;
+  req->list_cb = xml_cb;
+  req->url = strdup(thislink->href);
+  if (req->url == NULL) {
+    oom_error();
+    free_request(req);
+    return -1;
+  }
+
+  return engine_submit(api, req, TRANSFER_GET);
+}
+
+/*
+ * The asynchronous equivalent of internal_get_by_id().  output must stay
+ * valid until the callback has run.
+ */
+int internal_async_get_by_id(struct deltacloud_api *api, const char *id,
+			     const char *relname, const char *rootname,
+			     int (*xml_cb)(xmlNodePtr, xmlXPathContextPtr,
+					   void *),
+			     void *output, deltacloud_async_cb cb,
+			     void *userdata)
+{
+  struct async_request *req;
+
+  if (!valid_api(api) || !valid_arg(id) || !valid_arg(output))
+    return -1;
+
+  req = new_request(cb, userdata);
+  if (req == NULL)
+    /* new_request set the error */
+    return -1;
+
+  req->kind = ASYNC_SINGLE;
+  req->relname = relname;
+  req->rootname = rootname;
+  req->single_cb = xml_cb;
+  req->output = output;
+  req->url = internal_id_url(api, relname, id);
+  if (req->url == NULL) {
+    /* internal_id_url set the error */
+    free_request(req);
+    return -1;
+  }
+
+  return engine_submit(api, req, TRANSFER_GET);
+}
+
+/*
+ * An asynchronous POST (with no data) or DELETE of href, such as an
+ * instance action or a destroy.
+ */
+int internal_async_action(struct deltacloud_api *api, int method,
+			  const char *href, deltacloud_async_cb cb,
+			  void *userdata)
+{
+  struct async_request *req;
+
+  if (!valid_api(api) || !valid_arg(href))
+    return -1;
+
+  req = new_request(cb, userdata);
+  if (req == NULL)
+    /* new_request set the error */
+    return -1;
+
+  req->kind = ASYNC_ACTION;
+  req->url = strdup(href);
+  if (req->url == NULL) {
+    oom_error();
+    free_request(req);
+    return -1;
+  }
+
+  return engine_submit(api, req, method);
+}
+
+static void complete_request(struct deltacloud_api *api,
+			     struct async_request *req, CURLcode res)
+{
+  char *data = NULL;
+  xmlDocPtr doc = NULL;
+  void *result = NULL;
+  int status = -1;
+
+  switch (req->kind) {
+  case ASYNC_COLLECTION:
+    if (transfer_complete_xml(&req->xfer, res, &doc) < 0)
+      /* transfer_complete_xml set the error */
+      break;
+    status = internal_parse_collection(req->relname, req->rootname, doc,
+				       req->list_cb, &result);
+    break;
+  case ASYNC_SINGLE:
+    if (transfer_complete_xml(&req->xfer, res, &doc) < 0)
+      /* transfer_complete_xml set the error */
+      break;
+    status = internal_parse_single(req->relname, req->rootname, doc,
+				   req->single_cb, req->output);
+    if (status == 0)
+      result = req->output;
+    break;
+  case ASYNC_ACTION:
+    if (transfer_complete(&req->xfer, res, &data, NULL, NULL) < 0)
+      /* transfer_complete set the error */
+      break;
+    if (data != NULL && is_error_xml(data))
+      set_xml_error(data, req->xfer.errcode);
+    else {
+      internal_invalidate(api, req->url);
+      status = 0;
+    }
+    break;
+  }
+
+  SAFE_FREE(data);
+  /* give the connection back before running the callback, so that any
+   * request the callback starts can re-use it
+   */
+  transfer_cleanup(&req->xfer);
+
+  req->cb(api, status, result, req->userdata);
+
+  free_request(req);
+}
+
+/* run the callbacks of all finished transfers; returns how many finished */
+static int engine_dispatch(struct deltacloud_api *api)
+{
+  struct async_engine *engine = &api->priv->async;
+  struct async_request **curr;
+  struct async_request *req;
+  struct transfer *xfer;
+  CURLMsg *msg;
+  CURLcode res;
+  CURL *curl;
+  int left;
+  int done = 0;
+
+  while ((msg = curl_multi_info_read(engine->multi, &left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+
+    /* msg is only valid until the handle is removed, so take what we need
+     * from it first
+     */
+    curl = msg->easy_handle;
+    res = msg->data.result;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&xfer);
+    curl_multi_remove_handle(engine->multi, curl);
+
+    req = (struct async_request *)xfer;
+    for (curr = &engine->requests; *curr != NULL; curr = &(*curr)->next) {
+      if (*curr == req) {
+	*curr = req->next;
+	break;
+      }
+    }
+    engine->pending--;
+
+    complete_request(api, req, res);
+    done++;
+  }
+
+  return done;
+}
+
+static int engine_perform(struct async_engine *engine)
+{
+  CURLMcode mres;
+  int running;
+
+  mres = curl_multi_perform(engine->multi, &running);
+  if (mres != CURLM_OK) {
+    set_error(DELTACLOUD_GET_URL_ERROR, curl_multi_strerror(mres));
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * A function to drive the asynchronous requests started on this connection
+ * by the deltacloud_async_* functions.  It moves every transfer along as far
+ * as it can without blocking, and runs the completion callback of each
+ * request that finished.  If nothing finished, it waits up to timeout_ms
+ * milliseconds for network activity first.  Callers typically loop until
+ * it returns 0.  Requests held back by the rate limiter are started from
+ * here once it lets them through.  The asynchronous requests of a
+ * deltacloud_api structure must all be started and driven from the same
+ * thread.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] timeout_ms The maximum number of milliseconds to wait for
+ *                       activity when nothing is ready yet
+ * @returns The number of requests still in flight, or -1 on error
+ */
+int deltacloud_async_perform(struct deltacloud_api *api, int timeout_ms)
+{
+  struct async_engine *engine;
+  CURLMcode mres;
+  long wait_ms;
+
+  if (!valid_api(api))
+    return -1;
+
+  if (timeout_ms < 0) {
+    invalid_argument_error("timeout_ms must be >= 0");
+    return -1;
+  }
+
+  engine = &api->priv->async;
+
+  fault_resume(&api->priv->faults);
+  engine_start_queued(api);
+
+  if (engine_perform(engine) < 0)
+    /* engine_perform set the error */
+    return -1;
+
+  if (engine_dispatch(api) > 0 || engine->pending == 0 || timeout_ms == 0)
+    return engine->pending;
+
+  /* nothing wakes curl for a request queued for the rate limiter */
+  wait_ms = engine_start_queued(api);
+  if (wait_ms >= 0 && wait_ms < timeout_ms)
+    timeout_ms = (int)wait_ms;
+
+  /* curl_multi_wait() returns at once when curl has no sockets to offer */
+  if (engine->requests == NULL)
+    sleep_ms(timeout_ms);
+  else {
+    mres = fault_multi_wait(&api->priv->faults, engine->multi, timeout_ms);
+    if (mres != CURLM_OK) {
+      set_error(DELTACLOUD_GET_URL_ERROR, curl_multi_strerror(mres));
+      return -1;
+    }
+  }
+
+  engine_start_queued(api);
+
+  if (engine_perform(engine) < 0)
+    /* engine_perform set the error */
+    return -1;
+
+  engine_dispatch(api);
+
+  return engine->pending;
+}
+
+/**
+ * A function to find out how many asynchronous requests started on this
+ * connection have not yet completed.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @returns The number of requests in flight, or -1 on error
+ */
+int deltacloud_async_pending(struct deltacloud_api *api)
+{
+  if (!valid_api(api))
+    return -1;
+
+  return api->priv->async.pending;
+}
+
+/**
+ * A function to have the asynchronous engine of this connection tell an
+ * external event loop, such as one built on epoll, which sockets to watch
+ * and when to time out, as that changes.  This is an alternative to calling
+ * deltacloud_loop_get_fds() every time around the loop.  The socket and
+ * timer state at the time of the call is not replayed, so the hooks should
+ * be set before any asynchronous request is started.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] fd_cb The function to call when a socket should be watched
+ *                  differently, or NULL
+ * @param[in] timer_cb The function to call when the timeout changes, or NULL
+ * @param[in] userdata A pointer that is passed through to the hooks
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_loop_set_hooks(struct deltacloud_api *api,
+			      deltacloud_loop_fd_cb fd_cb,
+			      deltacloud_loop_timer_cb timer_cb,
+			      void *userdata)
+{
+  struct async_engine *engine;
+
+  if (!valid_api(api))
+    return -1;
+
+  engine = &api->priv->async;
+  engine->hook_api = api;
+  engine->fd_cb = fd_cb;
+  engine->timer_cb = timer_cb;
+  engine->hook_userdata = userdata;
+
+  return 0;
+}
+
+/**
+ * A function to find out which sockets an external event loop should watch
+ * for the asynchronous requests of this connection, and how long it may
+ * wait before calling deltacloud_loop_on_timeout().  A connection should be
+ * driven either through the deltacloud_loop_* functions or through
+ * deltacloud_async_perform(), not a mixture of both.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[out] fds An array to fill in with the sockets to watch; may be NULL
+ *                 if nfds is 0
+ * @param[in] nfds The number of entries in fds
+ * @param[out] timeout_ms The number of milliseconds until
+ *                        deltacloud_loop_on_timeout() should be called,
+ *                        or -1 if there is no timeout to wait for; may be
+ *                        NULL
+ * @returns The total number of sockets to watch, which may be larger than
+ *          nfds if the array was too small, or -1 on error
+ */
+int deltacloud_loop_get_fds(struct deltacloud_api *api,
+			    struct deltacloud_loop_fd *fds, int nfds,
+			    long *timeout_ms)
+{
+  struct async_engine *engine;
+  struct async_socket *sock;
+  long remaining;
+  int count = 0;
+
+  if (!valid_api(api))
+    return -1;
+
+  if (nfds < 0 || (nfds > 0 && fds == NULL)) {
+    invalid_argument_error("fds must hold nfds entries");
+    return -1;
+  }
+
+  engine = &api->priv->async;
+
+  for (sock = engine->sockets; sock != NULL; sock = sock->next) {
+    if (count < nfds) {
+      fds[count].fd = sock->fd;
+      fds[count].events = sock->events;
+    }
+    count++;
+  }
+
+  if (timeout_ms != NULL) {
+    if (!engine->have_deadline)
+      *timeout_ms = -1;
+    else {
+      remaining = (long)ceil(engine->deadline - now_ms());
+      *timeout_ms = remaining > 0 ? remaining : 0;
+    }
+  }
+
+  return count;
+}
+
+static int loop_action(struct deltacloud_api *api, curl_socket_t fd,
+		       int ev_bitmask)
+{
+  struct async_engine *engine;
+  CURLMcode mres;
+  int running;
+
+  if (!valid_api(api))
+    return -1;
+
+  engine = &api->priv->async;
+
+  fault_resume(&api->priv->faults);
+
+  mres = curl_multi_socket_action(engine->multi, fd, ev_bitmask, &running);
+  if (mres != CURLM_OK) {
+    set_error(DELTACLOUD_GET_URL_ERROR, curl_multi_strerror(mres));
+    return -1;
+  }
+
+  engine_dispatch(api);
+
+  engine_wake_timer(engine, earliest(fault_resume(&api->priv->faults),
+				     engine_start_queued(api)));
+
+  return engine->pending;
+}
+
+/**
+ * A function for an external event loop to call when a socket reported by
+ * deltacloud_loop_get_fds() or the fd hook has become readable.  Any
+ * request that completes as a result has its callback run before this
+ * returns.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] fd The socket that became readable
+ * @returns The number of requests still in flight, or -1 on error
+ */
+int deltacloud_loop_on_readable(struct deltacloud_api *api, int fd)
+{
+  return loop_action(api, fd, CURL_CSELECT_IN);
+}
+
+/**
+ * A function for an external event loop to call when a socket reported by
+ * deltacloud_loop_get_fds() or the fd hook has become writable.  Any
+ * request that completes as a result has its callback run before this
+ * returns.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] fd The socket that became writable
+ * @returns The number of requests still in flight, or -1 on error
+ */
+int deltacloud_loop_on_writable(struct deltacloud_api *api, int fd)
+{
+  return loop_action(api, fd, CURL_CSELECT_OUT);
+}
+
+/**
+ * A function for an external event loop to call once the timeout reported
+ * by deltacloud_loop_get_fds() or the timer hook has expired.  Newly
+ * started requests ask for an immediate timeout, so this is also what gets
+ * them going.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @returns The number of requests still in flight, or -1 on error
+ */
+int deltacloud_loop_on_timeout(struct deltacloud_api *api)
+{
+  return loop_action(api, CURL_SOCKET_TIMEOUT, 0);
+}
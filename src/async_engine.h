@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+#ifndef ASYNC_ENGINE_H
+#define ASYNC_ENGINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libxml/parser.h>
+#include <libxml/xpath.h>
+#include <curl/curl.h>
+#include "libdeltacloud.h"
+#include "curl_action.h"
+
+enum async_kind {
+  ASYNC_COLLECTION,
+  ASYNC_SINGLE,
+  ASYNC_ACTION,
+};
+
+struct async_request {
+  /* must stay the first member; the CURLOPT_PRIVATE pointer of the curl
+   * handle points at it, and we cast it back to the request
+   */
+  struct transfer xfer;
+
+  int kind;
+  int method;
+  char *url;
+  const char *relname;
+  const char *rootname;
+  int (*list_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt, void **data);
+  int (*single_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt, void *data);
+  void *output;
+
+  deltacloud_async_cb cb;
+  void *userdata;
+
+  struct async_request *next;
+};
+
+/* a socket that curl wants watched, as reported through
+ * CURLMOPT_SOCKETFUNCTION
+ */
+struct async_socket {
+  curl_socket_t fd;
+  int events; /* DELTACLOUD_LOOP_IN and/or DELTACLOUD_LOOP_OUT */
+
+  struct async_socket *next;
+};
+
+/* a curl multi handle together with the requests that are in flight on it.
+ * An engine is not thread-safe; it must only be used from one thread at a
+ * time.
+ */
+struct async_engine {
+  CURLM *multi;
+  struct async_request *requests;
+  /* requests waiting for the rate limiter, in the order they were made */
+  struct async_request *queued;
+  int pending; /* both those in flight and those queued */
+
+  /* state for driving the engine from an external event loop */
+  struct async_socket *sockets;
+  int have_deadline; /* whether the loop has a timeout to wait for */
+  double deadline; /* the now_ms() time at which it expires */
+  int have_curl_deadline; /* whether curl asked for a timeout at all */
+  double curl_deadline;
+  int wake_timer; /* whether deadline was brought forward by us */
+  struct deltacloud_api *hook_api;
+  deltacloud_loop_fd_cb fd_cb;
+  deltacloud_loop_timer_cb timer_cb;
+  void *hook_userdata;
+};
+
+int async_engine_init(struct async_engine *engine);
+void async_engine_destroy(struct async_engine *engine);
+
+int internal_async_get(struct deltacloud_api *api, const char *relname,
+		       const char *rootname,
+		       int (*xml_cb)(xmlNodePtr, xmlXPathContextPtr, void **),
+		       deltacloud_async_cb cb, void *userdata);
+int internal_async_get_by_id(struct deltacloud_api *api, const char *id,
+			     const char *relname, const char *rootname,
+			     int (*xml_cb)(xmlNodePtr, xmlXPathContextPtr,
+					   void *),
+			     void *output, deltacloud_async_cb cb,
+			     void *userdata);
+int internal_async_action(struct deltacloud_api *api, int method,
+			  const char *href, deltacloud_async_cb cb,
+			  void *userdata);
+#ifdef __cplusplus
+}
+#endif
+
+#endif
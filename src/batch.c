@@ -0,0 +1,608 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "curl_action.h"
+#include "batch.h"
+
+/* a batch of lookups by id can be served in one of two ways: a window of
+ * concurrent single GETs ("fan-out"), or one GET of the whole collection
+ * that is then searched for the ids ("collection").  Which is cheaper
+ * depends on how many ids there are compared to the size of the collection,
+ * so we keep running estimates of both from earlier batches and pick the
+ * plan that looks cheaper this time.
+ */
+
+int batch_planner_init(struct batch_planner *planner)
+{
+  memset(planner, 0, sizeof(struct batch_planner));
+
+  if (pthread_mutex_init(&planner->lock, NULL) != 0) {
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to initialize batch lock");
+    return -1;
+  }
+
+  planner->window = BATCH_DEFAULT_WINDOW;
+
+  return 0;
+}
+
+void batch_planner_destroy(struct batch_planner *planner)
+{
+  struct batch_stats *stats, *next;
+
+  stats = planner->stats;
+  while (stats != NULL) {
+    next = stats->next;
+    SAFE_FREE(stats);
+    stats = next;
+  }
+  planner->stats = NULL;
+  pthread_mutex_destroy(&planner->lock);
+}
+
+static void ewma(double *estimate, int samples, double sample)
+{
+  if (samples == 0)
+    *estimate = sample;
+  else
+    *estimate += BATCH_EWMA_WEIGHT * (sample - *estimate);
+}
+
+/* must be called with planner->lock held.  Returns NULL if there are no
+ * statistics for relname and they could not be allocated; the planner then
+ * just falls back to fan-out.
+ */
+static struct batch_stats *find_stats(struct batch_planner *planner,
+				      const char *relname)
+{
+  struct batch_stats *stats;
+
+  for (stats = planner->stats; stats != NULL; stats = stats->next) {
+    if (STREQ(stats->relname, relname))
+      return stats;
+  }
+
+  stats = calloc(1, sizeof(struct batch_stats));
+  if (stats == NULL)
+    return NULL;
+
+  /* relname always points at a string constant */
+  stats->relname = relname;
+  stats->next = planner->stats;
+  planner->stats = stats;
+
+  return stats;
+}
+
+static int use_collection(struct batch_planner *planner, const char *relname,
+			  int n)
+{
+  struct batch_stats *stats;
+  double fanout, collection, winner, loser;
+  int rounds;
+  int ret = 0;
+
+  pthread_mutex_lock(&planner->lock);
+
+  stats = find_stats(planner, relname);
+  rounds = (n + planner->window - 1) / planner->window;
+
+  if (stats == NULL || stats->fanout_samples == 0)
+    ret = 0;
+  else if (stats->collection_samples == 0)
+    /* try the collection once there is more than a single round of
+     * fan-out to save, so that we have something to compare against
+     */
+    ret = rounds > 1;
+  else {
+    fanout = rounds * stats->round_ms;
+    collection = stats->collection_ms +
+      stats->collection_size * stats->element_ms;
+    ret = collection < fanout;
+
+    planner->decisions++;
+    if (planner->decisions % BATCH_PROBE_INTERVAL == 0) {
+      winner = ret ? collection : fanout;
+      loser = ret ? fanout : collection;
+      if (loser <= winner * BATCH_PROBE_RATIO)
+	ret = !ret;
+    }
+  }
+
+  pthread_mutex_unlock(&planner->lock);
+
+  return ret;
+}
+
+static void record_fanout(struct batch_planner *planner, const char *relname,
+			  double elapsed, int n)
+{
+  struct batch_stats *stats;
+  int rounds;
+
+  pthread_mutex_lock(&planner->lock);
+  stats = find_stats(planner, relname);
+  if (stats != NULL) {
+    rounds = (n + planner->window - 1) / planner->window;
+    ewma(&stats->round_ms, stats->fanout_samples, elapsed / rounds);
+    stats->fanout_samples++;
+  }
+  pthread_mutex_unlock(&planner->lock);
+}
+
+static void record_collection(struct batch_planner *planner,
+			      const char *relname, double transfer,
+			      double parse, int elements)
+{
+  struct batch_stats *stats;
+
+  pthread_mutex_lock(&planner->lock);
+  stats = find_stats(planner, relname);
+  if (stats != NULL) {
+    ewma(&stats->collection_ms, stats->collection_samples, transfer);
+    if (elements > 0)
+      ewma(&stats->element_ms, stats->collection_samples, parse / elements);
+    ewma(&stats->collection_size, stats->collection_samples, elements);
+    stats->collection_samples++;
+  }
+  pthread_mutex_unlock(&planner->lock);
+}
+
+static void record_error(int *errors, int index, int ok)
+{
+  struct deltacloud_error *err;
+
+  if (errors == NULL)
+    return;
+
+  if (ok)
+    errors[index] = 0;
+  else {
+    err = deltacloud_get_last_error();
+    errors[index] = err != NULL ? err->error_num : DELTACLOUD_UNKNOWN_ERROR;
+  }
+}
+
+/******************************** FAN-OUT ************************************/
+
+/* one slot of the in-flight window */
+struct batch_slot {
+  /* must stay the first member, for the same reason as in async_request */
+  struct transfer xfer;
+  int index; /* position in the caller's ids array */
+  char *url;
+};
+
+/* have_token says whether the caller already took the rate limiter token
+ * for this GET; if not, it is waited for here
+ */
+static int slot_start(struct deltacloud_api *api, CURLM *multi,
+		      struct batch_slot *slot, const char *id,
+		      const char *relname, const char *rootname, int have_token)
+{
+  CURLMcode mres;
+  int ret;
+
+  slot->url = internal_id_url(api, relname, id);
+  if (slot->url == NULL)
+    /* internal_id_url set the error */
+    return -1;
+
+  if (have_token)
+    ret = transfer_setup_with_token(&slot->xfer, api, TRANSFER_GET, slot->url,
+				    NULL, NULL, NULL);
+  else
+    ret = transfer_setup(&slot->xfer, api, TRANSFER_GET, slot->url, NULL,
+			 NULL, NULL);
+  if (ret < 0)
+    /* transfer_setup set the error */
+    return -1;
+  transfer_stream_xml(&slot->xfer, rootname);
+
+  mres = curl_multi_add_handle(multi, slot->xfer.curl);
+  if (mres != CURLM_OK) {
+    set_error(slot->xfer.errcode, curl_multi_strerror(mres));
+    return -1;
+  }
+
+  return 0;
+}
+
+static void slot_release(struct batch_slot *slot)
+{
+  transfer_cleanup(&slot->xfer);
+  SAFE_FREE(slot->url);
+}
+
+/* the fan-out for an api with a transport of its own, which has no multi
+ * handle to run the GETs on; they are made one after the other instead
+ */
+static int batch_sequential(struct deltacloud_api *api,
+			    const struct batch_type *type, const char **ids,
+			    const int *todo, int ntodo, void *output,
+			    int *errors)
+{
+  xmlDocPtr doc;
+  char *url;
+  char *out;
+  int i;
+  int ret = 0;
+
+  for (i = 0; i < ntodo; i++) {
+    out = (char *)output + todo[i] * type->size;
+
+    url = internal_id_url(api, type->relname, ids[todo[i]]);
+    /* internal_id_url, get_url_xml and internal_parse_single set the
+     * error
+     */
+    if (url == NULL || get_url_xml(api, url, type->oneroot, &doc) < 0 ||
+	internal_parse_single(type->relname, type->oneroot, doc,
+			      type->one_cb, out) < 0) {
+      record_error(errors, todo[i], 0);
+      memset(out, 0, type->size);
+      ret = -1;
+    }
+    else
+      record_error(errors, todo[i], 1);
+    SAFE_FREE(url);
+  }
+
+  return ret;
+}
+
+/* fetch the ids[todo[0..ntodo-1]] with single GETs, at most window at a
+ * time.  The transfers run on a private multi handle, so that any
+ * deltacloud_async_* requests in flight on the connection are not completed
+ * behind the caller's back.
+ */
+static int batch_fanout(struct deltacloud_api *api,
+			const struct batch_type *type, const char **ids,
+			const int *todo, int ntodo, void *output, int *errors)
+{
+  struct batch_planner *planner = &api->priv->batch;
+  struct batch_slot *slots = NULL;
+  struct batch_slot *slot;
+  struct transfer *xfer;
+  CURLM *multi = NULL;
+  CURLMcode mres;
+  CURLMsg *msg;
+  double start;
+  xmlDocPtr doc;
+  char *out;
+  long rate_ms;
+  int window;
+  int next = 0;
+  int active = 0;
+  int running;
+  int left;
+  int i;
+  int ret = 0;
+
+  if (api->priv->transport != NULL)
+    return batch_sequential(api, type, ids, todo, ntodo, output, errors);
+
+  pthread_mutex_lock(&planner->lock);
+  window = planner->window;
+  pthread_mutex_unlock(&planner->lock);
+  if (window > ntodo)
+    window = ntodo;
+
+  slots = calloc(window, sizeof(struct batch_slot));
+  if (slots == NULL) {
+    oom_error();
+    goto fail_rest;
+  }
+
+  multi = curl_multi_init();
+  if (multi == NULL) {
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to initialize curl multi");
+    SAFE_FREE(slots);
+    goto fail_rest;
+  }
+  transfer_multi_setup(multi);
+
+  start = now_ms();
+
+  /* slots that are not in use have a NULL url */
+  while (next < ntodo || active > 0) {
+    rate_ms = -1;
+    for (i = 0; i < window && next < ntodo; i++) {
+      slot = &slots[i];
+      if (slot->url != NULL)
+	continue;
+
+      /* while other GETs are in flight, a slot that has to wait for the
+       * rate limiter stays empty until they have been driven along for that
+       * long; only with nothing in flight is the wait done in slot_start
+       */
+      if (active > 0) {
+	rate_ms = rate_limiter_try(api->priv->limiter, RATE_READ);
+	if (rate_ms > 0)
+	  break;
+      }
+
+      slot->index = todo[next++];
+      if (slot_start(api, multi, slot, ids[slot->index], type->relname,
+		     type->oneroot, active > 0) < 0) {
+	/* slot_start set the error */
+	record_error(errors, slot->index, 0);
+	ret = -1;
+	slot_release(slot);
+	continue;
+      }
+      active++;
+    }
+
+    if (active == 0)
+      continue;
+
+    mres = curl_multi_perform(multi, &running);
+    if (mres == CURLM_OK && running == active)
+      mres = fault_multi_wait(&api->priv->faults, multi,
+			      rate_ms > 0 && rate_ms < 1000 ? rate_ms : 1000);
+    if (mres != CURLM_OK) {
+      set_error(DELTACLOUD_GET_URL_ERROR, curl_multi_strerror(mres));
+      ret = -1;
+      break;
+    }
+
+    while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+      if (msg->msg != CURLMSG_DONE)
+	continue;
+
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&xfer);
+      slot = (struct batch_slot *)xfer;
+      out = (char *)output + slot->index * type->size;
+
+      if (transfer_complete_xml(&slot->xfer, msg->data.result, &doc) < 0 ||
+	  internal_parse_single(type->relname, type->oneroot, doc,
+				type->one_cb, out) < 0) {
+	/* transfer_complete_xml or internal_parse_single set the error */
+	record_error(errors, slot->index, 0);
+	memset(out, 0, type->size);
+	ret = -1;
+      }
+      else
+	record_error(errors, slot->index, 1);
+
+      curl_multi_remove_handle(multi, slot->xfer.curl);
+      slot_release(slot);
+      active--;
+    }
+  }
+
+  if (next == ntodo && active == 0)
+    record_fanout(planner, type->relname, now_ms() - start, ntodo);
+
+  /* only non-empty after a multi failure */
+  for (i = 0; i < window; i++) {
+    if (slots[i].url == NULL)
+      continue;
+    curl_multi_remove_handle(multi, slots[i].xfer.curl);
+    record_error(errors, slots[i].index, 0);
+    slot_release(&slots[i]);
+  }
+
+  curl_multi_cleanup(multi);
+  SAFE_FREE(slots);
+
+ fail_rest:
+  for (i = next; i < ntodo; i++) {
+    record_error(errors, todo[i], 0);
+    ret = -1;
+  }
+
+  return ret;
+}
+
+/****************************** COLLECTION ***********************************/
+
+struct batch_key {
+  const char *id;
+  int index;
+};
+
+static int compare_keys(const void *a, const void *b)
+{
+  const struct batch_key *ka = a;
+  const struct batch_key *kb = b;
+  int rc;
+
+  rc = strcmp(ka->id, kb->id);
+  if (rc == 0)
+    rc = ka->index - kb->index;
+
+  return rc;
+}
+
+/* returns the first key with the given id, or -1 if there is none */
+static int find_key(const struct batch_key *keys, int n, const char *id)
+{
+  int lo = 0;
+  int hi = n;
+  int mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (strcmp(keys[mid].id, id) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo < n && STREQ(keys[lo].id, id))
+    return lo;
+
+  return -1;
+}
+
+#define FIELD(elem, offset) ((void *)((char *)(elem) + (offset)))
+
+/* fetch the whole collection and move the elements that were asked for into
+ * output.  filled[i] is set for every ids[i] that was found.  An id that
+ * appears more than once is only filled in once; the caller fetches whatever
+ * is left over one by one, which also produces the per-id errors for ids
+ * that do not exist.
+ */
+static int batch_collection(struct deltacloud_api *api,
+			    const struct batch_type *type, const char **ids,
+			    int n, void *output, char *filled)
+{
+  struct deltacloud_link *thislink;
+  struct batch_key *keys;
+  void *list = NULL;
+  void **link;
+  void *elem;
+  xmlDocPtr doc = NULL;
+  char *id;
+  double start, fetched;
+  int elements = 0;
+  int i, k;
+  int ret = -1;
+
+  thislink = api_find_link(api, type->relname);
+  if (thislink == NULL)
+    /* api_find_link set the error */
+    return -1;
+
+  keys = malloc(n * sizeof(struct batch_key));
+  if (keys == NULL) {
+    oom_error();
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    keys[i].id = ids[i];
+    keys[i].index = i;
+  }
+  qsort(keys, n, sizeof(struct batch_key), compare_keys);
+
+  start = now_ms();
+  if (get_url_xml(api, thislink->href, type->listroot, &doc) != 0)
+    /* get_url_xml set the error */
+    goto cleanup;
+  fetched = now_ms();
+
+  if (internal_parse_collection(type->relname, type->listroot, doc,
+				type->list_cb, &list) < 0)
+    /* internal_parse_collection set the error */
+    goto cleanup;
+
+  link = &list;
+  while (*link != NULL) {
+    elem = *link;
+    elements++;
+
+    id = *(char **)FIELD(elem, type->id_offset);
+    k = id != NULL ? find_key(keys, n, id) : -1;
+    while (k >= 0 && k < n && STREQ(keys[k].id, id) && filled[keys[k].index])
+      k++;
+    if (k < 0 || k >= n || STRNEQ(keys[k].id, id)) {
+      link = FIELD(elem, type->next_offset);
+      continue;
+    }
+
+    /* unlink the element and move it into place */
+    *link = *(void **)FIELD(elem, type->next_offset);
+    memcpy((char *)output + keys[k].index * type->size, elem, type->size);
+    *(void **)FIELD((char *)output + keys[k].index * type->size,
+		    type->next_offset) = NULL;
+    filled[keys[k].index] = 1;
+    SAFE_FREE(elem);
+  }
+
+  record_collection(&api->priv->batch, type->relname, fetched - start,
+		    now_ms() - fetched, elements);
+
+  ret = 0;
+
+ cleanup:
+  type->free_all(&list);
+  SAFE_FREE(keys);
+
+  return ret;
+}
+
+/*
+ * Fetch n resources of the given type by id.  output is an array of n
+ * structures of type->size bytes each; entry i is filled in from ids[i], or
+ * left zeroed if that lookup failed.  If errors is not NULL, errors[i] is
+ * set to 0 or to the DELTACLOUD_*_ERROR of that lookup.  Returns 0 if every
+ * lookup succeeded, and -1 otherwise, with the last error describing the
+ * most recent failure.
+ */
+int internal_get_by_ids(struct deltacloud_api *api,
+			const struct batch_type *type, const char **ids, int n,
+			void *output, int *errors)
+{
+  char *filled;
+  int *todo;
+  int ntodo = 0;
+  int i;
+  int ret;
+
+  if (!valid_api(api) || !valid_arg(output))
+    return -1;
+
+  if (n < 0 || (n > 0 && ids == NULL)) {
+    invalid_argument_error("ids must hold n entries");
+    return -1;
+  }
+
+  for (i = 0; i < n; i++) {
+    if (!valid_arg(ids[i]))
+      return -1;
+  }
+
+  memset(output, 0, n * type->size);
+  if (n == 0)
+    return 0;
+
+  filled = calloc(n, sizeof(char));
+  todo = malloc(n * sizeof(int));
+  if (filled == NULL || todo == NULL) {
+    oom_error();
+    SAFE_FREE(filled);
+    SAFE_FREE(todo);
+    return -1;
+  }
+
+  /* if the collection fails as a whole, every id just goes through the
+   * fan-out below instead
+   */
+  if (use_collection(&api->priv->batch, type->relname, n))
+    batch_collection(api, type, ids, n, output, filled);
+
+  for (i = 0; i < n; i++) {
+    if (filled[i])
+      record_error(errors, i, 1);
+    else
+      todo[ntodo++] = i;
+  }
+
+  ret = 0;
+  if (ntodo > 0)
+    ret = batch_fanout(api, type, ids, todo, ntodo, output, errors);
+
+  SAFE_FREE(filled);
+  SAFE_FREE(todo);
+
+  return ret;
+}
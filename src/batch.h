@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <pthread.h>
+#include <libxml/parser.h>
+#include <libxml/xpath.h>
+#include "libdeltacloud.h"
+
+#define BATCH_DEFAULT_WINDOW 16
+
+/* weight given to the newest sample in the running estimates */
+#define BATCH_EWMA_WEIGHT 0.25
+
+/* every this many decisions, the plan that lost is tried anyway if its
+ * estimate was close, so that its estimate does not go stale
+ */
+#define BATCH_PROBE_INTERVAL 16
+#define BATCH_PROBE_RATIO 2.0
+
+/* everything internal_get_by_ids() needs to know about a resource type.
+ * All of the types it handles start with href and id, and are chained
+ * through a next pointer.
+ */
+struct batch_type {
+  const char *relname;
+  const char *listroot; /* root element of the collection */
+  const char *oneroot; /* root element of a single resource */
+  int (*list_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt, void **data);
+  int (*one_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt, void *data);
+  void (*free_all)(void *list); /* takes a pointer to the list head */
+  size_t size;
+  size_t id_offset;
+  size_t next_offset;
+};
+
+/* running estimates for one resource type; all times are in milliseconds */
+struct batch_stats {
+  const char *relname;
+  int fanout_samples;
+  double round_ms; /* one round of concurrent single GETs */
+  int collection_samples;
+  double collection_ms; /* fetching the whole collection */
+  double element_ms; /* parsing one element of the collection */
+  double collection_size; /* number of elements in the collection */
+
+  struct batch_stats *next;
+};
+
+struct batch_planner {
+  pthread_mutex_t lock;
+  int window; /* maximum number of single GETs in flight at once */
+  unsigned int decisions;
+  struct batch_stats *stats;
+};
+
+int batch_planner_init(struct batch_planner *planner);
+void batch_planner_destroy(struct batch_planner *planner);
+
+int internal_get_by_ids(struct deltacloud_api *api,
+			const struct batch_type *type, const char **ids, int n,
+			void *output, int *errors);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -27,6 +27,7 @@
 #include "common.h"
 #include "curl_action.h"
 #include "bucket.h"
+#include "decoder.h"
 
 /** @file */
 
@@ -36,119 +37,124 @@ static void free_metadata(struct deltacloud_bucket_blob_metadata *metadata)
   SAFE_FREE(metadata->value);
 }
 
-static int parse_one_blob(xmlNodePtr cur, xmlXPathContextPtr ctxt,
-			  void *output)
+static const struct decode_field blob_metadata_fields[] = {
+  DECODE_ATTR_STRING("key", struct deltacloud_bucket_blob_metadata, key),
+  DECODE_END
+};
+
+static int parse_blob_metadata(xmlNodePtr meta_cur, xmlXPathContextPtr ctxt,
+			       void *field)
 {
-  struct deltacloud_bucket_blob *thisblob = (struct deltacloud_bucket_blob *)output;
+  struct deltacloud_bucket_blob_metadata **metadata = (struct deltacloud_bucket_blob_metadata **)field;
   struct deltacloud_bucket_blob_metadata *thisentry;
-  xmlNodePtr meta_cur, entry_cur, oldnode;
-  int ret = -1;
+  xmlNodePtr entry_cur;
 
-  oldnode = ctxt->node;
+  for (entry_cur = meta_cur->children; entry_cur != NULL;
+       entry_cur = entry_cur->next) {
+    if (entry_cur->type != XML_ELEMENT_NODE ||
+	STRNEQ((const char *)entry_cur->name, "entry"))
+      continue;
 
-  memset(thisblob, 0, sizeof(struct deltacloud_bucket_blob));
+    thisentry = calloc(1, sizeof(struct deltacloud_bucket_blob_metadata));
+    if (thisentry == NULL) {
+      oom_error();
+      return -1;
+    }
 
-  thisblob->href = getXPathString("string(./@href)", ctxt);
-  thisblob->id = getXPathString("string(./@id)", ctxt);
-  thisblob->bucket_id = getXPathString("string(./bucket)", ctxt);
-  thisblob->content_length = getXPathString("string(./content_length)", ctxt);
-  thisblob->content_type = getXPathString("string(./content_type)", ctxt);
-  thisblob->last_modified = getXPathString("string(./last_modified)", ctxt);
-  thisblob->content_href = getXPathString("string(./content/@href)", ctxt);
-
-  meta_cur = cur->children;
-  while (meta_cur != NULL) {
-    if (meta_cur->type == XML_ELEMENT_NODE &&
-	STREQ((const char *)meta_cur->name, "user_metadata")) {
-
-      entry_cur = meta_cur->children;
-      while (entry_cur != NULL) {
-	if (entry_cur->type == XML_ELEMENT_NODE &&
-	    STREQ((const char *)entry_cur->name, "entry")) {
-
-	  ctxt->node = entry_cur;
-
-	  thisentry = calloc(1, sizeof(struct deltacloud_bucket_blob_metadata));
-	  if (thisentry == NULL) {
-	    deltacloud_free_bucket_blob(thisblob);
-	    oom_error();
-	    goto cleanup;
-	  }
-
-	  thisentry->key = getXPathString("string(./@key)", ctxt);
-	  thisentry->value = getXPathString("string(.)", ctxt);
-
-	  if (thisentry->value != NULL) {
-	    strip_trailing_whitespace(thisentry->value);
-	    strip_leading_whitespace(thisentry->value);
-	  }
-
-	  /* add_to_list can't fail */
-	  add_to_list(&thisblob->metadata,
-		      struct deltacloud_bucket_blob_metadata, thisentry);
-	}
-
-	entry_cur = entry_cur->next;
-      }
+    /* can't fail; there are no callbacks in the table */
+    decode_element(entry_cur, ctxt, blob_metadata_fields, thisentry);
+    thisentry->value = decode_text(entry_cur);
+
+    if (thisentry->value != NULL) {
+      strip_trailing_whitespace(thisentry->value);
+      strip_leading_whitespace(thisentry->value);
     }
 
-    meta_cur = meta_cur->next;
+    /* add_to_list can't fail */
+    add_to_list(metadata, struct deltacloud_bucket_blob_metadata, thisentry);
   }
 
-  ret = 0;
+  return 0;
+}
 
- cleanup:
-  ctxt->node = oldnode;
+static const struct decode_field blob_fields[] = {
+  DECODE_ATTR_STRING("href", struct deltacloud_bucket_blob, href),
+  DECODE_ATTR_STRING("id", struct deltacloud_bucket_blob, id),
+  DECODE_TEXT("bucket", struct deltacloud_bucket_blob, bucket_id),
+  DECODE_TEXT("content_length", struct deltacloud_bucket_blob,
+	      content_length),
+  DECODE_TEXT("content_type", struct deltacloud_bucket_blob, content_type),
+  DECODE_TEXT("last_modified", struct deltacloud_bucket_blob, last_modified),
+  DECODE_CHILD_ATTR("content", "href", struct deltacloud_bucket_blob,
+		    content_href),
+  DECODE_EACH("user_metadata", struct deltacloud_bucket_blob, metadata,
+	      parse_blob_metadata),
+  DECODE_END
+};
 
-  return ret;
+static int parse_one_blob(xmlNodePtr cur, xmlXPathContextPtr ctxt,
+			  void *output)
+{
+  struct deltacloud_bucket_blob *thisblob = (struct deltacloud_bucket_blob *)output;
+
+  memset(thisblob, 0, sizeof(struct deltacloud_bucket_blob));
+
+  if (decode_element(cur, ctxt, blob_fields, thisblob) < 0) {
+    /* parse_blob_metadata already set the error */
+    deltacloud_free_bucket_blob(thisblob);
+    return -1;
+  }
+
+  return 0;
 }
 
-static int parse_one_bucket(xmlNodePtr cur, xmlXPathContextPtr ctxt,
-			    void *output)
+static int parse_bucket_blob(xmlNodePtr blob_cur, xmlXPathContextPtr ctxt,
+			     void *field)
 {
-  struct deltacloud_bucket *thisbucket = (struct deltacloud_bucket *)output;
+  struct deltacloud_bucket_blob **blobs = (struct deltacloud_bucket_blob **)field;
   struct deltacloud_bucket_blob *thisblob;
-  xmlNodePtr blob_cur;
-  int ret = -1;
 
-  memset(thisbucket, 0, sizeof(struct deltacloud_bucket));
+  thisblob = calloc(1, sizeof(struct deltacloud_bucket_blob));
+  if (thisblob == NULL) {
+    oom_error();
+    return -1;
+  }
 
-  thisbucket->href = getXPathString("string(./@href)", ctxt);
-  thisbucket->id = getXPathString("string(./@id)", ctxt);
-  thisbucket->name = getXPathString("string(./name)", ctxt);
-  thisbucket->size = getXPathString("string(./size)", ctxt);
+  if (parse_one_blob(blob_cur, ctxt, thisblob) < 0) {
+    /* parse_one_blob already set the error */
+    SAFE_FREE(thisblob);
+    return -1;
+  }
 
-  blob_cur = cur->children;
-  while (blob_cur != NULL) {
-    if (blob_cur->type == XML_ELEMENT_NODE &&
-	STREQ((const char *)blob_cur->name, "blob")) {
+  /* add_to_list can't fail */
+  add_to_list(blobs, struct deltacloud_bucket_blob, thisblob);
 
-      thisblob = calloc(1, sizeof(struct deltacloud_bucket_blob));
-      if (thisblob == NULL) {
-	oom_error();
-	goto cleanup;
-      }
+  return 0;
+}
 
-      if (parse_one_blob(blob_cur, ctxt, thisblob) < 0) {
-	/* parse_one_blob already set the error */
-	SAFE_FREE(thisblob);
-	goto cleanup;
-      }
+static const struct decode_field bucket_fields[] = {
+  DECODE_ATTR_STRING("href", struct deltacloud_bucket, href),
+  DECODE_ATTR_STRING("id", struct deltacloud_bucket, id),
+  DECODE_TEXT("name", struct deltacloud_bucket, name),
+  DECODE_TEXT("size", struct deltacloud_bucket, size),
+  DECODE_EACH("blob", struct deltacloud_bucket, blobs, parse_bucket_blob),
+  DECODE_END
+};
 
-      /* add_to_list can't fail */
-      add_to_list(&thisbucket->blobs, struct deltacloud_bucket_blob, thisblob);
-    }
-
-    blob_cur = blob_cur->next;
-  }
+static int parse_one_bucket(xmlNodePtr cur, xmlXPathContextPtr ctxt,
+			    void *output)
+{
+  struct deltacloud_bucket *thisbucket = (struct deltacloud_bucket *)output;
 
-  ret = 0;
+  memset(thisbucket, 0, sizeof(struct deltacloud_bucket));
 
- cleanup:
-  if (ret < 0)
+  if (decode_element(cur, ctxt, bucket_fields, thisbucket) < 0) {
+    /* parse_bucket_blob already set the error */
     deltacloud_free_bucket(thisbucket);
+    return -1;
+  }
 
-  return ret;
+  return 0;
 }
 
 static int parse_bucket_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
@@ -195,6 +201,24 @@ static int parse_bucket_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
   return ret;
 }
 
+static int copy_bucket(struct deltacloud_bucket *dst,
+		       const struct deltacloud_bucket *src);
+static int copy_bucket_list(struct deltacloud_bucket **dst,
+			    const struct deltacloud_bucket *src);
+
+static const struct collection_type bucket_collection_type = {
+  .relname = "buckets",
+  .rootname = "buckets",
+  .list_cb = parse_bucket_xml,
+  .copy_all = (int (*)(void *, const void *))copy_bucket_list,
+  .free_all = (void (*)(void *))deltacloud_free_bucket_list,
+  .oneroot = "bucket",
+  .one_cb = parse_one_bucket,
+  .copy_one = (int (*)(void *, const void *))copy_bucket,
+  .free_one = (void (*)(void *))deltacloud_free_bucket,
+  .size = sizeof(struct deltacloud_bucket),
+};
+
 /**
  * A function to get a linked list of all of the buckets defined.  The caller
  * is expected to free the list using deltacloud_free_bucket_list().
@@ -206,8 +230,7 @@ static int parse_bucket_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 int deltacloud_get_buckets(struct deltacloud_api *api,
 			   struct deltacloud_bucket **buckets)
 {
-  return internal_get(api, "buckets", "buckets", parse_bucket_xml,
-		      (void **)buckets);
+  return internal_get(api, &bucket_collection_type, (void **)buckets);
 }
 
 /**
@@ -222,8 +245,7 @@ int deltacloud_get_buckets(struct deltacloud_api *api,
 int deltacloud_get_bucket_by_id(struct deltacloud_api *api, const char *id,
 				struct deltacloud_bucket *bucket)
 {
-  return internal_get_by_id(api, id, "buckets", "bucket", parse_one_bucket,
-			    bucket);
+  return internal_get_type_by_id(api, &bucket_collection_type, id, bucket);
 }
 
 /**
@@ -388,8 +410,7 @@ int deltacloud_bucket_create_blob_from_file(struct deltacloud_api *api,
     goto cleanup;
   }
 
-  if (do_multipart_post_url(href, api->user, api->password, api->driver, api->provider, httppost,
-			    &data) < 0)
+  if (do_multipart_post_url(api, href, httppost, &data) < 0)
     /* do_multipart_post_url already set the error */
     goto cleanup;
 
@@ -398,6 +419,8 @@ int deltacloud_bucket_create_blob_from_file(struct deltacloud_api *api,
     goto cleanup;
   }
 
+  collection_cache_invalidate(&api->priv->cache, "buckets");
+
   ret = 0;
 
  cleanup:
@@ -408,6 +431,54 @@ int deltacloud_bucket_create_blob_from_file(struct deltacloud_api *api,
   return ret;
 }
 
+/* the blobs of a bucket, as they are listed in the bucket itself; this is
+ * only good for internal_foreach()
+ */
+static const struct collection_type bucket_blob_collection_type = {
+  .relname = "buckets",
+  .rootname = "bucket",
+  .oneroot = "blob",
+  .one_cb = parse_one_blob,
+  .free_one = (void (*)(void *))deltacloud_free_bucket_blob,
+  .size = sizeof(struct deltacloud_bucket_blob),
+};
+
+/**
+ * A function to hand each blob of a bucket to a callback as soon as it has
+ * been downloaded, without building a list of them.  As with the blobs of
+ * deltacloud_get_bucket_by_id(), only the href and id are filled in.  See
+ * deltacloud_visit_cb for what the callback may do with the
+ * deltacloud_bucket_blob structure.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] bucket The deltacloud_bucket representing the bucket whose
+ *                   blobs to go through
+ * @param[in] visitor The function to call with each blob
+ * @param[in] userdata A pointer that is passed through to visitor
+ * @returns 0 on success, including when visitor stops early, -1 on error
+ */
+int deltacloud_bucket_foreach_blob(struct deltacloud_api *api,
+				   struct deltacloud_bucket *bucket,
+				   deltacloud_visit_cb visitor, void *userdata)
+{
+  char *url;
+  int rc;
+
+  if (!valid_api(api) || !valid_arg(bucket))
+    return -1;
+
+  url = internal_id_url(api, "buckets", bucket->id);
+  if (url == NULL)
+    /* internal_id_url set the error */
+    return -1;
+
+  /* internal_foreach sets its own errors */
+  rc = internal_foreach(api, &bucket_blob_collection_type, url, visitor,
+			userdata);
+  SAFE_FREE(url);
+
+  return rc;
+}
+
 /**
  * A function to lookup a blob by id.  It is up to the caller to free the
  * structure with deltacloud_free_bucket_blob().
@@ -500,8 +571,7 @@ int deltacloud_bucket_blob_update_metadata(struct deltacloud_api *api,
     }
   }
 
-  if (post_url_with_headers(bloburl, api->user, api->password, api->driver, api->provider, headers,
-			    &internal_data) != 0)
+  if (post_url_with_headers(api, bloburl, headers, &internal_data) != 0)
     /* post_url_with_headers sets its own errors, so don't overwrite it here */
     goto cleanup;
 
@@ -550,7 +620,7 @@ int deltacloud_bucket_blob_get_content(struct deltacloud_api *api,
     return -1;
   }
 
-  if (get_url(bloburl, api->user, api->password, api->driver, api->provider, output) != 0)
+  if (get_url(api, bloburl, output) != 0)
     /* get_url sets its own errors, so don't overwrite it here */
     return -1;
 
@@ -616,7 +686,7 @@ int deltacloud_bucket_blob_get_metadata(struct deltacloud_api *api,
     return -1;
   }
 
-  if (head_url(bloburl, api->user, api->password, api->driver, api->provider, &headers) != 0)
+  if (head_url(api, bloburl, &headers) != 0)
     /* head_url sets its own errors, so don't overwrite it here */
     goto cleanup;
 
@@ -694,7 +764,7 @@ int deltacloud_bucket_delete_blob(struct deltacloud_api *api,
   if (!valid_api(api) || !valid_arg(blob))
     return -1;
 
-  return internal_destroy(blob->href, api->user, api->password, api->driver, api->provider);
+  return internal_destroy(api, blob->href);
 }
 
 /**
@@ -730,7 +800,46 @@ int deltacloud_bucket_destroy(struct deltacloud_api *api,
   if (!valid_api(api) || !valid_arg(bucket))
     return -1;
 
-  return internal_destroy(bucket->href, api->user, api->password, api->driver, api->provider);
+  return internal_destroy(api, bucket->href);
+}
+
+/**
+ * A function to start fetching the list of all of the buckets without
+ * waiting for the result.  The callback runs from deltacloud_async_perform()
+ * with the list of buckets, which it is expected to free using
+ * deltacloud_free_bucket_list().
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] cb The function to call once the list has been fetched
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_buckets(struct deltacloud_api *api,
+				 deltacloud_async_cb cb, void *userdata)
+{
+  return internal_async_get(api, "buckets", "buckets", parse_bucket_xml,
+			    cb, userdata);
+}
+
+/**
+ * A function to start looking up a particular bucket by id without waiting
+ * for the result.  On success the callback is handed the deltacloud_bucket
+ * structure, which the caller is expected to free using
+ * deltacloud_free_bucket().
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] id The bucket ID to look for
+ * @param[out] bucket The deltacloud_bucket structure to fill in if the ID is
+ *             found; it must stay valid until cb has run
+ * @param[in] cb The function to call once the lookup has finished
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_bucket_by_id(struct deltacloud_api *api,
+				      const char *id,
+				      struct deltacloud_bucket *bucket,
+				      deltacloud_async_cb cb, void *userdata)
+{
+  return internal_async_get_by_id(api, id, "buckets", "bucket",
+				  parse_one_bucket, bucket, cb, userdata);
 }
 
 /**
@@ -760,3 +869,79 @@ void deltacloud_free_bucket_list(struct deltacloud_bucket **buckets)
 {
   free_list(buckets, struct deltacloud_bucket, deltacloud_free_bucket);
 }
+
+static void free_metadata_list(struct deltacloud_bucket_blob_metadata **metadata)
+{
+  free_list(metadata, struct deltacloud_bucket_blob_metadata, free_metadata);
+}
+
+static int copy_metadata(struct deltacloud_bucket_blob_metadata *dst,
+			 const struct deltacloud_bucket_blob_metadata *src)
+{
+  if (copy_string(&dst->key, src->key) < 0 ||
+      copy_string(&dst->value, src->value) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_metadata_list(struct deltacloud_bucket_blob_metadata **dst,
+			      const struct deltacloud_bucket_blob_metadata *src)
+{
+  copy_list(dst, src, struct deltacloud_bucket_blob_metadata, copy_metadata,
+	    free_metadata_list);
+
+  return 0;
+}
+
+static void free_blob_list(struct deltacloud_bucket_blob **blobs)
+{
+  free_list(blobs, struct deltacloud_bucket_blob, deltacloud_free_bucket_blob);
+}
+
+static int copy_blob(struct deltacloud_bucket_blob *dst,
+		     const struct deltacloud_bucket_blob *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->bucket_id, src->bucket_id) < 0 ||
+      copy_string(&dst->content_length, src->content_length) < 0 ||
+      copy_string(&dst->content_type, src->content_type) < 0 ||
+      copy_string(&dst->last_modified, src->last_modified) < 0 ||
+      copy_string(&dst->content_href, src->content_href) < 0 ||
+      copy_metadata_list(&dst->metadata, src->metadata) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_blob_list(struct deltacloud_bucket_blob **dst,
+			  const struct deltacloud_bucket_blob *src)
+{
+  copy_list(dst, src, struct deltacloud_bucket_blob, copy_blob,
+	    free_blob_list);
+
+  return 0;
+}
+
+static int copy_bucket(struct deltacloud_bucket *dst,
+		       const struct deltacloud_bucket *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->name, src->name) < 0 ||
+      copy_string(&dst->size, src->size) < 0 ||
+      copy_blob_list(&dst->blobs, src->blobs) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_bucket_list(struct deltacloud_bucket **dst,
+			    const struct deltacloud_bucket *src)
+{
+  copy_list(dst, src, struct deltacloud_bucket, copy_bucket,
+	    deltacloud_free_bucket_list);
+
+  return 0;
+}
@@ -0,0 +1,731 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "curl_action.h"
+#include "collection_cache.h"
+
+int collection_cache_init(struct collection_cache *cache)
+{
+  memset(cache, 0, sizeof(struct collection_cache));
+
+  if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to initialize cache lock");
+    return -1;
+  }
+
+  if (pthread_cond_init(&cache->idle, NULL) != 0) {
+    pthread_mutex_destroy(&cache->lock);
+    set_error(DELTACLOUD_INTERNAL_ERROR,
+	      "Failed to initialize cache condition");
+    return -1;
+  }
+
+  cache->max_refreshers = CACHE_DEFAULT_REFRESHERS;
+
+  return 0;
+}
+
+static void free_refresh(struct cache_refresh *job)
+{
+  SAFE_FREE(job->id);
+  SAFE_FREE(job->url);
+  SAFE_FREE(job);
+}
+
+static void free_entry(struct cache_entry *entry)
+{
+  if (entry->id == NULL)
+    entry->type->free_all(&entry->data);
+  else if (entry->data != NULL) {
+    entry->type->free_one(entry->data);
+    SAFE_FREE(entry->data);
+  }
+  SAFE_FREE(entry->id);
+  SAFE_FREE(entry->etag);
+  SAFE_FREE(entry->last_modified);
+  SAFE_FREE(entry);
+}
+
+static void free_entries(struct cache_entry *entry)
+{
+  struct cache_entry *next;
+
+  while (entry != NULL) {
+    next = entry->next;
+    free_entry(entry);
+    entry = next;
+  }
+}
+
+/* the refreshers use the connection pool, so this has to be called before
+ * the pool is torn down
+ */
+void collection_cache_destroy(struct collection_cache *cache)
+{
+  struct cache_ttl *next;
+  struct cache_refresh *job;
+
+  /* refreshes that have not started yet are abandoned; the ones in flight
+   * have to finish, since they still use the cache
+   */
+  pthread_mutex_lock(&cache->lock);
+  cache->stopping = 1;
+  while (cache->queue != NULL) {
+    job = cache->queue;
+    cache->queue = job->next;
+    free_refresh(job);
+  }
+  while (cache->refreshers > 0)
+    pthread_cond_wait(&cache->idle, &cache->lock);
+  pthread_mutex_unlock(&cache->lock);
+
+  free_entries(cache->entries);
+  cache->entries = NULL;
+  while (cache->ttls != NULL) {
+    next = cache->ttls->next;
+    SAFE_FREE(cache->ttls->relname);
+    SAFE_FREE(cache->ttls);
+    cache->ttls = next;
+  }
+  pthread_cond_destroy(&cache->idle);
+  pthread_mutex_destroy(&cache->lock);
+}
+
+/* must be called with cache->lock held.  Returns NULL if nothing was set
+ * for relname, which means that entries always have to be revalidated.
+ */
+static struct cache_ttl *policy_for(struct collection_cache *cache,
+				    const char *relname)
+{
+  struct cache_ttl *ttl;
+
+  for (ttl = cache->ttls; ttl != NULL; ttl = ttl->next) {
+    if (STREQ(ttl->relname, relname))
+      break;
+  }
+
+  return ttl;
+}
+
+/* set the ttl and/or stale period of relname; a NULL one is left alone */
+static int set_policy(struct collection_cache *cache, const char *relname,
+		      const int *seconds, const int *stale)
+{
+  struct cache_ttl *ttl;
+  struct cache_ttl *new = NULL;
+
+  /* allocate up front so that nothing can fail with the lock held */
+  new = calloc(1, sizeof(struct cache_ttl));
+  if (new == NULL || copy_string(&new->relname, relname) < 0) {
+    SAFE_FREE(new);
+    oom_error();
+    return -1;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  ttl = policy_for(cache, relname);
+  if (ttl == NULL) {
+    ttl = new;
+    ttl->next = cache->ttls;
+    cache->ttls = ttl;
+    new = NULL;
+  }
+  if (seconds != NULL)
+    ttl->seconds = *seconds;
+  if (stale != NULL)
+    ttl->stale = *stale;
+  pthread_mutex_unlock(&cache->lock);
+
+  if (new != NULL) {
+    SAFE_FREE(new->relname);
+    SAFE_FREE(new);
+  }
+
+  return 0;
+}
+
+int collection_cache_set_ttl(struct collection_cache *cache,
+			     const char *relname, int seconds)
+{
+  return set_policy(cache, relname, &seconds, NULL);
+}
+
+int collection_cache_set_stale(struct collection_cache *cache,
+			       const char *relname, int seconds)
+{
+  return set_policy(cache, relname, NULL, &seconds);
+}
+
+void collection_cache_set_refreshers(struct collection_cache *cache, int max)
+{
+  pthread_mutex_lock(&cache->lock);
+  cache->max_refreshers = max;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/* drop every entry of type relname, or every entry if relname is NULL */
+void collection_cache_invalidate(struct collection_cache *cache,
+				 const char *relname)
+{
+  struct cache_entry **curr;
+  struct cache_entry *dropped = NULL;
+  struct cache_entry *entry;
+
+  pthread_mutex_lock(&cache->lock);
+  curr = &cache->entries;
+  while (*curr != NULL) {
+    entry = *curr;
+    if (relname == NULL || STREQ(entry->type->relname, relname)) {
+      *curr = entry->next;
+      entry->next = dropped;
+      dropped = entry;
+    }
+    else
+      curr = &entry->next;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  /* freeing large lists takes a while, so do it outside of the lock */
+  free_entries(dropped);
+}
+
+/* must be called with cache->lock held.  id is NULL for the whole
+ * collection.
+ */
+static struct cache_entry **find_entry(struct collection_cache *cache,
+				       const struct collection_type *type,
+				       const char *id)
+{
+  struct cache_entry **curr;
+  struct cache_entry *entry;
+
+  for (curr = &cache->entries; *curr != NULL; curr = &(*curr)->next) {
+    entry = *curr;
+    if (STREQ(entry->type->relname, type->relname) &&
+	((id == NULL && entry->id == NULL) ||
+	 (id != NULL && entry->id != NULL && STREQ(entry->id, id))))
+      break;
+  }
+
+  return curr;
+}
+
+/* must be called with cache->lock held.  Copies the data of entry into
+ * output, the way the fetch would have filled it in.
+ */
+static int copy_out(struct cache_entry *entry, void *output)
+{
+  const struct collection_type *type = entry->type;
+
+  if (entry->id == NULL)
+    /* copy_all sets its own error */
+    return type->copy_all(output, entry->data);
+
+  memset(output, 0, type->size);
+  if (type->copy_one(output, entry->data) < 0) {
+    /* copy_one set the error */
+    type->free_one(output);
+    memset(output, 0, type->size);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int fetch(struct deltacloud_api *api, const struct collection_type *type,
+		 const char *id, const char *url, int conditional,
+		 void *output);
+
+/* must be called with cache->lock held.  Clears the refreshing flag of the
+ * entry that job was for, if it is still around.
+ */
+static void refresh_done(struct collection_cache *cache,
+			 struct cache_refresh *job)
+{
+  struct cache_entry *entry;
+
+  entry = *find_entry(cache, job->type, job->id);
+  if (entry != NULL)
+    entry->refreshing = 0;
+}
+
+/* fetch the data of job and throw it away; storing it in the cache is what
+ * fetch() does anyway.  Failures are not reported to anyone: the stale entry
+ * is served until it runs out, and then the next caller fetches it
+ * synchronously.
+ */
+static void refresh(struct deltacloud_api *api, struct cache_refresh *job)
+{
+  const struct collection_type *type = job->type;
+  void *list = NULL;
+  void *element;
+
+  if (job->id == NULL) {
+    if (fetch(api, type, NULL, job->url, 1, &list) == 0)
+      type->free_all(&list);
+    return;
+  }
+
+  element = calloc(1, type->size);
+  if (element == NULL)
+    return;
+  if (fetch(api, type, job->id, job->url, 1, element) == 0)
+    type->free_one(element);
+  SAFE_FREE(element);
+}
+
+/* a background refresh thread; it works through the queue and exits once it
+ * is empty
+ */
+static void *refresher(void *data)
+{
+  struct deltacloud_api *api = (struct deltacloud_api *)data;
+  struct collection_cache *cache = &api->priv->cache;
+  struct cache_refresh *job;
+
+  pthread_mutex_lock(&cache->lock);
+  while (!cache->stopping && cache->queue != NULL) {
+    job = cache->queue;
+    cache->queue = job->next;
+    pthread_mutex_unlock(&cache->lock);
+
+    refresh(api, job);
+
+    pthread_mutex_lock(&cache->lock);
+    refresh_done(cache, job);
+    free_refresh(job);
+  }
+  cache->refreshers--;
+  if (cache->refreshers == 0)
+    pthread_cond_broadcast(&cache->idle);
+  pthread_mutex_unlock(&cache->lock);
+
+  return NULL;
+}
+
+/* must be called with cache->lock held.  Queue a background refresh of
+ * entry, and start another refresher thread if there is room for one.
+ * This is an optimization, so failures are not reported; the entry is just
+ * fetched synchronously once it runs out.
+ */
+static void schedule_refresh(struct deltacloud_api *api,
+			     struct cache_entry *entry, const char *url)
+{
+  struct collection_cache *cache = &api->priv->cache;
+  struct cache_refresh *job;
+  struct cache_refresh **tail;
+  pthread_attr_t attr;
+  pthread_t thread;
+  int started;
+
+  if (entry->refreshing || cache->stopping)
+    return;
+
+  job = calloc(1, sizeof(struct cache_refresh));
+  if (job == NULL)
+    return;
+  job->type = entry->type;
+  if (copy_string(&job->id, entry->id) < 0 ||
+      copy_string(&job->url, url) < 0) {
+    free_refresh(job);
+    return;
+  }
+
+  for (tail = &cache->queue; *tail != NULL; tail = &(*tail)->next)
+    ;
+  *tail = job;
+  entry->refreshing = 1;
+
+  if (cache->refreshers >= cache->max_refreshers)
+    /* one of the running refreshers will get to it */
+    return;
+
+  started = pthread_attr_init(&attr) == 0;
+  if (started) {
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    started = pthread_create(&thread, &attr, refresher, api) == 0;
+    pthread_attr_destroy(&attr);
+  }
+  if (started)
+    cache->refreshers++;
+  else if (cache->refreshers == 0) {
+    /* nobody is going to pick the job up */
+    *tail = NULL;
+    entry->refreshing = 0;
+    free_refresh(job);
+  }
+}
+
+/* hand out a copy of the cached data, if there is any and either it is
+ * still fresh or the server just said it has not changed (revalidated is
+ * set).  Data that is past its TTL but still within the stale period is
+ * handed out too, and refreshed in the background.  Returns 1 if there is
+ * nothing suitable in the cache.
+ */
+static int use_entry(struct deltacloud_api *api,
+		     const struct collection_type *type, const char *id,
+		     const char *url, int revalidated, void *output)
+{
+  struct collection_cache *cache = &api->priv->cache;
+  struct cache_entry *entry;
+  struct cache_ttl *policy;
+  time_t now = time(NULL);
+  int ret = 1;
+
+  pthread_mutex_lock(&cache->lock);
+  entry = *find_entry(cache, type, id);
+  policy = policy_for(cache, type->relname);
+  if (entry != NULL) {
+    if (revalidated) {
+      entry->fetched = now;
+      ret = copy_out(entry, output);
+    }
+    else if (policy != NULL && now - entry->fetched < policy->seconds)
+      ret = copy_out(entry, output);
+    else if (policy != NULL &&
+	     now - entry->fetched < policy->seconds + policy->stale) {
+      ret = copy_out(entry, output);
+      if (ret == 0)
+	schedule_refresh(api, entry, url);
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  return ret;
+}
+
+/* ask the server to only send the data if it changed since the copy we
+ * have; returns 1 if there was a copy to ask about, 0 if not
+ */
+static int add_validators(struct collection_cache *cache,
+			  const struct collection_type *type, const char *id,
+			  struct transfer *xfer)
+{
+  struct cache_entry *entry;
+  char *inm = NULL;
+  char *ims = NULL;
+  int ret = -1;
+
+  pthread_mutex_lock(&cache->lock);
+  entry = *find_entry(cache, type, id);
+  if (entry == NULL ||
+      (entry->etag == NULL && entry->last_modified == NULL)) {
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+  }
+  if ((entry->etag != NULL &&
+       asprintf(&inm, "If-None-Match: %s", entry->etag) < 0) ||
+      (entry->last_modified != NULL &&
+       asprintf(&ims, "If-Modified-Since: %s", entry->last_modified) < 0)) {
+    pthread_mutex_unlock(&cache->lock);
+    oom_error();
+    goto cleanup;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  if ((inm != NULL && transfer_add_header(xfer, inm) < 0) ||
+      (ims != NULL && transfer_add_header(xfer, ims) < 0))
+    /* transfer_add_header set the error */
+    goto cleanup;
+
+  ret = 1;
+
+ cleanup:
+  SAFE_FREE(inm);
+  SAFE_FREE(ims);
+
+  return ret;
+}
+
+/* build a cache entry holding a copy of output; NULL on failure */
+static struct cache_entry *new_entry(const struct collection_type *type,
+				     const char *id, const void *output)
+{
+  struct cache_entry *entry;
+
+  entry = calloc(1, sizeof(struct cache_entry));
+  if (entry == NULL)
+    return NULL;
+  entry->type = type;
+  entry->fetched = time(NULL);
+
+  if (id == NULL) {
+    if (type->copy_all(&entry->data, *(void * const *)output) < 0)
+      goto fail;
+    return entry;
+  }
+
+  if (copy_string(&entry->id, id) < 0)
+    goto fail;
+  entry->data = calloc(1, type->size);
+  if (entry->data == NULL)
+    goto fail;
+  if (type->copy_one(entry->data, output) < 0)
+    goto fail;
+
+  return entry;
+
+ fail:
+  free_entry(entry);
+  return NULL;
+}
+
+/* remember a copy of output along with its validators, replacing whatever
+ * was cached for it before.  It is only worth keeping if there is something
+ * to revalidate it with or it may be handed out as is for a while; single
+ * elements are only kept in the latter case, since there can be any number
+ * of them.  Expired single elements are dropped on the way.  Ownership of
+ * etag and last_modified passes to this function.  Failing to cache is not
+ * an error for the caller, so nothing is reported.
+ */
+static void store_entry(struct collection_cache *cache,
+			const struct collection_type *type, const char *id,
+			const void *output, char *etag, char *last_modified)
+{
+  struct cache_entry *entry = NULL;
+  struct cache_entry **curr;
+  struct cache_entry *dropped = NULL;
+  struct cache_entry *old;
+  struct cache_ttl *policy;
+  time_t now = time(NULL);
+  int lifetime = 0;
+  int keep;
+
+  pthread_mutex_lock(&cache->lock);
+  policy = policy_for(cache, type->relname);
+  if (policy != NULL)
+    lifetime = policy->seconds + policy->stale;
+  pthread_mutex_unlock(&cache->lock);
+
+  if (id == NULL)
+    keep = lifetime > 0 || etag != NULL || last_modified != NULL;
+  else
+    keep = lifetime > 0;
+
+  if (keep) {
+    entry = new_entry(type, id, output);
+    if (entry != NULL) {
+      entry->etag = etag;
+      entry->last_modified = last_modified;
+      etag = NULL;
+      last_modified = NULL;
+    }
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  curr = &cache->entries;
+  while (*curr != NULL) {
+    old = *curr;
+    if (STREQ(old->type->relname, type->relname) &&
+	((id == NULL && old->id == NULL) ||
+	 (old->id != NULL &&
+	  ((id != NULL && STREQ(old->id, id)) ||
+	   now - old->fetched >= lifetime)))) {
+      *curr = old->next;
+      old->next = dropped;
+      dropped = old;
+    }
+    else
+      curr = &old->next;
+  }
+  if (entry != NULL) {
+    entry->next = cache->entries;
+    cache->entries = entry;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  /* freeing large lists takes a while, so do it outside of the lock */
+  free_entries(dropped);
+  SAFE_FREE(etag);
+  SAFE_FREE(last_modified);
+}
+
+struct fetch_get {
+  struct deltacloud_api *api;
+  const struct collection_type *type;
+  const char *id;
+  const char *url;
+  const char *rootname;
+  int conditional;
+};
+
+static int prepare_fetch(struct transfer *xfer, void *arg)
+{
+  struct fetch_get *get = (struct fetch_get *)arg;
+
+  if (transfer_setup(xfer, get->api, TRANSFER_GET, get->url, NULL, NULL,
+		     NULL) < 0)
+    /* transfer_setup set the error */
+    return -1;
+  /* a whole collection is parsed element by element as it arrives */
+  if (get->id == NULL) {
+    if (transfer_stream_list(xfer, get->rootname, get->type->list_cb,
+			     get->type->free_all) < 0)
+      /* transfer_stream_list set the error */
+      return -1;
+  }
+  else
+    transfer_stream_xml(xfer, get->rootname);
+
+  if (get->conditional &&
+      add_validators(&get->api->priv->cache, get->type, get->id, xfer) < 0)
+    /* add_validators set the error */
+    return -1;
+
+  return 0;
+}
+
+/* one GET of url, conditional on the cached copy if conditional is set.
+ * id is NULL for the whole collection, in which case output is a pointer
+ * to the list head; otherwise it is the element to fill in.  Returns 1 if
+ * the server said the data had not changed but the cached copy has gone
+ * away in the meantime.
+ */
+static int fetch(struct deltacloud_api *api, const struct collection_type *type,
+		 const char *id, const char *url, int conditional,
+		 void *output)
+{
+  struct collection_cache *cache = &api->priv->cache;
+  const char *rootname = id == NULL ? type->rootname : type->oneroot;
+  struct fetch_get get = { api, type, id, url, rootname, conditional };
+  struct transfer xfer;
+  struct retry_state retry;
+  xmlDocPtr doc = NULL;
+  void *list;
+  CURLcode res;
+  long code;
+  char *etag = NULL;
+  char *last_modified = NULL;
+  int ret = -1;
+
+  retry_start(&retry);
+  do {
+    if (prepare_fetch(&xfer, &get) < 0)
+      /* prepare_fetch set the error */
+      goto cleanup;
+
+    res = hedge_perform(api, &xfer, prepare_fetch, &get);
+  } while (transfer_retry(&xfer, &retry, res));
+  if (transfer_complete_xml(&xfer, res, &doc) < 0)
+    /* transfer_complete_xml set the error */
+    goto cleanup;
+
+  code = transfer_response_code(&xfer);
+  /* only a conditional GET can get this; if the validators could not be
+   * sent after all, the server answers in full
+   */
+  if (code == 304) {
+    if (doc != NULL)
+      xmlFreeDoc(doc);
+    /* use_entry sets its own error */
+    ret = use_entry(api, type, id, url, 1, output);
+    goto cleanup;
+  }
+
+  if (code == 200) {
+    etag = transfer_header_value(&xfer, "ETag");
+    last_modified = transfer_header_value(&xfer, "Last-Modified");
+  }
+
+  /* the handle can go back to the pool while we parse */
+  list = transfer_stream_take(&xfer);
+  transfer_cleanup(&xfer);
+
+  /* internal_parse_streamed and internal_parse_single set their own errors
+   * and free doc
+   */
+  if (id == NULL)
+    ret = internal_parse_streamed(type->relname, rootname, doc, list,
+				  type->list_cb, output);
+  else
+    ret = internal_parse_single(type->relname, rootname, doc, type->one_cb,
+				output);
+  if (ret < 0)
+    goto cleanup;
+
+  if (code == 200) {
+    store_entry(cache, type, id, output, etag, last_modified);
+    etag = NULL;
+    last_modified = NULL;
+  }
+
+ cleanup:
+  transfer_cleanup(&xfer);
+  SAFE_FREE(etag);
+  SAFE_FREE(last_modified);
+
+  return ret;
+}
+
+static int cached_get(struct deltacloud_api *api,
+		      const struct collection_type *type, const char *id,
+		      const char *url, void *output)
+{
+  int ret;
+
+  ret = use_entry(api, type, id, url, 0, output);
+  if (ret != 1)
+    return ret;
+
+  ret = fetch(api, type, id, url, 1, output);
+  if (ret == 1)
+    ret = fetch(api, type, id, url, 0, output);
+
+  /* a caching proxy, or a replayed trace, can answer 304 even to a GET
+   * without validators, which leaves nothing to fill output in from
+   */
+  if (ret == 1) {
+    set_error(DELTACLOUD_GET_URL_ERROR,
+	      "Server answered 304 Not Modified to an unconditional GET");
+    ret = -1;
+  }
+
+  return ret;
+}
+
+/*
+ * Fetch the collection of type at url into output.  If the type has a TTL
+ * and the cached copy is younger than that, the list is copied from the
+ * cache without asking the server at all.  Otherwise the validators of the
+ * last copy are sent along, so when the collection has not changed the
+ * server only answers 304 and the list is still copied from the cache
+ * instead of being downloaded and parsed again.
+ */
+int collection_cache_get(struct deltacloud_api *api,
+			 const struct collection_type *type, const char *url,
+			 void **output)
+{
+  return cached_get(api, type, NULL, url, output);
+}
+
+/*
+ * The single element equivalent of collection_cache_get(); url is where
+ * element id lives.
+ */
+int collection_cache_get_by_id(struct deltacloud_api *api,
+			       const struct collection_type *type,
+			       const char *id, const char *url, void *output)
+{
+  return cached_get(api, type, id, url, output);
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#ifndef COLLECTION_CACHE_H
+#define COLLECTION_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <time.h>
+#include <pthread.h>
+#include <libxml/parser.h>
+#include <libxml/xpath.h>
+#include "libdeltacloud.h"
+
+/* everything internal_get() and internal_get_type_by_id() need to know
+ * about a collection and its elements
+ */
+struct collection_type {
+  const char *relname;
+  const char *rootname;
+  int (*list_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt, void **data);
+  /* deep copies the list whose head is the second argument into the list
+   * head pointed to by the first
+   */
+  int (*copy_all)(void *dst, const void *src);
+  void (*free_all)(void *list); /* takes a pointer to the list head */
+
+  /* the same for a single element; these may be NULL for types that cannot
+   * be looked up by id
+   */
+  const char *oneroot;
+  int (*one_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt, void *data);
+  int (*copy_one)(void *dst, const void *src); /* dst must be zeroed */
+  void (*free_one)(void *element); /* frees the contents, not element */
+  size_t size;
+};
+
+/* the last successfully parsed copy of a collection, or of one element of
+ * it, together with the validators the server sent with it
+ */
+struct cache_entry {
+  const struct collection_type *type;
+  char *id; /* NULL for the whole collection */
+  char *etag;
+  char *last_modified;
+  time_t fetched; /* when the server last confirmed data */
+  void *data; /* the list head, or a pointer to the element */
+  int refreshing; /* whether a background refresh is queued or running */
+
+  struct cache_entry *next;
+};
+
+/* how long entries of one type may be handed out without asking the
+ * server at all, and for how long after that they may still be handed out
+ * while they are refreshed in the background
+ */
+struct cache_ttl {
+  char *relname;
+  int seconds;
+  int stale;
+
+  struct cache_ttl *next;
+};
+
+/* an entry waiting to be refreshed in the background */
+struct cache_refresh {
+  const struct collection_type *type;
+  char *id;
+  char *url;
+
+  struct cache_refresh *next;
+};
+
+#define CACHE_DEFAULT_REFRESHERS 1
+
+struct collection_cache {
+  pthread_mutex_t lock;
+  struct cache_entry *entries;
+  struct cache_ttl *ttls;
+
+  struct cache_refresh *queue;
+  int refreshers; /* number of background refresh threads running */
+  int max_refreshers;
+  int stopping; /* set once the cache is being torn down */
+  pthread_cond_t idle; /* signalled when the last refresher exits */
+};
+
+int collection_cache_init(struct collection_cache *cache);
+void collection_cache_destroy(struct collection_cache *cache);
+int collection_cache_set_ttl(struct collection_cache *cache,
+			     const char *relname, int seconds);
+int collection_cache_set_stale(struct collection_cache *cache,
+			       const char *relname, int seconds);
+void collection_cache_set_refreshers(struct collection_cache *cache,
+				     int max);
+void collection_cache_invalidate(struct collection_cache *cache,
+				 const char *relname);
+
+int collection_cache_get(struct deltacloud_api *api,
+			 const struct collection_type *type, const char *url,
+			 void **output);
+int collection_cache_get_by_id(struct deltacloud_api *api,
+			       const struct collection_type *type,
+			       const char *id, const char *url, void *output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,10 +24,13 @@
 #include <string.h>
 #include <time.h>
 #include <stdarg.h>
+#include <errno.h>
 #include <pthread.h>
 #include "libdeltacloud.h"
 #include "common.h"
 #include "curl_action.h"
+#include "decoder.h"
+#include "xml_cache.h"
 
 /****************** ERROR REPORTING FUNCTIONS ********************************/
 pthread_key_t deltacloud_last_error;
@@ -146,12 +149,12 @@ void set_curl_error(int errcode, const char *header, CURLcode res)
 }
 
 /********************** IMPLEMENTATIONS OF COMMON FUNCTIONS *****************/
-int internal_destroy(const char *href, const char *user, const char *password, const char *driver, const char *provider)
+int internal_destroy(struct deltacloud_api *api, const char *href)
 {
   char *data = NULL;
   int ret = -1;
 
-  if (delete_url(href, user, password, driver, provider, &data) < 0)
+  if (delete_url(api, href, &data) < 0)
     /* delete_url already set the error */
     return -1;
 
@@ -160,6 +163,8 @@ int internal_destroy(const char *href, const char *user, const char *password, c
     goto cleanup;
   }
 
+  internal_invalidate(api, href);
+
   ret = 0;
 
  cleanup:
@@ -220,8 +225,7 @@ int internal_post(struct deltacloud_api *api, const char *href,
   fclose(paramfp);
   paramfp = NULL;
 
-  if (post_url(href, api->user, api->password, api->driver, api->provider, param_string, &internal_data,
-	       headers) != 0)
+  if (post_url(api, href, param_string, &internal_data, headers) != 0)
     /* post_url sets its own errors, so don't overwrite it here */
     goto cleanup;
 
@@ -232,6 +236,8 @@ int internal_post(struct deltacloud_api *api, const char *href,
     goto cleanup;
   }
 
+  internal_invalidate(api, href);
+
   if (internal_data != NULL && data != NULL)
     *data = strdup(internal_data);
 
@@ -261,19 +267,125 @@ int internal_create(struct deltacloud_api *api, const char *link,
 		       headers);
 }
 
+/*
+ * An internal function to check the document returned from a GET of relname
+ * and parse it into output.  doc is NULL if the server sent no body at all.
+ * This is shared by the synchronous and asynchronous paths, so that both
+ * treat empty replies and <error> documents the same.  Ownership of doc
+ * passes to this function.
+ */
+int internal_parse_collection(const char *relname, const char *rootname,
+			      xmlDocPtr doc,
+			      int (*xml_cb)(xmlNodePtr, xmlXPathContextPtr,
+					    void **),
+			      void **output)
+{
+  if (doc == NULL) {
+    /* if we made it here, it means that the transfer was successful (ret
+     * was 0), but the data that we expected wasn't returned.  This is probably
+     * a deltacloud server bug, so just set an error and bail out
+     */
+    data_error(relname);
+    return -1;
+  }
+
+  if (is_error_doc(doc)) {
+    set_xml_error_doc(doc, DELTACLOUD_GET_URL_ERROR);
+    return -1;
+  }
+
+  *output = NULL;
+  /* see parse_xml() for the cast */
+  return internal_xml_parse_doc(doc, rootname,
+				(int (*)(xmlNodePtr, xmlXPathContextPtr,
+					 void *))xml_cb, 0, output);
+}
+
+/*
+ * The equivalent of internal_parse_collection() for a document that was
+ * downloaded with transfer_stream_list().  If the root was rootname, list
+ * holds its elements and doc has nothing but the root left; otherwise list
+ * is NULL and doc is whole.  Ownership of doc and list passes to this
+ * function.
+ */
+int internal_parse_streamed(const char *relname, const char *rootname,
+			    xmlDocPtr doc, void *list,
+			    int (*xml_cb)(xmlNodePtr, xmlXPathContextPtr,
+					  void **),
+			    void **output)
+{
+  if (list == NULL)
+    /* an empty collection, an <error> or something else entirely */
+    return internal_parse_collection(relname, rootname, doc, xml_cb, output);
+
+  xmlFreeDoc(doc);
+  *output = list;
+
+  return 0;
+}
+
+/*
+ * The single element equivalent of internal_parse_collection().
+ */
+int internal_parse_single(const char *relname, const char *rootname,
+			  xmlDocPtr doc,
+			  int (*cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt,
+				    void *data),
+			  void *output)
+{
+  if (doc == NULL) {
+    /* see internal_parse_collection() */
+    data_error(relname);
+    return -1;
+  }
+
+  if (is_error_doc(doc)) {
+    set_xml_error_doc(doc, DELTACLOUD_GET_URL_ERROR);
+    return -1;
+  }
+
+  /* internal_xml_parse_doc sets its own error */
+  return internal_xml_parse_doc(doc, rootname, cb, 1, output);
+}
+
+/*
+ * An internal function to build the URL of a single element of type relname.
+ * The id comes from the user, so it is URL escaped.  Returns a string that
+ * the caller must free, or NULL on error.
+ */
+char *internal_id_url(struct deltacloud_api *api, const char *relname,
+		      const char *id)
+{
+  char *url;
+  char *safeid;
+
+  safeid = curl_escape(id, 0);
+  if (safeid == NULL) {
+    oom_error();
+    return NULL;
+  }
+
+  if (asprintf(&url, "%s/%s/%s", api->url, relname, safeid) < 0) {
+    oom_error();
+    url = NULL;
+  }
+
+  curl_free(safeid);
+
+  return url;
+}
+
 /*
  * An internal function for fetching all of the elements of a particular
  * type.  Note that although relname and rootname is the same for almost
  * all types, there are a couple of them that don't conform to this pattern.
+ * Unchanged collections are revalidated rather than fetched again; see
+ * collection_cache_get().
  */
-int internal_get(struct deltacloud_api *api, const char *relname,
-		 const char *rootname,
-		 int (*xml_cb)(xmlNodePtr, xmlXPathContextPtr, void **),
-		 void **output)
+int internal_get(struct deltacloud_api *api,
+		 const struct collection_type *type, void **output)
 {
   struct deltacloud_link *thislink;
-  char *data = NULL;
-  int ret = -1;
 
   /* we only check api and output here, as those are the only parameters from
    * the user
@@ -281,37 +393,216 @@ int internal_get(struct deltacloud_api *api, const char *relname,
   if (!valid_api(api) || !valid_arg(output))
     return -1;
 
-  thislink = api_find_link(api, relname);
+  thislink = api_find_link(api, type->relname);
   if (thislink == NULL)
     /* api_find_link set the error */
     return -1;
 
-  if (get_url(thislink->href, api->user, api->password, api->driver, api->provider, &data) != 0)
-    /* get_url sets its own errors, so don't overwrite it here */
+  /* collection_cache_get sets its own errors */
+  return collection_cache_get(api, type, thislink->href, output);
+}
+
+struct foreach_visit {
+  const struct collection_type *type;
+  deltacloud_visit_cb visitor;
+  void *userdata;
+  void *scratch; /* the one element there ever is */
+};
+
+static int visit_element(xmlNodePtr cur, xmlXPathContextPtr ctxt, void *data)
+{
+  struct foreach_visit *visit = (struct foreach_visit *)data;
+  int stop;
+
+  if (cur->type != XML_ELEMENT_NODE ||
+      STRNEQ((const char *)cur->name, visit->type->oneroot))
+    return 0;
+
+  ctxt->node = cur;
+  if (visit->type->one_cb(cur, ctxt, visit->scratch) < 0)
+    /* the callbacks are expected to have set their own error */
     return -1;
 
-  if (data == NULL) {
-    /* if we made it here, it means that the transfer was successful (ret
-     * was 0), but the data that we expected wasn't returned.  This is probably
-     * a deltacloud server bug, so just set an error and bail out
-     */
-    data_error(relname);
-    goto cleanup;
+  stop = visit->visitor(visit->scratch, visit->userdata);
+  visit->type->free_one(visit->scratch);
+
+  return stop != 0;
+}
+
+static int skip_root(xmlNodePtr cur, xmlXPathContextPtr ctxt, void *data)
+{
+  return 0;
+}
+
+/*
+ * An internal function for handing each element of the collection of type
+ * at url to visitor, as soon as it has been downloaded, rather than making
+ * a list of them.  url is NULL for the collection behind the link of type.
+ * There is only ever one element in memory, which is reused for the next
+ * one, so nothing goes through the cache.
+ */
+int internal_foreach(struct deltacloud_api *api,
+		     const struct collection_type *type, const char *url,
+		     deltacloud_visit_cb visitor, void *userdata)
+{
+  struct deltacloud_link *thislink;
+  struct foreach_visit visit;
+  xmlDocPtr doc = NULL;
+  int rc;
+
+  /* we only check api and visitor here, as those are the only parameters
+   * from the user
+   */
+  if (!valid_api(api) || !valid_arg(visitor))
+    return -1;
+
+  if (url == NULL) {
+    thislink = api_find_link(api, type->relname);
+    if (thislink == NULL)
+      /* api_find_link set the error */
+      return -1;
+    url = thislink->href;
   }
 
-  if (is_error_xml(data)) {
-    set_xml_error(data, DELTACLOUD_GET_URL_ERROR);
-    goto cleanup;
+  visit.type = type;
+  visit.visitor = visitor;
+  visit.userdata = userdata;
+  visit.scratch = calloc(1, type->size);
+  if (visit.scratch == NULL) {
+    oom_error();
+    return -1;
   }
 
-  *output = NULL;
-  if (parse_xml(data, rootname, xml_cb, output) < 0)
-    goto cleanup;
+  rc = get_url_elements(api, url, type->rootname, visit_element, &visit,
+			&doc);
+  if (rc == 1)
+    /* the visitor had seen enough */
+    rc = 0;
+  else if (rc == 0)
+    /* all that is left is the root, unless the server sent an <error> or
+     * nothing at all instead; internal_parse_single tells them apart, sets
+     * its own error and frees doc
+     */
+    rc = internal_parse_single(type->relname, type->rootname, doc,
+			       skip_root, NULL);
+  /* otherwise get_url_elements set the error */
 
-  ret = 0;
+  SAFE_FREE(visit.scratch);
 
- cleanup:
-  SAFE_FREE(data);
+  return rc;
+}
+
+struct name_find {
+  const struct collection_type *type;
+  const char *name;
+  void *output;
+};
+
+static int find_element(xmlNodePtr cur, xmlXPathContextPtr ctxt, void *data)
+{
+  struct name_find *find = (struct name_find *)data;
+  char *name;
+  int match;
+
+  if (cur->type != XML_ELEMENT_NODE ||
+      STRNEQ((const char *)cur->name, find->type->oneroot))
+    return 0;
+
+  name = decode_child_text(cur, "name");
+  match = name != NULL && STREQ(name, find->name);
+  SAFE_FREE(name);
+  if (!match)
+    return 0;
+
+  ctxt->node = cur;
+  if (find->type->one_cb(cur, ctxt, find->output) < 0)
+    /* the callbacks are expected to have set their own error */
+    return -1;
+
+  /* that is all we came for, so stop the transfer here */
+  return 1;
+}
+
+/*
+ * An internal function for fetching the first element of the collection of
+ * type whose <name> is name.  The collection is parsed as it downloads, and
+ * the rest of it is not downloaded at all once the element has been found.
+ */
+int internal_get_by_name(struct deltacloud_api *api,
+			 const struct collection_type *type, const char *name,
+			 void *output)
+{
+  struct deltacloud_link *thislink;
+  struct name_find find;
+  xmlDocPtr doc = NULL;
+  char *msg;
+  int rc;
+
+  /* we only check api, name, and output here, as those are the only
+   * parameters from the user
+   */
+  if (!valid_api(api) || !valid_arg(name) || !valid_arg(output))
+    return -1;
+
+  thislink = api_find_link(api, type->relname);
+  if (thislink == NULL)
+    /* api_find_link set the error */
+    return -1;
+
+  find.type = type;
+  find.name = name;
+  find.output = output;
+
+  rc = get_url_elements(api, thislink->href, type->rootname, find_element,
+			&find, &doc);
+  if (rc == 1)
+    return 0;
+  if (rc < 0)
+    /* get_url_elements set the error */
+    return -1;
+
+  /* see internal_foreach() */
+  if (internal_parse_single(type->relname, type->rootname, doc, skip_root,
+			    NULL) < 0)
+    return -1;
+
+  if (asprintf(&msg, "Failed to find %s in %s list", type->oneroot,
+	       type->relname) < 0) {
+    oom_error();
+    return -1;
+  }
+  set_error(DELTACLOUD_NAME_NOT_FOUND_ERROR, msg);
+  SAFE_FREE(msg);
+
+  return -1;
+}
+
+/*
+ * An internal function for fetching a single element of a type that
+ * internal_get() knows about, going through the same cache.
+ */
+int internal_get_type_by_id(struct deltacloud_api *api,
+			    const struct collection_type *type, const char *id,
+			    void *output)
+{
+  char *url;
+  int ret;
+
+  /* we only check api, id, and output here, as those are the only parameters
+   * from the user
+   */
+  if (!valid_api(api) || !valid_arg(id) || !valid_arg(output))
+    return -1;
+
+  url = internal_id_url(api, type->relname, id);
+  if (url == NULL)
+    /* internal_id_url set the error */
+    return -1;
+
+  /* collection_cache_get_by_id sets its own errors */
+  ret = collection_cache_get_by_id(api, type, id, url, output);
+
+  SAFE_FREE(url);
 
   return ret;
 }
@@ -322,9 +613,8 @@ int internal_get_by_id(struct deltacloud_api *api, const char *id,
 				 void *data),
 		       void *output)
 {
-  char *url = NULL;
-  char *data = NULL;
-  char *safeid;
+  char *url;
+  xmlDocPtr doc = NULL;
   int ret = -1;
 
   /* we only check api, id, and output here, as those are the only parameters
@@ -333,45 +623,19 @@ int internal_get_by_id(struct deltacloud_api *api, const char *id,
   if (!valid_api(api) || !valid_arg(id) || !valid_arg(output))
     return -1;
 
-  safeid = curl_escape(id, 0);
-  if (safeid == NULL) {
-    oom_error();
+  url = internal_id_url(api, relname, id);
+  if (url == NULL)
+    /* internal_id_url set the error */
     return -1;
-  }
-
-  if (asprintf(&url, "%s/%s/%s", api->url, relname, safeid) < 0) {
-    oom_error();
-    goto cleanup;
-  }
 
-  if (get_url(url, api->user, api->password, api->driver, api->provider, &data) != 0)
-    /* get_url sets its own errors, so don't overwrite it here */
+  if (get_url_xml(api, url, rootname, &doc) != 0)
+    /* get_url_xml sets its own errors, so don't overwrite it here */
     goto cleanup;
 
-  if (data == NULL) {
-    /* if we made it here, it means that the transfer was successful (ret
-     * was 0), but the data that we expected wasn't returned.  This is probably
-     * a deltacloud server bug, so just set an error and bail out
-     */
-    data_error(relname);
-    goto cleanup;
-  }
-
-  if (is_error_xml(data)) {
-    set_xml_error(data, DELTACLOUD_GET_URL_ERROR);
-    goto cleanup;
-  }
-
-  if (parse_xml_single(data, rootname, cb, output) < 0)
-    /* parse_xml_single set the error */
-    goto cleanup;
-
-  ret = 0;
+  ret = internal_parse_single(relname, rootname, doc, cb, output);
 
  cleanup:
-  SAFE_FREE(data);
   SAFE_FREE(url);
-  curl_free(safeid);
 
   return ret;
 }
@@ -382,32 +646,22 @@ int internal_get_by_id_pp(struct deltacloud_api *api, const char *id,
 				 void **),
 		       void **output)
 {
-  char *url = NULL;
+  char *url;
   char *data = NULL;
-  char *safeid;
   int ret = -1;
 
   /* we only check api, id, and output here, as those are the only parameters
    * from the user
    */
   if (!valid_api(api) || !valid_arg(id) || !valid_arg(output))
-  {
-    
     return -1;
-  }
 
-  safeid = curl_escape(id, 0);
-  if (safeid == NULL) {
-    oom_error();
+  url = internal_id_url(api, relname, id);
+  if (url == NULL)
+    /* internal_id_url set the error */
     return -1;
-  }
 
-  if (asprintf(&url, "%s/%s/%s", api->url, relname, safeid) < 0) {
-    oom_error();
-    goto cleanup;
-  }
-
-  if (get_url(url, api->user, api->password, api->driver, api->provider, &data) != 0)
+  if (get_url(api, url, &data) != 0)
     /* get_url sets its own errors, so don't overwrite it here */
     goto cleanup;
 
@@ -434,7 +688,6 @@ int internal_get_by_id_pp(struct deltacloud_api *api, const char *id,
  cleanup:
   SAFE_FREE(data);
   SAFE_FREE(url);
-  curl_free(safeid);
 
   return ret;
 }
@@ -463,6 +716,31 @@ int is_error_xml(const char *xml)
   return STRPREFIX(xml, "<error");
 }
 
+int is_error_doc(xmlDocPtr xml)
+{
+  xmlNodePtr root;
+
+  root = xmlDocGetRootElement(xml);
+
+  return root != NULL && STREQ((const char *)root->name, "error");
+}
+
+/* the equivalent of set_xml_error() for a document that has already been
+ * parsed.  Ownership of xml passes to this function.
+ */
+void set_xml_error_doc(xmlDocPtr xml, int type)
+{
+  char *errmsg = NULL;
+
+  if (internal_xml_parse_doc(xml, "error", (xml_cb)parse_error_xml, 0,
+			     (void **)&errmsg) < 0)
+    errmsg = strdup("Unknown error");
+
+  set_error(type, errmsg);
+
+  SAFE_FREE(errmsg);
+}
+
 static void set_error_from_xml(const char *name, const char *usermsg)
 {
   xmlErrorPtr last;
@@ -479,19 +757,48 @@ static void set_error_from_xml(const char *name, const char *usermsg)
 int internal_xml_parse(const char *xml_string, const char *name, xml_cb cb,
 		       int single, void *output)
 {
+  return internal_xml_parse_buffer(xml_string, strlen(xml_string), name, cb,
+				   single, output);
+}
+
+/* parse the size bytes at buf, which need not be NUL terminated.  Passing the
+ * length along saves libxml2 from scanning the whole document for its end
+ * before it starts.
+ */
+int internal_xml_parse_buffer(const char *buf, size_t size, const char *name,
+			      xml_cb cb, int single, void *output)
+{
+  xmlParserCtxtPtr parser;
   xmlDocPtr xml;
-  xmlNodePtr root;
-  xmlXPathContextPtr ctxt = NULL;
-  int ret = -1;
-  int rc;
 
-  xml = xmlReadDoc(BAD_CAST xml_string, name, NULL,
-		   XML_PARSE_NOENT | XML_PARSE_NONET | XML_PARSE_NOERROR |
-		   XML_PARSE_NOWARNING);
+  parser = xml_cache_parser();
+  if (parser == NULL) {
+    oom_error();
+    return -1;
+  }
+
+  xml = xmlCtxtReadMemory(parser, buf, size, name, NULL, XML_READ_OPTIONS);
   if (!xml) {
     set_error_from_xml(name, "Failed to parse XML");
+    xml_cache_release_parser(parser);
     return -1;
   }
+  xml_cache_release_parser(parser);
+
+  return internal_xml_parse_doc(xml, name, cb, single, output);
+}
+
+/* the rest of internal_xml_parse_buffer(), for a document that has already
+ * been read, for instance by a push parser while it was downloaded.
+ * Ownership of xml passes to this function.
+ */
+int internal_xml_parse_doc(xmlDocPtr xml, const char *name, xml_cb cb,
+			   int single, void *output)
+{
+  xmlNodePtr root;
+  xmlXPathContextPtr ctxt = NULL;
+  int ret = -1;
+  int rc;
 
   root = xmlDocGetRootElement(xml);
   if (root == NULL) {
@@ -504,7 +811,7 @@ int internal_xml_parse(const char *xml_string, const char *name, xml_cb cb,
     goto cleanup;
   }
 
-  ctxt = xmlXPathNewContext(xml);
+  ctxt = xml_cache_xpath(xml);
   if (ctxt == NULL) {
     set_error_from_xml(name, "Failed to initialize XPath context");
     goto cleanup;
@@ -529,8 +836,7 @@ int internal_xml_parse(const char *xml_string, const char *name, xml_cb cb,
   ret = 0;
 
  cleanup:
-  if (ctxt != NULL)
-    xmlXPathFreeContext(ctxt);
+  xml_cache_release_xpath(ctxt);
   xmlFreeDoc(xml);
 
   return ret;
@@ -539,19 +845,28 @@ int internal_xml_parse(const char *xml_string, const char *name, xml_cb cb,
 int internal_xml_parse_pp(const char *xml_string, const char *name, int (*cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt, void **data),
 		       int single, void **output)
 {
+  xmlParserCtxtPtr parser;
   xmlDocPtr xml;
   xmlNodePtr root;
   xmlXPathContextPtr ctxt = NULL;
   int ret = -1;
   int rc;
 
-  xml = xmlReadDoc(BAD_CAST xml_string, name, NULL,
-		   XML_PARSE_NOENT | XML_PARSE_NONET | XML_PARSE_NOERROR |
-		   XML_PARSE_NOWARNING);
+  parser = xml_cache_parser();
+  if (parser == NULL) {
+    oom_error();
+    return -1;
+  }
+
+  xml = xmlCtxtReadDoc(parser, BAD_CAST xml_string, name, NULL,
+		       XML_PARSE_NOENT | XML_PARSE_NONET | XML_PARSE_NOERROR |
+		       XML_PARSE_NOWARNING);
   if (!xml) {
     set_error_from_xml(name, "Failed to parse XML");
+    xml_cache_release_parser(parser);
     return -1;
   }
+  xml_cache_release_parser(parser);
 
   root = xmlDocGetRootElement(xml);
   if (root == NULL) {
@@ -564,7 +879,7 @@ int internal_xml_parse_pp(const char *xml_string, const char *name, int (*cb)(xm
     goto cleanup;
   }
 
-  ctxt = xmlXPathNewContext(xml);
+  ctxt = xml_cache_xpath(xml);
   if (ctxt == NULL) {
     set_error_from_xml(name, "Failed to initialize XPath context");
     goto cleanup;
@@ -591,8 +906,7 @@ int internal_xml_parse_pp(const char *xml_string, const char *name, int (*cb)(xm
   ret = 0;
 
  cleanup:
-  if (ctxt != NULL)
-    xmlXPathFreeContext(ctxt);
+  xml_cache_release_xpath(ctxt);
   xmlFreeDoc(xml);
 
   return ret;
@@ -661,6 +975,28 @@ struct deltacloud_link *api_find_link(struct deltacloud_api *api,
   return thislink;
 }
 
+/* drop what the cache holds of the collection that a successful POST or
+ * DELETE of href changed.  Resources and their actions live below the URL
+ * of their collection in the entry point; if href is not below any of
+ * them, everything is dropped to be safe.
+ */
+void internal_invalidate(struct deltacloud_api *api, const char *href)
+{
+  struct deltacloud_link *thislink;
+  size_t len;
+
+  deltacloud_for_each(thislink, api->links) {
+    len = strlen(thislink->href);
+    if (strncmp(href, thislink->href, len) == 0 &&
+	(href[len] == '\0' || href[len] == '/' || href[len] == '?')) {
+      collection_cache_invalidate(&api->priv->cache, thislink->rel);
+      return;
+    }
+  }
+
+  collection_cache_invalidate(&api->priv->cache, NULL);
+}
+
 void free_parameters(struct deltacloud_create_parameter *params,
 		     int params_length)
 {
@@ -689,6 +1025,23 @@ int copy_parameters(struct deltacloud_create_parameter *dst,
   return i;
 }
 
+/* a strdup() that passes NULL through and sets the error on failure */
+int copy_string(char **dst, const char *src)
+{
+  if (src == NULL) {
+    *dst = NULL;
+    return 0;
+  }
+
+  *dst = strdup(src);
+  if (*dst == NULL) {
+    oom_error();
+    return -1;
+  }
+
+  return 0;
+}
+
 void free_and_null(void *ptrptr)
 {
   free (*(void**)ptrptr);
@@ -754,6 +1107,30 @@ void strip_leading_whitespace(char *msg)
   memmove(msg, p, strlen(p) + 1);
 }
 
+/* milliseconds on a clock that only ever goes forward, for timing things */
+double now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* sleep for ms milliseconds, carrying on after any signal */
+void sleep_ms(double ms)
+{
+  struct timespec ts;
+
+  if (ms <= 0)
+    return;
+
+  ts.tv_sec = (time_t)(ms / 1000);
+  ts.tv_nsec = (long)((ms - ts.tv_sec * 1000.0) * 1000000);
+  while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+    ;
+}
+
 /****************************** DEBUG FUNCTIONS *****************************/
 #ifdef DEBUG
 
@@ -772,16 +1149,29 @@ static void seed_random(void)
   done = 1;
 }
 
-#undef xmlReadDoc
-xmlDocPtr xmlReadDoc_sometimes_fail(const xmlChar *cur,
-				    const char *URL,
-				    const char *encoding,
-				    int options)
+#undef xmlCtxtReadDoc
+xmlDocPtr xmlCtxtReadDoc_sometimes_fail(xmlParserCtxtPtr ctxt,
+					const xmlChar *cur, const char *URL,
+					const char *encoding, int options)
+{
+  seed_random();
+
+  if (rand() % FAILRATE)
+    return xmlCtxtReadDoc(ctxt, cur, URL, encoding, options);
+  else
+    return NULL;
+}
+
+#undef xmlCtxtReadMemory
+xmlDocPtr xmlCtxtReadMemory_sometimes_fail(xmlParserCtxtPtr ctxt,
+					   const char *buffer, int size,
+					   const char *URL,
+					   const char *encoding, int options)
 {
   seed_random();
 
   if (rand() % FAILRATE)
-    return xmlReadDoc(cur, URL, encoding, options);
+    return xmlCtxtReadMemory(ctxt, buffer, size, URL, encoding, options);
   else
     return NULL;
 }
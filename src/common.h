@@ -29,6 +29,38 @@ extern "C" {
 #include <libxml/parser.h>
 #include <libxml/xpath.h>
 #include <curl/curl.h>
+#include "pool.h"
+#include "async_engine.h"
+#include "batch.h"
+#include "collection_cache.h"
+#include "retry.h"
+#include "ratelimit.h"
+#include "hedge.h"
+#include "fault.h"
+
+/********************** PER-CONNECTION PRIVATE STATE ************************/
+/* hangs off of deltacloud_api->priv; allocated in deltacloud_initialize()
+ * and released in deltacloud_free()
+ */
+struct deltacloud_private {
+  struct connection_pool pool;
+  struct async_engine async;
+  struct batch_planner batch;
+  struct transfer_stats stats;
+  struct collection_cache cache;
+  struct retry_policy retry;
+  struct rate_limiter *limiter; /* shared with the other apis of the provider */
+  long rate_wait_ms; /* how long a request may wait for the limiter */
+  struct hedge_policy hedge;
+  struct fault_injector faults;
+  /* NULL for libcurl; otherwise, where all requests go instead */
+  const struct deltacloud_transport *transport;
+  void *transport_ctx;
+  /* NULL unless deltacloud_trace_record() is on; see trace.c for locking */
+  struct trace_recorder *recorder;
+  int compression; /* whether to ask for compressed responses */
+  int http2; /* one of the DELTACLOUD_HTTP2_* modes */
+};
 
 /****************** ERROR REPORTING FUNCTIONS ********************************/
 extern pthread_key_t deltacloud_last_error;
@@ -41,22 +73,46 @@ void set_error(int errnum, const char *details);
 void set_curl_error(int errcode, const char *header, CURLcode res);
 
 /********************** IMPLEMENTATIONS OF COMMON FUNCTIONS *****************/
-int internal_destroy(const char *href, const char *user, const char *password, const char *driver, const char *provider);
+int internal_destroy(struct deltacloud_api *api, const char *href);
 int internal_post(struct deltacloud_api *api, const char *href,
 		  struct deltacloud_create_parameter *params,
 		  int params_length, char **data, char **headers);
 int internal_create(struct deltacloud_api *api, const char *link,
 		    struct deltacloud_create_parameter *params,
 		    int params_length, char **data, char **headers);
-int internal_get(struct deltacloud_api *api, const char *relname,
-		 const char *rootname,
-		 int (*xml_cb)(xmlNodePtr, xmlXPathContextPtr, void **),
-		 void **output);
+int internal_get(struct deltacloud_api *api,
+		 const struct collection_type *type, void **output);
+int internal_foreach(struct deltacloud_api *api,
+		     const struct collection_type *type, const char *url,
+		     deltacloud_visit_cb visitor, void *userdata);
+int internal_get_by_name(struct deltacloud_api *api,
+			 const struct collection_type *type, const char *name,
+			 void *output);
+int internal_get_type_by_id(struct deltacloud_api *api,
+			    const struct collection_type *type, const char *id,
+			    void *output);
 int internal_get_by_id(struct deltacloud_api *api, const char *id,
 		       const char *relname, const char *rootname,
 		       int (*cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 				 void *data),
 		       void *output);
+int internal_parse_collection(const char *relname, const char *rootname,
+			      xmlDocPtr doc,
+			      int (*xml_cb)(xmlNodePtr, xmlXPathContextPtr,
+					    void **),
+			      void **output);
+int internal_parse_streamed(const char *relname, const char *rootname,
+			    xmlDocPtr doc, void *list,
+			    int (*xml_cb)(xmlNodePtr, xmlXPathContextPtr,
+					  void **),
+			    void **output);
+int internal_parse_single(const char *relname, const char *rootname,
+			  xmlDocPtr doc,
+			  int (*cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt,
+				    void *data),
+			  void *output);
+char *internal_id_url(struct deltacloud_api *api, const char *relname,
+		      const char *id);
 int internal_get_by_id_pp(struct deltacloud_api *api, const char *id,
 		       const char *relname, const char *rootname,
 		       int (*cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt,
@@ -64,10 +120,18 @@ int internal_get_by_id_pp(struct deltacloud_api *api, const char *id,
 		       void **output);
 
 /************************** XML PARSING FUNCTIONS ****************************/
+#define XML_READ_OPTIONS (XML_PARSE_NOENT | XML_PARSE_NONET | \
+			  XML_PARSE_NOERROR | XML_PARSE_NOWARNING)
 int is_error_xml(const char *xml);
+int is_error_doc(xmlDocPtr xml);
+void set_xml_error_doc(xmlDocPtr xml, int type);
 typedef int (*xml_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt, void *data);
 int internal_xml_parse(const char *xml_string, const char *name, xml_cb cb,
 		       int single, void *output);
+int internal_xml_parse_buffer(const char *buf, size_t size, const char *name,
+			      xml_cb cb, int single, void *output);
+int internal_xml_parse_doc(xmlDocPtr xml, const char *name, xml_cb cb,
+			   int single, void *output);
 int internal_xml_parse_pp(const char *xml_string, const char *name, 
 		     int (*cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 			       void **data),
@@ -83,6 +147,7 @@ int parse_xml_single_pp(const char *xml_string, const char *name,
 char *getXPathString(const char *xpath, xmlXPathContextPtr ctxt);
 
 /************************ MISCELLANEOUS FUNCTIONS ***************************/
+void internal_invalidate(struct deltacloud_api *api, const char *href);
 struct deltacloud_link *api_find_link(struct deltacloud_api *api,
 				      const char *name);
 void free_parameters(struct deltacloud_create_parameter *params,
@@ -96,6 +161,9 @@ void deltacloud_error_free_data(void *data);
 int valid_api(struct deltacloud_api *api);
 void strip_trailing_whitespace(char *msg);
 void strip_leading_whitespace(char *msg);
+int copy_string(char **dst, const char *src);
+double now_ms(void);
+void sleep_ms(double ms);
 #define valid_arg(x) ((x == NULL) ? invalid_argument_error(#x " cannot be NULL"), 0 : 1)
 #define STREQ(a,b) (strcmp(a,b) == 0)
 #define STRNEQ(a,b) (strcmp(a,b) != 0)
@@ -131,6 +199,32 @@ void strip_leading_whitespace(char *msg);
     *list = NULL;				\
   } while(0)
 
+/* deep copy the list src into *dst, using cb to fill in each freshly zeroed
+ * element from its original.  Elements are linked in before cb runs, so on
+ * failure list_cb can free everything copied so far; the enclosing function
+ * then returns -1.
+ */
+#define copy_list(dst, src, type, cb, list_cb) do {	\
+    const type *curr;					\
+    type *copy, **tail;				\
+    *dst = NULL;					\
+    tail = dst;					\
+    for (curr = src; curr != NULL; curr = curr->next) {	\
+      copy = calloc(1, sizeof(type));			\
+      if (copy == NULL) {				\
+	oom_error();					\
+	list_cb(dst);					\
+	return -1;					\
+      }						\
+      *tail = copy;					\
+      tail = &copy->next;				\
+      if (cb(copy, curr) < 0) {			\
+	list_cb(dst);					\
+	return -1;					\
+      }						\
+    }						\
+  } while(0)
+
 
 #ifdef __cplusplus
 }
@@ -140,11 +234,16 @@ void strip_leading_whitespace(char *msg);
 #ifdef DEBUG
 #include <libxml/parser.h>
 #include <libxml/xpath.h>
-xmlDocPtr xmlReadDoc_sometimes_fail(const xmlChar *cur,
-				    const char *URL,
-				    const char *encoding,
-				    int options);
-#define xmlReadDoc xmlReadDoc_sometimes_fail
+xmlDocPtr xmlCtxtReadDoc_sometimes_fail(xmlParserCtxtPtr ctxt,
+					const xmlChar *cur, const char *URL,
+					const char *encoding, int options);
+#define xmlCtxtReadDoc xmlCtxtReadDoc_sometimes_fail
+
+xmlDocPtr xmlCtxtReadMemory_sometimes_fail(xmlParserCtxtPtr ctxt,
+					   const char *buffer, int size,
+					   const char *URL,
+					   const char *encoding, int options);
+#define xmlCtxtReadMemory xmlCtxtReadMemory_sometimes_fail
 
 xmlNodePtr xmlDocGetRootElement_sometimes_fail(xmlDocPtr doc);
 #define xmlDocGetRootElement xmlDocGetRootElement_sometimes_fail
@@ -19,31 +19,49 @@
  */
 
 #define _GNU_SOURCE
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "libdeltacloud.h"
 #include "curl_action.h"
 #include "common.h"
+#include "trace_capture.h"
+#include "fault.h"
+#include "xml_cache.h"
 
-struct memory {
-  char *data;
-  size_t size;
-};
-
-static size_t memory_callback(void *ptr, size_t size, size_t nmemb, void *data)
+/* make room for at least needed more bytes plus the terminator.  The buffer
+ * at least doubles each time it grows, so that receiving a body costs a
+ * logarithmic number of reallocs rather than one per chunk
+ */
+static int memory_reserve(struct memory *mem, size_t needed)
 {
-  size_t realsize = size * nmemb;
-  struct memory *mem = (struct memory *)data;
+  size_t capacity;
   char *tmp;
 
-  if (realsize == 0)
+  if (mem->size + needed + 1 <= mem->capacity)
     return 0;
 
-  tmp = realloc(mem->data, mem->size + realsize + 1);
+  capacity = mem->capacity * 2;
+  if (capacity < MEMORY_INITIAL_CAPACITY)
+    capacity = MEMORY_INITIAL_CAPACITY;
+  if (capacity < mem->size + needed + 1)
+    capacity = mem->size + needed + 1;
+
+  tmp = realloc(mem->data, capacity);
   if (tmp == NULL)
-    return 0;
+    return -1;
 
   mem->data = tmp;
+  mem->capacity = capacity;
+
+  return 0;
+}
+
+static size_t memory_append(struct memory *mem, const void *ptr,
+			    size_t realsize)
+{
+  if (memory_reserve(mem, realsize) < 0)
+    return 0;
 
   memcpy(mem->data + mem->size, ptr, realsize);
   mem->size += realsize;
@@ -52,6 +70,142 @@ static size_t memory_callback(void *ptr, size_t size, size_t nmemb, void *data)
   return realsize;
 }
 
+/* feed a chunk of the body to the push parser, so that the document is
+ * built while the rest of it is still on the wire.  Returning short makes
+ * curl abort the transfer, which we do as soon as the XML is known to be
+ * bad.
+ */
+static size_t push_chunk(struct transfer *xfer, const char *ptr,
+			 size_t realsize)
+{
+  if (xfer->parser == NULL) {
+    if (xfer->stream != NULL)
+      xfer->parser = xml_stream_parser(xfer->stream, xfer->xml_name);
+    else
+      xfer->parser = xml_cache_push_parser(NULL, xfer->xml_name);
+    if (xfer->parser == NULL) {
+      xfer->xml_failed = 1;
+      return 0;
+    }
+    xmlCtxtUseOptions(xfer->parser, XML_READ_OPTIONS);
+  }
+
+  if (xmlParseChunk(xfer->parser, ptr, realsize, 0) != 0) {
+    /* a stream that was stopped on purpose is not a parse failure, but
+     * the rest of the body is not wanted either
+     */
+    if (xfer->stream == NULL || !xfer->stream->stopped)
+      xfer->xml_failed = 1;
+    return 0;
+  }
+
+  return realsize;
+}
+
+/* the body of a response; before the first byte is stored, the buffer is
+ * sized from the Content-Length the server sent, if any
+ */
+static size_t store_body(struct transfer *xfer, const char *ptr,
+			 size_t realsize)
+{
+#if LIBCURL_VERSION_NUM >= 0x073700
+  curl_off_t length = -1;
+#else
+  double length = -1;
+#endif
+
+  xfer->decoded += realsize;
+  trace_capture_body(xfer, ptr, realsize);
+
+  if (xfer->xml_name != NULL)
+    return push_chunk(xfer, ptr, realsize);
+
+  if (xfer->chunk.data == NULL) {
+#if LIBCURL_VERSION_NUM >= 0x073700
+    curl_easy_getinfo(xfer->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+#else
+    curl_easy_getinfo(xfer->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &length);
+#endif
+    if (length > 0 && length <= MEMORY_MAX_PRESIZE &&
+	memory_reserve(&xfer->chunk, (size_t)length) < 0)
+      return 0;
+  }
+
+  return memory_append(&xfer->chunk, ptr, realsize);
+}
+
+static size_t store_header(struct transfer *xfer, const char *ptr,
+			   size_t realsize)
+{
+  trace_capture_headers(xfer, ptr, realsize);
+
+  return memory_append(&xfer->header_chunk, ptr, realsize);
+}
+
+/* stand in for the response of the server with the error status that the
+ * fault injected into xfer calls for (see fault.c)
+ */
+static int answer_fault(struct transfer *xfer)
+{
+  char headers[128];
+  char body[128];
+
+  snprintf(headers, sizeof(headers),
+	   "HTTP/1.1 %ld Injected fault\r\nContent-Type: application/xml\r\n\r\n",
+	   xfer->fault.status);
+  if (store_header(xfer, headers, strlen(headers)) == 0)
+    return -1;
+
+  if (xfer->method == TRANSFER_HEAD)
+    return 0;
+
+  snprintf(body, sizeof(body),
+	   "<error status=\"%ld\"><message>Injected fault</message></error>",
+	   xfer->fault.status);
+  if (store_body(xfer, body, strlen(body)) == 0)
+    return -1;
+
+  return 0;
+}
+
+static size_t body_callback(void *ptr, size_t size, size_t nmemb, void *data)
+{
+  size_t realsize = size * nmemb;
+  struct transfer *xfer = (struct transfer *)data;
+
+  if (realsize == 0)
+    return 0;
+
+  switch (fault_body(xfer, realsize)) {
+  case FAULT_PAUSE:
+    return CURL_WRITEFUNC_PAUSE;
+  case FAULT_DROP:
+    return realsize;
+  }
+
+  return store_body(xfer, ptr, realsize);
+}
+
+static size_t header_callback(void *ptr, size_t size, size_t nmemb, void *data)
+{
+  size_t realsize = size * nmemb;
+  struct transfer *xfer = (struct transfer *)data;
+
+  if (realsize == 0)
+    return 0;
+
+  switch (fault_headers(xfer)) {
+  case FAULT_PAUSE:
+    return CURL_WRITEFUNC_PAUSE;
+  case FAULT_DROP:
+    return realsize;
+  case FAULT_ANSWER:
+    return answer_fault(xfer) < 0 ? 0 : realsize;
+  }
+
+  return store_header(xfer, ptr, realsize);
+}
+
 static int set_user_password(CURL *curl, const char *user, const char *password)
 {
   CURLcode res;
@@ -103,21 +257,151 @@ static int set_user_password(CURL *curl, const char *user, const char *password)
   return 0;
 }
 
-/* errcode, url, user, and password are input parameters used to do the
- * setup
- *
- * curl, headers, chunk, and header_chunk are all output parameters that
- * are setup after this function call
+int transfer_stats_init(struct transfer_stats *stats)
+{
+  memset(stats, 0, sizeof(struct transfer_stats));
+
+  if (pthread_mutex_init(&stats->lock, NULL) != 0) {
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to initialize stats lock");
+    return -1;
+  }
+
+  return 0;
+}
+
+void transfer_stats_destroy(struct transfer_stats *stats)
+{
+  pthread_mutex_destroy(&stats->lock);
+}
+
+void transfer_stats_get(struct transfer_stats *stats,
+			struct deltacloud_transfer_stats *out)
+{
+  pthread_mutex_lock(&stats->lock);
+  out->wire_bytes = stats->wire_bytes;
+  out->decoded_bytes = stats->decoded_bytes;
+  out->retries = stats->retries;
+  out->retries_denied = stats->retries_denied;
+  out->hedges = stats->hedges;
+  out->hedges_won = stats->hedges_won;
+  pthread_mutex_unlock(&stats->lock);
+}
+
+void transfer_stats_reset(struct transfer_stats *stats)
+{
+  pthread_mutex_lock(&stats->lock);
+  stats->wire_bytes = 0;
+  stats->decoded_bytes = 0;
+  stats->retries = 0;
+  stats->retries_denied = 0;
+  stats->hedges = 0;
+  stats->hedges_won = 0;
+  pthread_mutex_unlock(&stats->lock);
+}
+
+void transfer_stats_count_retry(struct transfer_stats *stats, int granted)
+{
+  pthread_mutex_lock(&stats->lock);
+  if (granted)
+    stats->retries++;
+  else
+    stats->retries_denied++;
+  pthread_mutex_unlock(&stats->lock);
+}
+
+void transfer_stats_count_hedge(struct transfer_stats *stats, int won)
+{
+  pthread_mutex_lock(&stats->lock);
+  stats->hedges++;
+  if (won)
+    stats->hedges_won++;
+  pthread_mutex_unlock(&stats->lock);
+}
+
+/* add what the transfer on xfer->curl received to the counters of its api.
+ * curl counts the body as it came off the wire, while xfer->decoded counts
+ * what came out of the decompressor.
+ */
+static void account_transfer(struct transfer *xfer)
+{
+  struct transfer_stats *stats = &xfer->api->priv->stats;
+#if LIBCURL_VERSION_NUM >= 0x073700
+  curl_off_t wire = 0;
+
+  curl_easy_getinfo(xfer->curl, CURLINFO_SIZE_DOWNLOAD_T, &wire);
+#else
+  double wire = 0;
+
+  curl_easy_getinfo(xfer->curl, CURLINFO_SIZE_DOWNLOAD, &wire);
+#endif
+  /* a transport of our own hands over the body as it is */
+  if (xfer->api->priv->transport != NULL)
+    wire = xfer->decoded;
+
+  pthread_mutex_lock(&stats->lock);
+  stats->wire_bytes += (unsigned long long)wire;
+  stats->decoded_bytes += xfer->decoded;
+  pthread_mutex_unlock(&stats->lock);
+}
+
+/* map a DELTACLOUD_HTTP2_* mode onto the handle */
+static int set_http_version(CURL *curl, int mode, int errcode)
+{
+#if LIBCURL_VERSION_NUM >= 0x073100
+  long version;
+  CURLcode res;
+
+  switch (mode) {
+  case DELTACLOUD_HTTP2_NEGOTIATE:
+    version = CURL_HTTP_VERSION_2_0;
+    break;
+  case DELTACLOUD_HTTP2_TLS:
+    version = CURL_HTTP_VERSION_2TLS;
+    break;
+  case DELTACLOUD_HTTP2_PRIOR_KNOWLEDGE:
+    version = CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE;
+    break;
+  default:
+    /* leave it to libcurl, as before HTTP/2 support was added */
+    return 0;
+  }
+
+  res = curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, version);
+  if (res != CURLE_OK) {
+    set_curl_error(errcode, "Failed to set HTTP version", res);
+    return -1;
+  }
+
+  /* rather than opening a new connection while the first one is still
+   * finding out whether it can multiplex, wait and share it
+   */
+  res = curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+  if (res != CURLE_OK) {
+    set_curl_error(errcode, "Failed to set pipe wait", res);
+    return -1;
+  }
+#endif
+
+  return 0;
+}
+
+/* hand a handle back to the connection pool of the api it came from */
+static void internal_curl_release(struct deltacloud_api *api, CURL *curl)
+{
+  pool_return(&api->priv->pool, curl);
+}
+
+/* the setup common to every kind of transfer.  The curl handle comes out of
+ * the connection pool of the api, and is given back by transfer_cleanup()
  */
-static int internal_curl_setup(int errcode, const char *url, const char *user,
-			       const char *password, const char *driver, const char *provider, CURL **curl,
-			       struct curl_slist **headers,
-			       struct memory *chunk,
-			       struct memory *header_chunk)
+static int internal_curl_setup(struct transfer *xfer, const char *url,
+			       int want_body, int want_header)
 {
+  struct deltacloud_api *api = xfer->api;
+  int errcode = xfer->errcode;
+  CURLSH *share;
   CURLcode res;
 
-  *headers = NULL;
   const char *driver_header_name = "X-Deltacloud-Driver: ";
   const char *provider_header_name = "X-Deltacloud-Provider: ";
   //char driver_header[strlen(driver)+strlen(driver_header_name)+1];
@@ -126,293 +410,887 @@ static int internal_curl_setup(int errcode, const char *url, const char *user,
   char provider_header[100] = "";
 
   strcat(driver_header, driver_header_name);
-  strcat(driver_header, driver);
+  strcat(driver_header, api->driver);
   strcat(provider_header, provider_header_name);
-  strcat(provider_header, provider);
+  strcat(provider_header, api->provider);
 
-  *curl = curl_easy_init();
-  if (*curl == NULL) {
+  xfer->curl = pool_checkout(&api->priv->pool, &share);
+  if (xfer->curl == NULL) {
     set_error(errcode, "Failed to initialize curl library");
     return -1;
   }
 
-  res = curl_easy_setopt(*curl, CURLOPT_URL, url);
+  res = curl_easy_setopt(xfer->curl, CURLOPT_URL, url);
   if (res != CURLE_OK) {
     set_curl_error(errcode, "Failed to set URL header", res);
-    goto error;
+    return -1;
   }
 
-  *headers = curl_slist_append(*headers, "Accept: application/xml");
-  *headers = curl_slist_append(*headers, driver_header);
-  *headers = curl_slist_append(*headers, provider_header);
-  if (*headers == NULL) {
+  xfer->headers = curl_slist_append(xfer->headers, "Accept: application/xml");
+  xfer->headers = curl_slist_append(xfer->headers, driver_header);
+  xfer->headers = curl_slist_append(xfer->headers, provider_header);
+  if (xfer->headers == NULL) {
     set_error(errcode, "Failed to create header list");
-    goto error;
+    return -1;
   }
 
-  res = curl_easy_setopt(*curl, CURLOPT_HTTPHEADER, *headers);
-  if (res != CURLE_OK) {
-    set_curl_error(errcode, "Failed to set HTTP header", res);
-    goto error;
+  if (set_user_password(xfer->curl, api->user, api->password) < 0)
+    /* set_user_password already printed the error */
+    return -1;
+
+  if (set_http_version(xfer->curl, api->priv->http2, errcode) < 0)
+    /* set_http_version set the error */
+    return -1;
+
+  if (share != NULL) {
+    res = curl_easy_setopt(xfer->curl, CURLOPT_SHARE, share);
+    if (res != CURLE_OK) {
+      set_curl_error(errcode, "Failed to set share", res);
+      return -1;
+    }
   }
 
-  if (set_user_password(*curl, user, password) < 0)
-    /* set_user_password already printed the error */
-    goto error;
+  if (api->priv->compression) {
+    /* an empty string asks for every encoding this libcurl can decode, and
+     * makes curl decode the response transparently
+     */
+    res = curl_easy_setopt(xfer->curl, CURLOPT_ACCEPT_ENCODING, "");
+    if (res != CURLE_OK) {
+      set_curl_error(errcode, "Failed to set accepted encodings", res);
+      return -1;
+    }
+  }
 
-  if (chunk != NULL) {
-    memset(chunk, 0, sizeof(struct memory));
+  res = curl_easy_setopt(xfer->curl, CURLOPT_PRIVATE, (void *)xfer);
+  if (res != CURLE_OK) {
+    set_curl_error(errcode, "Failed to set private data", res);
+    return -1;
+  }
 
-    res = curl_easy_setopt(*curl, CURLOPT_WRITEFUNCTION, memory_callback);
+  if (want_body) {
+    res = curl_easy_setopt(xfer->curl, CURLOPT_WRITEFUNCTION, body_callback);
     if (res != CURLE_OK) {
       set_curl_error(errcode, "Failed to set data callback", res);
-      goto error;
+      return -1;
     }
 
-    res = curl_easy_setopt(*curl, CURLOPT_WRITEDATA, (void *)chunk);
+    res = curl_easy_setopt(xfer->curl, CURLOPT_WRITEDATA, (void *)xfer);
     if (res != CURLE_OK) {
       set_curl_error(errcode, "Failed to set data pointer", res);
-      goto error;
+      return -1;
     }
   }
 
-  if (header_chunk != NULL) {
-    memset(header_chunk, 0, sizeof(struct memory));
-
-    res = curl_easy_setopt(*curl, CURLOPT_HEADERFUNCTION, memory_callback);
+  if (want_header) {
+    res = curl_easy_setopt(xfer->curl, CURLOPT_HEADERFUNCTION, header_callback);
     if (res != CURLE_OK) {
       set_curl_error(errcode, "Failed to set header callback", res);
-      goto error;
+      return -1;
     }
 
-    res = curl_easy_setopt(*curl, CURLOPT_HEADERDATA, (void *)header_chunk);
+    res = curl_easy_setopt(xfer->curl, CURLOPT_HEADERDATA, (void *)xfer);
     if (res != CURLE_OK) {
       set_curl_error(errcode, "Failed to set header pointer", res);
-      goto error;
+      return -1;
     }
   }
 
   return 0;
-
- error:
-  curl_slist_free_all(*headers);
-  curl_easy_cleanup(*curl);
-  return -1;
 }
 
-int do_get_post_url(const char *url, const char *user, const char *password,
-                    const char *driver, const char *provider,
-		    int post, char *data, struct curl_slist *inheader,
-		    char **returndata, char **returnheader)
+static int setup_post(struct transfer *xfer, const char *data,
+		      struct curl_slist *inheader)
 {
-  CURL *curl;
-  CURLcode res;
-  struct curl_slist *headers = NULL;
   struct curl_slist *curr;
-  char *listdata;
-  struct memory chunk;
-  struct memory header_chunk;
-  int ret = -1;
+  CURLcode res;
   size_t datalen;
-  int errcode;
 
-  errcode = post ? DELTACLOUD_POST_URL_ERROR : DELTACLOUD_GET_URL_ERROR;
+  deltacloud_for_each(curr, inheader) {
+    /* curl_slist_append makes its own copy of the string, so the caller
+     * keeps ownership of inheader
+     */
+    xfer->headers = curl_slist_append(xfer->headers, curr->data);
+    if (xfer->headers == NULL) {
+      set_error(xfer->errcode, "Failed to create header list");
+      return -1;
+    }
+  }
 
-  if (internal_curl_setup(errcode, url, user, password, driver, provider, &curl, &headers, &chunk,
-			  &header_chunk) < 0)
-    /* internal_curl_setup set the error */
+  /* in this case, we want to do a POST; note, however, that it is possible
+   * for us to do a POST with no data
+   */
+  res = curl_easy_setopt(xfer->curl, CURLOPT_POST, 1);
+  if (res != CURLE_OK) {
+    set_curl_error(xfer->errcode, "Failed to set header POST", res);
     return -1;
+  }
 
-  if (inheader != NULL) {
-    curr = inheader;
-    while (curr != NULL) {
-      /* we have to strdup the data here because curl_slist_free_all frees
-       * the data and the structure
-       */
-      listdata = strdup(curr->data);
-      if (listdata == NULL) {
-	oom_error();
-	goto cleanup;
-      }
-      headers = curl_slist_append(headers, listdata);
-      if (headers == NULL) {
-	set_error(errcode, "Failed to create header list");
-	goto cleanup;
-      }
-      curr = curr->next;
+  /* it is imperative to set POSTFIELDSIZE so that 0-size POST transfers
+   * will work
+   */
+  datalen = data == NULL ? 0 : strlen(data);
+  res = curl_easy_setopt(xfer->curl, CURLOPT_POSTFIELDSIZE, datalen);
+  if (res != CURLE_OK) {
+    set_curl_error(xfer->errcode, "Failed to set post field size", res);
+    return -1;
+  }
+  if (data != NULL) {
+    res = curl_easy_setopt(xfer->curl, CURLOPT_POSTFIELDS, data);
+    if (res != CURLE_OK) {
+      set_curl_error(xfer->errcode, "Failed to set header post fields", res);
+      return -1;
     }
   }
 
-  if (post) {
-    /* in this case, we want to do a POST; note, however, that it is possible
-     * for us to do a POST with no data
-     */
-    res = curl_easy_setopt(curl, CURLOPT_POST, 1);
+  return 0;
+}
+
+/* the setup common to every multi handle that transfers run on.  Transfers
+ * to the same server are multiplexed over one connection whenever it turns
+ * out to speak HTTP/2; over HTTP/1.1 this changes nothing.
+ */
+void transfer_multi_setup(CURLM *multi)
+{
+#if LIBCURL_VERSION_NUM >= 0x073100
+  curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+}
+
+/* the rate limiter bucket that a request of the given method takes from */
+int transfer_rate_kind(int method)
+{
+  return method == TRANSFER_GET || method == TRANSFER_HEAD ?
+    RATE_READ : RATE_WRITE;
+}
+
+static int setup(struct transfer *xfer, struct deltacloud_api *api,
+		 int method, const char *url, const char *data,
+		 struct curl_slist *inheader, struct curl_httppost *httppost,
+		 int take_token)
+{
+  CURLcode res;
+
+  memset(xfer, 0, sizeof(struct transfer));
+  xfer->api = api;
+  xfer->method = method;
+  xfer->url = url;
+  xfer->data = data;
+  xfer->httppost = httppost;
+
+  switch (method) {
+  case TRANSFER_GET:
+  case TRANSFER_HEAD:
+    xfer->errcode = DELTACLOUD_GET_URL_ERROR;
+    break;
+  case TRANSFER_POST:
+    xfer->errcode = DELTACLOUD_POST_URL_ERROR;
+    break;
+  case TRANSFER_DELETE:
+    xfer->errcode = DELTACLOUD_DELETE_URL_ERROR;
+    break;
+  case TRANSFER_MULTIPART:
+    xfer->errcode = DELTACLOUD_MULTIPART_POST_URL_ERROR;
+    break;
+  default:
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Invalid transfer method");
+    return -1;
+  }
+
+  /* wait for the limiter before taking a handle from the pool, so that
+   * waiting does not keep one from the other threads
+   */
+  if (take_token &&
+      rate_limiter_take(api->priv->limiter, transfer_rate_kind(method),
+			api->priv->rate_wait_ms) < 0)
+    /* rate_limiter_take set the error */
+    return -1;
+
+  if (trace_capture_start(xfer) < 0)
+    /* trace_capture_start set the error */
+    return -1;
+
+  fault_transfer_setup(xfer);
+
+  /* a trace gets the response headers of every request, and an injected
+   * fault starts with them
+   */
+  if (internal_curl_setup(xfer, url, method != TRANSFER_HEAD,
+			  method == TRANSFER_GET || method == TRANSFER_POST ||
+			  method == TRANSFER_HEAD || xfer->trace != NULL ||
+			  xfer->fault.active) < 0)
+    /* internal_curl_setup set the error */
+    return -1;
+
+  switch (method) {
+  case TRANSFER_POST:
+    if (setup_post(xfer, data, inheader) < 0)
+      /* setup_post set the error */
+      return -1;
+    break;
+  case TRANSFER_DELETE:
+    res = curl_easy_setopt(xfer->curl, CURLOPT_CUSTOMREQUEST, "DELETE");
     if (res != CURLE_OK) {
-      set_curl_error(errcode, "Failed to set header POST", res);
-      goto cleanup;
+      set_curl_error(xfer->errcode, "Failed to set custom request to DELETE",
+		     res);
+      return -1;
     }
-
-    /* it is imperative to set POSTFIELDSIZE so that 0-size POST transfers
-     * will work
-     */
-    datalen = data == NULL ? 0 : strlen(data);
-    res = curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, datalen);
+    break;
+  case TRANSFER_MULTIPART:
+    res = curl_easy_setopt(xfer->curl, CURLOPT_HTTPPOST, httppost);
     if (res != CURLE_OK) {
-      set_curl_error(errcode, "Failed to set post field size", res);
-      goto cleanup;
+      set_curl_error(xfer->errcode, "Failed set HTTP POST multipart headers",
+		     res);
+      return -1;
     }
-    if (data != NULL) {
-      res = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
-      if (res != CURLE_OK) {
-	set_curl_error(errcode, "Failed to set header post fields", res);
-	goto cleanup;
-      }
+    break;
+  case TRANSFER_HEAD:
+    res = curl_easy_setopt(xfer->curl, CURLOPT_NOBODY, 1);
+    if (res != CURLE_OK) {
+      set_curl_error(xfer->errcode, "Failed to set header POST", res);
+      return -1;
     }
+    break;
   }
 
-  res = curl_easy_perform(curl);
+  /* this has to come last, since setup_post may add to the header list */
+  res = curl_easy_setopt(xfer->curl, CURLOPT_HTTPHEADER, xfer->headers);
   if (res != CURLE_OK) {
-    set_curl_error(errcode, "Failed to perform transfer", res);
-    goto cleanup;
+    set_curl_error(xfer->errcode, "Failed to set HTTP header", res);
+    return -1;
   }
 
-  ret = 0;
-  if (chunk.data != NULL && returndata != NULL)
-    *returndata = strdup(chunk.data);
+  return 0;
+}
 
-  if (header_chunk.data != NULL && returnheader != NULL)
-    *returnheader = strdup(header_chunk.data);
+/* prepare xfer for a transfer of the given method, after waiting for the
+ * rate limiter if need be; on success the handle in xfer->curl is ready to be
+ * handed to curl_easy_perform() or added to a multi handle.  Note that curl
+ * does not copy POST data, so data must stay around until the transfer is
+ * finished.  transfer_cleanup() must be called whether or not this succeeds.
+ */
+int transfer_setup(struct transfer *xfer, struct deltacloud_api *api,
+		   int method, const char *url, const char *data,
+		   struct curl_slist *inheader, struct curl_httppost *httppost)
+{
+  return setup(xfer, api, method, url, data, inheader, httppost, 1);
+}
 
- cleanup:
-  SAFE_FREE(chunk.data);
-  SAFE_FREE(header_chunk.data);
-  curl_slist_free_all(headers);
-  curl_easy_cleanup(curl);
+/* like transfer_setup(), for callers that must not sleep and so have already
+ * taken the token for this request with rate_limiter_try()
+ */
+int transfer_setup_with_token(struct transfer *xfer,
+			      struct deltacloud_api *api, int method,
+			      const char *url, const char *data,
+			      struct curl_slist *inheader,
+			      struct curl_httppost *httppost)
+{
+  return setup(xfer, api, method, url, data, inheader, httppost, 0);
+}
 
-  return ret;
+/* res is the result of the transfer.  On success, ownership of the received
+ * body and headers moves to returndata and returnheader (either may be NULL
+ * if the caller is not interested), without copying.  returnsize, if not
+ * NULL, is set to the length of the body.
+ */
+int transfer_complete(struct transfer *xfer, CURLcode res, char **returndata,
+		      size_t *returnsize, char **returnheader)
+{
+  trace_capture_finish(xfer);
+
+  if (res != CURLE_OK) {
+    set_curl_error(xfer->errcode, "Failed to perform transfer", res);
+    return -1;
+  }
+
+  if (returnsize != NULL)
+    *returnsize = xfer->chunk.size;
+
+  if (returndata != NULL) {
+    *returndata = xfer->chunk.data;
+    memset(&xfer->chunk, 0, sizeof(struct memory));
+  }
+
+  if (returnheader != NULL) {
+    *returnheader = xfer->header_chunk.data;
+    memset(&xfer->header_chunk, 0, sizeof(struct memory));
+  }
+
+  return 0;
 }
 
-int delete_url(const char *url, const char *user, const char *password,
-               const char *driver, const char *provider,
-	       char **returndata)
+void transfer_cleanup(struct transfer *xfer)
+{
+  /* the next transfer on this thread gets the parser, document freed */
+  xml_cache_release_push_parser(xfer->parser);
+  xfer->parser = NULL;
+  xml_stream_free(xfer->stream);
+  xfer->stream = NULL;
+  trace_capture_free(xfer);
+  fault_transfer_cleanup(xfer);
+  SAFE_FREE(xfer->chunk.data);
+  SAFE_FREE(xfer->header_chunk.data);
+  curl_slist_free_all(xfer->headers);
+  xfer->headers = NULL;
+  if (xfer->curl != NULL) {
+    account_transfer(xfer);
+    internal_curl_release(xfer->api, xfer->curl);
+  }
+  xfer->curl = NULL;
+}
+
+/* add one more "Name: value" request header to a transfer that has been set
+ * up but not started yet
+ */
+int transfer_add_header(struct transfer *xfer, const char *header)
 {
-  CURL *curl;
+  struct curl_slist *headers;
   CURLcode res;
-  struct curl_slist *headers = NULL;
-  struct memory chunk;
-  int ret = -1;
 
-  if (internal_curl_setup(DELTACLOUD_DELETE_URL_ERROR, url, user, password, driver, provider,
-			  &curl, &headers, &chunk, NULL) < 0)
-    /* internal_curl_setup set the error */
+  headers = curl_slist_append(xfer->headers, header);
+  if (headers == NULL) {
+    set_error(xfer->errcode, "Failed to add to header list");
     return -1;
+  }
+  xfer->headers = headers;
 
-  res = curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+  res = curl_easy_setopt(xfer->curl, CURLOPT_HTTPHEADER, xfer->headers);
   if (res != CURLE_OK) {
-    set_curl_error(DELTACLOUD_DELETE_URL_ERROR,
-		   "Failed to set custom request to DELETE", res);
-    goto cleanup;
+    set_curl_error(xfer->errcode, "Failed to set HTTP header", res);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* the HTTP status of a finished transfer, or 0 if there was none */
+long transfer_response_code(struct transfer *xfer)
+{
+  long code = 0;
+
+  if (xfer->fault.status != 0 && xfer->fault.answered)
+    return xfer->fault.status;
+
+  if (xfer->api->priv->transport != NULL)
+    return xfer->status;
+
+  if (curl_easy_getinfo(xfer->curl, CURLINFO_RESPONSE_CODE, &code) != CURLE_OK)
+    return 0;
+
+  return code;
+}
+
+/* the value of response header name of a finished transfer, without
+ * surrounding whitespace.  The received headers include those of any
+ * interim responses and redirects, so only the ones after the last status
+ * line count.  Returns a string that the caller must free, or NULL if the
+ * header was not sent (or could not be copied; the caller cannot tell these
+ * apart, so this is only for headers that are safe to miss).
+ */
+char *transfer_header_value(struct transfer *xfer, const char *name)
+{
+  const char *line;
+  const char *end;
+  const char *value = NULL;
+  size_t valuelen = 0;
+  size_t namelen;
+
+  if (xfer->header_chunk.data == NULL)
+    return NULL;
+
+  namelen = strlen(name);
+  for (line = xfer->header_chunk.data; *line != '\0'; line = end) {
+    end = strchr(line, '\n');
+    end = end != NULL ? end + 1 : line + strlen(line);
+
+    if (strncmp(line, "HTTP/", 5) == 0)
+      value = NULL;
+    else if (strncasecmp(line, name, namelen) == 0 && line[namelen] == ':') {
+      value = line + namelen + 1;
+      valuelen = end - value;
+    }
+  }
+
+  if (value == NULL)
+    return NULL;
+
+  while (valuelen > 0 && (*value == ' ' || *value == '\t')) {
+    value++;
+    valuelen--;
+  }
+  while (valuelen > 0 && (value[valuelen - 1] == '\r' ||
+			  value[valuelen - 1] == '\n' ||
+			  value[valuelen - 1] == ' ' ||
+			  value[valuelen - 1] == '\t'))
+    valuelen--;
+  if (valuelen == 0)
+    return NULL;
+
+  return strndup(value, valuelen);
+}
+
+/* have the body of a GET parsed as XML while it downloads, instead of being
+ * collected into a buffer.  name is used for error messages.  The result is
+ * picked up with transfer_complete_xml() instead of transfer_complete().
+ */
+void transfer_stream_xml(struct transfer *xfer, const char *name)
+{
+  xfer->xml_name = name;
+}
+
+/* like transfer_stream_xml(), but for a collection whose root is name: each
+ * element is handed to list_cb as soon as it has arrived, and then freed,
+ * so the document never has more than one of them in it.  The list is
+ * picked up with transfer_stream_take() after transfer_complete_xml(), which
+ * then returns just the root; a document with any other root, such as an
+ * <error>, is returned whole.
+ */
+int transfer_stream_list(struct transfer *xfer, const char *name,
+			 int (*list_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt,
+					void **data),
+			 void (*free_all)(void *list))
+{
+  xfer->stream = xml_stream_new(name, list_cb, free_all);
+  if (xfer->stream == NULL)
+    /* xml_stream_new set the error */
+    return -1;
+
+  xfer->xml_name = name;
+
+  return 0;
+}
+
+/* like transfer_stream_list(), but with each element handed to element_cb
+ * instead; see xml_stream_new_visit().  When element_cb stops the stream,
+ * the transfer is abandoned, and transfer_complete_xml() succeeds without
+ * a document.
+ */
+int transfer_stream_elements(struct transfer *xfer, const char *name,
+			     int (*element_cb)(xmlNodePtr cur,
+					       xmlXPathContextPtr ctxt,
+					       void *data),
+			     void *data)
+{
+  xfer->stream = xml_stream_new_visit(name, element_cb, data);
+  if (xfer->stream == NULL)
+    /* xml_stream_new_visit set the error */
+    return -1;
+
+  xfer->xml_name = name;
+
+  return 0;
+}
+
+/* the list that transfer_stream_list() had built, which the caller must
+ * free; NULL if there is none
+ */
+void *transfer_stream_take(struct transfer *xfer)
+{
+  if (xfer->stream == NULL)
+    return NULL;
+
+  return xml_stream_take(xfer->stream);
+}
+
+static void set_parser_error(struct transfer *xfer, const char *usermsg)
+{
+  const xmlError *last = NULL;
+  char *tmp;
+
+  if (xfer->parser != NULL)
+    last = xmlCtxtGetLastError(xfer->parser);
+
+  if (asprintf(&tmp, "%s for %s: %s", usermsg, xfer->xml_name,
+	       last != NULL && last->message != NULL ? last->message :
+	       "unknown error") < 0) {
+    set_error(DELTACLOUD_XML_ERROR, usermsg);
+    return;
+  }
+
+  strip_trailing_whitespace(tmp);
+  set_error(DELTACLOUD_XML_ERROR, tmp);
+  SAFE_FREE(tmp);
+}
+
+/* the streaming equivalent of transfer_complete().  On success, *doc is the
+ * parsed document, which the caller must free, or NULL if the server sent no
+ * body at all.
+ */
+int transfer_complete_xml(struct transfer *xfer, CURLcode res,
+			  xmlDocPtr *doc)
+{
+  *doc = NULL;
+
+  trace_capture_finish(xfer);
+
+  /* so does a failure to parse one of the elements of a list, which has
+   * already set its own error
+   */
+  if (xfer->stream != NULL && xfer->stream->failed)
+    return -1;
+
+  /* a stream that was stopped early aborted the transfer on purpose */
+  if (xfer->stream != NULL && xfer->stream->stopped)
+    return 0;
+
+  /* a parse failure aborts the transfer, so check for it first */
+  if (xfer->xml_failed) {
+    set_parser_error(xfer, "Failed to parse XML");
+    return -1;
   }
 
-  res = curl_easy_perform(curl);
   if (res != CURLE_OK) {
-    set_curl_error(DELTACLOUD_DELETE_URL_ERROR, "Failed to perform transfer",
-		   res);
-    goto cleanup;
+    set_curl_error(xfer->errcode, "Failed to perform transfer", res);
+    return -1;
   }
 
-  ret = 0;
+  if (xfer->parser == NULL)
+    /* no body */
+    return 0;
 
-  if (chunk.data != NULL && returndata != NULL)
-    *returndata = strdup(chunk.data);
+  if (xmlParseChunk(xfer->parser, NULL, 0, 1) != 0 ||
+      !xfer->parser->wellFormed) {
+    if (xfer->stream != NULL && xfer->stream->failed)
+      /* an element that was only parsed at the very end was bad */
+      return -1;
+    if (xfer->stream != NULL && xfer->stream->stopped)
+      return 0;
+    set_parser_error(xfer, "Failed to parse XML");
+    return -1;
+  }
+
+  *doc = xfer->parser->myDoc;
+  xfer->parser->myDoc = NULL;
+
+  return 0;
+}
+
+/* libcurl before 7.46 only had the unprefixed name */
+#ifndef CURL_HTTPPOST_FILENAME
+#define CURL_HTTPPOST_FILENAME HTTPPOST_FILENAME
+#endif
+
+/* the parts of a multipart form, as a transport gets to see them.  Returns
+ * the number of parts, or -1 on failure; *parts must be freed by the
+ * caller, but the strings in it belong to httppost.
+ */
+static int form_parts(struct curl_httppost *httppost,
+		      struct deltacloud_transport_part **parts)
+{
+  struct curl_httppost *curr;
+  int n = 0;
+
+  for (curr = httppost; curr != NULL; curr = curr->next)
+    n++;
+
+  *parts = calloc(n > 0 ? n : 1, sizeof(struct deltacloud_transport_part));
+  if (*parts == NULL)
+    return -1;
+
+  n = 0;
+  for (curr = httppost; curr != NULL; curr = curr->next) {
+    (*parts)[n].name = curr->name;
+    if (curr->flags & CURL_HTTPPOST_FILENAME)
+      (*parts)[n].filename = curr->contents;
+    else
+      (*parts)[n].contents = curr->contents;
+    n++;
+  }
+
+  return n;
+}
+
+/* hand the request in xfer to the transport of the api, and feed the
+ * response it comes back with through the same callbacks that libcurl
+ * would have
+ */
+static CURLcode transport_perform(struct transfer *xfer)
+{
+  const struct deltacloud_transport *transport = xfer->api->priv->transport;
+  void *ctx = xfer->api->priv->transport_ctx;
+  struct deltacloud_transport_response response;
+  struct deltacloud_transport_part *parts = NULL;
+  struct curl_slist *curr;
+  const char **headers;
+  char status[32];
+  CURLcode res = CURLE_OK;
+  int nparts;
+  int n = 0;
+  int ret = -1;
+
+  deltacloud_for_each(curr, xfer->headers)
+    n++;
+  headers = calloc(n + 1, sizeof(char *));
+  if (headers == NULL)
+    return CURLE_OUT_OF_MEMORY;
+  n = 0;
+  deltacloud_for_each(curr, xfer->headers)
+    headers[n++] = curr->data;
+
+  memset(&response, 0, sizeof(struct deltacloud_transport_response));
+
+  switch (xfer->method) {
+  case TRANSFER_GET:
+    if (transport->get != NULL)
+      ret = transport->get(ctx, xfer->url, headers, &response);
+    break;
+  case TRANSFER_HEAD:
+    if (transport->head != NULL)
+      ret = transport->head(ctx, xfer->url, headers, &response);
+    break;
+  case TRANSFER_DELETE:
+    if (transport->del != NULL)
+      ret = transport->del(ctx, xfer->url, headers, &response);
+    break;
+  case TRANSFER_POST:
+    if (transport->post != NULL)
+      ret = transport->post(ctx, xfer->url, headers, xfer->data, &response);
+    break;
+  case TRANSFER_MULTIPART:
+    if (transport->multipart == NULL)
+      break;
+    nparts = form_parts(xfer->httppost, &parts);
+    if (nparts < 0) {
+      SAFE_FREE(headers);
+      return CURLE_OUT_OF_MEMORY;
+    }
+    ret = transport->multipart(ctx, xfer->url, headers, parts, nparts,
+			       &response);
+    SAFE_FREE(parts);
+    break;
+  }
+  SAFE_FREE(headers);
+
+  if (ret < 0)
+    /* no answer at all; as far as the callers are concerned, that is the
+     * same as not being able to reach the server
+     */
+    return CURLE_COULDNT_CONNECT;
+
+  xfer->status = response.status;
+
+  /* transfer_header_value() only looks at the headers after the last
+   * status line
+   */
+  snprintf(status, sizeof(status), "HTTP/1.1 %ld\r\n", response.status);
+  if (header_callback(status, 1, strlen(status), xfer) == 0 ||
+      (response.headers != NULL &&
+       header_callback((void *)response.headers, 1, strlen(response.headers),
+		       xfer) == 0))
+    res = CURLE_OUT_OF_MEMORY;
+  else if (xfer->method != TRANSFER_HEAD && response.body_length > 0 &&
+	   body_callback((void *)response.body, 1, response.body_length,
+			 xfer) != response.body_length)
+    res = CURLE_WRITE_ERROR;
+
+  if (transport->release != NULL)
+    transport->release(ctx, &response);
+
+  return res;
+}
+
+/* run a transfer that has been set up, blocking until it is finished; the
+ * equivalent of curl_easy_perform(), but going through the transport of
+ * the api if it has one
+ */
+CURLcode transfer_perform(struct transfer *xfer)
+{
+  /* nothing else is waiting on this thread, so injected faults can sleep
+   * rather than pause
+   */
+  xfer->fault.blocking = 1;
+
+  if (xfer->api->priv->transport != NULL)
+    return transport_perform(xfer);
+
+  return curl_easy_perform(xfer->curl);
+}
+
+/* called after each attempt of a blocking transfer, with res the result of
+ * curl_easy_perform().  If it is a GET, HEAD or DELETE that failed in a way
+ * that the retry policy of the api says is worth another try, xfer is
+ * cleaned up, the backoff is waited out and 1 is returned; the caller then
+ * sets the transfer up again from scratch.  Otherwise, 0 is returned and
+ * xfer is left as it was.
+ */
+int transfer_retry(struct transfer *xfer, struct retry_state *state,
+		   CURLcode res)
+{
+  long delay;
+
+  if (xfer->method != TRANSFER_GET && xfer->method != TRANSFER_HEAD &&
+      xfer->method != TRANSFER_DELETE)
+    return 0;
+
+  delay = retry_backoff(&xfer->api->priv->retry, state, xfer, res);
+  if (delay < 0)
+    return 0;
+
+  transfer_cleanup(xfer);
+  sleep_ms(delay);
+
+  return 1;
+}
+
+/* run a single blocking transfer from start to finish */
+static int do_transfer(struct deltacloud_api *api, int method, const char *url,
+		       const char *data, struct curl_slist *inheader,
+		       struct curl_httppost *httppost, char **returndata,
+		       size_t *returnsize, char **returnheader)
+{
+  struct transfer xfer;
+  struct retry_state retry;
+  CURLcode res;
+  int ret = -1;
+
+  retry_start(&retry);
+  do {
+    if (transfer_setup(&xfer, api, method, url, data, inheader,
+		       httppost) < 0)
+      /* transfer_setup set the error */
+      goto cleanup;
+
+    res = transfer_perform(&xfer);
+  } while (transfer_retry(&xfer, &retry, res));
+
+  if (transfer_complete(&xfer, res, returndata, returnsize,
+			returnheader) < 0)
+    /* transfer_complete set the error */
+    goto cleanup;
+
+  ret = 0;
 
  cleanup:
-  SAFE_FREE(chunk.data);
-  curl_slist_free_all(headers);
-  curl_easy_cleanup(curl);
+  transfer_cleanup(&xfer);
 
   return ret;
 }
 
-int do_multipart_post_url(const char *url, const char *user,
-			  const char *password, const char *driver, const char *provider,
-			  struct curl_httppost *httppost,
-			  char **returndata)
+int do_get_post_url(struct deltacloud_api *api, const char *url,
+		    int post, char *data, struct curl_slist *inheader,
+		    char **returndata, size_t *returnsize,
+		    char **returnheader)
+{
+  return do_transfer(api, post ? TRANSFER_POST : TRANSFER_GET, url, data,
+		     inheader, NULL, returndata, returnsize, returnheader);
+}
+
+struct xml_get {
+  struct deltacloud_api *api;
+  const char *url;
+  const char *name;
+};
+
+static int prepare_xml_get(struct transfer *xfer, void *arg)
 {
-  CURL *curl;
+  struct xml_get *get = (struct xml_get *)arg;
+
+  if (transfer_setup(xfer, get->api, TRANSFER_GET, get->url, NULL, NULL,
+		     NULL) < 0)
+    /* transfer_setup set the error */
+    return -1;
+  transfer_stream_xml(xfer, get->name);
+
+  return 0;
+}
+
+/* a blocking GET of url whose body is parsed while it is downloaded */
+int get_url_xml(struct deltacloud_api *api, const char *url,
+		const char *name, xmlDocPtr *doc)
+{
+  struct xml_get get = { api, url, name };
+  struct transfer xfer;
+  struct retry_state retry;
   CURLcode res;
-  struct curl_slist *headers = NULL;
-  struct memory chunk;
   int ret = -1;
 
-  if (internal_curl_setup(DELTACLOUD_MULTIPART_POST_URL_ERROR, url, user,
-			  password, driver, provider, &curl, &headers, &chunk, NULL) < 0)
-    /* internal_curl_setup set the error */
-    return -1;
+  *doc = NULL;
 
-  res = curl_easy_setopt(curl, CURLOPT_HTTPPOST, httppost);
-  if (res != CURLE_OK) {
-    set_curl_error(DELTACLOUD_MULTIPART_POST_URL_ERROR,
-		   "Failed set HTTP POST multipart headers", res);
-    goto cleanup;
-  }
+  retry_start(&retry);
+  do {
+    if (prepare_xml_get(&xfer, &get) < 0)
+      /* prepare_xml_get set the error */
+      goto cleanup;
 
-  res = curl_easy_perform(curl);
-  if (res != CURLE_OK) {
-    set_curl_error(DELTACLOUD_MULTIPART_POST_URL_ERROR,
-		   "Failed to perform transfer", res);
+    res = hedge_perform(api, &xfer, prepare_xml_get, &get);
+  } while (transfer_retry(&xfer, &retry, res));
+
+  if (transfer_complete_xml(&xfer, res, doc) < 0)
+    /* transfer_complete_xml set the error */
     goto cleanup;
-  }
 
   ret = 0;
 
-  if (chunk.data != NULL && returndata != NULL)
-    *returndata = strdup(chunk.data);
-
  cleanup:
-  SAFE_FREE(chunk.data);
-  curl_slist_free_all(headers);
-  curl_easy_cleanup(curl);
+  transfer_cleanup(&xfer);
 
   return ret;
 }
 
-int head_url(const char *url, const char *user, const char *password, const char *driver, const char *provider,
-	     char **returnheader)
+/* a blocking GET of url, a collection whose root is name, with each
+ * element handed to element_cb as soon as it has arrived (see
+ * transfer_stream_elements()).  Returns 1 if element_cb stopped early, in
+ * which case *doc is NULL; otherwise *doc is what is left of the document,
+ * as with transfer_stream_list().
+ */
+int get_url_elements(struct deltacloud_api *api, const char *url,
+		     const char *name,
+		     int (*element_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt,
+				       void *data),
+		     void *data, xmlDocPtr *doc)
 {
-  CURL *curl;
+  struct transfer xfer;
+  struct retry_state retry;
   CURLcode res;
-  struct curl_slist *headers = NULL;
-  struct memory header_chunk;
   int ret = -1;
 
-  if (internal_curl_setup(DELTACLOUD_GET_URL_ERROR, url, user, password, driver, provider, &curl,
-			  &headers, NULL, &header_chunk) < 0)
-    /* internal_curl_setup set the error */
-    return -1;
+  *doc = NULL;
 
-  res = curl_easy_setopt(curl, CURLOPT_NOBODY, 1);
-  if (res != CURLE_OK) {
-    set_curl_error(DELTACLOUD_GET_URL_ERROR, "Failed to set header POST", res);
-    goto cleanup;
-  }
+  retry_start(&retry);
+  do {
+    if (transfer_setup(&xfer, api, TRANSFER_GET, url, NULL, NULL,
+		       NULL) < 0 ||
+	transfer_stream_elements(&xfer, name, element_cb, data) < 0)
+      /* transfer_setup and transfer_stream_elements set the error */
+      goto cleanup;
 
-  res = curl_easy_perform(curl);
-  if (res != CURLE_OK) {
-    set_curl_error(DELTACLOUD_GET_URL_ERROR, "Failed to perform transfer", res);
-    goto cleanup;
-  }
+    /* this is not hedged, as both copies would hand the same elements to
+     * element_cb; for the same reason, it is only tried again if none
+     * have been handed over yet
+     */
+    res = transfer_perform(&xfer);
+  } while (xfer.stream->elements == 0 &&
+	   transfer_retry(&xfer, &retry, res));
 
-  if (header_chunk.data != NULL && returnheader != NULL)
-    *returnheader = strdup(header_chunk.data);
+  if (transfer_complete_xml(&xfer, res, doc) < 0)
+    /* transfer_complete_xml set the error */
+    goto cleanup;
 
-  ret = 0;
+  ret = xfer.stream->stopped ? 1 : 0;
 
  cleanup:
-  SAFE_FREE(header_chunk.data);
-  curl_slist_free_all(headers);
-  curl_easy_cleanup(curl);
+  transfer_cleanup(&xfer);
 
   return ret;
 }
+
+int delete_url(struct deltacloud_api *api, const char *url,
+	       char **returndata)
+{
+  return do_transfer(api, TRANSFER_DELETE, url, NULL, NULL, NULL, returndata,
+		     NULL, NULL);
+}
+
+int do_multipart_post_url(struct deltacloud_api *api, const char *url,
+			  struct curl_httppost *httppost,
+			  char **returndata)
+{
+  return do_transfer(api, TRANSFER_MULTIPART, url, NULL, NULL, httppost,
+		     returndata, NULL, NULL);
+}
+
+int head_url(struct deltacloud_api *api, const char *url,
+	     char **returnheader)
+{
+  return do_transfer(api, TRANSFER_HEAD, url, NULL, NULL, NULL, NULL, NULL,
+		     returnheader);
+}
@@ -25,29 +25,157 @@
 extern "C" {
 #endif
 
+#include <pthread.h>
 #include <curl/curl.h>
+#include <libxml/parser.h>
+#include "libdeltacloud.h"
+#include "retry.h"
+#include "fault.h"
+#include "xml_stream.h"
 
-int do_get_post_url(const char *url, const char *user, const char *password,
-                    const char *driver, const char *provider,
+/* a growable byte buffer.  data is always NUL terminated once anything has
+ * been stored, so that it can also be treated as a string
+ */
+struct memory {
+  char *data;
+  size_t size; /* bytes stored, not counting the terminator */
+  size_t capacity; /* bytes allocated */
+};
+
+#define MEMORY_INITIAL_CAPACITY 4096
+/* a Content-Length larger than this is not trusted for pre-sizing */
+#define MEMORY_MAX_PRESIZE (64 * 1024 * 1024)
+
+/* byte counters shared by all of the transfers of one deltacloud_api */
+struct transfer_stats {
+  pthread_mutex_t lock;
+  unsigned long long wire_bytes;
+  unsigned long long decoded_bytes;
+  unsigned long long retries;
+  unsigned long long retries_denied;
+  unsigned long long hedges;
+  unsigned long long hedges_won;
+};
+
+struct trace_capture;
+
+enum transfer_method {
+  TRANSFER_GET,
+  TRANSFER_POST,
+  TRANSFER_DELETE,
+  TRANSFER_HEAD,
+  TRANSFER_MULTIPART,
+};
+
+/* the state of a single HTTP transfer; it is stored as the CURLOPT_PRIVATE
+ * pointer of its curl handle so that it can be found again from a multi
+ * handle
+ */
+struct transfer {
+  struct deltacloud_api *api;
+  int method;
+  int errcode; /* the DELTACLOUD_*_ERROR to report on failure */
+  CURL *curl;
+
+  /* what the request was set up with, for a transport of the api's own
+   * (see transfer_perform()); none of these are owned by the transfer
+   */
+  const char *url;
+  const char *data;
+  struct curl_httppost *httppost;
+  long status; /* the response status the transport reported */
+
+  struct curl_slist *headers;
+  struct memory chunk;
+  struct memory header_chunk;
+  size_t decoded; /* body bytes handed to us by curl, after decompression */
+
+  /* set by transfer_stream_xml(); the body then goes straight into a push
+   * parser as it arrives, instead of into chunk
+   */
+  const char *xml_name;
+  xmlParserCtxtPtr parser;
+  int xml_failed;
+  /* set by transfer_stream_list() as well; the elements of the document
+   * are then parsed into a list one by one, as each of them arrives
+   */
+  struct xml_stream *stream;
+
+  /* what is kept for the trace, while the api is being recorded */
+  struct trace_capture *trace;
+
+  /* what deltacloud_add_fault() has in store for this transfer */
+  struct fault_state fault;
+};
+
+int transfer_stats_init(struct transfer_stats *stats);
+void transfer_stats_destroy(struct transfer_stats *stats);
+void transfer_stats_get(struct transfer_stats *stats,
+			struct deltacloud_transfer_stats *out);
+void transfer_stats_reset(struct transfer_stats *stats);
+void transfer_stats_count_retry(struct transfer_stats *stats, int granted);
+void transfer_stats_count_hedge(struct transfer_stats *stats, int won);
+
+void transfer_multi_setup(CURLM *multi);
+
+int transfer_rate_kind(int method);
+int transfer_setup(struct transfer *xfer, struct deltacloud_api *api,
+		   int method, const char *url, const char *data,
+		   struct curl_slist *inheader, struct curl_httppost *httppost);
+int transfer_setup_with_token(struct transfer *xfer,
+			      struct deltacloud_api *api, int method,
+			      const char *url, const char *data,
+			      struct curl_slist *inheader,
+			      struct curl_httppost *httppost);
+int transfer_complete(struct transfer *xfer, CURLcode res, char **returndata,
+		      size_t *returnsize, char **returnheader);
+void transfer_cleanup(struct transfer *xfer);
+int transfer_add_header(struct transfer *xfer, const char *header);
+long transfer_response_code(struct transfer *xfer);
+char *transfer_header_value(struct transfer *xfer, const char *name);
+void transfer_stream_xml(struct transfer *xfer, const char *name);
+int transfer_stream_list(struct transfer *xfer, const char *name,
+			 int (*list_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt,
+					void **data),
+			 void (*free_all)(void *list));
+int transfer_stream_elements(struct transfer *xfer, const char *name,
+			     int (*element_cb)(xmlNodePtr cur,
+					       xmlXPathContextPtr ctxt,
+					       void *data),
+			     void *data);
+void *transfer_stream_take(struct transfer *xfer);
+int transfer_complete_xml(struct transfer *xfer, CURLcode res,
+			  xmlDocPtr *doc);
+int transfer_retry(struct transfer *xfer, struct retry_state *state,
+		   CURLcode res);
+CURLcode transfer_perform(struct transfer *xfer);
+
+int do_get_post_url(struct deltacloud_api *api, const char *url,
 		    int post, char *data, struct curl_slist *inheader,
-		    char **returndata, char **returnheader);
+		    char **returndata, size_t *returnsize,
+		    char **returnheader);
+
+#define get_url(api, url, returndata) do_get_post_url(api, url, 0, NULL, NULL, returndata, NULL, NULL)
+#define get_url_sized(api, url, returndata, returnsize) do_get_post_url(api, url, 0, NULL, NULL, returndata, returnsize, NULL)
+#define post_url(api, url, data, returndata, returnheader) do_get_post_url(api, url, 1, data, NULL, returndata, NULL, returnheader)
+#define post_url_with_headers(api, url, inputheaders, returndata) do_get_post_url(api, url, 1, NULL, inputheaders, returndata, NULL, NULL)
 
-#define get_url(url, user, password, driver, provider, returndata) do_get_post_url(url, user, password, driver, provider, 0, NULL, NULL, returndata, NULL)
-#define post_url(url, user, password, driver, provider, data, returndata, returnheader) do_get_post_url(url, user, password, driver, provider, 1, data, NULL, returndata, returnheader)
-#define post_url_with_headers(url, user, password, driver, provider, inputheaders, returndata) do_get_post_url(url, user, password, driver, provider, 1, NULL, inputheaders, returndata, NULL)
+int get_url_xml(struct deltacloud_api *api, const char *url,
+		const char *name, xmlDocPtr *doc);
+int get_url_elements(struct deltacloud_api *api, const char *url,
+		     const char *name,
+		     int (*element_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt,
+				       void *data),
+		     void *data, xmlDocPtr *doc);
 
-int delete_url(const char *url, const char *user, const char *password,
-               const char *driver, const char *provider,
+int delete_url(struct deltacloud_api *api, const char *url,
 	       char **returndata);
 
-int do_multipart_post_url(const char *url, const char *user,
-			  const char *password,
-                          const char *driver, const char *provider,
+int do_multipart_post_url(struct deltacloud_api *api, const char *url,
 			  struct curl_httppost *httppost,
 			  char **returndata);
 
-int head_url(const char *url, const char *user, const char *password,
-             const char *driver, const char *provider,
+int head_url(struct deltacloud_api *api, const char *url,
 	     char **returnheader);
 
 #ifdef __cplusplus
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "decoder.h"
+
+/* Decoding tables replace the string(./name) style XPath queries the parsers
+ * used to make, one per field, each of which compiled its expression and
+ * walked the element's children again.  Here the attributes and the children
+ * of an element are each visited exactly once, and every one of them is
+ * matched against the table by name.
+ *
+ * The results are those the old queries gave: the string value of the first
+ * match, with empty values coming out as NULL.  The one exception is
+ * DECODE_ATTR, which stands in for the xmlGetProp() calls that most parsers
+ * made for the attributes of the element itself, and so keeps an empty value
+ * as "".
+ */
+
+/** @cond INTERNAL */
+char *decode_text(xmlNodePtr node)
+{
+  char *text;
+
+  text = (char *)xmlNodeGetContent(node);
+  if (text != NULL && text[0] == '\0')
+    SAFE_FREE(text);
+
+  return text;
+}
+
+/* the equivalent of getXPathString("string(./child)") for just one field */
+char *decode_child_text(xmlNodePtr cur, const char *child)
+{
+  for (cur = cur->children; cur != NULL; cur = cur->next)
+    if (cur->type == XML_ELEMENT_NODE &&
+	STREQ((const char *)cur->name, child))
+      return decode_text(cur);
+
+  return NULL;
+}
+/** @endcond */
+
+static char **field_string(void *output, const struct decode_field *field)
+{
+  return (char **)((char *)output + field->offset);
+}
+
+static void decode_attrs(xmlNodePtr cur, const struct decode_field *fields,
+			 void *output)
+{
+  const struct decode_field *field;
+  xmlAttrPtr prop;
+  char **dst;
+
+  for (prop = cur->properties; prop != NULL; prop = prop->next) {
+    for (field = fields; field->source != DECODE_SOURCE_END; field++) {
+      if ((field->source != DECODE_SOURCE_ATTR &&
+	   field->source != DECODE_SOURCE_ATTR_STRING) ||
+	  STRNEQ(field->attr, (const char *)prop->name))
+	continue;
+
+      dst = field_string(output, field);
+      if (*dst != NULL)
+	continue;
+      if (field->source == DECODE_SOURCE_ATTR)
+	*dst = (char *)xmlNodeGetContent((xmlNodePtr)prop);
+      else
+	*dst = decode_text((xmlNodePtr)prop);
+    }
+  }
+}
+
+/** @cond INTERNAL */
+int decode_element(xmlNodePtr cur, xmlXPathContextPtr ctxt,
+		   const struct decode_field *fields, void *output)
+{
+  const struct decode_field *field;
+  unsigned long seen = 0;
+  xmlNodePtr child;
+  xmlAttrPtr prop;
+  char **dst;
+  int i;
+
+  decode_attrs(cur, fields, output);
+
+  for (child = cur->children; child != NULL; child = child->next) {
+    if (child->type != XML_ELEMENT_NODE)
+      continue;
+
+    for (i = 0, field = fields; field->source != DECODE_SOURCE_END;
+	 i++, field++) {
+      if (field->child == NULL ||
+	  STRNEQ(field->child, (const char *)child->name))
+	continue;
+
+      switch (field->source) {
+      case DECODE_SOURCE_TEXT:
+	dst = field_string(output, field);
+	if (*dst == NULL)
+	  *dst = decode_text(child);
+	break;
+      case DECODE_SOURCE_CHILD_ATTR:
+	dst = field_string(output, field);
+	if (*dst == NULL) {
+	  prop = xmlHasProp(child, BAD_CAST field->attr);
+	  if (prop != NULL)
+	    *dst = decode_text((xmlNodePtr)prop);
+	}
+	break;
+      case DECODE_SOURCE_CHILD:
+	/* only the first of them, as the callbacks fill in a whole list */
+	if (i >= DECODE_MAX_FIELDS || (seen & (1UL << i)))
+	  break;
+	seen |= 1UL << i;
+	/* fall through */
+      case DECODE_SOURCE_EACH:
+	if (field->cb(child, ctxt, (char *)output + field->offset) < 0)
+	  /* the callback is expected to have set its own error */
+	  return -1;
+	break;
+      case DECODE_SOURCE_NESTED:
+	if (decode_element(child, ctxt, field->nested, output) < 0)
+	  return -1;
+	break;
+      }
+    }
+  }
+
+  return 0;
+}
+/** @endcond */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#ifndef DECODER_H
+#define DECODER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <libxml/tree.h>
+#include <libxml/xpath.h>
+
+/* where in an element a field of the structure it is decoded into comes
+ * from
+ */
+enum decode_source {
+  DECODE_SOURCE_END, /* terminates a table */
+  DECODE_SOURCE_ATTR, /* an attribute of the element itself */
+  DECODE_SOURCE_ATTR_STRING, /* the same, with an empty value as NULL */
+  DECODE_SOURCE_TEXT, /* the text of a child element */
+  DECODE_SOURCE_CHILD_ATTR, /* an attribute of a child element */
+  DECODE_SOURCE_CHILD, /* the first such child, handed to a callback */
+  DECODE_SOURCE_EACH, /* every such child, handed to a callback in turn */
+  DECODE_SOURCE_NESTED, /* a child element, decoded with its own table */
+};
+
+typedef int (*decode_cb)(xmlNodePtr node, xmlXPathContextPtr ctxt,
+			 void *field);
+
+/* One entry of a decoding table.  Offsets are into the structure passed to
+ * decode_element(), nested tables included, so that something like
+ * <authentication><login><username> can land in instance->auth.username.
+ */
+struct decode_field {
+  int source;
+  const char *child; /* name of the child element, if any */
+  const char *attr; /* name of the attribute, if any */
+  size_t offset; /* of the char * (or whatever cb fills in) */
+  decode_cb cb;
+  const struct decode_field *nested;
+};
+
+#define DECODE_ATTR(attr, type, member)					\
+  { DECODE_SOURCE_ATTR, NULL, attr, offsetof(type, member), NULL, NULL }
+#define DECODE_ATTR_STRING(attr, type, member)				\
+  { DECODE_SOURCE_ATTR_STRING, NULL, attr, offsetof(type, member), NULL, \
+      NULL }
+#define DECODE_TEXT(child, type, member)				\
+  { DECODE_SOURCE_TEXT, child, NULL, offsetof(type, member), NULL, NULL }
+#define DECODE_CHILD_ATTR(child, attr, type, member)			\
+  { DECODE_SOURCE_CHILD_ATTR, child, attr, offsetof(type, member), NULL, \
+      NULL }
+#define DECODE_CHILD(child, type, member, cb)				\
+  { DECODE_SOURCE_CHILD, child, NULL, offsetof(type, member), cb, NULL }
+#define DECODE_EACH(child, type, member, cb)				\
+  { DECODE_SOURCE_EACH, child, NULL, offsetof(type, member), cb, NULL }
+#define DECODE_NESTED(child, table)					\
+  { DECODE_SOURCE_NESTED, child, NULL, 0, NULL, table }
+#define DECODE_END { DECODE_SOURCE_END, NULL, NULL, 0, NULL, NULL }
+
+/* tables may not have more entries than this, DECODE_END excluded */
+#define DECODE_MAX_FIELDS 32
+
+int decode_element(xmlNodePtr cur, xmlXPathContextPtr ctxt,
+		   const struct decode_field *fields, void *output);
+char *decode_text(xmlNodePtr node);
+char *decode_child_text(xmlNodePtr cur, const char *child);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
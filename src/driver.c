@@ -23,6 +23,7 @@
 #include <memory.h>
 #include "common.h"
 #include "driver.h"
+#include "decoder.h"
 
 /** @file */
 
@@ -31,38 +32,46 @@ static void free_provider(struct deltacloud_driver_provider *provider)
   SAFE_FREE(provider->id);
 }
 
-static int parse_one_driver(xmlNodePtr cur, xmlXPathContextPtr ctxt,
-			    void *output)
+static int parse_one_provider(xmlNodePtr providernode,
+			      xmlXPathContextPtr ctxt, void *field)
 {
-  struct deltacloud_driver *thisdriver = (struct deltacloud_driver *)output;
-  xmlNodePtr providernode;
+  struct deltacloud_driver_provider **providers = (struct deltacloud_driver_provider **)field;
   struct deltacloud_driver_provider *thisprovider;
 
-  memset(thisdriver, 0, sizeof(struct deltacloud_driver));
+  thisprovider = calloc(1, sizeof(struct deltacloud_driver_provider));
+  if (thisprovider == NULL) {
+    oom_error();
+    return -1;
+  }
 
-  thisdriver->href = (char *)xmlGetProp(cur, BAD_CAST "href");
-  thisdriver->id = (char *)xmlGetProp(cur, BAD_CAST "id");
-  thisdriver->name = getXPathString("string(./name)", ctxt);
+  thisprovider->id = (char *)xmlGetProp(providernode, BAD_CAST "id");
 
-  providernode = cur->children;
-  while (providernode != NULL) {
-    if (providernode->type == XML_ELEMENT_NODE &&
-	STREQ((const char *)providernode->name, "provider")) {
+  /* add_to_list can't fail */
+  add_to_list(providers, struct deltacloud_driver_provider, thisprovider);
 
-      thisprovider = calloc(1, sizeof(struct deltacloud_driver_provider));
-      if (thisprovider == NULL) {
-	oom_error();
-	deltacloud_free_driver(thisdriver);
-	return -1;
-      }
+  return 0;
+}
 
-      thisprovider->id = (char *)xmlGetProp(providernode, BAD_CAST "id");
+static const struct decode_field driver_fields[] = {
+  DECODE_ATTR("href", struct deltacloud_driver, href),
+  DECODE_ATTR("id", struct deltacloud_driver, id),
+  DECODE_TEXT("name", struct deltacloud_driver, name),
+  DECODE_EACH("provider", struct deltacloud_driver, providers,
+	      parse_one_provider),
+  DECODE_END
+};
 
-      /* add_to_list can't fail */
-      add_to_list(&thisdriver->providers, struct deltacloud_driver_provider,
-		  thisprovider);
-    }
-    providernode = providernode->next;
+static int parse_one_driver(xmlNodePtr cur, xmlXPathContextPtr ctxt,
+			    void *output)
+{
+  struct deltacloud_driver *thisdriver = (struct deltacloud_driver *)output;
+
+  memset(thisdriver, 0, sizeof(struct deltacloud_driver));
+
+  if (decode_element(cur, ctxt, driver_fields, thisdriver) < 0) {
+    /* parse_one_provider already set the error */
+    deltacloud_free_driver(thisdriver);
+    return -1;
   }
 
   return 0;
@@ -112,6 +121,24 @@ static int parse_driver_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
   return ret;
 }
 
+static int copy_driver(struct deltacloud_driver *dst,
+		       const struct deltacloud_driver *src);
+static int copy_driver_list(struct deltacloud_driver **dst,
+			    const struct deltacloud_driver *src);
+
+static const struct collection_type driver_collection_type = {
+  .relname = "drivers",
+  .rootname = "drivers",
+  .list_cb = parse_driver_xml,
+  .copy_all = (int (*)(void *, const void *))copy_driver_list,
+  .free_all = (void (*)(void *))deltacloud_free_driver_list,
+  .oneroot = "driver",
+  .one_cb = parse_one_driver,
+  .copy_one = (int (*)(void *, const void *))copy_driver,
+  .free_one = (void (*)(void *))deltacloud_free_driver,
+  .size = sizeof(struct deltacloud_driver),
+};
+
 /**
  * A function to get a linked list of all of the drivers supported.  The caller
  * is expected to free the list using deltacloud_free_driver_list().
@@ -123,8 +150,7 @@ static int parse_driver_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 int deltacloud_get_drivers(struct deltacloud_api *api,
 			   struct deltacloud_driver **drivers)
 {
-  return internal_get(api, "drivers", "drivers", parse_driver_xml,
-		      (void **)drivers);
+  return internal_get(api, &driver_collection_type, (void **)drivers);
 }
 
 /**
@@ -139,8 +165,7 @@ int deltacloud_get_drivers(struct deltacloud_api *api,
 int deltacloud_get_driver_by_id(struct deltacloud_api *api, const char *id,
 				struct deltacloud_driver *driver)
 {
-  return internal_get_by_id(api, id, "drivers", "driver", parse_one_driver,
-			    driver);
+  return internal_get_type_by_id(api, &driver_collection_type, id, driver);
 }
 
 /**
@@ -169,3 +194,44 @@ void deltacloud_free_driver_list(struct deltacloud_driver **drivers)
 {
   free_list(drivers, struct deltacloud_driver, deltacloud_free_driver);
 }
+
+static void free_provider_list(struct deltacloud_driver_provider **providers)
+{
+  free_list(providers, struct deltacloud_driver_provider, free_provider);
+}
+
+static int copy_provider(struct deltacloud_driver_provider *dst,
+			 const struct deltacloud_driver_provider *src)
+{
+  return copy_string(&dst->id, src->id);
+}
+
+static int copy_provider_list(struct deltacloud_driver_provider **dst,
+			      const struct deltacloud_driver_provider *src)
+{
+  copy_list(dst, src, struct deltacloud_driver_provider, copy_provider,
+	    free_provider_list);
+
+  return 0;
+}
+
+static int copy_driver(struct deltacloud_driver *dst,
+		       const struct deltacloud_driver *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->name, src->name) < 0 ||
+      copy_provider_list(&dst->providers, src->providers) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_driver_list(struct deltacloud_driver **dst,
+			    const struct deltacloud_driver *src)
+{
+  copy_list(dst, src, struct deltacloud_driver, copy_driver,
+	    deltacloud_free_driver_list);
+
+  return 0;
+}
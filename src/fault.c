@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "curl_action.h"
+#include "fault.h"
+
+int fault_injector_init(struct fault_injector *faults)
+{
+  memset(faults, 0, sizeof(struct fault_injector));
+
+  if (pthread_mutex_init(&faults->lock, NULL) != 0) {
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to initialize fault lock");
+    return -1;
+  }
+
+  faults->seed = (unsigned int)time(NULL) ^ (unsigned int)getpid() ^
+    (unsigned int)(unsigned long)faults;
+
+  return 0;
+}
+
+void fault_injector_destroy(struct fault_injector *faults)
+{
+  fault_injector_clear(faults);
+  pthread_mutex_destroy(&faults->lock);
+}
+
+int fault_injector_add(struct fault_injector *faults,
+		       const struct deltacloud_fault *fault)
+{
+  struct fault_rule *rule;
+
+  rule = calloc(1, sizeof(struct fault_rule));
+  if (rule == NULL) {
+    oom_error();
+    return -1;
+  }
+
+  rule->fault = *fault;
+  if (fault->pattern != NULL) {
+    rule->pattern = strdup(fault->pattern);
+    if (rule->pattern == NULL) {
+      oom_error();
+      SAFE_FREE(rule);
+      return -1;
+    }
+  }
+  /* the caller's copy need not outlive this call */
+  rule->fault.pattern = rule->pattern;
+
+  pthread_mutex_lock(&faults->lock);
+  if (faults->last == NULL)
+    faults->rules = rule;
+  else
+    faults->last->next = rule;
+  faults->last = rule;
+  pthread_mutex_unlock(&faults->lock);
+
+  return 0;
+}
+
+/* transfers already picked for a fault keep it */
+void fault_injector_clear(struct fault_injector *faults)
+{
+  struct fault_rule *rule;
+
+  pthread_mutex_lock(&faults->lock);
+  while ((rule = faults->rules) != NULL) {
+    faults->rules = rule->next;
+    SAFE_FREE(rule->pattern);
+    SAFE_FREE(rule);
+  }
+  faults->last = NULL;
+  pthread_mutex_unlock(&faults->lock);
+}
+
+/* must be called with faults->lock held; a number in (0, 1] */
+static double draw(struct fault_injector *faults)
+{
+  return (rand_r(&faults->seed) + 1.0) / (RAND_MAX + 1.0);
+}
+
+/* must be called with faults->lock held */
+static long draw_latency(struct fault_injector *faults,
+			 const struct deltacloud_fault *fault)
+{
+  double shape;
+
+  switch (fault->distribution) {
+  case DELTACLOUD_LATENCY_UNIFORM:
+    return fault->latency_ms + (long)(draw(faults) * fault->spread_ms);
+  case DELTACLOUD_LATENCY_EXPONENTIAL:
+    return (long)(-log(draw(faults)) * fault->latency_ms);
+  case DELTACLOUD_LATENCY_PARETO:
+    shape = fault->shape > 0 ? fault->shape : 1.5;
+    return (long)(fault->latency_ms / pow(draw(faults), 1 / shape));
+  default:
+    return fault->latency_ms;
+  }
+}
+
+/* pick the fault, if any, that xfer is to suffer: the first rule that
+ * matches its URL and whose dice come up
+ */
+void fault_transfer_setup(struct transfer *xfer)
+{
+  struct fault_injector *faults = &xfer->api->priv->faults;
+  struct fault_state *state = &xfer->fault;
+  struct fault_rule *rule;
+
+  memset(state, 0, sizeof(struct fault_state));
+
+  pthread_mutex_lock(&faults->lock);
+  for (rule = faults->rules; rule != NULL; rule = rule->next) {
+    if (rule->pattern != NULL && fnmatch(rule->pattern, xfer->url, 0) != 0)
+      continue;
+    if (draw(faults) > rule->fault.probability)
+      continue;
+
+    state->active = 1;
+    state->latency_ms = draw_latency(faults, &rule->fault);
+    state->bandwidth = rule->fault.bandwidth;
+    state->stall_after = rule->fault.stall_after;
+    state->stall_ms = rule->fault.stall_ms;
+    state->status = rule->fault.status;
+    break;
+  }
+  pthread_mutex_unlock(&faults->lock);
+}
+
+/* must be called with faults->lock held */
+static void unlink_paused(struct fault_injector *faults, struct transfer *xfer)
+{
+  struct transfer **curr;
+
+  for (curr = &faults->paused; *curr != NULL;
+       curr = &(*curr)->fault.next_paused) {
+    if (*curr == xfer) {
+      *curr = xfer->fault.next_paused;
+      break;
+    }
+  }
+  xfer->fault.next_paused = NULL;
+}
+
+/* a transfer can be abandoned while it is paused, such as the loser of a
+ * hedge
+ */
+void fault_transfer_cleanup(struct transfer *xfer)
+{
+  struct fault_injector *faults;
+
+  if (!xfer->fault.active || xfer->fault.ready_at == 0)
+    return;
+
+  faults = &xfer->api->priv->faults;
+  pthread_mutex_lock(&faults->lock);
+  unlink_paused(faults, xfer);
+  pthread_mutex_unlock(&faults->lock);
+  xfer->fault.ready_at = 0;
+}
+
+/* hold xfer up until at, a now_ms() time.  Returns 1 if the callback
+ * should pause the transfer, or 0 once the time is up.  A paused transfer
+ * gets its data handed to the callback again when it is resumed, which is
+ * when this is called again; at is only looked at the first time.
+ */
+static int hold_until(struct transfer *xfer, double at)
+{
+  struct fault_injector *faults = &xfer->api->priv->faults;
+  struct fault_state *state = &xfer->fault;
+  double now = now_ms();
+
+  if (state->ready_at == 0) {
+    if (at <= now)
+      return 0;
+    state->ready_at = at;
+  }
+
+  if (state->blocking) {
+    sleep_ms(state->ready_at - now);
+    state->ready_at = 0;
+    return 0;
+  }
+
+  if (now >= state->ready_at) {
+    state->ready_at = 0;
+    return 0;
+  }
+
+  state->owner = pthread_self();
+  pthread_mutex_lock(&faults->lock);
+  state->next_paused = faults->paused;
+  faults->paused = xfer;
+  pthread_mutex_unlock(&faults->lock);
+
+  return 1;
+}
+
+static int hold(struct transfer *xfer, long ms)
+{
+  if (xfer->fault.ready_at == 0 && ms <= 0)
+    return 0;
+
+  return hold_until(xfer, now_ms() + ms);
+}
+
+/* called with the first bytes of the response headers, and again with
+ * every later piece of them
+ */
+int fault_headers(struct transfer *xfer)
+{
+  struct fault_state *state = &xfer->fault;
+
+  if (!state->active)
+    return FAULT_PASS;
+
+  if (state->answered)
+    return state->status != 0 ? FAULT_DROP : FAULT_PASS;
+
+  if (hold(xfer, state->latency_ms))
+    return FAULT_PAUSE;
+
+  state->answered = 1;
+
+  return state->status != 0 ? FAULT_ANSWER : FAULT_PASS;
+}
+
+/* called with every size bytes of the response body */
+int fault_body(struct transfer *xfer, size_t size)
+{
+  struct fault_state *state = &xfer->fault;
+
+  if (!state->active)
+    return FAULT_PASS;
+
+  if (state->status != 0)
+    return FAULT_DROP;
+
+  if (state->stall_ms > 0 && !state->stalled &&
+      state->received + size > state->stall_after) {
+    if (hold(xfer, state->stall_ms))
+      return FAULT_PAUSE;
+    state->stalled = 1;
+  }
+
+  /* the body may not get ahead of the bandwidth; this paces it, rather
+   * than the socket, which is all that a transport has anyway
+   */
+  if (state->bandwidth > 0) {
+    if (state->body_started == 0)
+      state->body_started = now_ms();
+    if (hold_until(xfer, state->body_started + (state->received + size) *
+		   1000.0 / state->bandwidth))
+      return FAULT_PAUSE;
+  }
+
+  state->received += size;
+
+  return FAULT_PASS;
+}
+
+/* must be called with faults->lock held; how long it is until the next of
+ * the transfers paused by this thread is due, or -1 if there are none
+ */
+static double next_due(struct fault_injector *faults, double now)
+{
+  struct transfer *xfer;
+  pthread_t self = pthread_self();
+  double next = -1;
+
+  for (xfer = faults->paused; xfer != NULL; xfer = xfer->fault.next_paused) {
+    if (!pthread_equal(xfer->fault.owner, self))
+      continue;
+    if (next < 0 || xfer->fault.ready_at - now < next)
+      next = xfer->fault.ready_at - now;
+  }
+
+  return next < 0 ? -1 : next > 0 ? next : 0;
+}
+
+/* get the transfers that this thread paused going again once their time is
+ * up.  Returns how many milliseconds it is until the next one of them is
+ * due, so that the caller does not wait for longer than that, or -1 if
+ * there are none left.
+ */
+long fault_resume(struct fault_injector *faults)
+{
+  struct transfer **curr;
+  struct transfer *xfer;
+  struct transfer *due = NULL;
+  pthread_t self = pthread_self();
+  double now = now_ms();
+  double next;
+
+  pthread_mutex_lock(&faults->lock);
+  curr = &faults->paused;
+  while ((xfer = *curr) != NULL) {
+    if (pthread_equal(xfer->fault.owner, self) &&
+	xfer->fault.ready_at <= now) {
+      *curr = xfer->fault.next_paused;
+      xfer->fault.next_paused = due;
+      due = xfer;
+    }
+    else
+      curr = &xfer->fault.next_paused;
+  }
+  pthread_mutex_unlock(&faults->lock);
+
+  /* unpausing runs the callbacks, which may pause the transfer again, so
+   * it has to be done outside of the lock
+   */
+  while ((xfer = due) != NULL) {
+    due = xfer->fault.next_paused;
+    xfer->fault.next_paused = NULL;
+    curl_easy_pause(xfer->curl, CURLPAUSE_CONT);
+  }
+
+  pthread_mutex_lock(&faults->lock);
+  next = next_due(faults, now_ms());
+  pthread_mutex_unlock(&faults->lock);
+
+  return next < 0 ? -1 : (long)ceil(next);
+}
+
+/* curl_multi_wait() on a multi handle whose transfers may be held up by
+ * faults.  Nothing wakes curl when one of those is due, so the wait is cut
+ * short then, and whatever is due by the end of it is resumed.
+ */
+CURLMcode fault_multi_wait(struct fault_injector *faults, CURLM *multi,
+			   long timeout_ms)
+{
+  CURLMcode mres;
+  long fault_ms;
+
+  fault_ms = fault_resume(faults);
+  if (fault_ms >= 0 && fault_ms < timeout_ms)
+    timeout_ms = fault_ms;
+
+  mres = curl_multi_wait(multi, NULL, 0, (int)timeout_ms, NULL);
+
+  fault_resume(faults);
+
+  return mres;
+}
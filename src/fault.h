@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#ifndef FAULT_H
+#define FAULT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <curl/curl.h>
+#include "libdeltacloud.h"
+
+struct transfer;
+
+/* one deltacloud_add_fault(), with the pattern copied */
+struct fault_rule {
+  struct deltacloud_fault fault;
+  char *pattern;
+
+  struct fault_rule *next;
+};
+
+/* the faults injected into the transfers of one deltacloud_api, and the
+ * transfers they are holding up.  A transfer in a multi handle cannot just
+ * sleep in its callbacks without holding up every other transfer in the
+ * handle, so it is paused instead, and whoever drives the multi handle
+ * calls fault_resume() to get it going again.
+ */
+struct fault_injector {
+  pthread_mutex_t lock;
+  struct fault_rule *rules; /* in the order they were added */
+  struct fault_rule *last;
+  unsigned int seed;
+  struct transfer *paused;
+};
+
+/* the fault, if any, that one transfer was picked for */
+struct fault_state {
+  int active;
+  int blocking; /* whether it may sleep rather than pause */
+  long latency_ms; /* drawn from the distribution of the rule */
+  long bandwidth;
+  size_t stall_after;
+  long stall_ms;
+  long status;
+
+  int answered; /* the response has started to arrive */
+  int stalled;
+  size_t received; /* body bytes passed on so far */
+  double body_started; /* when the first of them arrived */
+  double ready_at; /* when a pause is over, or 0 if there is none */
+  pthread_t owner; /* the thread that paused the transfer */
+  struct transfer *next_paused;
+};
+
+/* what the callbacks of a transfer are to do with what they were given */
+enum fault_action {
+  FAULT_PASS, /* carry on as usual */
+  FAULT_PAUSE, /* return CURL_WRITEFUNC_PAUSE */
+  FAULT_DROP, /* swallow it; the response is being replaced */
+  FAULT_ANSWER, /* replace the response with an error of fault.status */
+};
+
+int fault_injector_init(struct fault_injector *faults);
+void fault_injector_destroy(struct fault_injector *faults);
+int fault_injector_add(struct fault_injector *faults,
+		       const struct deltacloud_fault *fault);
+void fault_injector_clear(struct fault_injector *faults);
+
+void fault_transfer_setup(struct transfer *xfer);
+void fault_transfer_cleanup(struct transfer *xfer);
+int fault_headers(struct transfer *xfer);
+int fault_body(struct transfer *xfer, size_t size);
+long fault_resume(struct fault_injector *faults);
+CURLMcode fault_multi_wait(struct fault_injector *faults, CURLM *multi,
+			   long timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,6 +24,7 @@
 #include <string.h>
 #include "common.h"
 #include "firewall.h"
+#include "decoder.h"
 
 /** @file */
 
@@ -49,123 +50,129 @@ static void free_firewall_rule(struct deltacloud_firewall_rule *rule)
 	    free_firewall_rule_source);
 }
 
-static int parse_one_rule(xmlNodePtr cur, xmlXPathContextPtr ctxt, void *output)
+static const struct decode_field rule_source_fields[] = {
+  DECODE_ATTR_STRING("type", struct deltacloud_firewall_rule_source, type),
+  DECODE_ATTR_STRING("name", struct deltacloud_firewall_rule_source, name),
+  DECODE_ATTR_STRING("owner", struct deltacloud_firewall_rule_source, owner),
+  DECODE_ATTR_STRING("prefix", struct deltacloud_firewall_rule_source,
+		     prefix),
+  DECODE_ATTR_STRING("address", struct deltacloud_firewall_rule_source,
+		     address),
+  DECODE_ATTR_STRING("family", struct deltacloud_firewall_rule_source,
+		     family),
+  DECODE_END
+};
+
+static int parse_rule_sources(xmlNodePtr source_cur, xmlXPathContextPtr ctxt,
+			      void *field)
 {
-  struct deltacloud_firewall_rule *thisrule = (struct deltacloud_firewall_rule *)output;
+  struct deltacloud_firewall_rule_source **sources = (struct deltacloud_firewall_rule_source **)field;
   struct deltacloud_firewall_rule_source *thissource;
-  xmlNodePtr source_cur, oldnode, asource_cur;
-  int ret = -1;
+  xmlNodePtr asource_cur;
 
-  oldnode = ctxt->node;
-
-  memset(thisrule, 0, sizeof(struct deltacloud_firewall_rule));
+  for (asource_cur = source_cur->children; asource_cur != NULL;
+       asource_cur = asource_cur->next) {
+    if (asource_cur->type == XML_ELEMENT_NODE &&
+	STREQ((const char *)asource_cur->name, "source")) {
 
-  thisrule->href = getXPathString("string(./@href)", ctxt);
-  thisrule->id = getXPathString("string(./@id)", ctxt);
-  thisrule->allow_protocol = getXPathString("string(./allow_protocol)", ctxt);
-  thisrule->from_port = getXPathString("string(./port_from)", ctxt);
-  thisrule->to_port = getXPathString("string(./port_to)", ctxt);
-  thisrule->direction = getXPathString("string(./direction)", ctxt);
-
-  for (source_cur = cur->children; source_cur != NULL;
-       source_cur = source_cur->next) {
-    if (source_cur->type == XML_ELEMENT_NODE &&
-	STREQ((const char *)source_cur->name, "sources")) {
-
-      for (asource_cur = source_cur->children; asource_cur != NULL;
-	   asource_cur = asource_cur->next) {
-	if (asource_cur->type == XML_ELEMENT_NODE &&
-	    STREQ((const char *)asource_cur->name, "source")) {
-
-	  ctxt->node = asource_cur;
-
-	  thissource = calloc(1,
-			      sizeof(struct deltacloud_firewall_rule_source));
-	  if (thissource == NULL) {
-	    oom_error();
-	    goto cleanup;
-	  }
-
-	  thissource->type = getXPathString("string(./@type)", ctxt);
-	  thissource->name = getXPathString("string(./@name)", ctxt);
-	  thissource->owner = getXPathString("string(./@owner)", ctxt);
-	  thissource->prefix = getXPathString("string(./@prefix)", ctxt);
-	  thissource->address = getXPathString("string(./@address)", ctxt);
-	  thissource->family = getXPathString("string(./@family)", ctxt);
-
-	  /* add_to_list can't fail */
-	  add_to_list(&thisrule->sources,
-		      struct deltacloud_firewall_rule_source, thissource);
-	}
+      thissource = calloc(1, sizeof(struct deltacloud_firewall_rule_source));
+      if (thissource == NULL) {
+	oom_error();
+	return -1;
       }
+
+      /* can't fail; there are no callbacks in the table */
+      decode_element(asource_cur, ctxt, rule_source_fields, thissource);
+
+      /* add_to_list can't fail */
+      add_to_list(sources, struct deltacloud_firewall_rule_source,
+		  thissource);
     }
   }
 
-  ret = 0;
+  return 0;
+}
 
- cleanup:
-  ctxt->node = oldnode;
+static const struct decode_field rule_fields[] = {
+  DECODE_ATTR_STRING("href", struct deltacloud_firewall_rule, href),
+  DECODE_ATTR_STRING("id", struct deltacloud_firewall_rule, id),
+  DECODE_TEXT("allow_protocol", struct deltacloud_firewall_rule,
+	      allow_protocol),
+  DECODE_TEXT("port_from", struct deltacloud_firewall_rule, from_port),
+  DECODE_TEXT("port_to", struct deltacloud_firewall_rule, to_port),
+  DECODE_TEXT("direction", struct deltacloud_firewall_rule, direction),
+  DECODE_EACH("sources", struct deltacloud_firewall_rule, sources,
+	      parse_rule_sources),
+  DECODE_END
+};
 
-  return ret;
+static int parse_one_rule(xmlNodePtr cur, xmlXPathContextPtr ctxt, void *output)
+{
+  struct deltacloud_firewall_rule *thisrule = (struct deltacloud_firewall_rule *)output;
+
+  memset(thisrule, 0, sizeof(struct deltacloud_firewall_rule));
+
+  return decode_element(cur, ctxt, rule_fields, thisrule);
 }
 
-static int parse_one_firewall(xmlNodePtr cur, xmlXPathContextPtr ctxt,
-			      void *output)
+static int parse_firewall_rules(xmlNodePtr rule_cur, xmlXPathContextPtr ctxt,
+				void *field)
 {
-  struct deltacloud_firewall *thisfirewall = (struct deltacloud_firewall *)output;
+  struct deltacloud_firewall_rule **rules = (struct deltacloud_firewall_rule **)field;
   struct deltacloud_firewall_rule *thisrule;
-  xmlNodePtr rule_cur, arule_cur, oldnode;
-  int ret = -1;
+  xmlNodePtr arule_cur;
 
-  oldnode = ctxt->node;
+  for (arule_cur = rule_cur->children; arule_cur != NULL;
+       arule_cur = arule_cur->next) {
+    if (arule_cur->type == XML_ELEMENT_NODE &&
+	STREQ((const char *)arule_cur->name, "rule")) {
 
-  memset(thisfirewall, 0, sizeof(struct deltacloud_firewall));
+      thisrule = calloc(1, sizeof(struct deltacloud_firewall_rule));
+      if (thisrule == NULL) {
+	oom_error();
+	return -1;
+      }
 
-  thisfirewall->href = getXPathString("string(./@href)", ctxt);
-  thisfirewall->id = getXPathString("string(./@id)", ctxt);
-  thisfirewall->name = getXPathString("string(./name)", ctxt);
-  thisfirewall->description = getXPathString("string(./description)", ctxt);
-  thisfirewall->owner_id = getXPathString("string(./owner_id)", ctxt);
-
-  for (rule_cur = cur->children; rule_cur != NULL; rule_cur = rule_cur->next) {
-    if (rule_cur->type == XML_ELEMENT_NODE &&
-	STREQ((const char *)rule_cur->name, "rules")) {
-
-      for (arule_cur = rule_cur->children; arule_cur != NULL;
-	   arule_cur = arule_cur->next) {
-	if (arule_cur->type == XML_ELEMENT_NODE &&
-	    STREQ((const char *)arule_cur->name, "rule")) {
-
-	  ctxt->node = arule_cur;
-
-	  thisrule = calloc(1, sizeof(struct deltacloud_firewall_rule));
-	  if (thisrule == NULL) {
-	    oom_error();
-	    goto cleanup;
-	  }
-
-	  if (parse_one_rule(arule_cur, ctxt, thisrule) < 0) {
-	    /* parse_one_rule already set the error */
-	    SAFE_FREE(thisrule);
-	    goto cleanup;
-	  }
-
-	  /* add_to_list can't fail */
-	  add_to_list(&thisfirewall->rules, struct deltacloud_firewall_rule,
-		      thisrule);
-	}
+      if (parse_one_rule(arule_cur, ctxt, thisrule) < 0) {
+	/* parse_one_rule already set the error */
+	free_firewall_rule(thisrule);
+	SAFE_FREE(thisrule);
+	return -1;
       }
+
+      /* add_to_list can't fail */
+      add_to_list(rules, struct deltacloud_firewall_rule, thisrule);
     }
   }
 
-  ret = 0;
+  return 0;
+}
 
- cleanup:
-  ctxt->node = oldnode;
-  if (ret < 0)
+static const struct decode_field firewall_fields[] = {
+  DECODE_ATTR_STRING("href", struct deltacloud_firewall, href),
+  DECODE_ATTR_STRING("id", struct deltacloud_firewall, id),
+  DECODE_TEXT("name", struct deltacloud_firewall, name),
+  DECODE_TEXT("description", struct deltacloud_firewall, description),
+  DECODE_TEXT("owner_id", struct deltacloud_firewall, owner_id),
+  DECODE_EACH("rules", struct deltacloud_firewall, rules,
+	      parse_firewall_rules),
+  DECODE_END
+};
+
+static int parse_one_firewall(xmlNodePtr cur, xmlXPathContextPtr ctxt,
+			      void *output)
+{
+  struct deltacloud_firewall *thisfirewall = (struct deltacloud_firewall *)output;
+
+  memset(thisfirewall, 0, sizeof(struct deltacloud_firewall));
+
+  if (decode_element(cur, ctxt, firewall_fields, thisfirewall) < 0) {
+    /* parse_firewall_rules already set the error */
     deltacloud_free_firewall(thisfirewall);
+    return -1;
+  }
 
-  return ret;
+  return 0;
 }
 
 static int parse_firewall_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
@@ -211,6 +218,24 @@ static int parse_firewall_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
   return ret;
 }
 
+static int copy_firewall(struct deltacloud_firewall *dst,
+			 const struct deltacloud_firewall *src);
+static int copy_firewall_list(struct deltacloud_firewall **dst,
+			      const struct deltacloud_firewall *src);
+
+static const struct collection_type firewall_collection_type = {
+  .relname = "firewalls",
+  .rootname = "firewalls",
+  .list_cb = parse_firewall_xml,
+  .copy_all = (int (*)(void *, const void *))copy_firewall_list,
+  .free_all = (void (*)(void *))deltacloud_free_firewall_list,
+  .oneroot = "firewall",
+  .one_cb = parse_one_firewall,
+  .copy_one = (int (*)(void *, const void *))copy_firewall,
+  .free_one = (void (*)(void *))deltacloud_free_firewall,
+  .size = sizeof(struct deltacloud_firewall),
+};
+
 /**
  * A function to get a linked list of all of the firewalls.  The caller
  * is expected to free the list using deltacloud_free_firewall_list().
@@ -222,8 +247,7 @@ static int parse_firewall_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 int deltacloud_get_firewalls(struct deltacloud_api *api,
 			     struct deltacloud_firewall **firewalls)
 {
-  return internal_get(api, "firewalls", "firewalls", parse_firewall_xml,
-		      (void **)firewalls);
+  return internal_get(api, &firewall_collection_type, (void **)firewalls);
 }
 
 /**
@@ -238,8 +262,7 @@ int deltacloud_get_firewalls(struct deltacloud_api *api,
 int deltacloud_get_firewall_by_id(struct deltacloud_api *api, const char *id,
 				  struct deltacloud_firewall *firewall)
 {
-  return internal_get_by_id(api, id, "firewalls", "firewall",
-			    parse_one_firewall, firewall);
+  return internal_get_type_by_id(api, &firewall_collection_type, id, firewall);
 }
 
 /**
@@ -410,7 +433,7 @@ int deltacloud_firewall_delete_rule(struct deltacloud_api *api,
   if (!valid_api(api) || !valid_arg(rule))
     return -1;
 
-  return internal_destroy(rule->href, api->user, api->password, api->driver, api->provider);
+  return internal_destroy(api, rule->href);
 }
 
 /**
@@ -426,7 +449,7 @@ int deltacloud_firewall_destroy(struct deltacloud_api *api,
   if (!valid_api(api) || !valid_arg(firewall))
     return -1;
 
-  return internal_destroy(firewall->href, api->user, api->password, api->driver, api->provider);
+  return internal_destroy(api, firewall->href);
 }
 
 /**
@@ -458,3 +481,84 @@ void deltacloud_free_firewall_list(struct deltacloud_firewall **firewalls)
 {
   free_list(firewalls, struct deltacloud_firewall, deltacloud_free_firewall);
 }
+
+static void free_source_list(struct deltacloud_firewall_rule_source **sources)
+{
+  free_list(sources, struct deltacloud_firewall_rule_source,
+	    free_firewall_rule_source);
+}
+
+static int copy_source(struct deltacloud_firewall_rule_source *dst,
+		       const struct deltacloud_firewall_rule_source *src)
+{
+  if (copy_string(&dst->type, src->type) < 0 ||
+      copy_string(&dst->name, src->name) < 0 ||
+      copy_string(&dst->owner, src->owner) < 0 ||
+      copy_string(&dst->prefix, src->prefix) < 0 ||
+      copy_string(&dst->address, src->address) < 0 ||
+      copy_string(&dst->family, src->family) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_source_list(struct deltacloud_firewall_rule_source **dst,
+			    const struct deltacloud_firewall_rule_source *src)
+{
+  copy_list(dst, src, struct deltacloud_firewall_rule_source, copy_source,
+	    free_source_list);
+
+  return 0;
+}
+
+static void free_rule_list(struct deltacloud_firewall_rule **rules)
+{
+  free_list(rules, struct deltacloud_firewall_rule, free_firewall_rule);
+}
+
+static int copy_rule(struct deltacloud_firewall_rule *dst,
+		     const struct deltacloud_firewall_rule *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->allow_protocol, src->allow_protocol) < 0 ||
+      copy_string(&dst->from_port, src->from_port) < 0 ||
+      copy_string(&dst->to_port, src->to_port) < 0 ||
+      copy_string(&dst->direction, src->direction) < 0 ||
+      copy_source_list(&dst->sources, src->sources) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_rule_list(struct deltacloud_firewall_rule **dst,
+			  const struct deltacloud_firewall_rule *src)
+{
+  copy_list(dst, src, struct deltacloud_firewall_rule, copy_rule,
+	    free_rule_list);
+
+  return 0;
+}
+
+static int copy_firewall(struct deltacloud_firewall *dst,
+			 const struct deltacloud_firewall *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->name, src->name) < 0 ||
+      copy_string(&dst->description, src->description) < 0 ||
+      copy_string(&dst->owner_id, src->owner_id) < 0 ||
+      copy_rule_list(&dst->rules, src->rules) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_firewall_list(struct deltacloud_firewall **dst,
+			      const struct deltacloud_firewall *src)
+{
+  copy_list(dst, src, struct deltacloud_firewall, copy_firewall,
+	    deltacloud_free_firewall_list);
+
+  return 0;
+}
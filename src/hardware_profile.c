@@ -23,6 +23,7 @@
 #include <memory.h>
 #include "common.h"
 #include "hardware_profile.h"
+#include "decoder.h"
 
 /** @file */
 
@@ -124,46 +125,50 @@ static int parse_hwp_params_enums_ranges(xmlNodePtr property,
   return 0;
 }
 
-static int parse_hardware_profile_properties(xmlNodePtr hwp,
-					     struct deltacloud_property **props)
+static const struct decode_field property_fields[] = {
+  DECODE_ATTR("kind", struct deltacloud_property, kind),
+  DECODE_ATTR("name", struct deltacloud_property, name),
+  DECODE_ATTR("unit", struct deltacloud_property, unit),
+  DECODE_ATTR("value", struct deltacloud_property, value),
+  DECODE_END
+};
+
+static int parse_hardware_profile_property(xmlNodePtr property,
+					   xmlXPathContextPtr ctxt,
+					   void *field)
 {
-  xmlNodePtr profile_cur;
+  struct deltacloud_property **props = (struct deltacloud_property **)field;
   struct deltacloud_property *thisprop;
 
-  profile_cur = hwp->children;
-
-  while (profile_cur != NULL) {
-    if (profile_cur->type == XML_ELEMENT_NODE &&
-	STREQ((const char *)profile_cur->name, "property")) {
-
-      thisprop = calloc(1, sizeof(struct deltacloud_property));
-      if (thisprop == NULL) {
-	oom_error();
-	return -1;
-      }
-
-      thisprop->kind = (char *)xmlGetProp(profile_cur, BAD_CAST "kind");
-      thisprop->name = (char *)xmlGetProp(profile_cur, BAD_CAST "name");
-      thisprop->unit = (char *)xmlGetProp(profile_cur, BAD_CAST "unit");
-      thisprop->value = (char *)xmlGetProp(profile_cur, BAD_CAST "value");
-
-      if (parse_hwp_params_enums_ranges(profile_cur->children, thisprop) < 0) {
-	/* parse_hwp_params_enums_ranges already set the error */
-	free_prop(thisprop);
-	SAFE_FREE(thisprop);
-	return -1;
-      }
-
-      /* add_to_list can't fail */
-      add_to_list(props, struct deltacloud_property, thisprop);
-    }
+  thisprop = calloc(1, sizeof(struct deltacloud_property));
+  if (thisprop == NULL) {
+    oom_error();
+    return -1;
+  }
 
-    profile_cur = profile_cur->next;
+  if (decode_element(property, ctxt, property_fields, thisprop) < 0 ||
+      parse_hwp_params_enums_ranges(property->children, thisprop) < 0) {
+    /* parse_hwp_params_enums_ranges already set the error */
+    free_prop(thisprop);
+    SAFE_FREE(thisprop);
+    return -1;
   }
 
+  /* add_to_list can't fail */
+  add_to_list(props, struct deltacloud_property, thisprop);
+
   return 0;
 }
 
+static const struct decode_field hardware_profile_fields[] = {
+  DECODE_ATTR("href", struct deltacloud_hardware_profile, href),
+  DECODE_ATTR("id", struct deltacloud_hardware_profile, id),
+  DECODE_TEXT("name", struct deltacloud_hardware_profile, name),
+  DECODE_EACH("property", struct deltacloud_hardware_profile, properties,
+	      parse_hardware_profile_property),
+  DECODE_END
+};
+
 /** @cond INTERNAL */
 int parse_one_hardware_profile(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 			       void *output)
@@ -172,12 +177,8 @@ int parse_one_hardware_profile(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 
   memset(thishwp, 0, sizeof(struct deltacloud_hardware_profile));
 
-  thishwp->href = (char *)xmlGetProp(cur, BAD_CAST "href");
-  thishwp->id = (char *)xmlGetProp(cur, BAD_CAST "id");
-  thishwp->name = getXPathString("string(./name)", ctxt);
-
-  if (parse_hardware_profile_properties(cur, &(thishwp->properties)) < 0) {
-    /* parse_hardware_profile_properties already set the error */
+  if (decode_element(cur, ctxt, hardware_profile_fields, thishwp) < 0) {
+    /* parse_hardware_profile_property already set the error */
     deltacloud_free_hardware_profile(thishwp);
     return -1;
   }
@@ -231,6 +232,24 @@ int parse_hardware_profile_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 }
 /** @endcond */
 
+int copy_hardware_profile(struct deltacloud_hardware_profile *dst,
+			  const struct deltacloud_hardware_profile *src);
+static int copy_hardware_profile_list(struct deltacloud_hardware_profile **dst,
+				      const struct deltacloud_hardware_profile *src);
+
+static const struct collection_type hardware_profile_collection_type = {
+  .relname = "hardware_profiles",
+  .rootname = "hardware_profiles",
+  .list_cb = parse_hardware_profile_xml,
+  .copy_all = (int (*)(void *, const void *))copy_hardware_profile_list,
+  .free_all = (void (*)(void *))deltacloud_free_hardware_profile_list,
+  .oneroot = "hardware_profile",
+  .one_cb = parse_one_hardware_profile,
+  .copy_one = (int (*)(void *, const void *))copy_hardware_profile,
+  .free_one = (void (*)(void *))deltacloud_free_hardware_profile,
+  .size = sizeof(struct deltacloud_hardware_profile),
+};
+
 /**
  * A function to get a linked list of all of the hardware profiles supported.
  * The caller is expected to free the list using
@@ -243,8 +262,8 @@ int parse_hardware_profile_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 int deltacloud_get_hardware_profiles(struct deltacloud_api *api,
 				     struct deltacloud_hardware_profile **profiles)
 {
-  return internal_get(api, "hardware_profiles", "hardware_profiles",
-		      parse_hardware_profile_xml, (void **)profiles);
+  return internal_get(api, &hardware_profile_collection_type,
+		      (void **)profiles);
 }
 
 /**
@@ -261,8 +280,50 @@ int deltacloud_get_hardware_profile_by_id(struct deltacloud_api *api,
 					  const char *id,
 					  struct deltacloud_hardware_profile *profile)
 {
-  return internal_get_by_id(api, id, "hardware_profiles", "hardware_profile",
-			    parse_one_hardware_profile, profile);
+  return internal_get_type_by_id(api, &hardware_profile_collection_type, id,
+				 profile);
+}
+
+/**
+ * A function to start fetching the list of all of the hardware profiles
+ * without waiting for the result.  The callback runs from
+ * deltacloud_async_perform() with the list of hardware profiles, which it is
+ * expected to free using deltacloud_free_hardware_profile_list().
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] cb The function to call once the list has been fetched
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_hardware_profiles(struct deltacloud_api *api,
+					   deltacloud_async_cb cb,
+					   void *userdata)
+{
+  return internal_async_get(api, "hardware_profiles", "hardware_profiles",
+			    parse_hardware_profile_xml, cb, userdata);
+}
+
+/**
+ * A function to start looking up a particular hardware profile by id
+ * without waiting for the result.  On success the callback is handed the
+ * deltacloud_hardware_profile structure, which the caller is expected to
+ * free using deltacloud_free_hardware_profile().
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] id The hardware profile ID to look for
+ * @param[out] profile The deltacloud_hardware_profile structure to fill in
+ *                     if the ID is found; it must stay valid until cb has
+ *                     run
+ * @param[in] cb The function to call once the lookup has finished
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_hardware_profile_by_id(struct deltacloud_api *api,
+		const char *id, struct deltacloud_hardware_profile *profile,
+		deltacloud_async_cb cb, void *userdata)
+{
+  return internal_async_get_by_id(api, id, "hardware_profiles",
+				  "hardware_profile",
+				  parse_one_hardware_profile, profile, cb,
+				  userdata);
 }
 
 /**
@@ -293,3 +354,125 @@ void deltacloud_free_hardware_profile_list(struct deltacloud_hardware_profile **
   free_list(profiles, struct deltacloud_hardware_profile,
 	    deltacloud_free_hardware_profile);
 }
+
+static void free_range_list(struct deltacloud_property_range **ranges)
+{
+  free_list(ranges, struct deltacloud_property_range, free_range);
+}
+
+static int copy_range(struct deltacloud_property_range *dst,
+		      const struct deltacloud_property_range *src)
+{
+  if (copy_string(&dst->first, src->first) < 0 ||
+      copy_string(&dst->last, src->last) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_range_list(struct deltacloud_property_range **dst,
+			   const struct deltacloud_property_range *src)
+{
+  copy_list(dst, src, struct deltacloud_property_range, copy_range,
+	    free_range_list);
+
+  return 0;
+}
+
+static void free_enum_list(struct deltacloud_property_enum **enums)
+{
+  free_list(enums, struct deltacloud_property_enum, free_enum);
+}
+
+static int copy_enum(struct deltacloud_property_enum *dst,
+		     const struct deltacloud_property_enum *src)
+{
+  return copy_string(&dst->value, src->value);
+}
+
+static int copy_enum_list(struct deltacloud_property_enum **dst,
+			  const struct deltacloud_property_enum *src)
+{
+  copy_list(dst, src, struct deltacloud_property_enum, copy_enum,
+	    free_enum_list);
+
+  return 0;
+}
+
+static void free_param_list(struct deltacloud_property_param **params)
+{
+  free_list(params, struct deltacloud_property_param, free_param);
+}
+
+static int copy_param(struct deltacloud_property_param *dst,
+		      const struct deltacloud_property_param *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->method, src->method) < 0 ||
+      copy_string(&dst->name, src->name) < 0 ||
+      copy_string(&dst->operation, src->operation) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_param_list(struct deltacloud_property_param **dst,
+			   const struct deltacloud_property_param *src)
+{
+  copy_list(dst, src, struct deltacloud_property_param, copy_param,
+	    free_param_list);
+
+  return 0;
+}
+
+static void free_prop_list(struct deltacloud_property **props)
+{
+  free_list(props, struct deltacloud_property, free_prop);
+}
+
+static int copy_prop(struct deltacloud_property *dst,
+		     const struct deltacloud_property *src)
+{
+  if (copy_string(&dst->kind, src->kind) < 0 ||
+      copy_string(&dst->name, src->name) < 0 ||
+      copy_string(&dst->unit, src->unit) < 0 ||
+      copy_string(&dst->value, src->value) < 0 ||
+      copy_param_list(&dst->params, src->params) < 0 ||
+      copy_enum_list(&dst->enums, src->enums) < 0 ||
+      copy_range_list(&dst->ranges, src->ranges) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_prop_list(struct deltacloud_property **dst,
+			  const struct deltacloud_property *src)
+{
+  copy_list(dst, src, struct deltacloud_property, copy_prop, free_prop_list);
+
+  return 0;
+}
+
+/** @cond INTERNAL */
+/* dst must be zeroed; on failure it is left for the caller to free */
+int copy_hardware_profile(struct deltacloud_hardware_profile *dst,
+			  const struct deltacloud_hardware_profile *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->name, src->name) < 0 ||
+      copy_prop_list(&dst->properties, src->properties) < 0)
+    return -1;
+
+  return 0;
+}
+/** @endcond */
+
+static int copy_hardware_profile_list(struct deltacloud_hardware_profile **dst,
+				      const struct deltacloud_hardware_profile *src)
+{
+  copy_list(dst, src, struct deltacloud_hardware_profile,
+	    copy_hardware_profile, deltacloud_free_hardware_profile_list);
+
+  return 0;
+}
@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "curl_action.h"
+#include "hedge.h"
+#include "retry.h"
+
+int hedge_policy_init(struct hedge_policy *policy)
+{
+  memset(policy, 0, sizeof(struct hedge_policy));
+
+  if (pthread_mutex_init(&policy->lock, NULL) != 0) {
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to initialize hedge lock");
+    return -1;
+  }
+
+  return 0;
+}
+
+void hedge_policy_destroy(struct hedge_policy *policy)
+{
+  struct hedge_stats *stats;
+  struct hedge_stats *next;
+  int i;
+
+  stats = policy->stats;
+  while (stats != NULL) {
+    next = stats->next;
+    SAFE_FREE(stats->name);
+    SAFE_FREE(stats);
+    stats = next;
+  }
+  policy->stats = NULL;
+
+  for (i = 0; i < policy->nidle; i++)
+    curl_multi_cleanup(policy->idle[i]);
+  policy->nidle = 0;
+
+  pthread_mutex_destroy(&policy->lock);
+}
+
+void hedge_policy_set(struct hedge_policy *policy, int percentile,
+		      long min_delay_ms)
+{
+  struct hedge_stats *stats;
+
+  pthread_mutex_lock(&policy->lock);
+  policy->percentile = percentile;
+  policy->min_delay_ms = min_delay_ms;
+  /* the deadlines were computed for the old percentile */
+  for (stats = policy->stats; stats != NULL; stats = stats->next)
+    stats->fresh = HEDGE_RECOMPUTE;
+  pthread_mutex_unlock(&policy->lock);
+}
+
+/* close the connections that hedged GETs have left open, so that new ones
+ * pick up changed connection settings
+ */
+void hedge_policy_flush(struct hedge_policy *policy)
+{
+  CURLM *idle[HEDGE_MAX_IDLE];
+  int nidle;
+  int i;
+
+  pthread_mutex_lock(&policy->lock);
+  nidle = policy->nidle;
+  memcpy(idle, policy->idle, nidle * sizeof(CURLM *));
+  policy->nidle = 0;
+  pthread_mutex_unlock(&policy->lock);
+
+  for (i = 0; i < nidle; i++)
+    curl_multi_cleanup(idle[i]);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* must be called with policy->lock held.  NULL if there is no entry for
+ * name yet and one cannot be made; hedging is only an optimization, so
+ * that is not an error.
+ */
+static struct hedge_stats *find_stats(struct hedge_policy *policy,
+				      const char *name)
+{
+  struct hedge_stats *stats;
+
+  for (stats = policy->stats; stats != NULL; stats = stats->next) {
+    if (STREQ(stats->name, name))
+      return stats;
+  }
+
+  stats = calloc(1, sizeof(struct hedge_stats));
+  if (stats == NULL)
+    return NULL;
+  stats->name = strdup(name);
+  if (stats->name == NULL) {
+    SAFE_FREE(stats);
+    return NULL;
+  }
+  stats->deadline_ms = -1;
+
+  stats->next = policy->stats;
+  policy->stats = stats;
+
+  return stats;
+}
+
+/* must be called with policy->lock held */
+static void compute_deadline(struct hedge_policy *policy,
+			     struct hedge_stats *stats)
+{
+  double sorted[HEDGE_SAMPLES];
+  int index;
+
+  stats->fresh = 0;
+  if (stats->count < HEDGE_MIN_SAMPLES) {
+    stats->deadline_ms = -1;
+    return;
+  }
+
+  memcpy(sorted, stats->samples, stats->count * sizeof(double));
+  qsort(sorted, stats->count, sizeof(double), compare_doubles);
+  index = (stats->count * policy->percentile + 99) / 100 - 1;
+  if (index < 0)
+    index = 0;
+  stats->deadline_ms = sorted[index];
+}
+
+/* whether hedging is on at all, and if so, how many milliseconds a GET of
+ * kind name may take before it is hedged in *deadline; that is negative
+ * while there are too few latencies to go by
+ */
+static int get_deadline(struct hedge_policy *policy, const char *name,
+			double *deadline)
+{
+  struct hedge_stats *stats;
+  int on;
+
+  *deadline = -1;
+
+  pthread_mutex_lock(&policy->lock);
+  on = policy->percentile > 0;
+  if (on) {
+    stats = find_stats(policy, name);
+    if (stats != NULL) {
+      if (stats->fresh >= HEDGE_RECOMPUTE)
+	compute_deadline(policy, stats);
+      *deadline = stats->deadline_ms;
+      if (*deadline >= 0 && *deadline < policy->min_delay_ms)
+	*deadline = policy->min_delay_ms;
+    }
+  }
+  pthread_mutex_unlock(&policy->lock);
+
+  return on;
+}
+
+static void record_latency(struct hedge_policy *policy, const char *name,
+			   double ms)
+{
+  struct hedge_stats *stats;
+
+  pthread_mutex_lock(&policy->lock);
+  stats = find_stats(policy, name);
+  if (stats != NULL) {
+    stats->samples[stats->pos] = ms;
+    stats->pos = (stats->pos + 1) % HEDGE_SAMPLES;
+    if (stats->count < HEDGE_SAMPLES)
+      stats->count++;
+    stats->fresh++;
+    if (stats->deadline_ms < 0 && stats->count >= HEDGE_MIN_SAMPLES)
+      compute_deadline(policy, stats);
+  }
+  pthread_mutex_unlock(&policy->lock);
+}
+
+static CURLM *checkout_multi(struct hedge_policy *policy)
+{
+  CURLM *multi = NULL;
+
+  pthread_mutex_lock(&policy->lock);
+  if (policy->nidle > 0)
+    multi = policy->idle[--policy->nidle];
+  pthread_mutex_unlock(&policy->lock);
+
+  if (multi == NULL) {
+    multi = curl_multi_init();
+    if (multi != NULL)
+      transfer_multi_setup(multi);
+  }
+
+  return multi;
+}
+
+static void return_multi(struct hedge_policy *policy, CURLM *multi)
+{
+  pthread_mutex_lock(&policy->lock);
+  if (policy->nidle < HEDGE_MAX_IDLE) {
+    policy->idle[policy->nidle++] = multi;
+    multi = NULL;
+  }
+  pthread_mutex_unlock(&policy->lock);
+
+  if (multi != NULL)
+    curl_multi_cleanup(multi);
+}
+
+/* start the second copy of a GET.  The hedge is only worth sending if it
+ * can go out now, so it is skipped rather than made to wait for the rate
+ * limiter.
+ */
+static int start_hedge(struct deltacloud_api *api, CURLM *multi,
+		       struct transfer *hedge, hedge_prepare_cb prepare,
+		       void *arg)
+{
+  if (!rate_limiter_ready(api->priv->limiter, RATE_READ))
+    return 0;
+
+  if (prepare(hedge, arg) < 0) {
+    transfer_cleanup(hedge);
+    return 0;
+  }
+
+  if (curl_multi_add_handle(multi, hedge->curl) != CURLM_OK) {
+    transfer_cleanup(hedge);
+    return 0;
+  }
+
+  return 1;
+}
+
+/* race xfer, already added to multi, against a copy of it started at
+ * deadline milliseconds.  Returns the result of the winner, which is left
+ * in xfer.
+ */
+static CURLcode race(struct deltacloud_api *api, CURLM *multi,
+		     struct transfer *xfer, double deadline,
+		     hedge_prepare_cb prepare, void *arg)
+{
+  struct hedge_policy *policy = &api->priv->hedge;
+  struct transfer hedge;
+  CURLcode results[2] = { CURLE_OK, CURLE_OK };
+  int ok[2] = { 0, 0 }; /* 1 for an answer worth keeping */
+  CURLMcode mres;
+  CURLMsg *msg;
+  double start[2];
+  double elapsed;
+  long wait_ms;
+  int done[2] = { 0, 0 };
+  int fired = 0; /* 1 if the hedge is running, -1 if it could not be */
+  int winner = -1;
+  int running;
+  int left;
+  int i;
+
+  memset(&hedge, 0, sizeof(struct transfer));
+  start[0] = now_ms();
+  start[1] = 0;
+
+  for (;;) {
+    mres = curl_multi_perform(multi, &running);
+    if (mres != CURLM_OK)
+      break;
+
+    while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+      if (msg->msg != CURLMSG_DONE)
+	continue;
+      i = msg->easy_handle == xfer->curl ? 0 : 1;
+      done[i] = 1;
+      results[i] = msg->data.result;
+      /* a server that is overloaded or throttling may well answer the
+       * other copy properly, so such an answer does not win outright
+       */
+      ok[i] = results[i] == CURLE_OK &&
+	!retry_transient_status(transfer_response_code(i == 0 ? xfer :
+							&hedge));
+    }
+
+    /* the first to succeed wins; a failure only counts once there is
+     * nothing else left to wait for
+     */
+    if (done[0] && ok[0])
+      winner = 0;
+    else if (done[1] && ok[1])
+      winner = 1;
+    else if (done[0] && (fired != 1 || done[1]))
+      /* an HTTP answer, even a bad one, says more than none */
+      winner = done[1] && results[0] != CURLE_OK && results[1] == CURLE_OK;
+    if (winner >= 0)
+      break;
+
+    elapsed = now_ms() - start[0];
+    if (fired == 0 && elapsed >= deadline) {
+      fired = start_hedge(api, multi, &hedge, prepare, arg) ? 1 : -1;
+      start[1] = now_ms();
+    }
+
+    wait_ms = fired != 0 ? 1000 : (long)(deadline - elapsed) + 1;
+    mres = fault_multi_wait(&api->priv->faults, multi, wait_ms);
+    if (mres != CURLM_OK)
+      break;
+  }
+
+  if (winner < 0) {
+    /* the multi handle itself failed, which leaves nothing to report but
+     * the failure
+     */
+    winner = 0;
+    results[0] = CURLE_FAILED_INIT;
+  }
+
+  /* removing a transfer that is still running abandons it */
+  curl_multi_remove_handle(multi, xfer->curl);
+  if (fired == 1)
+    curl_multi_remove_handle(multi, hedge.curl);
+
+  if (ok[winner])
+    record_latency(policy, xfer->xml_name != NULL ? xfer->xml_name : "",
+		   now_ms() - start[winner]);
+
+  if (fired == 1)
+    transfer_stats_count_hedge(&api->priv->stats, winner == 1 && ok[1]);
+
+  if (winner == 1) {
+    /* both transfers are finished with, so nothing refers to the old
+     * address of hedge any more
+     */
+    transfer_cleanup(xfer);
+    memcpy(xfer, &hedge, sizeof(struct transfer));
+  }
+  else if (fired == 1)
+    transfer_cleanup(&hedge);
+
+  return results[winner];
+}
+
+/* perform the GET that prepare set up in xfer, like curl_easy_perform()
+ * does, hedging it if the hedging policy of the api says so.  prepare is
+ * called again to set up the copy.
+ */
+CURLcode hedge_perform(struct deltacloud_api *api, struct transfer *xfer,
+		       hedge_prepare_cb prepare, void *arg)
+{
+  struct hedge_policy *policy = &api->priv->hedge;
+  const char *name = xfer->xml_name != NULL ? xfer->xml_name : "";
+  CURLM *multi;
+  CURLcode res;
+  double deadline;
+  double start;
+
+  /* a transport of the api's own has no connections to race on */
+  if (api->priv->transport != NULL || !get_deadline(policy, name, &deadline))
+    return transfer_perform(xfer);
+
+  if (deadline >= 0) {
+    multi = checkout_multi(policy);
+    if (multi != NULL) {
+      if (curl_multi_add_handle(multi, xfer->curl) == CURLM_OK) {
+	res = race(api, multi, xfer, deadline, prepare, arg);
+	return_multi(policy, multi);
+	return res;
+      }
+      return_multi(policy, multi);
+    }
+  }
+
+  /* not enough latencies to go by yet */
+  start = now_ms();
+  res = transfer_perform(xfer);
+  if (res == CURLE_OK)
+    record_latency(policy, name, now_ms() - start);
+
+  return res;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#ifndef HEDGE_H
+#define HEDGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <curl/curl.h>
+
+/* how many of the most recent latencies the deadline is computed from */
+#define HEDGE_SAMPLES 128
+/* no hedging until this many latencies have been seen */
+#define HEDGE_MIN_SAMPLES 20
+/* the deadline is computed again after this many new latencies */
+#define HEDGE_RECOMPUTE 16
+/* idle multi handles kept around, along with their connections */
+#define HEDGE_MAX_IDLE 4
+
+/* recent latencies of one kind of GET, keyed on the root element the
+ * response is expected to have; "instance" and "instances" take very
+ * different times, so they get separate deadlines
+ */
+struct hedge_stats {
+  char *name;
+  double samples[HEDGE_SAMPLES]; /* milliseconds, a ring */
+  int count; /* samples in use */
+  int pos; /* where the next one goes */
+  int fresh; /* samples since the deadline was computed */
+  double deadline_ms; /* negative until there are enough samples */
+
+  struct hedge_stats *next;
+};
+
+/* A GET that has not finished by the percentile-th percentile of the
+ * latencies of its kind gets a second copy sent on another connection.
+ * Whichever answers first is used, and the other is abandoned.
+ */
+struct hedge_policy {
+  pthread_mutex_t lock;
+  int percentile; /* 0 turns hedging off */
+  long min_delay_ms; /* never hedge sooner than this */
+  struct hedge_stats *stats;
+
+  /* the transfers of a hedged GET run on a multi handle rather than with
+   * curl_easy_perform(), and the connections they leave behind belong to
+   * that multi handle; keeping it around lets the next GET reuse them
+   */
+  CURLM *idle[HEDGE_MAX_IDLE];
+  int nidle;
+};
+
+struct deltacloud_api;
+struct transfer;
+
+/* sets up xfer from scratch, exactly like the transfer it is a copy of */
+typedef int (*hedge_prepare_cb)(struct transfer *xfer, void *arg);
+
+int hedge_policy_init(struct hedge_policy *policy);
+void hedge_policy_destroy(struct hedge_policy *policy);
+void hedge_policy_set(struct hedge_policy *policy, int percentile,
+		      long min_delay_ms);
+void hedge_policy_flush(struct hedge_policy *policy);
+
+CURLcode hedge_perform(struct deltacloud_api *api, struct transfer *xfer,
+		       hedge_prepare_cb prepare, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
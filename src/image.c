@@ -23,9 +23,21 @@
 #include <string.h>
 #include "common.h"
 #include "image.h"
+#include "decoder.h"
 
 /** @file */
 
+static const struct decode_field image_fields[] = {
+  DECODE_ATTR("href", struct deltacloud_image, href),
+  DECODE_ATTR("id", struct deltacloud_image, id),
+  DECODE_TEXT("description", struct deltacloud_image, description),
+  DECODE_TEXT("architecture", struct deltacloud_image, architecture),
+  DECODE_TEXT("owner_id", struct deltacloud_image, owner_id),
+  DECODE_TEXT("name", struct deltacloud_image, name),
+  DECODE_TEXT("state", struct deltacloud_image, state),
+  DECODE_END
+};
+
 static int parse_one_image(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 			   void *output)
 {
@@ -33,15 +45,7 @@ static int parse_one_image(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 
   memset(thisimage, 0, sizeof(struct deltacloud_image));
 
-  thisimage->href = (char *)xmlGetProp(cur, BAD_CAST "href");
-  thisimage->id = (char *)xmlGetProp(cur, BAD_CAST "id");
-  thisimage->description = getXPathString("string(./description)", ctxt);
-  thisimage->architecture = getXPathString("string(./architecture)", ctxt);
-  thisimage->owner_id = getXPathString("string(./owner_id)", ctxt);
-  thisimage->name = getXPathString("string(./name)", ctxt);
-  thisimage->state = getXPathString("string(./state)", ctxt);
-
-  return 0;
+  return decode_element(cur, ctxt, image_fields, thisimage);
 }
 
 static int parse_image_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
@@ -88,6 +92,24 @@ static int parse_image_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
   return ret;
 }
 
+static int copy_image(struct deltacloud_image *dst,
+		      const struct deltacloud_image *src);
+static int copy_image_list(struct deltacloud_image **dst,
+			   const struct deltacloud_image *src);
+
+static const struct collection_type image_collection_type = {
+  .relname = "images",
+  .rootname = "images",
+  .list_cb = parse_image_xml,
+  .copy_all = (int (*)(void *, const void *))copy_image_list,
+  .free_all = (void (*)(void *))deltacloud_free_image_list,
+  .oneroot = "image",
+  .one_cb = parse_one_image,
+  .copy_one = (int (*)(void *, const void *))copy_image,
+  .free_one = (void (*)(void *))deltacloud_free_image,
+  .size = sizeof(struct deltacloud_image),
+};
+
 /**
  * A function to get a linked list of all of the images.  The caller
  * is expected to free the list using deltacloud_free_image_list().
@@ -99,8 +121,23 @@ static int parse_image_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 int deltacloud_get_images(struct deltacloud_api *api,
 			  struct deltacloud_image **images)
 {
-  return internal_get(api, "images", "images", parse_image_xml,
-		      (void **)images);
+  return internal_get(api, &image_collection_type, (void **)images);
+}
+
+/**
+ * A function to hand each image to a callback as soon as it has been
+ * downloaded, without building a list of them.  See deltacloud_visit_cb for
+ * what the callback may do with the deltacloud_image structure.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] visitor The function to call with each image
+ * @param[in] userdata A pointer that is passed through to visitor
+ * @returns 0 on success, including when visitor stops early, -1 on error
+ */
+int deltacloud_foreach_image(struct deltacloud_api *api,
+			     deltacloud_visit_cb visitor, void *userdata)
+{
+  return internal_foreach(api, &image_collection_type, NULL, visitor,
+			  userdata);
 }
 
 /**
@@ -115,7 +152,60 @@ int deltacloud_get_images(struct deltacloud_api *api,
 int deltacloud_get_image_by_id(struct deltacloud_api *api, const char *id,
 			       struct deltacloud_image *image)
 {
-  return internal_get_by_id(api, id, "images", "image", parse_one_image, image);
+  return internal_get_type_by_id(api, &image_collection_type, id, image);
+}
+
+/**
+ * A function to look up a particular image by name.  The caller is expected
+ * to free the deltacloud_image structure using deltacloud_free_image().
+ * Note that deltacloud does not guarantee that image names are unique; this
+ * function will only find and return the first image with the desired name.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] name The image name to look for
+ * @param[out] image The deltacloud_image structure to fill in if the name is
+ *                   found
+ * @returns 0 on success, -1 if the image cannot be found or on error
+ */
+int deltacloud_get_image_by_name(struct deltacloud_api *api, const char *name,
+				 struct deltacloud_image *image)
+{
+  return internal_get_by_name(api, &image_collection_type, name, image);
+}
+
+static const struct batch_type image_batch_type = {
+  .relname = "images",
+  .listroot = "images",
+  .oneroot = "image",
+  .list_cb = parse_image_xml,
+  .one_cb = parse_one_image,
+  .free_all = (void (*)(void *))deltacloud_free_image_list,
+  .size = sizeof(struct deltacloud_image),
+  .id_offset = offsetof(struct deltacloud_image, id),
+  .next_offset = offsetof(struct deltacloud_image, next),
+};
+
+/**
+ * A function to look up several images by id at once.  The requests are
+ * issued concurrently, up to the window set with
+ * deltacloud_set_batch_window(), so n lookups cost far fewer than n round
+ * trips.  The caller is expected to free each deltacloud_image structure
+ * using deltacloud_free_image(); the entries of failed lookups are left
+ * zeroed, and freeing those is harmless.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] ids The array of n image IDs to look for
+ * @param[in] n The number of IDs
+ * @param[out] images An array of n deltacloud_image structures; entry i is
+ *                    filled in from ids[i]
+ * @param[out] errors An array of n error codes; entry i is set to 0 if
+ *                    ids[i] was found, or to the DELTACLOUD_*_ERROR of that
+ *                    lookup otherwise.  May be NULL
+ * @returns 0 if every image was found, -1 if any lookup failed or on error
+ */
+int deltacloud_get_images_by_ids(struct deltacloud_api *api, const char **ids,
+				 int n, struct deltacloud_image *images,
+				 int *errors)
+{
+  return internal_get_by_ids(api, &image_batch_type, ids, n, images, errors);
 }
 
 /**
@@ -199,6 +289,45 @@ int deltacloud_create_image(struct deltacloud_api *api, const char *name,
   return ret;
 }
 
+/**
+ * A function to start fetching the list of all of the images without
+ * waiting for the result.  The callback runs from deltacloud_async_perform()
+ * with the list of images, which it is expected to free using
+ * deltacloud_free_image_list().
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] cb The function to call once the list has been fetched
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_images(struct deltacloud_api *api,
+				deltacloud_async_cb cb, void *userdata)
+{
+  return internal_async_get(api, "images", "images", parse_image_xml,
+			    cb, userdata);
+}
+
+/**
+ * A function to start looking up a particular image by id without waiting
+ * for the result.  On success the callback is handed the deltacloud_image
+ * structure, which the caller is expected to free using
+ * deltacloud_free_image().
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] id The image ID to look for
+ * @param[out] image The deltacloud_image structure to fill in if the ID is
+ *             found; it must stay valid until cb has run
+ * @param[in] cb The function to call once the lookup has finished
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_image_by_id(struct deltacloud_api *api,
+				     const char *id,
+				     struct deltacloud_image *image,
+				     deltacloud_async_cb cb, void *userdata)
+{
+  return internal_async_get_by_id(api, id, "images", "image",
+				  parse_one_image, image, cb, userdata);
+}
+
 /**
  * A function to free a deltacloud_image structure initially allocated
  * by deltacloud_get_image_by_id().
@@ -227,3 +356,27 @@ void deltacloud_free_image_list(struct deltacloud_image **images)
 {
   free_list(images, struct deltacloud_image, deltacloud_free_image);
 }
+
+static int copy_image(struct deltacloud_image *dst,
+		      const struct deltacloud_image *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->description, src->description) < 0 ||
+      copy_string(&dst->architecture, src->architecture) < 0 ||
+      copy_string(&dst->owner_id, src->owner_id) < 0 ||
+      copy_string(&dst->name, src->name) < 0 ||
+      copy_string(&dst->state, src->state) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_image_list(struct deltacloud_image **dst,
+			   const struct deltacloud_image *src)
+{
+  copy_list(dst, src, struct deltacloud_image, copy_image,
+	    deltacloud_free_image_list);
+
+  return 0;
+}
@@ -24,6 +24,7 @@
 #include "common.h"
 #include "instance.h"
 #include "curl_action.h"
+#include "decoder.h"
 
 /** @file */
 
@@ -33,83 +34,67 @@
  * from having to have -I/path/to/libxml2/headers in their build paths.
  */
 int parse_addresses_xml(xmlNodePtr root, xmlXPathContextPtr ctxt,
-			struct deltacloud_address **addresses);
-int parse_actions_xml(xmlNodePtr root, struct deltacloud_action **actions);
+			void *data);
+int parse_actions_xml(xmlNodePtr root, xmlXPathContextPtr ctxt, void *data);
 int parse_one_hardware_profile(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 			       void *output);
+int copy_address_list(struct deltacloud_address **dst,
+		      const struct deltacloud_address *src);
+int copy_action_list(struct deltacloud_action **dst,
+		     const struct deltacloud_action *src);
+int copy_hardware_profile(struct deltacloud_hardware_profile *dst,
+			  const struct deltacloud_hardware_profile *src);
 /** @endcond */
 
+static const struct decode_field instance_login_fields[] = {
+  DECODE_TEXT("keyname", struct deltacloud_instance, auth.keyname),
+  DECODE_TEXT("username", struct deltacloud_instance, auth.username),
+  DECODE_TEXT("password", struct deltacloud_instance, auth.password),
+  DECODE_END
+};
+
+static const struct decode_field instance_auth_fields[] = {
+  DECODE_NESTED("login", instance_login_fields),
+  DECODE_END
+};
+
+static const struct decode_field instance_fields[] = {
+  DECODE_ATTR("href", struct deltacloud_instance, href),
+  DECODE_ATTR("id", struct deltacloud_instance, id),
+  DECODE_TEXT("name", struct deltacloud_instance, name),
+  DECODE_TEXT("owner_id", struct deltacloud_instance, owner_id),
+  DECODE_CHILD_ATTR("image", "id", struct deltacloud_instance, image_id),
+  DECODE_CHILD_ATTR("image", "href", struct deltacloud_instance, image_href),
+  DECODE_CHILD_ATTR("realm", "id", struct deltacloud_instance, realm_id),
+  DECODE_CHILD_ATTR("realm", "href", struct deltacloud_instance, realm_href),
+  DECODE_TEXT("state", struct deltacloud_instance, state),
+  DECODE_TEXT("launch_time", struct deltacloud_instance, launch_time),
+  DECODE_CHILD("hardware_profile", struct deltacloud_instance, hwp,
+	       parse_one_hardware_profile),
+  DECODE_CHILD("actions", struct deltacloud_instance, actions,
+	       parse_actions_xml),
+  DECODE_CHILD("public_addresses", struct deltacloud_instance,
+	       public_addresses, parse_addresses_xml),
+  DECODE_CHILD("private_addresses", struct deltacloud_instance,
+	       private_addresses, parse_addresses_xml),
+  DECODE_CHILD_ATTR("authentication", "type", struct deltacloud_instance,
+		    auth.type),
+  DECODE_NESTED("authentication", instance_auth_fields),
+  DECODE_END
+};
+
 static int parse_one_instance(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 			      void *output)
 {
   struct deltacloud_instance *thisinst = (struct deltacloud_instance *)output;
-  xmlXPathObjectPtr hwpset, actionset, pubset, privset;
 
   memset(thisinst, 0, sizeof(struct deltacloud_instance));
 
-  thisinst->href = (char *)xmlGetProp(cur, BAD_CAST "href");
-  thisinst->id = (char *)xmlGetProp(cur, BAD_CAST "id");
-  thisinst->name = getXPathString("string(./name)", ctxt);
-  thisinst->owner_id = getXPathString("string(./owner_id)", ctxt);
-  thisinst->image_id = getXPathString("string(./image/@id)", ctxt);
-  thisinst->image_href = getXPathString("string(./image/@href)", ctxt);
-  thisinst->realm_id = getXPathString("string(./realm/@id)", ctxt);
-  thisinst->realm_href = getXPathString("string(./realm/@href)", ctxt);
-  thisinst->state = getXPathString("string(./state)", ctxt);
-  thisinst->launch_time = getXPathString("string(./launch_time)", ctxt);
-
-  hwpset = xmlXPathEval(BAD_CAST "./hardware_profile", ctxt);
-  if (hwpset && hwpset->type == XPATH_NODESET && hwpset->nodesetval &&
-      hwpset->nodesetval->nodeNr == 1) {
-    if (parse_one_hardware_profile(hwpset->nodesetval->nodeTab[0], ctxt,
-				   &thisinst->hwp) < 0) {
-      deltacloud_free_instance(thisinst);
-      xmlXPathFreeObject(hwpset);
-      return -1;
-    }
-  }
-  xmlXPathFreeObject(hwpset);
-
-  actionset = xmlXPathEval(BAD_CAST "./actions", ctxt);
-  if (actionset && actionset->type == XPATH_NODESET &&
-      actionset->nodesetval && actionset->nodesetval->nodeNr == 1) {
-    if (parse_actions_xml(actionset->nodesetval->nodeTab[0],
-			  &(thisinst->actions)) < 0) {
-      deltacloud_free_instance(thisinst);
-      xmlXPathFreeObject(actionset);
-      return -1;
-    }
-  }
-  xmlXPathFreeObject(actionset);
-
-  pubset = xmlXPathEval(BAD_CAST "./public_addresses", ctxt);
-  if (pubset && pubset->type == XPATH_NODESET && pubset->nodesetval &&
-      pubset->nodesetval->nodeNr == 1) {
-    if (parse_addresses_xml(pubset->nodesetval->nodeTab[0], ctxt,
-			    &(thisinst->public_addresses)) < 0) {
-      deltacloud_free_instance(thisinst);
-      xmlXPathFreeObject(pubset);
-      return -1;
-    }
-  }
-  xmlXPathFreeObject(pubset);
-
-  privset = xmlXPathEval(BAD_CAST "./private_addresses", ctxt);
-  if (privset && privset->type == XPATH_NODESET && privset->nodesetval &&
-      privset->nodesetval->nodeNr == 1) {
-    if (parse_addresses_xml(privset->nodesetval->nodeTab[0], ctxt,
-			    &(thisinst->private_addresses)) < 0) {
-      deltacloud_free_instance(thisinst);
-      xmlXPathFreeObject(privset);
-      return -1;
-    }
+  if (decode_element(cur, ctxt, instance_fields, thisinst) < 0) {
+    /* the callbacks are expected to have set their own errors */
+    deltacloud_free_instance(thisinst);
+    return -1;
   }
-  xmlXPathFreeObject(privset);
-
-  thisinst->auth.type = getXPathString("string(./authentication/@type)", ctxt);
-  thisinst->auth.keyname = getXPathString("string(./authentication/login/keyname)", ctxt);
-  thisinst->auth.username = getXPathString("string(./authentication/login/username)", ctxt);
-  thisinst->auth.password = getXPathString("string(./authentication/login/password)", ctxt);
 
   return 0;
 }
@@ -193,11 +178,31 @@ static char *parse_create_headers(char *headers)
   return instid;
 }
 
+/* find the URL to perform action_name on instance; sets the error and
+ * returns NULL if the instance does not support the action
+ */
+static const char *find_action_href(struct deltacloud_instance *instance,
+				    const char *action_name)
+{
+  struct deltacloud_action *act = NULL;
+
+  deltacloud_for_each(act, instance->actions) {
+    if (STREQ(act->rel, action_name))
+      break;
+  }
+  if (act == NULL) {
+    link_error(action_name);
+    return NULL;
+  }
+
+  return act->href;
+}
+
 static int instance_action(struct deltacloud_api *api,
 			   struct deltacloud_instance *instance,
 			   const char *action_name)
 {
-  struct deltacloud_action *act = NULL;
+  const char *href;
   char *data = NULL;
   int ret = -1;
 
@@ -208,16 +213,12 @@ static int instance_action(struct deltacloud_api *api,
    * external API
    */
 
-  deltacloud_for_each(act, instance->actions) {
-    if (STREQ(act->rel, action_name))
-      break;
-  }
-  if (act == NULL) {
-    link_error(action_name);
+  href = find_action_href(instance, action_name);
+  if (href == NULL)
+    /* find_action_href set the error */
     return -1;
-  }
 
-  if (post_url(act->href, api->user, api->password, api->driver, api->provider, NULL, &data, NULL) != 0)
+  if (post_url(api, href, NULL, &data, NULL) != 0)
     /* post_url sets its own errors, so don't overwrite it here */
     return -1;
 
@@ -226,6 +227,8 @@ static int instance_action(struct deltacloud_api *api,
     goto cleanup;
   }
 
+  internal_invalidate(api, href);
+
   ret = 0;
 
  cleanup:
@@ -234,43 +237,22 @@ static int instance_action(struct deltacloud_api *api,
   return ret;
 }
 
-struct instance_find {
-  struct deltacloud_instance *instance;
-  const char *name;
-};
-
-static int find_and_parse_instance(xmlNodePtr cur, xmlXPathContextPtr ctxt,
-				   void *data)
+static int async_instance_action(struct deltacloud_api *api,
+				 struct deltacloud_instance *instance,
+				 const char *action_name,
+				 deltacloud_async_cb cb, void *userdata)
 {
-  struct instance_find *finder = (struct instance_find *)data;
-  char *instname;
-
-  while (cur != NULL) {
-    if (cur->type == XML_ELEMENT_NODE &&
-	STREQ((const char *)cur->name, "instance")) {
-
-      ctxt->node = cur;
-      instname = getXPathString("string(./name)", ctxt);
-      if (STREQ(instname, finder->name)) {
-	SAFE_FREE(instname);
-	if (parse_one_instance(cur, ctxt, finder->instance) < 0)
-	  /* parse_one_instance set the error */
-	  return -1;
-	break;
-      }
-      SAFE_FREE(instname);
-    }
+  const char *href;
 
-    cur = cur->next;
-  }
+  if (!valid_api(api) || !valid_arg(instance))
+    return -1;
 
-  if (cur == NULL) {
-    set_error(DELTACLOUD_NAME_NOT_FOUND_ERROR,
-	      "Failed to find instance in instances list");
+  href = find_action_href(instance, action_name);
+  if (href == NULL)
+    /* find_action_href set the error */
     return -1;
-  }
 
-  return 0;
+  return internal_async_action(api, TRANSFER_POST, href, cb, userdata);
 }
 
 /**
@@ -399,9 +381,27 @@ int deltacloud_instance_destroy(struct deltacloud_api *api,
   if (!valid_api(api) || !valid_arg(instance))
     return -1;
 
-  return internal_destroy(instance->href, api->user, api->password, api->driver, api->provider);
+  return internal_destroy(api, instance->href);
 }
 
+static int copy_instance(struct deltacloud_instance *dst,
+			 const struct deltacloud_instance *src);
+static int copy_instance_list(struct deltacloud_instance **dst,
+			      const struct deltacloud_instance *src);
+
+static const struct collection_type instance_collection_type = {
+  .relname = "instances",
+  .rootname = "instances",
+  .list_cb = parse_instance_xml,
+  .copy_all = (int (*)(void *, const void *))copy_instance_list,
+  .free_all = (void (*)(void *))deltacloud_free_instance_list,
+  .oneroot = "instance",
+  .one_cb = parse_one_instance,
+  .copy_one = (int (*)(void *, const void *))copy_instance,
+  .free_one = (void (*)(void *))deltacloud_free_instance,
+  .size = sizeof(struct deltacloud_instance),
+};
+
 /**
  * A function to get a linked list of all of the instances.  The caller
  * is expected to free the list using deltacloud_free_instance_list().
@@ -413,8 +413,23 @@ int deltacloud_instance_destroy(struct deltacloud_api *api,
 int deltacloud_get_instances(struct deltacloud_api *api,
 			     struct deltacloud_instance **instances)
 {
-  return internal_get(api, "instances", "instances", parse_instance_xml,
-		      (void **)instances);
+  return internal_get(api, &instance_collection_type, (void **)instances);
+}
+
+/**
+ * A function to hand each instance to a callback as soon as it has been
+ * downloaded, without building a list of them.  See deltacloud_visit_cb for
+ * what the callback may do with the deltacloud_instance structure.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] visitor The function to call with each instance
+ * @param[in] userdata A pointer that is passed through to visitor
+ * @returns 0 on success, including when visitor stops early, -1 on error
+ */
+int deltacloud_foreach_instance(struct deltacloud_api *api,
+				deltacloud_visit_cb visitor, void *userdata)
+{
+  return internal_foreach(api, &instance_collection_type, NULL, visitor,
+			  userdata);
 }
 
 /**
@@ -429,8 +444,44 @@ int deltacloud_get_instances(struct deltacloud_api *api,
 int deltacloud_get_instance_by_id(struct deltacloud_api *api, const char *id,
 				  struct deltacloud_instance *instance)
 {
-  return internal_get_by_id(api, id, "instances", "instance",
-			    parse_one_instance, instance);
+  return internal_get_type_by_id(api, &instance_collection_type, id, instance);
+}
+
+static const struct batch_type instance_batch_type = {
+  .relname = "instances",
+  .listroot = "instances",
+  .oneroot = "instance",
+  .list_cb = parse_instance_xml,
+  .one_cb = parse_one_instance,
+  .free_all = (void (*)(void *))deltacloud_free_instance_list,
+  .size = sizeof(struct deltacloud_instance),
+  .id_offset = offsetof(struct deltacloud_instance, id),
+  .next_offset = offsetof(struct deltacloud_instance, next),
+};
+
+/**
+ * A function to look up several instances by id at once.  The requests are
+ * issued concurrently, up to the window set with
+ * deltacloud_set_batch_window(), so n lookups cost far fewer than n round
+ * trips.  The caller is expected to free each deltacloud_instance structure
+ * using deltacloud_free_instance(); the entries of failed lookups are left
+ * zeroed, and freeing those is harmless.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] ids The array of n instance IDs to look for
+ * @param[in] n The number of IDs
+ * @param[out] instances An array of n deltacloud_instance structures; entry i
+ *                       is filled in from ids[i]
+ * @param[out] errors An array of n error codes; entry i is set to 0 if
+ *                    ids[i] was found, or to the DELTACLOUD_*_ERROR of that
+ *                    lookup otherwise.  May be NULL
+ * @returns 0 if every instance was found, -1 if any lookup failed or on error
+ */
+int deltacloud_get_instances_by_ids(struct deltacloud_api *api,
+				    const char **ids, int n,
+				    struct deltacloud_instance *instances,
+				    int *errors)
+{
+  return internal_get_by_ids(api, &instance_batch_type, ids, n, instances, errors);
 }
 
 /**
@@ -448,51 +499,116 @@ int deltacloud_get_instance_by_name(struct deltacloud_api *api,
 				    const char *name,
 				    struct deltacloud_instance *instance)
 {
-  struct deltacloud_link *thislink;
-  char *data = NULL;
-  int ret = -1;
-  struct instance_find finder;
-
-  if (!valid_api(api) || !valid_arg(name) || !valid_arg(instance))
-    return -1;
-
-  thislink = api_find_link(api, "instances");
-  if (thislink == NULL)
-    /* api_find_link set the error */
-    return -1;
-
-  if (get_url(thislink->href, api->user, api->password, api->driver, api->provider, &data) != 0)
-    /* get_url sets its own errors, so don't overwrite it here */
-    return -1;
+  return internal_get_by_name(api, &instance_collection_type, name, instance);
+}
 
-  if (data == NULL) {
-    /* if we made it here, it means that the transfer was successful (ret
-     * was 0), but the data that we expected wasn't returned.  This is probably
-     * a deltacloud server bug, so just set an error and bail out
-     */
-    data_error("instances");
-    goto cleanup;
-  }
+/**
+ * A function to start fetching the list of all of the instances without
+ * waiting for the result.  The callback runs from deltacloud_async_perform()
+ * with the list of instances, which it is expected to free using
+ * deltacloud_free_instance_list().
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] cb The function to call once the list has been fetched
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_instances(struct deltacloud_api *api,
+				   deltacloud_async_cb cb, void *userdata)
+{
+  return internal_async_get(api, "instances", "instances", parse_instance_xml,
+			    cb, userdata);
+}
 
-  if (is_error_xml(data)) {
-    set_xml_error(data, DELTACLOUD_GET_URL_ERROR);
-    goto cleanup;
-  }
+/**
+ * A function to start looking up a particular instance by id without waiting
+ * for the result.  On success the callback is handed the instance structure,
+ * which the caller is expected to free using deltacloud_free_instance().
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] id The instance ID to look for
+ * @param[out] instance The deltacloud_instance structure to fill in if the ID
+ *                      is found; it must stay valid until cb has run
+ * @param[in] cb The function to call once the lookup has finished
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_instance_by_id(struct deltacloud_api *api,
+					const char *id,
+					struct deltacloud_instance *instance,
+					deltacloud_async_cb cb, void *userdata)
+{
+  return internal_async_get_by_id(api, id, "instances", "instance",
+				  parse_one_instance, instance, cb, userdata);
+}
 
-  finder.instance = instance;
-  finder.name = name;
+/**
+ * A function to start the stop action on an instance without waiting for the
+ * result.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] instance The deltacloud_instance structure representing the
+ *                     instance
+ * @param[in] cb The function to call once the action has finished
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_instance_stop(struct deltacloud_api *api,
+				   struct deltacloud_instance *instance,
+				   deltacloud_async_cb cb, void *userdata)
+{
+  return async_instance_action(api, instance, "stop", cb, userdata);
+}
 
-  if (internal_xml_parse(data, "instances", find_and_parse_instance, 0,
-			 &finder) < 0)
-    /* internal_xml_parse already set the error */
-    goto cleanup;
+/**
+ * A function to start the reboot action on an instance without waiting for
+ * the result.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] instance The deltacloud_instance structure representing the
+ *                     instance
+ * @param[in] cb The function to call once the action has finished
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_instance_reboot(struct deltacloud_api *api,
+				     struct deltacloud_instance *instance,
+				     deltacloud_async_cb cb, void *userdata)
+{
+  return async_instance_action(api, instance, "reboot", cb, userdata);
+}
 
-  ret = 0;
+/**
+ * A function to start the start action on an instance without waiting for
+ * the result.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] instance The deltacloud_instance structure representing the
+ *                     instance
+ * @param[in] cb The function to call once the action has finished
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_instance_start(struct deltacloud_api *api,
+				    struct deltacloud_instance *instance,
+				    deltacloud_async_cb cb, void *userdata)
+{
+  return async_instance_action(api, instance, "start", cb, userdata);
+}
 
- cleanup:
-  SAFE_FREE(data);
+/**
+ * A function to start destroying an instance without waiting for the result.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] instance The deltacloud_instance structure representing the
+ *                     instance
+ * @param[in] cb The function to call once the instance has been destroyed
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_instance_destroy(struct deltacloud_api *api,
+				      struct deltacloud_instance *instance,
+				      deltacloud_async_cb cb, void *userdata)
+{
+  if (!valid_api(api) || !valid_arg(instance))
+    return -1;
 
-  return ret;
+  return internal_async_action(api, TRANSFER_DELETE, instance->href, cb,
+			       userdata);
 }
 
 /**
@@ -515,10 +631,15 @@ void deltacloud_free_instance(struct deltacloud_instance *instance)
   SAFE_FREE(instance->realm_id);
   SAFE_FREE(instance->realm_href);
   SAFE_FREE(instance->state);
+  SAFE_FREE(instance->launch_time);
   deltacloud_free_hardware_profile(&instance->hwp);
   free_action_list(&instance->actions);
   free_address_list(&instance->public_addresses);
   free_address_list(&instance->private_addresses);
+  SAFE_FREE(instance->auth.type);
+  SAFE_FREE(instance->auth.keyname);
+  SAFE_FREE(instance->auth.username);
+  SAFE_FREE(instance->auth.password);
 }
 
 /**
@@ -530,3 +651,38 @@ void deltacloud_free_instance_list(struct deltacloud_instance **instances)
 {
   free_list(instances, struct deltacloud_instance, deltacloud_free_instance);
 }
+
+static int copy_instance(struct deltacloud_instance *dst,
+			 const struct deltacloud_instance *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->name, src->name) < 0 ||
+      copy_string(&dst->owner_id, src->owner_id) < 0 ||
+      copy_string(&dst->image_id, src->image_id) < 0 ||
+      copy_string(&dst->image_href, src->image_href) < 0 ||
+      copy_string(&dst->realm_id, src->realm_id) < 0 ||
+      copy_string(&dst->realm_href, src->realm_href) < 0 ||
+      copy_string(&dst->state, src->state) < 0 ||
+      copy_string(&dst->launch_time, src->launch_time) < 0 ||
+      copy_hardware_profile(&dst->hwp, &src->hwp) < 0 ||
+      copy_action_list(&dst->actions, src->actions) < 0 ||
+      copy_address_list(&dst->public_addresses, src->public_addresses) < 0 ||
+      copy_address_list(&dst->private_addresses, src->private_addresses) < 0 ||
+      copy_string(&dst->auth.type, src->auth.type) < 0 ||
+      copy_string(&dst->auth.keyname, src->auth.keyname) < 0 ||
+      copy_string(&dst->auth.username, src->auth.username) < 0 ||
+      copy_string(&dst->auth.password, src->auth.password) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_instance_list(struct deltacloud_instance **dst,
+			      const struct deltacloud_instance *src)
+{
+  copy_list(dst, src, struct deltacloud_instance, copy_instance,
+	    deltacloud_free_instance_list);
+
+  return 0;
+}
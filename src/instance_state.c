@@ -118,6 +118,17 @@ static int parse_instance_state_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
   return ret;
 }
 
+static int copy_instance_state_list(struct deltacloud_instance_state **dst,
+				    const struct deltacloud_instance_state *src);
+
+static const struct collection_type instance_state_collection_type = {
+  .relname = "instance_states",
+  .rootname = "states",
+  .list_cb = parse_instance_state_xml,
+  .copy_all = (int (*)(void *, const void *))copy_instance_state_list,
+  .free_all = (void (*)(void *))deltacloud_free_instance_state_list,
+};
+
 /**
  * A function to get a linked list of all of the instance states.  The caller
  * is expected to free the list using deltacloud_free_instance_state_list().
@@ -129,8 +140,8 @@ static int parse_instance_state_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 int deltacloud_get_instance_states(struct deltacloud_api *api,
 				   struct deltacloud_instance_state **instance_states)
 {
-  return internal_get(api, "instance_states", "states",
-		      parse_instance_state_xml, (void **)instance_states);
+  return internal_get(api, &instance_state_collection_type,
+		      (void **)instance_states);
 }
 
 /**
@@ -144,3 +155,48 @@ void deltacloud_free_instance_state_list(struct deltacloud_instance_state **inst
   free_list(instance_states, struct deltacloud_instance_state,
 	    free_instance_state);
 }
+
+static void free_transition_list(struct deltacloud_instance_state_transition **transitions)
+{
+  free_list(transitions, struct deltacloud_instance_state_transition,
+	    free_transition);
+}
+
+static int copy_transition(struct deltacloud_instance_state_transition *dst,
+			   const struct deltacloud_instance_state_transition *src)
+{
+  if (copy_string(&dst->action, src->action) < 0 ||
+      copy_string(&dst->to, src->to) < 0 ||
+      copy_string(&dst->automatically, src->automatically) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_transition_list(struct deltacloud_instance_state_transition **dst,
+				const struct deltacloud_instance_state_transition *src)
+{
+  copy_list(dst, src, struct deltacloud_instance_state_transition, copy_transition,
+	    free_transition_list);
+
+  return 0;
+}
+
+static int copy_instance_state(struct deltacloud_instance_state *dst,
+			       const struct deltacloud_instance_state *src)
+{
+  if (copy_string(&dst->name, src->name) < 0 ||
+      copy_transition_list(&dst->transitions, src->transitions) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_instance_state_list(struct deltacloud_instance_state **dst,
+				    const struct deltacloud_instance_state *src)
+{
+  copy_list(dst, src, struct deltacloud_instance_state, copy_instance_state,
+	    deltacloud_free_instance_state_list);
+
+  return 0;
+}
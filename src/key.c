@@ -22,10 +22,21 @@
 #include <stdlib.h>
 #include <memory.h>
 #include "common.h"
+#include "curl_action.h"
 #include "key.h"
+#include "decoder.h"
 
 /** @file */
 
+static const struct decode_field key_fields[] = {
+  DECODE_ATTR("href", struct deltacloud_key, href),
+  DECODE_ATTR("id", struct deltacloud_key, id),
+  DECODE_ATTR("type", struct deltacloud_key, type),
+  DECODE_TEXT("state", struct deltacloud_key, state),
+  DECODE_TEXT("fingerprint", struct deltacloud_key, fingerprint),
+  DECODE_END
+};
+
 static int parse_one_key(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 			 void *output)
 {
@@ -33,13 +44,7 @@ static int parse_one_key(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 
   memset(thiskey, 0, sizeof(struct deltacloud_key));
 
-  thiskey->href = (char *)xmlGetProp(cur, BAD_CAST "href");
-  thiskey->id = (char *)xmlGetProp(cur, BAD_CAST "id");
-  thiskey->type = (char *)xmlGetProp(cur, BAD_CAST "type");
-  thiskey->state = getXPathString("string(./state)", ctxt);
-  thiskey->fingerprint = getXPathString("string(./fingerprint)", ctxt);
-
-  return 0;
+  return decode_element(cur, ctxt, key_fields, thiskey);
 }
 
 static int parse_key_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt, void **data)
@@ -85,6 +90,24 @@ static int parse_key_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt, void **data)
   return ret;
 }
 
+static int copy_key(struct deltacloud_key *dst,
+		    const struct deltacloud_key *src);
+static int copy_key_list(struct deltacloud_key **dst,
+			 const struct deltacloud_key *src);
+
+static const struct collection_type key_collection_type = {
+  .relname = "keys",
+  .rootname = "keys",
+  .list_cb = parse_key_xml,
+  .copy_all = (int (*)(void *, const void *))copy_key_list,
+  .free_all = (void (*)(void *))deltacloud_free_key_list,
+  .oneroot = "key",
+  .one_cb = parse_one_key,
+  .copy_one = (int (*)(void *, const void *))copy_key,
+  .free_one = (void (*)(void *))deltacloud_free_key,
+  .size = sizeof(struct deltacloud_key),
+};
+
 /**
  * A function to get a linked list of all of the keys.  The caller
  * is expected to free the list using deltacloud_free_key_list().
@@ -96,7 +119,23 @@ static int parse_key_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt, void **data)
 int deltacloud_get_keys(struct deltacloud_api *api,
 			struct deltacloud_key **keys)
 {
-  return internal_get(api, "keys", "keys", parse_key_xml, (void **)keys);
+  return internal_get(api, &key_collection_type, (void **)keys);
+}
+
+/**
+ * A function to hand each key to a callback as soon as it has been
+ * downloaded, without building a list of them.  See deltacloud_visit_cb for
+ * what the callback may do with the deltacloud_key structure.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] visitor The function to call with each key
+ * @param[in] userdata A pointer that is passed through to visitor
+ * @returns 0 on success, including when visitor stops early, -1 on error
+ */
+int deltacloud_foreach_key(struct deltacloud_api *api,
+			   deltacloud_visit_cb visitor, void *userdata)
+{
+  return internal_foreach(api, &key_collection_type, NULL, visitor,
+			  userdata);
 }
 
 /**
@@ -167,7 +206,7 @@ int deltacloud_key_destroy(struct deltacloud_api *api,
   if (!valid_api(api) || !valid_arg(key))
     return -1;
 
-  return internal_destroy(key->href, api->user, api->password, api->driver, api->provider);
+  return internal_destroy(api, key->href);
 }
 
 /**
@@ -181,7 +220,64 @@ int deltacloud_key_destroy(struct deltacloud_api *api,
 int deltacloud_get_key_by_id(struct deltacloud_api *api, const char *id,
 			     struct deltacloud_key *key)
 {
-  return internal_get_by_id(api, id, "keys", "key", parse_one_key, key);
+  return internal_get_type_by_id(api, &key_collection_type, id, key);
+}
+
+/**
+ * A function to start fetching the list of all of the keys without
+ * waiting for the result.  The callback runs from deltacloud_async_perform()
+ * with the list of keys, which it is expected to free using
+ * deltacloud_free_key_list().
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] cb The function to call once the list has been fetched
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_keys(struct deltacloud_api *api,
+			      deltacloud_async_cb cb, void *userdata)
+{
+  return internal_async_get(api, "keys", "keys", parse_key_xml,
+			    cb, userdata);
+}
+
+/**
+ * A function to start looking up a particular key by id without waiting
+ * for the result.  On success the callback is handed the deltacloud_key
+ * structure, which the caller is expected to free using
+ * deltacloud_free_key().
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] id The key ID to look for
+ * @param[out] key The deltacloud_key structure to fill in if the ID is
+ *             found; it must stay valid until cb has run
+ * @param[in] cb The function to call once the lookup has finished
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_key_by_id(struct deltacloud_api *api, const char *id,
+				   struct deltacloud_key *key,
+				   deltacloud_async_cb cb, void *userdata)
+{
+  return internal_async_get_by_id(api, id, "keys", "key",
+				  parse_one_key, key, cb, userdata);
+}
+
+/**
+ * A function to start destroying a key without waiting for the result.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] key The deltacloud_key structure representing the key
+ * @param[in] cb The function to call once the key has been destroyed
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_key_destroy(struct deltacloud_api *api,
+				 struct deltacloud_key *key,
+				 deltacloud_async_cb cb, void *userdata)
+{
+  if (!valid_api(api) || !valid_arg(key))
+    return -1;
+
+  return internal_async_action(api, TRANSFER_DELETE, key->href, cb,
+			       userdata);
 }
 
 /**
@@ -211,3 +307,25 @@ void deltacloud_free_key_list(struct deltacloud_key **keys)
   free_list(keys, struct deltacloud_key, deltacloud_free_key);
 }
 
+static int copy_key(struct deltacloud_key *dst,
+		    const struct deltacloud_key *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->type, src->type) < 0 ||
+      copy_string(&dst->state, src->state) < 0 ||
+      copy_string(&dst->fingerprint, src->fingerprint) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_key_list(struct deltacloud_key **dst,
+			 const struct deltacloud_key *src)
+{
+  copy_list(dst, src, struct deltacloud_key, copy_key,
+	    deltacloud_free_key_list);
+
+  return 0;
+}
+
@@ -27,7 +27,9 @@
 #include <pthread.h>
 #include "libdeltacloud.h"
 #include "common.h"
+#include "share.h"
 #include "curl_action.h"
+#include "trace_capture.h"
 
 /** @file */
 
@@ -184,8 +186,92 @@ static int parse_api_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt, void *data)
   return ret;
 }
 
+static int private_init(struct deltacloud_api *api)
+{
+  struct deltacloud_private *priv;
+
+  priv = calloc(1, sizeof(struct deltacloud_private));
+  if (priv == NULL) {
+    oom_error();
+    return -1;
+  }
+
+  /* each of the *_init functions sets its own error */
+  if (pool_init(&priv->pool) < 0)
+    goto free_priv;
+  if (async_engine_init(&priv->async) < 0)
+    goto free_pool;
+  if (batch_planner_init(&priv->batch) < 0)
+    goto free_async;
+  if (transfer_stats_init(&priv->stats) < 0)
+    goto free_batch;
+  if (collection_cache_init(&priv->cache) < 0)
+    goto free_stats;
+  if (retry_policy_init(&priv->retry) < 0)
+    goto free_cache;
+  priv->limiter = rate_limiter_acquire(api->driver, api->provider);
+  if (priv->limiter == NULL)
+    goto free_retry;
+  priv->rate_wait_ms = RATE_DEFAULT_MAX_WAIT_MS;
+  if (hedge_policy_init(&priv->hedge) < 0)
+    goto free_limiter;
+  if (fault_injector_init(&priv->faults) < 0)
+    goto free_hedge;
+
+  api->priv = priv;
+
+  return 0;
+
+ free_hedge:
+  hedge_policy_destroy(&priv->hedge);
+ free_limiter:
+  rate_limiter_release(priv->limiter);
+ free_retry:
+  retry_policy_destroy(&priv->retry);
+ free_cache:
+  collection_cache_destroy(&priv->cache);
+ free_stats:
+  transfer_stats_destroy(&priv->stats);
+ free_batch:
+  batch_planner_destroy(&priv->batch);
+ free_async:
+  async_engine_destroy(&priv->async);
+ free_pool:
+  pool_destroy(&priv->pool);
+ free_priv:
+  SAFE_FREE(priv);
+  return -1;
+}
+
+static void private_free(struct deltacloud_api *api)
+{
+  if (api->priv == NULL)
+    return;
+
+  /* the background refreshers of the cache and the engine hand their
+   * handles back to the pool, so they go first
+   */
+  collection_cache_destroy(&api->priv->cache);
+  batch_planner_destroy(&api->priv->batch);
+  async_engine_destroy(&api->priv->async);
+  hedge_policy_destroy(&api->priv->hedge);
+  fault_injector_destroy(&api->priv->faults);
+  /* every handle has been returned by now, so the idle ones that are
+   * cleaned up here were the last ones attached to the share
+   */
+  pool_destroy(&api->priv->pool);
+  if (api->priv->pool.share != NULL)
+    share_release();
+  transfer_stats_destroy(&api->priv->stats);
+  retry_policy_destroy(&api->priv->retry);
+  rate_limiter_release(api->priv->limiter);
+  trace_recorder_release(api->priv->recorder);
+  SAFE_FREE(api->priv);
+}
+
 static void internal_free(struct deltacloud_api *api)
 {
+  private_free(api);
   free_link_list(&api->links);
   SAFE_FREE(api->user);
   SAFE_FREE(api->password);
@@ -196,18 +282,11 @@ static void internal_free(struct deltacloud_api *api)
   memset(api, 0, sizeof(struct deltacloud_api));
 }
 
-/**
- * The main API entry point.  All users of the library \b must call this
- * function first to initialize the library.  The caller must free the
- * deltacloud_api structure using deltacloud_free() when finished.
- * @param[in,out] api The api structure
- * @param[in] url The url to the deltacloud server
- * @param[in] user The username required to connect to the deltacloud server
- * @param[in] password The password required to connect to the deltacloud server
- * @returns 0 on success, -1 on error
- */
-int deltacloud_initialize(struct deltacloud_api *api, char *url, char *user,
-			  char *password, char *driver, char *provider)
+static int internal_initialize(struct deltacloud_api *api, char *url,
+			       char *user, char *password, char *driver,
+			       char *provider,
+			       const struct deltacloud_transport *transport,
+			       void *transport_ctx)
 {
   char *data = NULL;
   int ret = -1;
@@ -254,7 +333,13 @@ int deltacloud_initialize(struct deltacloud_api *api, char *url, char *user,
     goto cleanup;
   }
 
-  if (get_url(api->url, api->user, api->password, api->driver, api->provider, &data) != 0)
+  if (private_init(api) < 0)
+    /* private_init already set the error */
+    goto cleanup;
+  api->priv->transport = transport;
+  api->priv->transport_ctx = transport_ctx;
+
+  if (get_url(api, api->url, &data) != 0)
     /* get_url sets its own errors, so don't overwrite it here */
     goto cleanup;
 
@@ -288,6 +373,56 @@ int deltacloud_initialize(struct deltacloud_api *api, char *url, char *user,
   return ret;
 }
 
+/**
+ * The main API entry point.  All users of the library \b must call this
+ * function (or deltacloud_initialize_transport()) first to initialize the
+ * library.  The caller must free the deltacloud_api structure using
+ * deltacloud_free() when finished.
+ * @param[in,out] api The api structure
+ * @param[in] url The url to the deltacloud server
+ * @param[in] user The username required to connect to the deltacloud server
+ * @param[in] password The password required to connect to the deltacloud server
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_initialize(struct deltacloud_api *api, char *url, char *user,
+			  char *password, char *driver, char *provider)
+{
+  return internal_initialize(api, url, user, password, driver, provider,
+			     NULL, NULL);
+}
+
+/**
+ * A function to initialize a deltacloud_api structure that sends all of its
+ * HTTP requests through transport instead of libcurl, starting with the
+ * request for the API entry point.  A transport that answers from memory
+ * lets the parsing, list building and freeing code be exercised and
+ * benchmarked with no server and no sockets at all.  The transport, and
+ * whatever ctx points to, must stay around until the structure is freed
+ * with deltacloud_free().  Asynchronous requests are not available through
+ * such a structure.
+ * @param[in,out] api The api structure
+ * @param[in] url The url to the deltacloud server
+ * @param[in] user The username required to connect to the deltacloud server
+ * @param[in] password The password required to connect to the deltacloud server
+ * @param[in] driver The driver to ask the server to use
+ * @param[in] provider The provider to ask the server to use
+ * @param[in] transport The functions to send the requests through
+ * @param[in] ctx Passed as is to each of the transport functions
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_initialize_transport(struct deltacloud_api *api, char *url,
+				    char *user, char *password, char *driver,
+				    char *provider,
+				    const struct deltacloud_transport *transport,
+				    void *ctx)
+{
+  if (!valid_arg(transport))
+    return -1;
+
+  return internal_initialize(api, url, user, password, driver, provider,
+			     transport, ctx);
+}
+
 /**
  * A function to prepare a deltacloud_create_parameter structure for use.  A
  * deltacloud_create_parameter structure is used as an optional input parameter
@@ -405,6 +540,606 @@ int deltacloud_has_link(struct deltacloud_api *api, const char *name)
   return 0;
 }
 
+/**
+ * A function to set the number of idle connections that are kept open for
+ * re-use by this deltacloud_api structure.  Every request checks a
+ * connection out of the pool and hands it back when it is done, so that
+ * consecutive requests to the deltacloud server can skip the TCP (and, for
+ * HTTPS, TLS) handshake.  Connections beyond this limit are closed as they
+ * are handed back.  The pool is safe to use from multiple threads.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] size The maximum number of idle connections to keep; 0 disables
+ *                 connection re-use altogether
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_pool_size(struct deltacloud_api *api, int size)
+{
+  if (!valid_api(api))
+    return -1;
+
+  if (size < 0) {
+    invalid_argument_error("size must be >= 0");
+    return -1;
+  }
+
+  pool_set_size(&api->priv->pool, size);
+
+  return 0;
+}
+
+/**
+ * A function to set how long an idle connection may sit in the connection
+ * pool of this deltacloud_api structure before it is closed.  Servers and
+ * proxies tend to drop idle keep-alive connections after a while, so there
+ * is little point in holding onto them forever.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] seconds The number of seconds after which an idle connection is
+ *                    closed; 0 means idle connections never expire
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_pool_idle_timeout(struct deltacloud_api *api, int seconds)
+{
+  if (!valid_api(api))
+    return -1;
+
+  if (seconds < 0) {
+    invalid_argument_error("seconds must be >= 0");
+    return -1;
+  }
+
+  pool_set_idle_timeout(&api->priv->pool, seconds);
+
+  return 0;
+}
+
+/**
+ * A function to turn HTTP response compression on or off for this
+ * deltacloud_api structure.  When it is on, every request advertises all of
+ * the content encodings that libcurl supports (typically gzip and deflate,
+ * and br if libcurl was built with brotli), and responses are decompressed
+ * transparently.  Deltacloud XML compresses very well, so this is worth
+ * turning on whenever bandwidth rather than CPU is the bottleneck.  It is
+ * off by default.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] enabled 1 to turn compression on, 0 to turn it off
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_compression(struct deltacloud_api *api, int enabled)
+{
+  if (!valid_api(api))
+    return -1;
+
+  api->priv->compression = enabled ? 1 : 0;
+
+  return 0;
+}
+
+/**
+ * A function to choose whether this deltacloud_api structure speaks HTTP/2.
+ * With HTTP/2, the requests that are in flight at the same time (from the
+ * deltacloud_async_* functions, the deltacloud_get_*_by_ids functions and so
+ * on) are multiplexed as streams over one connection to the server instead
+ * of each opening its own socket.  In the DELTACLOUD_HTTP2_NEGOTIATE and
+ * DELTACLOUD_HTTP2_TLS modes, servers that do not speak HTTP/2 are talked
+ * to over HTTP/1.1 as before.  DELTACLOUD_HTTP2_PRIOR_KNOWLEDGE is meant for
+ * local plaintext (h2c) proxies that are known to speak HTTP/2.  The mode
+ * cannot be changed while asynchronous requests are in flight, and is best
+ * chosen before any are started.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] mode One of the DELTACLOUD_HTTP2_* modes
+ * @returns 0 on success, -1 on error, including when the libcurl in use was
+ *          built without HTTP/2 support
+ */
+int deltacloud_set_http2(struct deltacloud_api *api, int mode)
+{
+  curl_version_info_data *info;
+
+  if (!valid_api(api))
+    return -1;
+
+  if (mode < DELTACLOUD_HTTP2_OFF || mode > DELTACLOUD_HTTP2_PRIOR_KNOWLEDGE) {
+    invalid_argument_error("mode must be one of the DELTACLOUD_HTTP2_* modes");
+    return -1;
+  }
+
+  if (mode != DELTACLOUD_HTTP2_OFF) {
+    info = curl_version_info(CURLVERSION_NOW);
+    if (LIBCURL_VERSION_NUM < 0x073100 || info == NULL ||
+	!(info->features & CURL_VERSION_HTTP2)) {
+      set_error(DELTACLOUD_INTERNAL_ERROR,
+		"libcurl was built without HTTP/2 support");
+      return -1;
+    }
+  }
+
+  if (mode == api->priv->http2)
+    return 0;
+
+  if (api->priv->async.pending > 0) {
+    invalid_argument_error("cannot change HTTP version with asynchronous requests in flight");
+    return -1;
+  }
+
+  api->priv->http2 = mode;
+
+  /* libcurl happily reuses an HTTP/1.1 connection for a request that asked
+   * for HTTP/2 with prior knowledge, which the server then rejects, so drop
+   * the connections that were opened under the old mode
+   */
+  pool_flush(&api->priv->pool);
+  hedge_policy_flush(&api->priv->hedge);
+
+  return 0;
+}
+
+/**
+ * A function to make this deltacloud_api structure share its DNS cache and
+ * its TLS session cache with every other deltacloud_api structure in the
+ * process that has this turned on.  When many of them talk to the same
+ * server, for instance one per tenant, a new one can then skip the name
+ * lookup and resume a TLS session the others already negotiated.  Live
+ * connections are never shared, since libcurl does not support using one
+ * connection cache from several threads at once; each structure keeps its
+ * own.  This cannot be changed while any request on this structure is in
+ * flight.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] enabled 1 to share, 0 (the default) to keep to itself
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_shared_caches(struct deltacloud_api *api, int enabled)
+{
+  CURLSH *share;
+  CURLSH *old;
+
+  if (!valid_api(api))
+    return -1;
+
+  if (api->priv->async.pending > 0) {
+    invalid_argument_error("cannot change sharing with asynchronous requests in flight");
+    return -1;
+  }
+
+  if (enabled) {
+    share = share_acquire();
+    if (share == NULL)
+      /* share_acquire set the error */
+      return -1;
+  }
+  else
+    share = NULL;
+
+  /* this also closes the idle handles, which are attached to the old share */
+  if (pool_set_share(&api->priv->pool, share, &old) < 0) {
+    /* pool_set_share set the error */
+    if (share != NULL)
+      share_release();
+    return -1;
+  }
+  hedge_policy_flush(&api->priv->hedge);
+  /* when sharing was on already, this drops the reference taken above */
+  if (old != NULL)
+    share_release();
+
+  return 0;
+}
+
+/**
+ * A function to have the GET, HEAD and DELETE requests of this
+ * deltacloud_api structure sent again when they fail in a way that may
+ * well go away by itself: the connection could not be made or broke down,
+ * it timed out, or the server answered with a 5xx error (other than 501
+ * and 505) or 429.  Before each retry the request waits for a random time
+ * between base_ms and three times its previous wait, but never more than
+ * max_ms, so that clients that failed together do not come back together.
+ * A Retry-After from the server is honored, unless it asks for more than
+ * max_ms, in which case the request fails instead.  Retries are also
+ * limited by the budget set with deltacloud_set_retry_budget().  Requests
+ * that create or change resources are never retried, and neither are
+ * asynchronous ones.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] max_retries How many times to retry a request, at most; 0 (the
+ *                        default) turns retrying off
+ * @param[in] base_ms The shortest wait before a retry, in milliseconds
+ *                    (default 100)
+ * @param[in] max_ms The longest wait before a retry, in milliseconds
+ *                   (default 10000)
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_retries(struct deltacloud_api *api, int max_retries,
+			   long base_ms, long max_ms)
+{
+  if (!valid_api(api))
+    return -1;
+
+  if (max_retries < 0 || base_ms < 1 || max_ms < base_ms) {
+    invalid_argument_error("max_retries must be at least 0, base_ms at least 1 and max_ms at least base_ms");
+    return -1;
+  }
+
+  retry_policy_set(&api->priv->retry, max_retries, base_ms, max_ms);
+
+  return 0;
+}
+
+/**
+ * A function to limit how much extra load the retries of this
+ * deltacloud_api structure can put on the server while it is struggling.
+ * Every request earns percent hundredths of a retry, up to a reserve of
+ * reserve retries, and every retry spends one.  When nothing is left, a
+ * failed request fails right away, however many retries
+ * deltacloud_set_retries() allows; these show up in the retries_denied
+ * counter of deltacloud_get_transfer_stats().
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] percent Retries earned per hundred requests (default 10)
+ * @param[in] reserve The most retries that can be saved up, and so the
+ *                    largest burst of them (default 10)
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_retry_budget(struct deltacloud_api *api, int percent,
+				int reserve)
+{
+  if (!valid_api(api))
+    return -1;
+
+  if (percent < 0 || reserve < 1) {
+    invalid_argument_error("percent must be at least 0 and reserve at least 1");
+    return -1;
+  }
+
+  retry_policy_set_budget(&api->priv->retry, percent, reserve);
+
+  return 0;
+}
+
+/**
+ * A function to limit how fast requests are sent to the driver and
+ * provider of this deltacloud_api structure, to stay under the quota of the
+ * provider instead of running into its throttling.  The limit is a token
+ * bucket that allows per_second requests a second on average, and bursts
+ * of up to burst requests after a quiet spell.  Reads and writes have
+ * separate buckets.  The buckets belong to the driver and provider, not to
+ * this structure: every deltacloud_api structure in the process that was
+ * initialized with the same driver and provider draws from them, and a
+ * limit set through any one of them applies to all.  Retries count as
+ * requests of their own.  What happens to a request that finds its bucket
+ * empty is set with deltacloud_set_rate_limit_wait().
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] kind DELTACLOUD_RATE_READ or DELTACLOUD_RATE_WRITE
+ * @param[in] per_second The average number of requests a second; 0 (the
+ *                       default) removes the limit
+ * @param[in] burst The most requests that can be sent at once; at least 1
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_rate_limit(struct deltacloud_api *api, int kind,
+			      double per_second, int burst)
+{
+  if (!valid_api(api))
+    return -1;
+
+  if (kind != DELTACLOUD_RATE_READ && kind != DELTACLOUD_RATE_WRITE) {
+    invalid_argument_error("kind must be DELTACLOUD_RATE_READ or DELTACLOUD_RATE_WRITE");
+    return -1;
+  }
+  if (per_second < 0 || burst < 1) {
+    invalid_argument_error("per_second must be at least 0 and burst at least 1");
+    return -1;
+  }
+
+  rate_limiter_set(api->priv->limiter,
+		   kind == DELTACLOUD_RATE_READ ? RATE_READ : RATE_WRITE,
+		   per_second, burst);
+
+  return 0;
+}
+
+/**
+ * A function to choose how long requests made through this deltacloud_api
+ * structure wait when the rate limit set with deltacloud_set_rate_limit()
+ * has been reached.  A request that would have to wait longer fails right
+ * away with DELTACLOUD_RATE_LIMITED_ERROR, without having been sent.  This
+ * does not apply to the deltacloud_async_* requests, which never wait in the
+ * calling thread: one that finds its bucket empty is held back, and counted
+ * as pending, until whatever drives the engine finds a token for it.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] max_wait_ms The longest wait in milliseconds; 0 never waits,
+ *                        and -1 (the default) waits as long as it takes
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_rate_limit_wait(struct deltacloud_api *api,
+				   long max_wait_ms)
+{
+  if (!valid_api(api))
+    return -1;
+
+  if (max_wait_ms < -1) {
+    invalid_argument_error("max_wait_ms must be at least -1");
+    return -1;
+  }
+
+  api->priv->rate_wait_ms = max_wait_ms;
+
+  return 0;
+}
+
+/**
+ * A function to have the GETs of this deltacloud_api structure hedged: when
+ * one has not been answered by the time that percentile percent of recent
+ * GETs of the same kind were, the same GET is sent again on another
+ * connection, the first answer to arrive is used and the other request is
+ * abandoned.  This trims the long tail of response times that a server
+ * produces when the odd request gets stuck, at the cost of sending the
+ * slowest (100 - percentile) percent of GETs twice.  Hedging starts once
+ * a kind of GET has been seen 20 times.  Hedges are not sent when the rate
+ * limit set with deltacloud_set_rate_limit() would make them wait.  The
+ * hedges and hedges_won counters of deltacloud_get_transfer_stats() show
+ * how often hedges were sent and how often they answered first.
+ * Asynchronous GETs are not hedged.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] percentile The percentile of response times to hedge at, from
+ *                       50 to 99; 0 (the default) turns hedging off
+ * @param[in] min_delay_ms Never hedge a GET before it has been running
+ *                         this many milliseconds
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_hedging(struct deltacloud_api *api, int percentile,
+			   long min_delay_ms)
+{
+  if (!valid_api(api))
+    return -1;
+
+  if ((percentile != 0 && (percentile < 50 || percentile > 99)) ||
+      min_delay_ms < 0) {
+    invalid_argument_error("percentile must be 0 or from 50 to 99, and min_delay_ms at least 0");
+    return -1;
+  }
+
+  hedge_policy_set(&api->priv->hedge, percentile, min_delay_ms);
+
+  return 0;
+}
+
+/**
+ * A function to make some of the requests of this deltacloud_api structure
+ * slow or fail on purpose, to see how retries, hedging, timeouts and the
+ * callers themselves hold up against a server with a long tail.  Each
+ * request is checked against the faults in the order they were added, and
+ * gets the first one whose pattern matches its URL and that its
+ * probability picks it for.  The injected latency and stalls hold up the
+ * response as it arrives rather than the thread, so that the other
+ * transfers of an asynchronous or hedged request carry on meanwhile.  The
+ * bandwidth cap applies to the response body.  An injected status replaces
+ * the response of the server, as a failing proxy in front of it would: the
+ * request itself is still sent, and the response carries an error document
+ * instead of the body of the server.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] fault The fault to inject; it is copied
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_add_fault(struct deltacloud_api *api,
+			 const struct deltacloud_fault *fault)
+{
+  if (!valid_api(api) || !valid_arg(fault))
+    return -1;
+
+  if (fault->probability <= 0 || fault->probability > 1) {
+    invalid_argument_error("probability must be above 0 and at most 1");
+    return -1;
+  }
+
+  if (fault->distribution < DELTACLOUD_LATENCY_FIXED ||
+      fault->distribution > DELTACLOUD_LATENCY_PARETO) {
+    invalid_argument_error("distribution must be one of the DELTACLOUD_LATENCY_* values");
+    return -1;
+  }
+
+  if (fault->latency_ms < 0 || fault->spread_ms < 0 || fault->shape < 0 ||
+      fault->bandwidth < 0 || fault->stall_ms < 0) {
+    invalid_argument_error("latency_ms, spread_ms, shape, bandwidth and stall_ms must be at least 0");
+    return -1;
+  }
+
+  if (fault->status != 0 && (fault->status < 100 || fault->status > 599)) {
+    invalid_argument_error("status must be 0 or an HTTP status");
+    return -1;
+  }
+
+  return fault_injector_add(&api->priv->faults, fault);
+}
+
+/**
+ * A function to stop injecting the faults added with deltacloud_add_fault()
+ * into the requests of this deltacloud_api structure.  Requests already
+ * under way keep the fault they were picked for.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_clear_faults(struct deltacloud_api *api)
+{
+  if (!valid_api(api))
+    return -1;
+
+  fault_injector_clear(&api->priv->faults);
+
+  return 0;
+}
+
+/**
+ * A function to let this deltacloud_api structure hand out collections of
+ * one type, and the elements of it looked up by id, from an in-process cache
+ * for a while instead of asking the server each time.  This is meant for
+ * types that rarely change, like hardware_profiles, realms, drivers,
+ * instance_states and images; within the TTL a call costs a copy of the
+ * cached data rather than a round trip and a parse.  Creating, destroying
+ * or acting on a resource through this structure drops the cached copies
+ * of its type; use deltacloud_invalidate_cache() after changes made some
+ * other way.  See also deltacloud_set_cache_stale().
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] type The collection, as named in the API entry point (e.g.
+ *                 "realms" or "hardware_profiles")
+ * @param[in] seconds How long a cached copy may be used; 0 (the default)
+ *                    means it is always checked with the server first
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_cache_ttl(struct deltacloud_api *api, const char *type,
+			     int seconds)
+{
+  if (!valid_api(api) || !valid_arg(type))
+    return -1;
+
+  if (seconds < 0) {
+    invalid_argument_error("seconds must be >= 0");
+    return -1;
+  }
+
+  if (api_find_link(api, type) == NULL)
+    /* api_find_link set the error */
+    return -1;
+
+  /* collection_cache_set_ttl sets its own error */
+  return collection_cache_set_ttl(&api->priv->cache, type, seconds);
+}
+
+/**
+ * A function to let this deltacloud_api structure keep handing out cached
+ * copies of one collection type for a while after their TTL (see
+ * deltacloud_set_cache_ttl()) has run out, while they are refreshed in the
+ * background.  The first caller after the TTL then gets an answer straight
+ * away instead of waiting for the server, at the price of the answer being
+ * up to seconds out of date.  If the refresh fails, the stale copy keeps
+ * being used until the period is over, after which callers wait for the
+ * server as usual.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] type The collection, as named in the API entry point (e.g.
+ *                 "instances")
+ * @param[in] seconds How long past its TTL a cached copy may be used; 0 (the
+ *                    default) turns background refreshes off
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_cache_stale(struct deltacloud_api *api, const char *type,
+			       int seconds)
+{
+  if (!valid_api(api) || !valid_arg(type))
+    return -1;
+
+  if (seconds < 0) {
+    invalid_argument_error("seconds must be >= 0");
+    return -1;
+  }
+
+  if (api_find_link(api, type) == NULL)
+    /* api_find_link set the error */
+    return -1;
+
+  /* collection_cache_set_stale sets its own error */
+  return collection_cache_set_stale(&api->priv->cache, type, seconds);
+}
+
+/**
+ * A function to set how many background threads this deltacloud_api
+ * structure may use at once to refresh stale cache entries (see
+ * deltacloud_set_cache_stale()).  Refreshes beyond that wait their turn.
+ * The default is one.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] max The maximum number of concurrent refreshes; must be >= 1
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_cache_refreshers(struct deltacloud_api *api, int max)
+{
+  if (!valid_api(api))
+    return -1;
+
+  if (max < 1) {
+    invalid_argument_error("max must be >= 1");
+    return -1;
+  }
+
+  collection_cache_set_refreshers(&api->priv->cache, max);
+
+  return 0;
+}
+
+/**
+ * A function to throw away what this deltacloud_api structure has cached of
+ * one collection type and its elements, or of everything.  The next call
+ * fetches them from the server in full.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] type The collection to forget (e.g. "instances"), or NULL to
+ *                 forget all of them
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_invalidate_cache(struct deltacloud_api *api, const char *type)
+{
+  if (!valid_api(api))
+    return -1;
+
+  collection_cache_invalidate(&api->priv->cache, type);
+
+  return 0;
+}
+
+/**
+ * A function to find out how many response body bytes this deltacloud_api
+ * structure has received since it was initialized or the counters were last
+ * reset, both as they came over the network and after decompression, and
+ * how many of its requests were retried or hedged.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[out] stats The deltacloud_transfer_stats structure to fill in
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_get_transfer_stats(struct deltacloud_api *api,
+				  struct deltacloud_transfer_stats *stats)
+{
+  if (!valid_api(api) || !valid_arg(stats))
+    return -1;
+
+  transfer_stats_get(&api->priv->stats, stats);
+
+  return 0;
+}
+
+/**
+ * A function to reset the counters reported by
+ * deltacloud_get_transfer_stats() to zero.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_reset_transfer_stats(struct deltacloud_api *api)
+{
+  if (!valid_api(api))
+    return -1;
+
+  transfer_stats_reset(&api->priv->stats);
+
+  return 0;
+}
+
+/**
+ * A function to set how many requests the deltacloud_get_*_by_ids functions
+ * may have in flight at once on this deltacloud_api structure.  A bigger
+ * window hides more round trips, at the cost of more simultaneous
+ * connections to the server.  The window also feeds into the choice between
+ * fetching the ids one by one and fetching the whole collection.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] window The maximum number of concurrent requests; must be >= 1
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_set_batch_window(struct deltacloud_api *api, int window)
+{
+  if (!valid_api(api))
+    return -1;
+
+  if (window < 1) {
+    invalid_argument_error("window must be >= 1");
+    return -1;
+  }
+
+  pthread_mutex_lock(&api->priv->batch.lock);
+  api->priv->batch.window = window;
+  pthread_mutex_unlock(&api->priv->batch.lock);
+
+  return 0;
+}
+
 /**
  * A function to free up a deltacloud_api structure originally configured
  * through deltacloud_initialize().
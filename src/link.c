@@ -147,3 +147,71 @@ void free_link_list(struct deltacloud_link **links)
 {
   free_list(links, struct deltacloud_link, free_link);
 }
+
+static void free_constraint_list(struct deltacloud_feature_constraint **constraints)
+{
+  free_list(constraints, struct deltacloud_feature_constraint,
+	    free_constraint);
+}
+
+static int copy_constraint(struct deltacloud_feature_constraint *dst,
+			   const struct deltacloud_feature_constraint *src)
+{
+  if (copy_string(&dst->name, src->name) < 0 ||
+      copy_string(&dst->value, src->value) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_constraint_list(struct deltacloud_feature_constraint **dst,
+				const struct deltacloud_feature_constraint *src)
+{
+  copy_list(dst, src, struct deltacloud_feature_constraint, copy_constraint,
+	    free_constraint_list);
+
+  return 0;
+}
+
+static void free_feature_list(struct deltacloud_feature **features)
+{
+  free_list(features, struct deltacloud_feature, free_feature);
+}
+
+static int copy_feature(struct deltacloud_feature *dst,
+			const struct deltacloud_feature *src)
+{
+  if (copy_string(&dst->name, src->name) < 0 ||
+      copy_constraint_list(&dst->constraints, src->constraints) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_feature_list(struct deltacloud_feature **dst,
+			     const struct deltacloud_feature *src)
+{
+  copy_list(dst, src, struct deltacloud_feature, copy_feature,
+	    free_feature_list);
+
+  return 0;
+}
+
+static int copy_link(struct deltacloud_link *dst,
+		     const struct deltacloud_link *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->rel, src->rel) < 0 ||
+      copy_feature_list(&dst->features, src->features) < 0)
+    return -1;
+
+  return 0;
+}
+
+int copy_link_list(struct deltacloud_link **dst,
+		   const struct deltacloud_link *src)
+{
+  copy_list(dst, src, struct deltacloud_link, copy_link, free_link_list);
+
+  return 0;
+}
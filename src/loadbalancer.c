@@ -24,6 +24,7 @@
 #include <memory.h>
 #include "common.h"
 #include "loadbalancer.h"
+#include "decoder.h"
 
 /** @file */
 
@@ -33,9 +34,15 @@
  * from having to have -I/path/to/libxml2/headers in their build paths.
  */
 int parse_addresses_xml(xmlNodePtr root, xmlXPathContextPtr ctxt,
-			struct deltacloud_address **addresses);
-int parse_actions_xml(xmlNodePtr root, struct deltacloud_action **actions);
+			void *data);
+int parse_actions_xml(xmlNodePtr root, xmlXPathContextPtr ctxt, void *data);
 int parse_link_xml(xmlNodePtr linknode, struct deltacloud_link **links);
+int copy_address_list(struct deltacloud_address **dst,
+		      const struct deltacloud_address *src);
+int copy_action_list(struct deltacloud_action **dst,
+		     const struct deltacloud_action *src);
+int copy_link_list(struct deltacloud_link **dst,
+		   const struct deltacloud_link *src);
 /** @endcond */
 
 static void free_lb_instance(struct deltacloud_loadbalancer_instance *instance)
@@ -52,18 +59,24 @@ static void free_listener(struct deltacloud_loadbalancer_listener *listener)
   SAFE_FREE(listener->instance_port);
 }
 
+static const struct decode_field listener_fields[] = {
+  DECODE_ATTR("protocol", struct deltacloud_loadbalancer_listener, protocol),
+  DECODE_TEXT("load_balancer_port", struct deltacloud_loadbalancer_listener,
+	      load_balancer_port),
+  DECODE_TEXT("instance_port", struct deltacloud_loadbalancer_listener,
+	      instance_port),
+  DECODE_END
+};
+
 static int parse_listener_xml(xmlNodePtr root, xmlXPathContextPtr ctxt,
-			      struct deltacloud_loadbalancer_listener **listeners)
+			      void *data)
 {
+  struct deltacloud_loadbalancer_listener **listeners = (struct deltacloud_loadbalancer_listener **)data;
   struct deltacloud_loadbalancer_listener *thislistener;
-  xmlNodePtr oldnode, cur;
-  int ret = -1;
+  xmlNodePtr cur;
 
   *listeners = NULL;
 
-  oldnode = ctxt->node;
-
-  ctxt->node = root;
   cur = root->children;
   while (cur != NULL) {
     if (cur->type == XML_ELEMENT_NODE &&
@@ -72,14 +85,11 @@ static int parse_listener_xml(xmlNodePtr root, xmlXPathContextPtr ctxt,
       thislistener = calloc(1, sizeof(struct deltacloud_loadbalancer_listener));
       if (thislistener == NULL) {
 	oom_error();
-	goto cleanup;
+	return -1;
       }
 
-      thislistener->protocol = (char *)xmlGetProp(cur, BAD_CAST "protocol");
-      thislistener->load_balancer_port = getXPathString("string(./listener/load_balancer_port)",
-							ctxt);
-      thislistener->instance_port = getXPathString("string(./listener/instance_port)",
-						   ctxt);
+      /* can't fail; there are no callbacks in the table */
+      decode_element(cur, ctxt, listener_fields, thislistener);
 
       /* add_to_list can't fail */
       add_to_list(listeners, struct deltacloud_loadbalancer_listener,
@@ -88,26 +98,24 @@ static int parse_listener_xml(xmlNodePtr root, xmlXPathContextPtr ctxt,
     cur = cur->next;
   }
 
-  ret = 0;
-
- cleanup:
-  ctxt->node = oldnode;
-
-  return ret;
+  return 0;
 }
 
+static const struct decode_field lb_instance_fields[] = {
+  DECODE_ATTR("href", struct deltacloud_loadbalancer_instance, href),
+  DECODE_ATTR("id", struct deltacloud_loadbalancer_instance, id),
+  DECODE_END
+};
+
 static int parse_lb_instance_xml(xmlNodePtr root, xmlXPathContextPtr ctxt,
-				 struct deltacloud_loadbalancer_instance **instances)
+				 void *data)
 {
+  struct deltacloud_loadbalancer_instance **instances = (struct deltacloud_loadbalancer_instance **)data;
   struct deltacloud_loadbalancer_instance *thisinst;
-  xmlNodePtr oldnode, cur;
-  int ret = -1;
+  xmlNodePtr cur;
 
   *instances = NULL;
 
-  oldnode = ctxt->node;
-
-  ctxt->node = root;
   cur = root->children;
   while (cur != NULL) {
     if (cur->type == XML_ELEMENT_NODE &&
@@ -116,16 +124,16 @@ static int parse_lb_instance_xml(xmlNodePtr root, xmlXPathContextPtr ctxt,
       thisinst = calloc(1, sizeof(struct deltacloud_loadbalancer_instance));
       if (thisinst == NULL) {
 	oom_error();
-	goto cleanup;
+	return -1;
       }
 
-      thisinst->href = (char *)xmlGetProp(cur, BAD_CAST "href");
-      thisinst->id = (char *)xmlGetProp(cur, BAD_CAST "id");
+      /* can't fail; there are no callbacks in the table */
+      decode_element(cur, ctxt, lb_instance_fields, thisinst);
 
       if (parse_link_xml(cur->children, &(thisinst->links)) < 0) {
 	free_lb_instance(thisinst);
 	SAFE_FREE(thisinst);
-	goto cleanup;
+	return -1;
       }
 
       /* add_to_list can't fail */
@@ -134,75 +142,39 @@ static int parse_lb_instance_xml(xmlNodePtr root, xmlXPathContextPtr ctxt,
     cur = cur->next;
   }
 
-  ret = 0;
-
- cleanup:
-  ctxt->node = oldnode;
-
-  return ret;
+  return 0;
 }
 
+static const struct decode_field loadbalancer_fields[] = {
+  DECODE_ATTR("href", struct deltacloud_loadbalancer, href),
+  DECODE_ATTR("id", struct deltacloud_loadbalancer, id),
+  DECODE_TEXT("created_at", struct deltacloud_loadbalancer, created_at),
+  DECODE_CHILD_ATTR("realm", "href", struct deltacloud_loadbalancer,
+		    realm_href),
+  DECODE_CHILD_ATTR("realm", "id", struct deltacloud_loadbalancer, realm_id),
+  DECODE_CHILD("actions", struct deltacloud_loadbalancer, actions,
+	       parse_actions_xml),
+  DECODE_CHILD("public_addresses", struct deltacloud_loadbalancer,
+	       public_addresses, parse_addresses_xml),
+  DECODE_CHILD("listeners", struct deltacloud_loadbalancer, listeners,
+	       parse_listener_xml),
+  DECODE_CHILD("instances", struct deltacloud_loadbalancer, instances,
+	       parse_lb_instance_xml),
+  DECODE_END
+};
+
 static int parse_one_loadbalancer(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 				  void *output)
 {
   struct deltacloud_loadbalancer *thislb = (struct deltacloud_loadbalancer *)output;
-  xmlXPathObjectPtr actionset, pubset, listenerset, instanceset;
 
   memset(thislb, 0, sizeof(struct deltacloud_loadbalancer));
 
-  thislb->href = (char *)xmlGetProp(cur, BAD_CAST "href");
-  thislb->id = (char *)xmlGetProp(cur, BAD_CAST "id");
-  thislb->created_at = getXPathString("string(./created_at)", ctxt);
-  thislb->realm_href = getXPathString("string(./realm/@href)", ctxt);
-  thislb->realm_id = getXPathString("string(./realm/@id)", ctxt);
-
-  actionset = xmlXPathEval(BAD_CAST "./actions", ctxt);
-  if (actionset && actionset->type == XPATH_NODESET &&
-      actionset->nodesetval && actionset->nodesetval->nodeNr == 1) {
-    if (parse_actions_xml(actionset->nodesetval->nodeTab[0],
-			  &(thislb->actions)) < 0) {
-      deltacloud_free_loadbalancer(thislb);
-      xmlXPathFreeObject(actionset);
-      return -1;
-    }
-  }
-  xmlXPathFreeObject(actionset);
-
-  pubset = xmlXPathEval(BAD_CAST "./public_addresses", ctxt);
-  if (pubset && pubset->type == XPATH_NODESET && pubset->nodesetval &&
-      pubset->nodesetval->nodeNr == 1) {
-    if (parse_addresses_xml(pubset->nodesetval->nodeTab[0], ctxt,
-			    &(thislb->public_addresses)) < 0) {
-      deltacloud_free_loadbalancer(thislb);
-      xmlXPathFreeObject(pubset);
-      return -1;
-    }
-  }
-  xmlXPathFreeObject(pubset);
-
-  listenerset = xmlXPathEval(BAD_CAST "./listeners", ctxt);
-  if (listenerset && listenerset->type == XPATH_NODESET &&
-      listenerset->nodesetval && listenerset->nodesetval->nodeNr == 1) {
-    if (parse_listener_xml(listenerset->nodesetval->nodeTab[0], ctxt,
-			   &(thislb->listeners)) < 0) {
-      deltacloud_free_loadbalancer(thislb);
-      xmlXPathFreeObject(listenerset);
-      return -1;
-    }
-  }
-  xmlXPathFreeObject(listenerset);
-
-  instanceset = xmlXPathEval(BAD_CAST "./instances", ctxt);
-  if (instanceset && instanceset->type == XPATH_NODESET &&
-      instanceset->nodesetval && instanceset->nodesetval->nodeNr == 1) {
-    if (parse_lb_instance_xml(instanceset->nodesetval->nodeTab[0], ctxt,
-			      &(thislb->instances)) < 0) {
-      deltacloud_free_loadbalancer(thislb);
-      xmlXPathFreeObject(instanceset);
-      return -1;
-    }
+  if (decode_element(cur, ctxt, loadbalancer_fields, thislb) < 0) {
+    /* the callbacks are expected to have set their own errors */
+    deltacloud_free_loadbalancer(thislb);
+    return -1;
   }
-  xmlXPathFreeObject(instanceset);
 
   return 0;
 }
@@ -333,6 +305,24 @@ static int lb_register_unregister(struct deltacloud_api *api,
   return ret;
 }
 
+static int copy_loadbalancer(struct deltacloud_loadbalancer *dst,
+			     const struct deltacloud_loadbalancer *src);
+static int copy_loadbalancer_list(struct deltacloud_loadbalancer **dst,
+				  const struct deltacloud_loadbalancer *src);
+
+static const struct collection_type loadbalancer_collection_type = {
+  .relname = "load_balancers",
+  .rootname = "load_balancers",
+  .list_cb = parse_loadbalancer_xml,
+  .copy_all = (int (*)(void *, const void *))copy_loadbalancer_list,
+  .free_all = (void (*)(void *))deltacloud_free_loadbalancer_list,
+  .oneroot = "load_balancer",
+  .one_cb = parse_one_loadbalancer,
+  .copy_one = (int (*)(void *, const void *))copy_loadbalancer,
+  .free_one = (void (*)(void *))deltacloud_free_loadbalancer,
+  .size = sizeof(struct deltacloud_loadbalancer),
+};
+
 /**
  * A function to get a linked list of all of the load balancers.  The caller
  * is expected to free the list using deltacloud_free_loadbalancer_list().
@@ -344,8 +334,7 @@ static int lb_register_unregister(struct deltacloud_api *api,
 int deltacloud_get_loadbalancers(struct deltacloud_api *api,
 				 struct deltacloud_loadbalancer **balancers)
 {
-  return internal_get(api, "load_balancers", "load_balancers",
-		      parse_loadbalancer_xml, (void **)balancers);
+  return internal_get(api, &loadbalancer_collection_type, (void **)balancers);
 }
 
 /**
@@ -362,8 +351,8 @@ int deltacloud_get_loadbalancer_by_id(struct deltacloud_api *api,
 				      const char *id,
 				      struct deltacloud_loadbalancer *balancer)
 {
-  return internal_get_by_id(api, id, "load_balancers", "load_balancer",
-			    parse_one_loadbalancer, balancer);
+  return internal_get_type_by_id(api, &loadbalancer_collection_type, id,
+				 balancer);
 }
 
 /**
@@ -509,7 +498,7 @@ int deltacloud_loadbalancer_destroy(struct deltacloud_api *api,
   if (!valid_api(api) || !valid_arg(balancer))
     return -1;
 
-  return internal_destroy(balancer->href, api->user, api->password, api->driver, api->provider);
+  return internal_destroy(api, balancer->href);
 }
 
 /**
@@ -545,3 +534,80 @@ void deltacloud_free_loadbalancer_list(struct deltacloud_loadbalancer **lbs)
 {
   free_list(lbs, struct deltacloud_loadbalancer, deltacloud_free_loadbalancer);
 }
+
+static void free_listener_list(struct deltacloud_loadbalancer_listener **listeners)
+{
+  free_list(listeners, struct deltacloud_loadbalancer_listener, free_listener);
+}
+
+static int copy_listener(struct deltacloud_loadbalancer_listener *dst,
+			 const struct deltacloud_loadbalancer_listener *src)
+{
+  if (copy_string(&dst->protocol, src->protocol) < 0 ||
+      copy_string(&dst->load_balancer_port, src->load_balancer_port) < 0 ||
+      copy_string(&dst->instance_port, src->instance_port) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_listener_list(struct deltacloud_loadbalancer_listener **dst,
+			      const struct deltacloud_loadbalancer_listener *src)
+{
+  copy_list(dst, src, struct deltacloud_loadbalancer_listener, copy_listener,
+	    free_listener_list);
+
+  return 0;
+}
+
+static void free_lb_instance_list(struct deltacloud_loadbalancer_instance **instances)
+{
+  free_list(instances, struct deltacloud_loadbalancer_instance,
+	    free_lb_instance);
+}
+
+static int copy_lb_instance(struct deltacloud_loadbalancer_instance *dst,
+			    const struct deltacloud_loadbalancer_instance *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_link_list(&dst->links, src->links) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_lb_instance_list(struct deltacloud_loadbalancer_instance **dst,
+				 const struct deltacloud_loadbalancer_instance *src)
+{
+  copy_list(dst, src, struct deltacloud_loadbalancer_instance, copy_lb_instance,
+	    free_lb_instance_list);
+
+  return 0;
+}
+
+static int copy_loadbalancer(struct deltacloud_loadbalancer *dst,
+			     const struct deltacloud_loadbalancer *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->created_at, src->created_at) < 0 ||
+      copy_string(&dst->realm_href, src->realm_href) < 0 ||
+      copy_string(&dst->realm_id, src->realm_id) < 0 ||
+      copy_action_list(&dst->actions, src->actions) < 0 ||
+      copy_address_list(&dst->public_addresses, src->public_addresses) < 0 ||
+      copy_listener_list(&dst->listeners, src->listeners) < 0 ||
+      copy_lb_instance_list(&dst->instances, src->instances) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_loadbalancer_list(struct deltacloud_loadbalancer **dst,
+				  const struct deltacloud_loadbalancer *src)
+{
+  copy_list(dst, src, struct deltacloud_loadbalancer, copy_loadbalancer,
+	    deltacloud_free_loadbalancer_list);
+
+  return 0;
+}
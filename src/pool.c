@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "pool.h"
+
+int pool_init(struct connection_pool *pool)
+{
+  memset(pool, 0, sizeof(struct connection_pool));
+
+  if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to initialize pool lock");
+    return -1;
+  }
+
+  pool->size = POOL_DEFAULT_SIZE;
+  pool->idle_timeout = POOL_DEFAULT_IDLE_TIMEOUT;
+
+  return 0;
+}
+
+/* must be called with pool->lock held.  Entries are kept most recently
+ * returned first, so everything after the first stale entry is stale too.
+ * We also trim the list down to pool->size here, in case the size was
+ * lowered after the handles were returned.
+ */
+static struct pool_entry *unlink_expired(struct connection_pool *pool,
+					 time_t now)
+{
+  struct pool_entry **curr;
+  struct pool_entry *expired;
+  int kept = 0;
+
+  curr = &pool->idle;
+  while (*curr != NULL) {
+    if (kept >= pool->size ||
+	(pool->idle_timeout > 0 &&
+	 now - (*curr)->last_used >= pool->idle_timeout))
+      break;
+    kept++;
+    curr = &(*curr)->next;
+  }
+
+  expired = *curr;
+  *curr = NULL;
+  pool->count = kept;
+
+  return expired;
+}
+
+static void free_entries(struct pool_entry *entry)
+{
+  struct pool_entry *next;
+
+  while (entry != NULL) {
+    next = entry->next;
+    curl_easy_cleanup(entry->curl);
+    SAFE_FREE(entry);
+    entry = next;
+  }
+}
+
+void pool_destroy(struct connection_pool *pool)
+{
+  free_entries(pool->idle);
+  pool->idle = NULL;
+  pool->count = 0;
+  pthread_mutex_destroy(&pool->lock);
+}
+
+/* hand out an idle handle if there is one, otherwise a brand new one.  The
+ * handle comes back with all options reset to their defaults, so callers
+ * set it up exactly as they would a handle from curl_easy_init(), and then
+ * attach it to *share if that is not NULL.  The share stays valid until the
+ * handle is given back with pool_return().
+ */
+CURL *pool_checkout(struct connection_pool *pool, CURLSH **share)
+{
+  struct pool_entry *entry;
+  struct pool_entry *expired;
+  CURL *curl;
+
+  pthread_mutex_lock(&pool->lock);
+  expired = unlink_expired(pool, time(NULL));
+  entry = pool->idle;
+  if (entry != NULL) {
+    pool->idle = entry->next;
+    pool->count--;
+  }
+  pool->out++;
+  *share = pool->share;
+  pthread_mutex_unlock(&pool->lock);
+
+  /* closing connections can block, so do it outside of the lock */
+  free_entries(expired);
+
+  if (entry != NULL) {
+    curl = entry->curl;
+    SAFE_FREE(entry);
+    curl_easy_reset(curl);
+    return curl;
+  }
+
+  curl = curl_easy_init();
+  if (curl == NULL) {
+    pthread_mutex_lock(&pool->lock);
+    pool->out--;
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  return curl;
+}
+
+void pool_return(struct connection_pool *pool, CURL *curl)
+{
+  struct pool_entry *entry;
+  struct pool_entry *expired;
+  time_t now;
+
+  if (curl == NULL)
+    return;
+
+  entry = malloc(sizeof(struct pool_entry));
+  if (entry == NULL) {
+    /* not worth failing the caller over; just don't cache the handle */
+    curl_easy_cleanup(curl);
+    pthread_mutex_lock(&pool->lock);
+    pool->out--;
+    pthread_mutex_unlock(&pool->lock);
+    return;
+  }
+
+  now = time(NULL);
+  entry->curl = curl;
+  entry->last_used = now;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->out--;
+  expired = unlink_expired(pool, now);
+  if (pool->count < pool->size) {
+    entry->next = pool->idle;
+    pool->idle = entry;
+    pool->count++;
+    entry = NULL;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  free_entries(expired);
+  if (entry != NULL) {
+    curl_easy_cleanup(entry->curl);
+    SAFE_FREE(entry);
+  }
+}
+
+void pool_set_size(struct connection_pool *pool, int size)
+{
+  struct pool_entry *expired;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->size = size;
+  expired = unlink_expired(pool, time(NULL));
+  pthread_mutex_unlock(&pool->lock);
+
+  free_entries(expired);
+}
+
+void pool_set_idle_timeout(struct connection_pool *pool, int seconds)
+{
+  struct pool_entry *expired;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->idle_timeout = seconds;
+  expired = unlink_expired(pool, time(NULL));
+  pthread_mutex_unlock(&pool->lock);
+
+  free_entries(expired);
+}
+
+/* close every idle handle, and with them the connections they keep open */
+void pool_flush(struct connection_pool *pool)
+{
+  struct pool_entry *expired;
+
+  pthread_mutex_lock(&pool->lock);
+  expired = pool->idle;
+  pool->idle = NULL;
+  pool->count = 0;
+  pthread_mutex_unlock(&pool->lock);
+
+  free_entries(expired);
+}
+
+/* attach every handle checked out from now on to share instead, and put the
+ * old one in *old.  The idle handles are still attached to the old share,
+ * so they are closed; the ones that are checked out cannot be reached from
+ * here, so the change is refused while there are any.
+ */
+int pool_set_share(struct connection_pool *pool, CURLSH *share, CURLSH **old)
+{
+  struct pool_entry *expired;
+
+  pthread_mutex_lock(&pool->lock);
+  *old = pool->share;
+  if (share == pool->share) {
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+  }
+  if (pool->out > 0) {
+    pthread_mutex_unlock(&pool->lock);
+    invalid_argument_error("cannot change sharing with requests in flight");
+    return -1;
+  }
+  pool->share = share;
+  expired = pool->idle;
+  pool->idle = NULL;
+  pool->count = 0;
+  pthread_mutex_unlock(&pool->lock);
+
+  free_entries(expired);
+
+  return 0;
+}
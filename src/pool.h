@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <time.h>
+#include <pthread.h>
+#include <curl/curl.h>
+
+#define POOL_DEFAULT_SIZE 8
+#define POOL_DEFAULT_IDLE_TIMEOUT 60
+
+struct pool_entry {
+  CURL *curl;
+  time_t last_used;
+
+  struct pool_entry *next;
+};
+
+/* A pool of idle curl easy handles.  An easy handle keeps its live
+ * connections, its DNS cache and its SSL session cache across
+ * curl_easy_reset(), so handing the same handle out again lets consecutive
+ * requests to the same server skip the TCP and TLS handshakes.
+ */
+struct connection_pool {
+  pthread_mutex_t lock;
+  struct pool_entry *idle; /* most recently returned handle first */
+  int count; /* number of handles on the idle list */
+  int size; /* maximum number of idle handles to keep around */
+  int idle_timeout; /* seconds an idle handle may sit before it is closed */
+  int out; /* number of handles checked out and not yet returned */
+  CURLSH *share; /* what every handle checked out gets attached to, or NULL */
+};
+
+int pool_init(struct connection_pool *pool);
+void pool_destroy(struct connection_pool *pool);
+CURL *pool_checkout(struct connection_pool *pool, CURLSH **share);
+void pool_return(struct connection_pool *pool, CURL *curl);
+void pool_set_size(struct connection_pool *pool, int size);
+void pool_set_idle_timeout(struct connection_pool *pool, int seconds);
+void pool_flush(struct connection_pool *pool);
+int pool_set_share(struct connection_pool *pool, CURLSH *share,
+		   CURLSH **old);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "common.h"
+#include "ratelimit.h"
+
+/* protects limiters and the users count of each of them */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rate_limiter *limiters = NULL;
+
+static void free_limiter(struct rate_limiter *limiter)
+{
+  pthread_mutex_destroy(&limiter->lock);
+  SAFE_FREE(limiter->driver);
+  SAFE_FREE(limiter->provider);
+  SAFE_FREE(limiter);
+}
+
+static struct rate_limiter *new_limiter(const char *driver,
+					const char *provider)
+{
+  struct rate_limiter *limiter;
+
+  limiter = calloc(1, sizeof(struct rate_limiter));
+  if (limiter == NULL) {
+    oom_error();
+    return NULL;
+  }
+
+  if (pthread_mutex_init(&limiter->lock, NULL) != 0) {
+    SAFE_FREE(limiter);
+    set_error(DELTACLOUD_INTERNAL_ERROR,
+	      "Failed to initialize rate limiter lock");
+    return NULL;
+  }
+
+  limiter->driver = strdup(driver);
+  limiter->provider = strdup(provider);
+  if (limiter->driver == NULL || limiter->provider == NULL) {
+    free_limiter(limiter);
+    oom_error();
+    return NULL;
+  }
+
+  return limiter;
+}
+
+/* the limiter for driver and provider, created unlimited if this is the
+ * first deltacloud_api to use them.  Every successful call must be paired
+ * with a call to rate_limiter_release().
+ */
+struct rate_limiter *rate_limiter_acquire(const char *driver,
+					  const char *provider)
+{
+  struct rate_limiter *limiter;
+
+  pthread_mutex_lock(&registry_lock);
+
+  for (limiter = limiters; limiter != NULL; limiter = limiter->next) {
+    if (STREQ(limiter->driver, driver) &&
+	STREQ(limiter->provider, provider))
+      break;
+  }
+
+  if (limiter == NULL) {
+    /* new_limiter sets the error */
+    limiter = new_limiter(driver, provider);
+    if (limiter != NULL) {
+      limiter->next = limiters;
+      limiters = limiter;
+    }
+  }
+
+  if (limiter != NULL)
+    limiter->users++;
+
+  pthread_mutex_unlock(&registry_lock);
+
+  return limiter;
+}
+
+void rate_limiter_release(struct rate_limiter *limiter)
+{
+  struct rate_limiter **curr;
+
+  pthread_mutex_lock(&registry_lock);
+
+  limiter->users--;
+  if (limiter->users == 0) {
+    for (curr = &limiters; *curr != NULL; curr = &(*curr)->next) {
+      if (*curr == limiter) {
+	*curr = limiter->next;
+	break;
+      }
+    }
+    free_limiter(limiter);
+  }
+
+  pthread_mutex_unlock(&registry_lock);
+}
+
+/* must be called with limiter->lock held */
+static void refill(struct rate_bucket *bucket, double now)
+{
+  bucket->tokens += (now - bucket->updated_ms) * bucket->rate / 1000.0;
+  if (bucket->tokens > bucket->burst)
+    bucket->tokens = bucket->burst;
+  bucket->updated_ms = now;
+}
+
+void rate_limiter_set(struct rate_limiter *limiter, int kind, double rate,
+		      int burst)
+{
+  struct rate_bucket *bucket = &limiter->buckets[kind];
+
+  pthread_mutex_lock(&limiter->lock);
+  bucket->rate = rate;
+  bucket->burst = burst;
+  /* start out full, as if the limit had always been there */
+  bucket->tokens = burst;
+  bucket->updated_ms = now_ms();
+  pthread_mutex_unlock(&limiter->lock);
+}
+
+/* take a token from the bucket for kind before sending a request.  If none
+ * is left, wait for the next one, unless that would take longer than
+ * max_wait_ms; a negative max_wait_ms waits as long as it takes.  The token
+ * is claimed before waiting, so that waiting callers are served in the
+ * order they arrived.  Returns 0 when the request may go ahead, or -1 with
+ * the error set if it may not.
+ */
+int rate_limiter_take(struct rate_limiter *limiter, int kind,
+		      long max_wait_ms)
+{
+  struct rate_bucket *bucket = &limiter->buckets[kind];
+  double wait = 0;
+  char *tmp;
+
+  pthread_mutex_lock(&limiter->lock);
+
+  if (bucket->rate > 0) {
+    refill(bucket, now_ms());
+    if (bucket->tokens < 1)
+      wait = (1 - bucket->tokens) * 1000.0 / bucket->rate;
+    if (max_wait_ms >= 0 && wait > max_wait_ms) {
+      pthread_mutex_unlock(&limiter->lock);
+      if (asprintf(&tmp, "Rate limit for %s requests to %s/%s reached; "
+		   "the next one can be sent in %.0f ms",
+		   kind == RATE_READ ? "read" : "write", limiter->driver,
+		   limiter->provider, wait) < 0)
+	set_error(DELTACLOUD_RATE_LIMITED_ERROR, "Rate limit reached");
+      else {
+	set_error(DELTACLOUD_RATE_LIMITED_ERROR, tmp);
+	SAFE_FREE(tmp);
+      }
+      return -1;
+    }
+    bucket->tokens -= 1;
+  }
+
+  pthread_mutex_unlock(&limiter->lock);
+
+  if (wait > 0)
+    sleep_ms(wait);
+
+  return 0;
+}
+
+/* take a token from the bucket for kind only if there is one right now,
+ * for callers that must not sleep, such as an event loop.  Returns 0 if the
+ * token was taken, or else how many milliseconds it will be until there is
+ * one; nothing is claimed in that case, and no error is set.
+ */
+long rate_limiter_try(struct rate_limiter *limiter, int kind)
+{
+  struct rate_bucket *bucket = &limiter->buckets[kind];
+  long wait = 0;
+
+  pthread_mutex_lock(&limiter->lock);
+  if (bucket->rate > 0) {
+    refill(bucket, now_ms());
+    if (bucket->tokens >= 1)
+      bucket->tokens -= 1;
+    else
+      wait = (long)ceil((1 - bucket->tokens) * 1000.0 / bucket->rate);
+  }
+  pthread_mutex_unlock(&limiter->lock);
+
+  return wait;
+}
+
+/* whether a request of kind could go out right now without waiting */
+int rate_limiter_ready(struct rate_limiter *limiter, int kind)
+{
+  struct rate_bucket *bucket = &limiter->buckets[kind];
+  int ready = 1;
+
+  pthread_mutex_lock(&limiter->lock);
+  if (bucket->rate > 0) {
+    refill(bucket, now_ms());
+    ready = bucket->tokens >= 1;
+  }
+  pthread_mutex_unlock(&limiter->lock);
+
+  return ready;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+
+/* indexes into rate_limiter->buckets */
+#define RATE_READ 0 /* GET and HEAD */
+#define RATE_WRITE 1 /* everything that can change something */
+#define RATE_KINDS 2
+
+/* a token bucket; a rate of 0 means unlimited */
+struct rate_bucket {
+  double rate; /* tokens added per second */
+  double burst; /* the most tokens the bucket holds */
+  double tokens; /* may go negative while callers wait for tokens they took */
+  double updated_ms; /* when tokens was last brought up to date */
+};
+
+/* The limits on the requests sent to one driver and provider.  There is one
+ * of these per driver and provider in the process, shared by every
+ * deltacloud_api that was initialized with them, since it is the provider
+ * behind the server that enforces the quota we are trying to stay under.
+ */
+struct rate_limiter {
+  char *driver;
+  char *provider;
+  int users; /* protected by the registry lock, not by lock */
+  pthread_mutex_t lock;
+  struct rate_bucket buckets[RATE_KINDS];
+
+  struct rate_limiter *next;
+};
+
+#define RATE_DEFAULT_MAX_WAIT_MS -1 /* wait as long as it takes */
+
+struct rate_limiter *rate_limiter_acquire(const char *driver,
+					  const char *provider);
+void rate_limiter_release(struct rate_limiter *limiter);
+void rate_limiter_set(struct rate_limiter *limiter, int kind, double rate,
+		      int burst);
+int rate_limiter_take(struct rate_limiter *limiter, int kind,
+		      long max_wait_ms);
+long rate_limiter_try(struct rate_limiter *limiter, int kind);
+int rate_limiter_ready(struct rate_limiter *limiter, int kind);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
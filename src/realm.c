@@ -23,9 +23,19 @@
 #include <string.h>
 #include "common.h"
 #include "realm.h"
+#include "decoder.h"
 
 /** @file */
 
+static const struct decode_field realm_fields[] = {
+  DECODE_ATTR("href", struct deltacloud_realm, href),
+  DECODE_ATTR("id", struct deltacloud_realm, id),
+  DECODE_TEXT("name", struct deltacloud_realm, name),
+  DECODE_TEXT("state", struct deltacloud_realm, state),
+  DECODE_TEXT("limit", struct deltacloud_realm, limit),
+  DECODE_END
+};
+
 static int parse_one_realm(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 			   void *output)
 {
@@ -33,13 +43,7 @@ static int parse_one_realm(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 
   memset(thisrealm, 0, sizeof(struct deltacloud_realm));
 
-  thisrealm->href = (char *)xmlGetProp(cur, BAD_CAST "href");
-  thisrealm->id = (char *)xmlGetProp(cur, BAD_CAST "id");
-  thisrealm->name = getXPathString("string(./name)", ctxt);
-  thisrealm->state = getXPathString("string(./state)", ctxt);
-  thisrealm->limit = getXPathString("string(./limit)", ctxt);
-
-  return 0;
+  return decode_element(cur, ctxt, realm_fields, thisrealm);
 }
 
 static int parse_realm_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
@@ -86,6 +90,24 @@ static int parse_realm_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
   return ret;
 }
 
+static int copy_realm(struct deltacloud_realm *dst,
+		      const struct deltacloud_realm *src);
+static int copy_realm_list(struct deltacloud_realm **dst,
+			   const struct deltacloud_realm *src);
+
+static const struct collection_type realm_collection_type = {
+  .relname = "realms",
+  .rootname = "realms",
+  .list_cb = parse_realm_xml,
+  .copy_all = (int (*)(void *, const void *))copy_realm_list,
+  .free_all = (void (*)(void *))deltacloud_free_realm_list,
+  .oneroot = "realm",
+  .one_cb = parse_one_realm,
+  .copy_one = (int (*)(void *, const void *))copy_realm,
+  .free_one = (void (*)(void *))deltacloud_free_realm,
+  .size = sizeof(struct deltacloud_realm),
+};
+
 /**
  * A function to get a linked list of all of the realms.  The caller
  * is expected to free the list using deltacloud_free_realm_list().
@@ -97,8 +119,7 @@ static int parse_realm_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 int deltacloud_get_realms(struct deltacloud_api *api,
 			  struct deltacloud_realm **realms)
 {
-  return internal_get(api, "realms", "realms", parse_realm_xml,
-		      (void **)realms);
+  return internal_get(api, &realm_collection_type, (void **)realms);
 }
 
 /**
@@ -113,7 +134,46 @@ int deltacloud_get_realms(struct deltacloud_api *api,
 int deltacloud_get_realm_by_id(struct deltacloud_api *api, const char *id,
 			       struct deltacloud_realm *realm)
 {
-  return internal_get_by_id(api, id, "realms", "realm", parse_one_realm, realm);
+  return internal_get_type_by_id(api, &realm_collection_type, id, realm);
+}
+
+/**
+ * A function to start fetching the list of all of the realms without
+ * waiting for the result.  The callback runs from deltacloud_async_perform()
+ * with the list of realms, which it is expected to free using
+ * deltacloud_free_realm_list().
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] cb The function to call once the list has been fetched
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_realms(struct deltacloud_api *api,
+				deltacloud_async_cb cb, void *userdata)
+{
+  return internal_async_get(api, "realms", "realms", parse_realm_xml,
+			    cb, userdata);
+}
+
+/**
+ * A function to start looking up a particular realm by id without waiting
+ * for the result.  On success the callback is handed the deltacloud_realm
+ * structure, which the caller is expected to free using
+ * deltacloud_free_realm().
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] id The realm ID to look for
+ * @param[out] realm The deltacloud_realm structure to fill in if the ID is
+ *             found; it must stay valid until cb has run
+ * @param[in] cb The function to call once the lookup has finished
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_realm_by_id(struct deltacloud_api *api,
+				     const char *id,
+				     struct deltacloud_realm *realm,
+				     deltacloud_async_cb cb, void *userdata)
+{
+  return internal_async_get_by_id(api, id, "realms", "realm",
+				  parse_one_realm, realm, cb, userdata);
 }
 
 /**
@@ -142,3 +202,25 @@ void deltacloud_free_realm_list(struct deltacloud_realm **realms)
 {
   free_list(realms, struct deltacloud_realm, deltacloud_free_realm);
 }
+
+static int copy_realm(struct deltacloud_realm *dst,
+		      const struct deltacloud_realm *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->name, src->name) < 0 ||
+      copy_string(&dst->limit, src->limit) < 0 ||
+      copy_string(&dst->state, src->state) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_realm_list(struct deltacloud_realm **dst,
+			   const struct deltacloud_realm *src)
+{
+  copy_list(dst, src, struct deltacloud_realm, copy_realm,
+	    deltacloud_free_realm_list);
+
+  return 0;
+}
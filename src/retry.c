@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "curl_action.h"
+#include "retry.h"
+
+int retry_policy_init(struct retry_policy *policy)
+{
+  memset(policy, 0, sizeof(struct retry_policy));
+
+  if (pthread_mutex_init(&policy->lock, NULL) != 0) {
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to initialize retry lock");
+    return -1;
+  }
+
+  policy->base_ms = RETRY_DEFAULT_BASE_MS;
+  policy->max_ms = RETRY_DEFAULT_MAX_MS;
+  policy->budget_percent = RETRY_DEFAULT_BUDGET_PERCENT;
+  policy->budget_reserve = RETRY_DEFAULT_BUDGET_RESERVE;
+  policy->balance = policy->budget_reserve;
+  /* handles created at the same moment should still not retry in step */
+  policy->seed = (unsigned int)time(NULL) ^ (unsigned int)getpid() ^
+    (unsigned int)(unsigned long)policy;
+
+  return 0;
+}
+
+void retry_policy_destroy(struct retry_policy *policy)
+{
+  pthread_mutex_destroy(&policy->lock);
+}
+
+void retry_policy_set(struct retry_policy *policy, int max_retries,
+		      long base_ms, long max_ms)
+{
+  pthread_mutex_lock(&policy->lock);
+  policy->max_retries = max_retries;
+  policy->base_ms = base_ms;
+  policy->max_ms = max_ms;
+  pthread_mutex_unlock(&policy->lock);
+}
+
+void retry_policy_set_budget(struct retry_policy *policy, int percent,
+			     int reserve)
+{
+  pthread_mutex_lock(&policy->lock);
+  policy->budget_percent = percent;
+  policy->budget_reserve = reserve;
+  if (policy->balance > reserve)
+    policy->balance = reserve;
+  pthread_mutex_unlock(&policy->lock);
+}
+
+void retry_start(struct retry_state *state)
+{
+  memset(state, 0, sizeof(struct retry_state));
+}
+
+/* errors that say more about the network or the server at this moment than
+ * about the request itself
+ */
+static int transient_error(CURLcode res)
+{
+  switch (res) {
+  case CURLE_COULDNT_RESOLVE_HOST:
+  case CURLE_COULDNT_CONNECT:
+  case CURLE_OPERATION_TIMEDOUT:
+  case CURLE_SEND_ERROR:
+  case CURLE_RECV_ERROR:
+  case CURLE_GOT_NOTHING:
+  case CURLE_PARTIAL_FILE:
+  case CURLE_SSL_CONNECT_ERROR:
+#if LIBCURL_VERSION_NUM >= 0x072600
+  case CURLE_HTTP2:
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073100
+  case CURLE_HTTP2_STREAM:
+#endif
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/* 501 and 505 are server errors too, but asking again will not change the
+ * answer; deltacloud uses 501 for operations a driver does not support
+ */
+int retry_transient_status(long code)
+{
+  if (code == 501 || code == 505)
+    return 0;
+
+  return code == 429 || (code >= 500 && code <= 599);
+}
+
+/* the Retry-After of a throttling response in milliseconds, or 0 if there
+ * was none.  Only the delay-seconds form is understood.
+ */
+static long retry_after(struct transfer *xfer)
+{
+  char *value;
+  char *end;
+  long seconds;
+
+  value = transfer_header_value(xfer, "Retry-After");
+  if (value == NULL)
+    return 0;
+
+  errno = 0;
+  seconds = strtol(value, &end, 10);
+  if (errno != 0 || *end != '\0' || seconds < 0 || seconds > 86400)
+    seconds = 0;
+  SAFE_FREE(value);
+
+  return seconds * 1000;
+}
+
+/* must be called with policy->lock held.  This is the "decorrelated
+ * jitter" backoff: each delay is drawn uniformly between the base and three
+ * times the previous one, so that clients that failed together spread out
+ * instead of coming back together.
+ */
+static long next_delay(struct retry_policy *policy, long previous)
+{
+  long upper;
+  long delay;
+
+  if (previous < policy->base_ms)
+    previous = policy->base_ms;
+  upper = previous * 3;
+  if (upper > policy->max_ms)
+    upper = policy->max_ms;
+
+  delay = policy->base_ms;
+  if (upper > delay)
+    delay += rand_r(&policy->seed) % (upper - delay + 1);
+
+  return delay;
+}
+
+/* called after every attempt of a blocking idempotent request, with res
+ * the result of curl_easy_perform().  Returns the number of milliseconds
+ * to wait before trying again, or -1 if the request should not be tried
+ * again, either because it did not fail in a way that another attempt
+ * could fix, or because it has used up its retries or the budget.
+ */
+long retry_backoff(struct retry_policy *policy, struct retry_state *state,
+		   struct transfer *xfer, CURLcode res)
+{
+  struct transfer_stats *stats = &xfer->api->priv->stats;
+  long delay = -1;
+  long wait = 0;
+  int retryable;
+  int denied = 0;
+
+  retryable = transient_error(res);
+  if (retry_transient_status(transfer_response_code(xfer))) {
+    retryable = 1;
+    wait = retry_after(xfer);
+  }
+
+  pthread_mutex_lock(&policy->lock);
+
+  if (state->attempts++ == 0) {
+    policy->balance += policy->budget_percent / 100.0;
+    if (policy->balance > policy->budget_reserve)
+      policy->balance = policy->budget_reserve;
+  }
+
+  if (!retryable || state->attempts > policy->max_retries)
+    goto unlock;
+
+  /* a server that asks us to stay away longer than we would ever wait is
+   * not going to be ready any sooner
+   */
+  if (wait > policy->max_ms)
+    goto unlock;
+
+  if (policy->balance < 1) {
+    denied = 1;
+    goto unlock;
+  }
+  policy->balance -= 1;
+
+  delay = next_delay(policy, state->delay_ms);
+  state->delay_ms = delay;
+  if (delay < wait)
+    delay = wait;
+
+ unlock:
+  pthread_mutex_unlock(&policy->lock);
+
+  if (delay >= 0 || denied)
+    transfer_stats_count_retry(stats, delay >= 0);
+
+  return delay;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#ifndef RETRY_H
+#define RETRY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <curl/curl.h>
+
+#define RETRY_DEFAULT_BASE_MS 100
+#define RETRY_DEFAULT_MAX_MS 10000
+#define RETRY_DEFAULT_BUDGET_PERCENT 10
+#define RETRY_DEFAULT_BUDGET_RESERVE 10
+
+/* When and how often the blocking idempotent requests of one
+ * deltacloud_api are sent again after a transient failure.  The budget is
+ * a token bucket: every request that goes out for the first time adds
+ * budget_percent hundredths of a token, every retry takes a whole one, and
+ * the bucket holds at most budget_reserve tokens.  However many requests
+ * are failing, retries can then add no more than budget_percent percent to
+ * the load on the server, plus a burst of budget_reserve.
+ */
+struct retry_policy {
+  pthread_mutex_t lock;
+  int max_retries; /* 0 turns retrying off */
+  long base_ms; /* the shortest backoff */
+  long max_ms; /* the longest backoff */
+  int budget_percent;
+  int budget_reserve;
+  double balance; /* tokens left in the budget */
+  unsigned int seed; /* for the jitter */
+};
+
+/* the progress of one request through its retries */
+struct retry_state {
+  int attempts; /* attempts made so far */
+  long delay_ms; /* the backoff before the previous retry */
+};
+
+struct transfer;
+
+int retry_policy_init(struct retry_policy *policy);
+void retry_policy_destroy(struct retry_policy *policy);
+void retry_policy_set(struct retry_policy *policy, int max_retries,
+		      long base_ms, long max_ms);
+void retry_policy_set_budget(struct retry_policy *policy, int percent,
+			     int reserve);
+
+void retry_start(struct retry_state *state);
+long retry_backoff(struct retry_policy *policy, struct retry_state *state,
+		   struct transfer *xfer, CURLcode res);
+int retry_transient_status(long code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
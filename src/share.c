@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#include <pthread.h>
+#include "common.h"
+#include "share.h"
+
+/* protects share and share_users */
+static pthread_mutex_t share_lock = PTHREAD_MUTEX_INITIALIZER;
+static CURLSH *share = NULL;
+static int share_users = 0;
+
+/* libcurl asks for the data it shares to be locked one kind at a time */
+static pthread_mutex_t data_locks[CURL_LOCK_DATA_LAST];
+
+static void lock_cb(CURL *curl, curl_lock_data data, curl_lock_access access,
+		    void *userp)
+{
+  if (data >= 0 && data < CURL_LOCK_DATA_LAST)
+    pthread_mutex_lock(&data_locks[data]);
+}
+
+static void unlock_cb(CURL *curl, curl_lock_data data, void *userp)
+{
+  if (data >= 0 && data < CURL_LOCK_DATA_LAST)
+    pthread_mutex_unlock(&data_locks[data]);
+}
+
+static void destroy_data_locks(int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    pthread_mutex_destroy(&data_locks[i]);
+}
+
+/* must be called with share_lock held */
+static CURLSH *create_share(void)
+{
+  CURLSH *sh;
+  int i;
+
+  for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+    if (pthread_mutex_init(&data_locks[i], NULL) != 0) {
+      destroy_data_locks(i);
+      set_error(DELTACLOUD_INTERNAL_ERROR,
+		"Failed to initialize share lock");
+      return NULL;
+    }
+  }
+
+  sh = curl_share_init();
+  if (sh == NULL) {
+    destroy_data_locks(CURL_LOCK_DATA_LAST);
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to initialize curl share");
+    return NULL;
+  }
+
+  if (curl_share_setopt(sh, CURLSHOPT_LOCKFUNC, lock_cb) != CURLSHE_OK ||
+      curl_share_setopt(sh, CURLSHOPT_UNLOCKFUNC, unlock_cb) != CURLSHE_OK ||
+      curl_share_setopt(sh, CURLSHOPT_SHARE,
+			CURL_LOCK_DATA_DNS) != CURLSHE_OK ||
+      curl_share_setopt(sh, CURLSHOPT_SHARE,
+			CURL_LOCK_DATA_SSL_SESSION) != CURLSHE_OK) {
+    curl_share_cleanup(sh);
+    destroy_data_locks(CURL_LOCK_DATA_LAST);
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to set up curl share");
+    return NULL;
+  }
+
+  return sh;
+}
+
+CURLSH *share_acquire(void)
+{
+  CURLSH *sh;
+
+  pthread_mutex_lock(&share_lock);
+  if (share == NULL)
+    /* create_share sets the error */
+    share = create_share();
+  if (share != NULL)
+    share_users++;
+  sh = share;
+  pthread_mutex_unlock(&share_lock);
+
+  return sh;
+}
+
+/* every handle that was attached by this user must have been cleaned up
+ * before this is called.  Should one still be attached anyway, libcurl
+ * refuses to clean up the share; it and its locks are then kept, to be
+ * reused by the next user or cleaned up when that one lets go.
+ */
+void share_release(void)
+{
+  pthread_mutex_lock(&share_lock);
+  share_users--;
+  if (share_users == 0 && share != NULL &&
+      curl_share_cleanup(share) == CURLSHE_OK) {
+    share = NULL;
+    destroy_data_locks(CURL_LOCK_DATA_LAST);
+  }
+  pthread_mutex_unlock(&share_lock);
+}
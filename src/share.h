@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#ifndef SHARE_H
+#define SHARE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <curl/curl.h>
+
+/* The process-wide curl share object.  Every deltacloud_api that opts in
+ * attaches its handles to the same one, so that they all use one DNS cache
+ * and one TLS session cache.  Connections are not shared: libcurl does not
+ * support one connection cache used from several threads at once.  It is
+ * created when the first user acquires it and cleaned
+ * up when the last one releases it.
+ */
+CURLSH *share_acquire(void);
+void share_release(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -22,10 +22,24 @@
 #include <stdlib.h>
 #include <memory.h>
 #include "common.h"
+#include "curl_action.h"
 #include "storage_snapshot.h"
+#include "decoder.h"
 
 /** @file */
 
+static const struct decode_field storage_snapshot_fields[] = {
+  DECODE_ATTR("href", struct deltacloud_storage_snapshot, href),
+  DECODE_ATTR("id", struct deltacloud_storage_snapshot, id),
+  DECODE_TEXT("created", struct deltacloud_storage_snapshot, created),
+  DECODE_TEXT("state", struct deltacloud_storage_snapshot, state),
+  DECODE_CHILD_ATTR("storage_volume", "href",
+		    struct deltacloud_storage_snapshot, storage_volume_href),
+  DECODE_CHILD_ATTR("storage_volume", "id",
+		    struct deltacloud_storage_snapshot, storage_volume_id),
+  DECODE_END
+};
+
 static int parse_one_storage_snapshot(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 				      void *output)
 {
@@ -33,16 +47,7 @@ static int parse_one_storage_snapshot(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 
   memset(thissnapshot, 0, sizeof(struct deltacloud_storage_snapshot));
 
-  thissnapshot->href = (char *)xmlGetProp(cur, BAD_CAST "href");
-  thissnapshot->id = (char *)xmlGetProp(cur, BAD_CAST "id");
-  thissnapshot->created = getXPathString("string(./created)", ctxt);
-  thissnapshot->state = getXPathString("string(./state)", ctxt);
-  thissnapshot->storage_volume_href = getXPathString("string(./storage_volume/@href)",
-						     ctxt);
-  thissnapshot->storage_volume_id = getXPathString("string(./storage_volume/@id)",
-						   ctxt);
-
-  return 0;
+  return decode_element(cur, ctxt, storage_snapshot_fields, thissnapshot);
 }
 
 static int parse_storage_snapshot_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
@@ -90,6 +95,24 @@ static int parse_storage_snapshot_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
   return ret;
 }
 
+static int copy_storage_snapshot(struct deltacloud_storage_snapshot *dst,
+				 const struct deltacloud_storage_snapshot *src);
+static int copy_storage_snapshot_list(struct deltacloud_storage_snapshot **dst,
+				      const struct deltacloud_storage_snapshot *src);
+
+static const struct collection_type storage_snapshot_collection_type = {
+  .relname = "storage_snapshots",
+  .rootname = "storage_snapshots",
+  .list_cb = parse_storage_snapshot_xml,
+  .copy_all = (int (*)(void *, const void *))copy_storage_snapshot_list,
+  .free_all = (void (*)(void *))deltacloud_free_storage_snapshot_list,
+  .oneroot = "storage_snapshot",
+  .one_cb = parse_one_storage_snapshot,
+  .copy_one = (int (*)(void *, const void *))copy_storage_snapshot,
+  .free_one = (void (*)(void *))deltacloud_free_storage_snapshot,
+  .size = sizeof(struct deltacloud_storage_snapshot),
+};
+
 /**
  * A function to get a linked list of all of the storage snapshots.  The caller
  * is expected to free the list using deltacloud_free_storage_snapshot_list().
@@ -101,8 +124,25 @@ static int parse_storage_snapshot_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 int deltacloud_get_storage_snapshots(struct deltacloud_api *api,
 				     struct deltacloud_storage_snapshot **storage_snapshots)
 {
-  return internal_get(api, "storage_snapshots", "storage_snapshots",
-		      parse_storage_snapshot_xml, (void **)storage_snapshots);
+  return internal_get(api, &storage_snapshot_collection_type,
+		      (void **)storage_snapshots);
+}
+
+/**
+ * A function to hand each storage snapshot to a callback as soon as it has been
+ * downloaded, without building a list of them.  See deltacloud_visit_cb for
+ * what the callback may do with the deltacloud_storage_snapshot structure.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] visitor The function to call with each storage snapshot
+ * @param[in] userdata A pointer that is passed through to visitor
+ * @returns 0 on success, including when visitor stops early, -1 on error
+ */
+int deltacloud_foreach_storage_snapshot(struct deltacloud_api *api,
+					deltacloud_visit_cb visitor,
+					void *userdata)
+{
+  return internal_foreach(api, &storage_snapshot_collection_type, NULL,
+			  visitor, userdata);
 }
 
 /**
@@ -119,8 +159,45 @@ int deltacloud_get_storage_snapshot_by_id(struct deltacloud_api *api,
 					  const char *id,
 					  struct deltacloud_storage_snapshot *storage_snapshot)
 {
-  return internal_get_by_id(api, id, "storage_snapshots", "storage_snapshot",
-			    parse_one_storage_snapshot, storage_snapshot);
+  return internal_get_type_by_id(api, &storage_snapshot_collection_type, id,
+				 storage_snapshot);
+}
+
+static const struct batch_type storage_snapshot_batch_type = {
+  .relname = "storage_snapshots",
+  .listroot = "storage_snapshots",
+  .oneroot = "storage_snapshot",
+  .list_cb = parse_storage_snapshot_xml,
+  .one_cb = parse_one_storage_snapshot,
+  .free_all = (void (*)(void *))deltacloud_free_storage_snapshot_list,
+  .size = sizeof(struct deltacloud_storage_snapshot),
+  .id_offset = offsetof(struct deltacloud_storage_snapshot, id),
+  .next_offset = offsetof(struct deltacloud_storage_snapshot, next),
+};
+
+/**
+ * A function to look up several storage snapshots by id at once.  The requests are
+ * issued concurrently, up to the window set with
+ * deltacloud_set_batch_window(), so n lookups cost far fewer than n round
+ * trips.  The caller is expected to free each deltacloud_storage_snapshot structure
+ * using deltacloud_free_storage_snapshot(); the entries of failed lookups are left
+ * zeroed, and freeing those is harmless.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] ids The array of n storage snapshot IDs to look for
+ * @param[in] n The number of IDs
+ * @param[out] storage_snapshots An array of n deltacloud_storage_snapshot
+ *                               structures; entry i is filled in from ids[i]
+ * @param[out] errors An array of n error codes; entry i is set to 0 if
+ *                    ids[i] was found, or to the DELTACLOUD_*_ERROR of that
+ *                    lookup otherwise.  May be NULL
+ * @returns 0 if every storage snapshot was found, -1 if any lookup failed or on error
+ */
+int deltacloud_get_storage_snapshots_by_ids(struct deltacloud_api *api,
+					    const char **ids, int n,
+					    struct deltacloud_storage_snapshot *storage_snapshots,
+					    int *errors)
+{
+  return internal_get_by_ids(api, &storage_snapshot_batch_type, ids, n, storage_snapshots, errors);
 }
 
 /**
@@ -214,7 +291,68 @@ int deltacloud_storage_snapshot_destroy(struct deltacloud_api *api,
   if (!valid_api(api) || !valid_arg(storage_snapshot))
     return -1;
 
-  return internal_destroy(storage_snapshot->href, api->user, api->password, api->driver, api->provider);
+  return internal_destroy(api, storage_snapshot->href);
+}
+
+/**
+ * A function to start fetching the list of all of the storage snapshots without
+ * waiting for the result.  The callback runs from deltacloud_async_perform()
+ * with the list of storage snapshots, which it is expected to free using
+ * deltacloud_free_storage_snapshot_list().
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] cb The function to call once the list has been fetched
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_storage_snapshots(struct deltacloud_api *api,
+					   deltacloud_async_cb cb,
+					   void *userdata)
+{
+  return internal_async_get(api, "storage_snapshots", "storage_snapshots", parse_storage_snapshot_xml,
+			    cb, userdata);
+}
+
+/**
+ * A function to start looking up a particular storage snapshot by id without waiting
+ * for the result.  On success the callback is handed the deltacloud_storage_snapshot
+ * structure, which the caller is expected to free using
+ * deltacloud_free_storage_snapshot().
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] id The storage snapshot ID to look for
+ * @param[out] storage_snapshot The deltacloud_storage_snapshot structure to fill in if the ID is
+ *             found; it must stay valid until cb has run
+ * @param[in] cb The function to call once the lookup has finished
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_storage_snapshot_by_id(struct deltacloud_api *api,
+						const char *id,
+						struct deltacloud_storage_snapshot *storage_snapshot,
+						deltacloud_async_cb cb,
+						void *userdata)
+{
+  return internal_async_get_by_id(api, id, "storage_snapshots", "storage_snapshot",
+				  parse_one_storage_snapshot, storage_snapshot, cb, userdata);
+}
+
+/**
+ * A function to start destroying a storage snapshot without waiting for the result.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] storage_snapshot The deltacloud_storage_snapshot structure representing the storage snapshot
+ * @param[in] cb The function to call once the storage snapshot has been destroyed
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_storage_snapshot_destroy(struct deltacloud_api *api,
+					      struct deltacloud_storage_snapshot *storage_snapshot,
+					      deltacloud_async_cb cb,
+					      void *userdata)
+{
+  if (!valid_api(api) || !valid_arg(storage_snapshot))
+    return -1;
+
+  return internal_async_action(api, TRANSFER_DELETE, storage_snapshot->href, cb,
+			       userdata);
 }
 
 /**
@@ -247,3 +385,26 @@ void deltacloud_free_storage_snapshot_list(struct deltacloud_storage_snapshot **
   free_list(storage_snapshots, struct deltacloud_storage_snapshot,
 	    deltacloud_free_storage_snapshot);
 }
+
+static int copy_storage_snapshot(struct deltacloud_storage_snapshot *dst,
+				 const struct deltacloud_storage_snapshot *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->created, src->created) < 0 ||
+      copy_string(&dst->state, src->state) < 0 ||
+      copy_string(&dst->storage_volume_href, src->storage_volume_href) < 0 ||
+      copy_string(&dst->storage_volume_id, src->storage_volume_id) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_storage_snapshot_list(struct deltacloud_storage_snapshot **dst,
+				      const struct deltacloud_storage_snapshot *src)
+{
+  copy_list(dst, src, struct deltacloud_storage_snapshot, copy_storage_snapshot,
+	    deltacloud_free_storage_snapshot_list);
+
+  return 0;
+}
@@ -23,7 +23,9 @@
 #include <stdlib.h>
 #include <memory.h>
 #include "common.h"
+#include "curl_action.h"
 #include "storage_volume.h"
+#include "decoder.h"
 
 /** @file */
 
@@ -40,6 +42,30 @@ static void free_mount(struct deltacloud_storage_volume_mount *curr)
   SAFE_FREE(curr->device_name);
 }
 
+static const struct decode_field storage_volume_mount_fields[] = {
+  DECODE_CHILD_ATTR("instance", "href", struct deltacloud_storage_volume,
+		    mount.instance_href),
+  DECODE_CHILD_ATTR("instance", "id", struct deltacloud_storage_volume,
+		    mount.instance_id),
+  DECODE_CHILD_ATTR("device", "name", struct deltacloud_storage_volume,
+		    mount.device_name),
+  DECODE_END
+};
+
+static const struct decode_field storage_volume_fields[] = {
+  DECODE_ATTR("href", struct deltacloud_storage_volume, href),
+  DECODE_ATTR("id", struct deltacloud_storage_volume, id),
+  DECODE_TEXT("created", struct deltacloud_storage_volume, created),
+  DECODE_TEXT("state", struct deltacloud_storage_volume, state),
+  DECODE_CHILD_ATTR("capacity", "unit", struct deltacloud_storage_volume,
+		    capacity.unit),
+  DECODE_TEXT("capacity", struct deltacloud_storage_volume, capacity.size),
+  DECODE_TEXT("device", struct deltacloud_storage_volume, device),
+  DECODE_TEXT("realm_id", struct deltacloud_storage_volume, realm_id),
+  DECODE_NESTED("mount", storage_volume_mount_fields),
+  DECODE_END
+};
+
 static int parse_one_storage_volume(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 				    void *output)
 {
@@ -47,23 +73,7 @@ static int parse_one_storage_volume(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 
   memset(thisvolume, 0, sizeof(struct deltacloud_storage_volume));
 
-  thisvolume->href = (char *)xmlGetProp(cur, BAD_CAST "href");
-  thisvolume->id = (char *)xmlGetProp(cur, BAD_CAST "id");
-  thisvolume->created = getXPathString("string(./created)", ctxt);
-  thisvolume->state = getXPathString("string(./state)", ctxt);
-  thisvolume->capacity.unit = getXPathString("string(./capacity/@unit)",
-					     ctxt);
-  thisvolume->capacity.size = getXPathString("string(./capacity)", ctxt);
-  thisvolume->device = getXPathString("string(./device)", ctxt);
-  thisvolume->realm_id = getXPathString("string(./realm_id)", ctxt);
-  thisvolume->mount.instance_href = getXPathString("string(./mount/instance/@href)",
-						   ctxt);
-  thisvolume->mount.instance_id = getXPathString("string(./mount/instance/@id)",
-						 ctxt);
-  thisvolume->mount.device_name = getXPathString("string(./mount/device/@name)",
-						 ctxt);
-
-  return 0;
+  return decode_element(cur, ctxt, storage_volume_fields, thisvolume);
 }
 
 static int parse_storage_volume_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
@@ -111,6 +121,24 @@ static int parse_storage_volume_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
   return ret;
 }
 
+static int copy_storage_volume(struct deltacloud_storage_volume *dst,
+			       const struct deltacloud_storage_volume *src);
+static int copy_storage_volume_list(struct deltacloud_storage_volume **dst,
+				    const struct deltacloud_storage_volume *src);
+
+static const struct collection_type storage_volume_collection_type = {
+  .relname = "storage_volumes",
+  .rootname = "storage_volumes",
+  .list_cb = parse_storage_volume_xml,
+  .copy_all = (int (*)(void *, const void *))copy_storage_volume_list,
+  .free_all = (void (*)(void *))deltacloud_free_storage_volume_list,
+  .oneroot = "storage_volume",
+  .one_cb = parse_one_storage_volume,
+  .copy_one = (int (*)(void *, const void *))copy_storage_volume,
+  .free_one = (void (*)(void *))deltacloud_free_storage_volume,
+  .size = sizeof(struct deltacloud_storage_volume),
+};
+
 /**
  * A function to get a linked list of all of the storage volumes.  The caller
  * is expected to free the list using deltacloud_free_storage_volume_list().
@@ -122,8 +150,25 @@ static int parse_storage_volume_xml(xmlNodePtr cur, xmlXPathContextPtr ctxt,
 int deltacloud_get_storage_volumes(struct deltacloud_api *api,
 				   struct deltacloud_storage_volume **storage_volumes)
 {
-  return internal_get(api, "storage_volumes", "storage_volumes",
-		      parse_storage_volume_xml, (void **)storage_volumes);
+  return internal_get(api, &storage_volume_collection_type,
+		      (void **)storage_volumes);
+}
+
+/**
+ * A function to hand each storage volume to a callback as soon as it has been
+ * downloaded, without building a list of them.  See deltacloud_visit_cb for
+ * what the callback may do with the deltacloud_storage_volume structure.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] visitor The function to call with each storage volume
+ * @param[in] userdata A pointer that is passed through to visitor
+ * @returns 0 on success, including when visitor stops early, -1 on error
+ */
+int deltacloud_foreach_storage_volume(struct deltacloud_api *api,
+				      deltacloud_visit_cb visitor,
+				      void *userdata)
+{
+  return internal_foreach(api, &storage_volume_collection_type, NULL,
+			  visitor, userdata);
 }
 
 /**
@@ -140,8 +185,45 @@ int deltacloud_get_storage_volume_by_id(struct deltacloud_api *api,
 					const char *id,
 					struct deltacloud_storage_volume *storage_volume)
 {
-  return internal_get_by_id(api, id, "storage_volumes", "storage_volume",
-			    parse_one_storage_volume, storage_volume);
+  return internal_get_type_by_id(api, &storage_volume_collection_type, id,
+				 storage_volume);
+}
+
+static const struct batch_type storage_volume_batch_type = {
+  .relname = "storage_volumes",
+  .listroot = "storage_volumes",
+  .oneroot = "storage_volume",
+  .list_cb = parse_storage_volume_xml,
+  .one_cb = parse_one_storage_volume,
+  .free_all = (void (*)(void *))deltacloud_free_storage_volume_list,
+  .size = sizeof(struct deltacloud_storage_volume),
+  .id_offset = offsetof(struct deltacloud_storage_volume, id),
+  .next_offset = offsetof(struct deltacloud_storage_volume, next),
+};
+
+/**
+ * A function to look up several storage volumes by id at once.  The requests are
+ * issued concurrently, up to the window set with
+ * deltacloud_set_batch_window(), so n lookups cost far fewer than n round
+ * trips.  The caller is expected to free each deltacloud_storage_volume structure
+ * using deltacloud_free_storage_volume(); the entries of failed lookups are left
+ * zeroed, and freeing those is harmless.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] ids The array of n storage volume IDs to look for
+ * @param[in] n The number of IDs
+ * @param[out] storage_volumes An array of n deltacloud_storage_volume
+ *                             structures; entry i is filled in from ids[i]
+ * @param[out] errors An array of n error codes; entry i is set to 0 if
+ *                    ids[i] was found, or to the DELTACLOUD_*_ERROR of that
+ *                    lookup otherwise.  May be NULL
+ * @returns 0 if every storage volume was found, -1 if any lookup failed or on error
+ */
+int deltacloud_get_storage_volumes_by_ids(struct deltacloud_api *api,
+					  const char **ids, int n,
+					  struct deltacloud_storage_volume *storage_volumes,
+					  int *errors)
+{
+  return internal_get_by_ids(api, &storage_volume_batch_type, ids, n, storage_volumes, errors);
 }
 
 /**
@@ -187,7 +269,7 @@ int deltacloud_storage_volume_destroy(struct deltacloud_api *api,
   if (!valid_api(api) || !valid_arg(storage_volume))
     return -1;
 
-  return internal_destroy(storage_volume->href, api->user, api->password, api->driver, api->provider);
+  return internal_destroy(api, storage_volume->href);
 }
 
 /**
@@ -327,6 +409,67 @@ int deltacloud_storage_volume_detach(struct deltacloud_api *api,
   return 0;
 }
 
+/**
+ * A function to start fetching the list of all of the storage volumes without
+ * waiting for the result.  The callback runs from deltacloud_async_perform()
+ * with the list of storage volumes, which it is expected to free using
+ * deltacloud_free_storage_volume_list().
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] cb The function to call once the list has been fetched
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_storage_volumes(struct deltacloud_api *api,
+					 deltacloud_async_cb cb,
+					 void *userdata)
+{
+  return internal_async_get(api, "storage_volumes", "storage_volumes", parse_storage_volume_xml,
+			    cb, userdata);
+}
+
+/**
+ * A function to start looking up a particular storage volume by id without waiting
+ * for the result.  On success the callback is handed the deltacloud_storage_volume
+ * structure, which the caller is expected to free using
+ * deltacloud_free_storage_volume().
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] id The storage volume ID to look for
+ * @param[out] storage_volume The deltacloud_storage_volume structure to fill in if the ID is
+ *             found; it must stay valid until cb has run
+ * @param[in] cb The function to call once the lookup has finished
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_get_storage_volume_by_id(struct deltacloud_api *api,
+					      const char *id,
+					      struct deltacloud_storage_volume *storage_volume,
+					      deltacloud_async_cb cb,
+					      void *userdata)
+{
+  return internal_async_get_by_id(api, id, "storage_volumes", "storage_volume",
+				  parse_one_storage_volume, storage_volume, cb, userdata);
+}
+
+/**
+ * A function to start destroying a storage volume without waiting for the result.
+ * @param[in] api The deltacloud_api structure representing the connection
+ * @param[in] storage_volume The deltacloud_storage_volume structure representing the storage volume
+ * @param[in] cb The function to call once the storage volume has been destroyed
+ * @param[in] userdata A pointer that is passed through to cb
+ * @returns 0 if the request was started, -1 on error
+ */
+int deltacloud_async_storage_volume_destroy(struct deltacloud_api *api,
+					    struct deltacloud_storage_volume *storage_volume,
+					    deltacloud_async_cb cb,
+					    void *userdata)
+{
+  if (!valid_api(api) || !valid_arg(storage_volume))
+    return -1;
+
+  return internal_async_action(api, TRANSFER_DELETE, storage_volume->href, cb,
+			       userdata);
+}
+
 /**
  * A function to free a deltacloud_storage_volume structure initially
  * allocated by deltacloud_get_storage_volume_by_id().
@@ -359,3 +502,31 @@ void deltacloud_free_storage_volume_list(struct deltacloud_storage_volume **stor
   free_list(storage_volumes, struct deltacloud_storage_volume,
 	    deltacloud_free_storage_volume);
 }
+
+static int copy_storage_volume(struct deltacloud_storage_volume *dst,
+			       const struct deltacloud_storage_volume *src)
+{
+  if (copy_string(&dst->href, src->href) < 0 ||
+      copy_string(&dst->id, src->id) < 0 ||
+      copy_string(&dst->created, src->created) < 0 ||
+      copy_string(&dst->state, src->state) < 0 ||
+      copy_string(&dst->capacity.unit, src->capacity.unit) < 0 ||
+      copy_string(&dst->capacity.size, src->capacity.size) < 0 ||
+      copy_string(&dst->device, src->device) < 0 ||
+      copy_string(&dst->realm_id, src->realm_id) < 0 ||
+      copy_string(&dst->mount.instance_href, src->mount.instance_href) < 0 ||
+      copy_string(&dst->mount.instance_id, src->mount.instance_id) < 0 ||
+      copy_string(&dst->mount.device_name, src->mount.device_name) < 0)
+    return -1;
+
+  return 0;
+}
+
+static int copy_storage_volume_list(struct deltacloud_storage_volume **dst,
+				    const struct deltacloud_storage_volume *src)
+{
+  copy_list(dst, src, struct deltacloud_storage_volume, copy_storage_volume,
+	    deltacloud_free_storage_volume_list);
+
+  return 0;
+}
@@ -0,0 +1,784 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libxml/entities.h>
+#include "common.h"
+#include "trace_capture.h"
+
+/** @file */
+
+/*
+ * A trace is a text file that starts with TRACE_MAGIC and then has one
+ * record per transfer:
+ *
+ *   > VERB START ELAPSED STATUS URLLEN REQHDRLEN REQBODYLEN HDRLEN BODYLEN
+ *   url
+ *   request headers
+ *   request body
+ *   response headers
+ *   response body
+ *
+ * START is when the transfer was set up and ELAPSED how long it took, both
+ * in milliseconds.  Each of the five blocks is exactly as many bytes long
+ * as the matching length says, followed by a newline that is not counted,
+ * so bodies need no escaping.  A STATUS of 0 means there was no response.
+ */
+
+/* protects the recorder pointer of every api and the refs of every
+ * recorder
+ */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/************************** RECORDING ****************************************/
+void trace_recorder_release(struct trace_recorder *recorder)
+{
+  int refs;
+
+  if (recorder == NULL)
+    return;
+
+  pthread_mutex_lock(&trace_lock);
+  refs = --recorder->refs;
+  pthread_mutex_unlock(&trace_lock);
+
+  if (refs > 0)
+    return;
+
+  fclose(recorder->fp);
+  pthread_mutex_destroy(&recorder->lock);
+  SAFE_FREE(recorder);
+}
+
+/* start capturing xfer if its api is being recorded */
+int trace_capture_start(struct transfer *xfer)
+{
+  struct trace_capture *capture;
+
+  xfer->trace = NULL;
+
+  pthread_mutex_lock(&trace_lock);
+  if (xfer->api->priv->recorder == NULL) {
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+  }
+  xfer->api->priv->recorder->refs++;
+  capture = calloc(1, sizeof(struct trace_capture));
+  if (capture != NULL)
+    capture->recorder = xfer->api->priv->recorder;
+  else
+    xfer->api->priv->recorder->refs--;
+  pthread_mutex_unlock(&trace_lock);
+
+  if (capture == NULL) {
+    oom_error();
+    return -1;
+  }
+
+  capture->started = now_ms();
+  capture->headers_fp = open_memstream(&capture->headers,
+				       &capture->headers_size);
+  capture->body_fp = open_memstream(&capture->body, &capture->body_size);
+  xfer->trace = capture;
+  if (capture->headers_fp == NULL || capture->body_fp == NULL) {
+    oom_error();
+    return -1;
+  }
+
+  return 0;
+}
+
+void trace_capture_headers(struct transfer *xfer, const void *ptr,
+			   size_t size)
+{
+  if (xfer->trace != NULL)
+    fwrite(ptr, 1, size, xfer->trace->headers_fp);
+}
+
+void trace_capture_body(struct transfer *xfer, const void *ptr, size_t size)
+{
+  if (xfer->trace != NULL)
+    fwrite(ptr, 1, size, xfer->trace->body_fp);
+}
+
+static const char *method_verb(int method)
+{
+  switch (method) {
+  case TRANSFER_GET:
+    return "GET";
+  case TRANSFER_HEAD:
+    return "HEAD";
+  case TRANSFER_DELETE:
+    return "DELETE";
+  default:
+    return "POST";
+  }
+}
+
+/* write one block of a record; see the top of the file */
+static void write_block(FILE *fp, const char *data, size_t size)
+{
+  if (size > 0)
+    fwrite(data, 1, size, fp);
+  fputc('\n', fp);
+}
+
+/* write the transfer out to the trace, once it has finished one way or
+ * another.  Nothing is reported if that fails; a trace is a diagnostic, and
+ * the transfer itself went fine.
+ */
+void trace_capture_finish(struct transfer *xfer)
+{
+  struct trace_capture *capture = xfer->trace;
+  struct trace_recorder *recorder;
+  struct curl_slist *curr;
+  struct curl_httppost *part;
+  char *reqheaders = NULL;
+  size_t reqheaders_size = 0;
+  char *reqbody = NULL;
+  size_t reqbody_size = 0;
+  FILE *fp;
+  double elapsed;
+  double total = 0;
+  long status;
+
+  if (capture == NULL || capture->headers_fp == NULL ||
+      capture->body_fp == NULL)
+    return;
+
+  recorder = capture->recorder;
+  elapsed = now_ms() - capture->started;
+  if (xfer->api->priv->transport == NULL &&
+      curl_easy_getinfo(xfer->curl, CURLINFO_TOTAL_TIME, &total) == CURLE_OK)
+    /* leaves out the time spent waiting for the caller to pick it up */
+    elapsed = total * 1000.0;
+  status = transfer_response_code(xfer);
+
+  /* the credentials go in through curl options, not through these, so they
+   * never end up in the trace
+   */
+  fp = open_memstream(&reqheaders, &reqheaders_size);
+  if (fp == NULL)
+    return;
+  deltacloud_for_each(curr, xfer->headers)
+    fprintf(fp, "%s\n", curr->data);
+  fclose(fp);
+
+  fp = open_memstream(&reqbody, &reqbody_size);
+  if (fp == NULL) {
+    SAFE_FREE(reqheaders);
+    return;
+  }
+  if (xfer->method == TRANSFER_POST && xfer->data != NULL)
+    fputs(xfer->data, fp);
+  else if (xfer->method == TRANSFER_MULTIPART) {
+    for (part = xfer->httppost; part != NULL; part = part->next)
+      fprintf(fp, "%s=%s%s\n", part->name,
+	      part->flags & CURL_HTTPPOST_FILENAME ? "@" : "", part->contents);
+  }
+  fclose(fp);
+
+  fflush(capture->headers_fp);
+  fflush(capture->body_fp);
+
+  pthread_mutex_lock(&recorder->lock);
+  fprintf(recorder->fp, "> %s %.3f %.3f %ld %zu %zu %zu %zu %zu\n",
+	  method_verb(xfer->method), capture->started - recorder->origin,
+	  elapsed, status, strlen(xfer->url), reqheaders_size, reqbody_size,
+	  capture->headers_size, capture->body_size);
+  write_block(recorder->fp, xfer->url, strlen(xfer->url));
+  write_block(recorder->fp, reqheaders, reqheaders_size);
+  write_block(recorder->fp, reqbody, reqbody_size);
+  write_block(recorder->fp, capture->headers, capture->headers_size);
+  write_block(recorder->fp, capture->body, capture->body_size);
+  fflush(recorder->fp);
+  pthread_mutex_unlock(&recorder->lock);
+
+  SAFE_FREE(reqheaders);
+  SAFE_FREE(reqbody);
+}
+
+void trace_capture_free(struct transfer *xfer)
+{
+  struct trace_capture *capture = xfer->trace;
+
+  if (capture == NULL)
+    return;
+
+  if (capture->headers_fp != NULL)
+    fclose(capture->headers_fp);
+  if (capture->body_fp != NULL)
+    fclose(capture->body_fp);
+  SAFE_FREE(capture->headers);
+  SAFE_FREE(capture->body);
+  trace_recorder_release(capture->recorder);
+  SAFE_FREE(xfer->trace);
+}
+
+/**
+ * A function to write every request this deltacloud_api structure makes,
+ * and the response to it, to a trace file: the verb, URL, request headers
+ * and body, response status, headers and body, when the request was made
+ * and how long it took.  The credentials of the structure are not written.
+ * The API entry point is fetched again first, so that the trace holds
+ * everything deltacloud_initialize_transport() needs to replay it with
+ * deltacloud_replay_transport().  Requests that are retried only have the
+ * attempt whose answer was used written out, and of a hedged request only
+ * the copy that answered first.  Recording to a new file stops recording
+ * to the old one; requests already under way finish writing to the file
+ * they started with.
+ * @param[in] api The deltacloud_api structure representing this connection
+ * @param[in] filename The file to write the trace to, which is truncated
+ *                     first, or NULL to stop recording
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_trace_record(struct deltacloud_api *api, const char *filename)
+{
+  struct trace_recorder *recorder = NULL;
+  struct trace_recorder *old;
+  char *data = NULL;
+  int ret = -1;
+
+  if (!valid_api(api))
+    return -1;
+
+  if (filename != NULL) {
+    recorder = calloc(1, sizeof(struct trace_recorder));
+    if (recorder == NULL) {
+      oom_error();
+      return -1;
+    }
+
+    recorder->fp = fopen(filename, "w");
+    if (recorder->fp == NULL) {
+      set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to open the trace file");
+      SAFE_FREE(recorder);
+      return -1;
+    }
+    fputs(TRACE_MAGIC, recorder->fp);
+
+    pthread_mutex_init(&recorder->lock, NULL);
+    recorder->origin = now_ms();
+    recorder->refs = 1;
+  }
+
+  pthread_mutex_lock(&trace_lock);
+  old = api->priv->recorder;
+  api->priv->recorder = recorder;
+  pthread_mutex_unlock(&trace_lock);
+
+  trace_recorder_release(old);
+
+  if (recorder == NULL)
+    return 0;
+
+  if (get_url(api, api->url, &data) != 0) {
+    /* get_url set the error */
+    deltacloud_trace_record(api, NULL);
+    goto cleanup;
+  }
+
+  ret = 0;
+
+ cleanup:
+  SAFE_FREE(data);
+
+  return ret;
+}
+
+/************************** REPLAYING ****************************************/
+/* requests are matched on their verb and URL through a hash table of this
+ * many buckets
+ */
+#define REPLAY_BUCKETS 1024
+
+struct replay_response {
+  long status;
+  double elapsed; /* milliseconds */
+  char *headers; /* without the status line */
+  char *body;
+  size_t body_length;
+
+  struct replay_response *next;
+};
+
+/* every response recorded for one verb and URL, in the order they were
+ * recorded in
+ */
+struct replay_request {
+  char *key; /* "VERB URL" */
+  struct replay_response *responses;
+  struct replay_response *last;
+  struct replay_response *cursor; /* the one to hand out next */
+
+  struct replay_request *next;
+};
+
+struct deltacloud_replay {
+  pthread_mutex_t lock; /* protects the cursors */
+  double speed;
+  struct replay_request *table[REPLAY_BUCKETS];
+};
+
+static unsigned int replay_hash(const char *key)
+{
+  unsigned int hash = 2166136261u;
+
+  for (; *key != '\0'; key++)
+    hash = (hash ^ (unsigned char)*key) * 16777619u;
+
+  return hash % REPLAY_BUCKETS;
+}
+
+static struct replay_request *replay_find(struct deltacloud_replay *replay,
+					  const char *key)
+{
+  struct replay_request *req;
+
+  for (req = replay->table[replay_hash(key)]; req != NULL; req = req->next)
+    if (STREQ(req->key, key))
+      return req;
+
+  return NULL;
+}
+
+/* read size bytes and the newline after them; returns a nul terminated
+ * copy that the caller must free, or NULL if the file ends too soon
+ */
+static char *read_block(FILE *fp, size_t size)
+{
+  char *block;
+
+  block = malloc(size + 1);
+  if (block == NULL)
+    return NULL;
+
+  if (fread(block, 1, size, fp) != size || fgetc(fp) != '\n') {
+    SAFE_FREE(block);
+    return NULL;
+  }
+  block[size] = '\0';
+
+  return block;
+}
+
+/* the headers of the last response in a recording, which may include
+ * interim responses and redirects, without the status line; the
+ * transport interface adds its own
+ */
+static char *final_headers(const char *headers)
+{
+  const char *line;
+  const char *start = headers;
+
+  for (line = headers; *line != '\0'; line = strchrnul(line, '\n') + 1) {
+    if (STRPREFIX(line, "HTTP/"))
+      start = strchrnul(line, '\n');
+    if (*strchrnul(line, '\n') == '\0')
+      break;
+  }
+  if (*start == '\n')
+    start++;
+
+  return strdup(start);
+}
+
+/* a copy of the last response with status 200 recorded for req, or NULL if
+ * there is none or it could not be copied
+ */
+static struct replay_response *last_ok_copy(struct replay_request *req)
+{
+  struct replay_response *resp;
+  struct replay_response *ok = NULL;
+  struct replay_response *copy;
+
+  for (resp = req->responses; resp != NULL; resp = resp->next)
+    if (resp->status == 200)
+      ok = resp;
+  if (ok == NULL)
+    return NULL;
+
+  copy = calloc(1, sizeof(struct replay_response));
+  if (copy == NULL)
+    return NULL;
+  copy->status = ok->status;
+  copy->headers = strdup(ok->headers);
+  copy->body = malloc(ok->body_length + 1);
+  if (copy->headers == NULL || copy->body == NULL) {
+    SAFE_FREE(copy->headers);
+    SAFE_FREE(copy->body);
+    SAFE_FREE(copy);
+    return NULL;
+  }
+  memcpy(copy->body, ok->body, ok->body_length + 1);
+  copy->body_length = ok->body_length;
+
+  return copy;
+}
+
+/* add one record of the trace to replay.  Returns 1 if one was added, 0 at
+ * the end of the file and -1 on error
+ */
+static int replay_load_one(struct deltacloud_replay *replay, FILE *fp)
+{
+  struct replay_response *resp = NULL;
+  struct replay_response *copy;
+  struct replay_request *req;
+  char verb[16];
+  char *line = NULL;
+  size_t linesize = 0;
+  char *url = NULL;
+  char *key = NULL;
+  char *headers = NULL;
+  char *skip;
+  double start;
+  size_t lengths[5];
+  unsigned int bucket;
+  int ret = -1;
+
+  if (getline(&line, &linesize, fp) < 0) {
+    SAFE_FREE(line);
+    return 0;
+  }
+
+  resp = calloc(1, sizeof(struct replay_response));
+  if (resp == NULL) {
+    oom_error();
+    goto cleanup;
+  }
+
+  if (sscanf(line, "> %15s %lf %lf %ld %zu %zu %zu %zu %zu", verb, &start,
+	     &resp->elapsed, &resp->status, &lengths[0], &lengths[1],
+	     &lengths[2], &lengths[3], &lengths[4]) != 9) {
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Malformed record in trace file");
+    goto cleanup;
+  }
+
+  url = read_block(fp, lengths[0]);
+  if (url == NULL)
+    goto truncated;
+  /* the request itself is only there for people reading the trace */
+  skip = read_block(fp, lengths[1]);
+  if (skip == NULL)
+    goto truncated;
+  SAFE_FREE(skip);
+  skip = read_block(fp, lengths[2]);
+  if (skip == NULL)
+    goto truncated;
+  SAFE_FREE(skip);
+  headers = read_block(fp, lengths[3]);
+  if (headers == NULL)
+    goto truncated;
+  resp->body = read_block(fp, lengths[4]);
+  if (resp->body == NULL)
+    goto truncated;
+  resp->body_length = lengths[4];
+
+  resp->headers = final_headers(headers);
+  if (resp->headers == NULL || asprintf(&key, "%s %s", verb, url) < 0) {
+    key = NULL;
+    oom_error();
+    goto cleanup;
+  }
+
+  req = replay_find(replay, key);
+  if (req == NULL) {
+    req = calloc(1, sizeof(struct replay_request));
+    if (req == NULL) {
+      oom_error();
+      goto cleanup;
+    }
+    req->key = key;
+    key = NULL;
+    bucket = replay_hash(req->key);
+    req->next = replay->table[bucket];
+    replay->table[bucket] = req;
+  }
+
+  /* a 304 answered a conditional request that the replaying api, which
+   * starts out with an empty cache, may not make, and the transport gets no
+   * say over that anyway; hand out the 200 it confirmed instead.  One with
+   * nothing to confirm in the trace is left out.
+   */
+  if (resp->status == 304) {
+    copy = last_ok_copy(req);
+    if (copy == NULL) {
+      ret = 1;
+      goto cleanup;
+    }
+    copy->elapsed = resp->elapsed;
+    SAFE_FREE(resp->headers);
+    SAFE_FREE(resp->body);
+    SAFE_FREE(resp);
+    resp = copy;
+  }
+
+  if (req->last == NULL)
+    req->responses = req->cursor = resp;
+  else
+    req->last->next = resp;
+  req->last = resp;
+  resp = NULL;
+
+  ret = 1;
+  goto cleanup;
+
+ truncated:
+  set_error(DELTACLOUD_INTERNAL_ERROR, "Truncated record in trace file");
+
+ cleanup:
+  if (resp != NULL) {
+    SAFE_FREE(resp->headers);
+    SAFE_FREE(resp->body);
+    SAFE_FREE(resp);
+  }
+  SAFE_FREE(headers);
+  SAFE_FREE(key);
+  SAFE_FREE(url);
+  SAFE_FREE(line);
+
+  return ret;
+}
+
+/**
+ * A function to load a trace written by deltacloud_trace_record() for
+ * replay.  Passing the result as the ctx of deltacloud_initialize_transport(),
+ * along with deltacloud_replay_transport(), gives a deltacloud_api
+ * structure that answers each request with the response recorded for the
+ * same verb and URL, with no network involved.  A request that was recorded
+ * several times gets the recorded responses in turn, and the last one
+ * from then on, so a trace of one run can be replayed any number of times.
+ * Request headers play no part in the matching, so a recorded 304 Not
+ * Modified is replayed as the 200 response it confirmed.
+ * A request that is not in the trace gets a 404 response.  The replay
+ * must not be closed before every deltacloud_api structure using it has
+ * been freed.
+ * @param[in] filename The trace file to load
+ * @param[in] speed How fast to replay: 1.0 makes each response take as long
+ *                  as it took when it was recorded, 2.0 half as long, and
+ *                  so on; 0 answers at once
+ * @param[out] replay The loaded trace, to be freed with
+ *                    deltacloud_replay_close()
+ * @returns 0 on success, -1 on error
+ */
+int deltacloud_replay_open(const char *filename, double speed,
+			   struct deltacloud_replay **replay)
+{
+  char magic[sizeof(TRACE_MAGIC)];
+  FILE *fp;
+  int rc;
+
+  if (!valid_arg(filename) || !valid_arg(replay))
+    return -1;
+
+  if (speed < 0) {
+    invalid_argument_error("speed must be at least 0");
+    return -1;
+  }
+
+  fp = fopen(filename, "r");
+  if (fp == NULL) {
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Failed to open the trace file");
+    return -1;
+  }
+
+  if (fgets(magic, sizeof(magic), fp) == NULL || STRNEQ(magic, TRACE_MAGIC)) {
+    set_error(DELTACLOUD_INTERNAL_ERROR, "Not a deltacloud trace file");
+    fclose(fp);
+    return -1;
+  }
+
+  *replay = calloc(1, sizeof(struct deltacloud_replay));
+  if (*replay == NULL) {
+    oom_error();
+    fclose(fp);
+    return -1;
+  }
+  pthread_mutex_init(&(*replay)->lock, NULL);
+  (*replay)->speed = speed;
+
+  while ((rc = replay_load_one(*replay, fp)) > 0)
+    ;
+  fclose(fp);
+
+  if (rc < 0) {
+    /* replay_load_one set the error */
+    deltacloud_replay_close(*replay);
+    *replay = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * A function to free a trace loaded with deltacloud_replay_open().
+ * @param[in] replay The trace to free
+ */
+void deltacloud_replay_close(struct deltacloud_replay *replay)
+{
+  struct replay_request *req;
+  struct replay_response *resp;
+  int i;
+
+  if (replay == NULL)
+    return;
+
+  for (i = 0; i < REPLAY_BUCKETS; i++) {
+    while ((req = replay->table[i]) != NULL) {
+      replay->table[i] = req->next;
+      while ((resp = req->responses) != NULL) {
+	req->responses = resp->next;
+	SAFE_FREE(resp->headers);
+	SAFE_FREE(resp->body);
+	SAFE_FREE(resp);
+      }
+      SAFE_FREE(req->key);
+      SAFE_FREE(req);
+    }
+  }
+
+  pthread_mutex_destroy(&replay->lock);
+  SAFE_FREE(replay);
+}
+
+static int replay_answer(void *ctx, const char *verb, const char *url,
+			 struct deltacloud_transport_response *response)
+{
+  struct deltacloud_replay *replay = (struct deltacloud_replay *)ctx;
+  struct replay_request *req;
+  struct replay_response *resp = NULL;
+  xmlChar *safekey;
+  char *key;
+  char *body;
+
+  if (asprintf(&key, "%s %s", verb, url) < 0)
+    return -1;
+
+  pthread_mutex_lock(&replay->lock);
+  req = replay_find(replay, key);
+  if (req != NULL) {
+    resp = req->cursor;
+    if (resp->next != NULL)
+      req->cursor = resp->next;
+  }
+  pthread_mutex_unlock(&replay->lock);
+
+  if (resp == NULL) {
+    /* the URL may well have a & in it */
+    safekey = xmlEncodeSpecialChars(NULL, BAD_CAST key);
+    SAFE_FREE(key);
+    if (safekey == NULL)
+      return -1;
+    if (asprintf(&body, "<error status=\"404\"><message>%s is not in the trace</message></error>",
+		 (char *)safekey) < 0) {
+      xmlFree(safekey);
+      return -1;
+    }
+    xmlFree(safekey);
+    response->status = 404;
+    response->body = body;
+    response->body_length = strlen(body);
+    response->cookie = body;
+    return 0;
+  }
+  SAFE_FREE(key);
+
+  if (replay->speed > 0 && resp->elapsed > 0)
+    sleep_ms(resp->elapsed / replay->speed);
+
+  if (resp->status == 0)
+    /* there was no response when it was recorded either */
+    return -1;
+
+  /* the responses stay put until the replay is closed, so they are handed
+   * out as they are
+   */
+  response->status = resp->status;
+  response->headers = resp->headers;
+  response->body = resp->body;
+  response->body_length = resp->body_length;
+
+  return 0;
+}
+
+static int replay_get(void *ctx, const char *url, const char *const *headers,
+		      struct deltacloud_transport_response *response)
+{
+  return replay_answer(ctx, "GET", url, response);
+}
+
+static int replay_head(void *ctx, const char *url, const char *const *headers,
+		       struct deltacloud_transport_response *response)
+{
+  return replay_answer(ctx, "HEAD", url, response);
+}
+
+static int replay_del(void *ctx, const char *url, const char *const *headers,
+		      struct deltacloud_transport_response *response)
+{
+  return replay_answer(ctx, "DELETE", url, response);
+}
+
+static int replay_post(void *ctx, const char *url, const char *const *headers,
+		       const char *body,
+		       struct deltacloud_transport_response *response)
+{
+  return replay_answer(ctx, "POST", url, response);
+}
+
+static int replay_multipart(void *ctx, const char *url,
+			    const char *const *headers,
+			    const struct deltacloud_transport_part *parts,
+			    int nparts,
+			    struct deltacloud_transport_response *response)
+{
+  return replay_answer(ctx, "POST", url, response);
+}
+
+static void replay_release(void *ctx,
+			   struct deltacloud_transport_response *response)
+{
+  /* only the answers made up for requests missing from the trace are
+   * allocated
+   */
+  SAFE_FREE(response->cookie);
+}
+
+static const struct deltacloud_transport replay_transport = {
+  replay_get,
+  replay_head,
+  replay_del,
+  replay_post,
+  replay_multipart,
+  replay_release,
+};
+
+/**
+ * A function to get the transport that replays a trace loaded with
+ * deltacloud_replay_open(), for use with deltacloud_initialize_transport().
+ * @returns The replay transport
+ */
+const struct deltacloud_transport *deltacloud_replay_transport(void)
+{
+  return &replay_transport;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#ifndef TRACE_CAPTURE_H
+#define TRACE_CAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include "curl_action.h"
+
+#define TRACE_MAGIC "DELTACLOUD-TRACE 1\n"
+
+/* the trace file that the transfers of a deltacloud_api are written to.
+ * Transfers hold a reference while they run, so that recording can be
+ * stopped or moved to another file underneath them.
+ */
+struct trace_recorder {
+  pthread_mutex_t lock; /* serializes writes to fp */
+  FILE *fp;
+  double origin; /* when recording started, in milliseconds */
+  int refs; /* protected by the lock in trace.c, not by lock */
+};
+
+/* what is kept of one transfer while its api is being recorded.  The body
+ * is copied as it arrives, since it may be going into a push parser
+ * rather than into memory, and the headers may be handed to the caller
+ * before the transfer is written out.
+ */
+struct trace_capture {
+  struct trace_recorder *recorder;
+  double started;
+  char *headers;
+  size_t headers_size;
+  FILE *headers_fp;
+  char *body;
+  size_t body_size;
+  FILE *body_fp;
+};
+
+int trace_capture_start(struct transfer *xfer);
+void trace_capture_headers(struct transfer *xfer, const void *ptr,
+			   size_t size);
+void trace_capture_body(struct transfer *xfer, const void *ptr, size_t size);
+void trace_capture_finish(struct transfer *xfer);
+void trace_capture_free(struct transfer *xfer);
+
+void trace_recorder_release(struct trace_recorder *recorder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
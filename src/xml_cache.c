@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common.h"
+#include "xml_cache.h"
+
+/* A reused parser keeps its dictionary, and with it every name it has
+ * interned so far.  The documents of one API only ever use a few hundred,
+ * but one that has grown past this many has been fed something else, and is
+ * dropped rather than kept around.
+ */
+#define XML_CACHE_MAX_DICT 65536
+
+/** @cond INTERNAL */
+
+struct xml_cache {
+  xmlParserCtxtPtr parser; /* for xmlCtxtReadMemory() and friends */
+  xmlParserCtxtPtr push; /* for documents fed in as they download */
+  xmlXPathContextPtr xpath;
+};
+
+static pthread_key_t xml_cache_key;
+static pthread_once_t xml_cache_once = PTHREAD_ONCE_INIT;
+static int xml_cache_usable = 0;
+
+static void xml_cache_free(void *data)
+{
+  struct xml_cache *cache = (struct xml_cache *)data;
+
+  if (cache->parser != NULL)
+    xmlFreeParserCtxt(cache->parser);
+  if (cache->push != NULL)
+    xmlFreeParserCtxt(cache->push);
+  if (cache->xpath != NULL)
+    xmlXPathFreeContext(cache->xpath);
+  SAFE_FREE(cache);
+}
+
+static void xml_cache_init(void)
+{
+  if (pthread_key_create(&xml_cache_key, xml_cache_free) == 0)
+    xml_cache_usable = 1;
+}
+
+/* the cache of the calling thread, or NULL if there is none and one cannot
+ * be made, in which case contexts are simply not reused
+ */
+static struct xml_cache *get_cache(void)
+{
+  struct xml_cache *cache;
+
+  pthread_once(&xml_cache_once, xml_cache_init);
+  if (!xml_cache_usable)
+    return NULL;
+
+  cache = pthread_getspecific(xml_cache_key);
+  if (cache != NULL)
+    return cache;
+
+  cache = calloc(1, sizeof(struct xml_cache));
+  if (cache == NULL)
+    return NULL;
+  if (pthread_setspecific(xml_cache_key, cache) != 0) {
+    SAFE_FREE(cache);
+    return NULL;
+  }
+
+  return cache;
+}
+
+/* the parser is done with; free its document if nobody took it, and put it
+ * in slot unless the slot is taken or the parser is worth dropping
+ */
+static void release_parser(xmlParserCtxtPtr *slot, xmlParserCtxtPtr parser)
+{
+  if (parser->myDoc != NULL) {
+    xmlFreeDoc(parser->myDoc);
+    parser->myDoc = NULL;
+  }
+
+  if (slot == NULL || *slot != NULL ||
+      (parser->dict != NULL && xmlDictSize(parser->dict) > XML_CACHE_MAX_DICT))
+    xmlFreeParserCtxt(parser);
+  else
+    *slot = parser;
+}
+
+/* a parser for xmlCtxtReadMemory() or xmlCtxtReadDoc(), which reset it
+ * themselves before every document
+ */
+xmlParserCtxtPtr xml_cache_parser(void)
+{
+  struct xml_cache *cache = get_cache();
+  xmlParserCtxtPtr parser;
+
+  if (cache != NULL && cache->parser != NULL) {
+    parser = cache->parser;
+    cache->parser = NULL;
+    return parser;
+  }
+
+  return xmlNewParserCtxt();
+}
+
+void xml_cache_release_parser(xmlParserCtxtPtr parser)
+{
+  struct xml_cache *cache;
+
+  if (parser == NULL)
+    return;
+
+  cache = get_cache();
+  release_parser(cache != NULL ? &cache->parser : NULL, parser);
+}
+
+/* a push parser ready for the first chunk of a document called name, using
+ * the handlers in sax, or the stock SAX2 ones if sax is NULL.  The options
+ * are up to the caller, as they are for xmlCreatePushParserCtxt().
+ */
+xmlParserCtxtPtr xml_cache_push_parser(const xmlSAXHandler *sax,
+				       const char *name)
+{
+  struct xml_cache *cache = get_cache();
+  xmlParserCtxtPtr parser;
+
+  if (cache == NULL || cache->push == NULL)
+    return xmlCreatePushParserCtxt((xmlSAXHandlerPtr)sax, NULL, NULL, 0,
+				   name);
+
+  parser = cache->push;
+  cache->push = NULL;
+
+  /* the handlers are copied in by xmlCreatePushParserCtxt(), and survive a
+   * reset, so those of the previous document have to be put back first
+   */
+  if (sax != NULL)
+    memcpy(parser->sax, sax, sizeof(xmlSAXHandler));
+  else
+    xmlSAXVersion(parser->sax, 2);
+  parser->_private = NULL;
+
+  if (xmlCtxtResetPush(parser, NULL, 0, name, NULL) != 0) {
+    xmlFreeParserCtxt(parser);
+    return NULL;
+  }
+
+  return parser;
+}
+
+void xml_cache_release_push_parser(xmlParserCtxtPtr parser)
+{
+  struct xml_cache *cache;
+
+  if (parser == NULL)
+    return;
+
+  cache = get_cache();
+  release_parser(cache != NULL ? &cache->push : NULL, parser);
+}
+
+/* an XPath context for doc, as xmlXPathNewContext() would have made it.
+ * Setting one up registers all of the XPath functions, which is the part
+ * worth saving.
+ */
+xmlXPathContextPtr xml_cache_xpath(xmlDocPtr doc)
+{
+  struct xml_cache *cache = get_cache();
+  xmlXPathContextPtr ctxt;
+
+  if (cache == NULL || cache->xpath == NULL)
+    return xmlXPathNewContext(doc);
+
+  ctxt = cache->xpath;
+  cache->xpath = NULL;
+
+  ctxt->doc = doc;
+  ctxt->node = NULL;
+  ctxt->namespaces = NULL;
+  ctxt->nsNr = 0;
+  ctxt->contextSize = -1;
+  ctxt->proximityPosition = -1;
+  xmlResetError(&ctxt->lastError);
+
+  return ctxt;
+}
+
+void xml_cache_release_xpath(xmlXPathContextPtr ctxt)
+{
+  struct xml_cache *cache;
+
+  if (ctxt == NULL)
+    return;
+
+  cache = get_cache();
+  if (cache == NULL || cache->xpath != NULL) {
+    xmlXPathFreeContext(ctxt);
+    return;
+  }
+
+  /* don't leave a pointer to a document that is about to be freed */
+  ctxt->doc = NULL;
+  ctxt->node = NULL;
+  cache->xpath = ctxt;
+}
+/** @endcond */
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+
+#ifndef XML_CACHE_H
+#define XML_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libxml/parser.h>
+#include <libxml/xpath.h>
+
+/* Parser and XPath contexts kept around per thread, so that a program
+ * polling the same collections over and over does not set up and tear down
+ * a fresh context, with its dictionary and XPath function table, for every
+ * document it reads.  Each getter hands over the cached context, or a new
+ * one if the thread has none to spare, and the matching release puts it
+ * back; a context still in use by an outer parse is therefore never handed
+ * out twice.
+ */
+
+xmlParserCtxtPtr xml_cache_parser(void);
+void xml_cache_release_parser(xmlParserCtxtPtr parser);
+
+xmlParserCtxtPtr xml_cache_push_parser(const xmlSAXHandler *sax,
+				       const char *name);
+void xml_cache_release_push_parser(xmlParserCtxtPtr parser);
+
+xmlXPathContextPtr xml_cache_xpath(xmlDocPtr doc);
+void xml_cache_release_xpath(xmlXPathContextPtr ctxt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
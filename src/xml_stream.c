@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libxml/SAX2.h>
+#include "common.h"
+#include "xml_cache.h"
+#include "xml_stream.h"
+
+/* The tree is built by the stock SAX2 handlers, as it is for any other push
+ * parser; the two below only wrap them to notice when a child of the root
+ * has been closed.  At that point the child is complete, so the list
+ * callback can parse it exactly as it would have in the full document, and
+ * it is then freed along with any whitespace that came before it.
+ */
+
+static void stream_start_element(void *ctx, const xmlChar *localname,
+				 const xmlChar *prefix, const xmlChar *URI,
+				 int nb_namespaces, const xmlChar **namespaces,
+				 int nb_attributes, int nb_defaulted,
+				 const xmlChar **attributes)
+{
+  xmlParserCtxtPtr parser = (xmlParserCtxtPtr)ctx;
+  struct xml_stream *stream = (struct xml_stream *)parser->_private;
+
+  xmlSAX2StartElementNs(ctx, localname, prefix, URI, nb_namespaces,
+			namespaces, nb_attributes, nb_defaulted, attributes);
+
+  if (stream->depth == 0 && STREQ((const char *)localname, stream->rootname))
+    stream->active = 1;
+  stream->depth++;
+}
+
+static void stream_end_element(void *ctx, const xmlChar *localname,
+			       const xmlChar *prefix, const xmlChar *URI)
+{
+  xmlParserCtxtPtr parser = (xmlParserCtxtPtr)ctx;
+  struct xml_stream *stream = (struct xml_stream *)parser->_private;
+  xmlNodePtr root, cur;
+  int rc;
+
+  xmlSAX2EndElementNs(ctx, localname, prefix, URI);
+
+  stream->depth--;
+  if (!stream->active || stream->failed || stream->depth != 1)
+    return;
+
+  root = xmlDocGetRootElement(parser->myDoc);
+  if (root == NULL)
+    return;
+
+  if (stream->ctxt == NULL) {
+    stream->ctxt = xml_cache_xpath(parser->myDoc);
+    if (stream->ctxt == NULL) {
+      oom_error();
+      goto fail;
+    }
+  }
+  stream->ctxt->node = root;
+
+  if (stream->element_cb != NULL)
+    /* the element that was just closed is the last child of the root */
+    rc = stream->element_cb(root->last, stream->ctxt, stream->data);
+  else
+    /* everything before the element has already been handed over and
+     * freed, so it is the only element in the list
+     */
+    rc = stream->list_cb(root->children, stream->ctxt, &stream->list);
+  if (rc < 0)
+    /* the callbacks are expected to have set their own error */
+    goto fail;
+  stream->elements++;
+
+  while ((cur = root->children) != NULL) {
+    xmlUnlinkNode(cur);
+    xmlFreeNode(cur);
+  }
+
+  if (rc > 0) {
+    stream->stopped = 1;
+    xmlStopParser(parser);
+  }
+
+  return;
+
+ fail:
+  stream->failed = 1;
+  xmlStopParser(parser);
+}
+
+/** @cond INTERNAL */
+struct xml_stream *xml_stream_new(const char *rootname,
+				  int (*list_cb)(xmlNodePtr cur,
+						 xmlXPathContextPtr ctxt,
+						 void **data),
+				  void (*free_all)(void *list))
+{
+  struct xml_stream *stream;
+
+  stream = calloc(1, sizeof(struct xml_stream));
+  if (stream == NULL) {
+    oom_error();
+    return NULL;
+  }
+
+  stream->rootname = rootname;
+  stream->list_cb = list_cb;
+  stream->free_all = free_all;
+
+  return stream;
+}
+
+/* a stream whose elements are handed to element_cb, one at a time, along
+ * with data.  element_cb returns -1 on error, after setting it, 1 to stop
+ * the stream there, or 0 to go on.
+ */
+struct xml_stream *xml_stream_new_visit(const char *rootname,
+					int (*element_cb)(xmlNodePtr cur,
+							  xmlXPathContextPtr ctxt,
+							  void *data),
+					void *data)
+{
+  struct xml_stream *stream;
+
+  stream = calloc(1, sizeof(struct xml_stream));
+  if (stream == NULL) {
+    oom_error();
+    return NULL;
+  }
+
+  stream->rootname = rootname;
+  stream->element_cb = element_cb;
+  stream->data = data;
+
+  return stream;
+}
+
+/* a push parser like the one transfer_stream_xml() uses, but with the
+ * elements of the document going to the list callback of stream.  name is
+ * used for error messages.
+ */
+xmlParserCtxtPtr xml_stream_parser(struct xml_stream *stream,
+				   const char *name)
+{
+  xmlSAXHandler sax;
+  xmlParserCtxtPtr parser;
+
+  memset(&sax, 0, sizeof(xmlSAXHandler));
+  xmlSAXVersion(&sax, 2);
+  sax.startElementNs = stream_start_element;
+  sax.endElementNs = stream_end_element;
+
+  parser = xml_cache_push_parser(&sax, name);
+  if (parser == NULL)
+    return NULL;
+
+  parser->_private = stream;
+
+  return parser;
+}
+
+/* hand over the list built so far; the stream no longer owns it */
+void *xml_stream_take(struct xml_stream *stream)
+{
+  void *list = stream->list;
+
+  stream->list = NULL;
+
+  return list;
+}
+
+void xml_stream_free(struct xml_stream *stream)
+{
+  if (stream == NULL)
+    return;
+
+  if (stream->list != NULL)
+    stream->free_all(&stream->list);
+  xml_cache_release_xpath(stream->ctxt);
+  SAFE_FREE(stream);
+}
+/** @endcond */
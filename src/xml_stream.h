@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#ifndef XML_STREAM_H
+#define XML_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libxml/parser.h>
+#include <libxml/xpath.h>
+
+/* A collection document that is parsed while it downloads, with every
+ * element handed over as soon as it is complete and then dropped from the
+ * document, so that only the root and the element being read are ever in
+ * memory, rather than the whole tree.
+ */
+struct xml_stream {
+  const char *rootname; /* anything else, such as <error>, is kept whole */
+
+  /* the elements either go into a list... */
+  int (*list_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt, void **data);
+  void (*free_all)(void *list); /* takes a pointer to the list head */
+  void *list; /* what list_cb has built so far */
+
+  /* ...or to element_cb one by one, which returns 1 to stop the stream */
+  int (*element_cb)(xmlNodePtr cur, xmlXPathContextPtr ctxt, void *data);
+  void *data;
+
+  xmlXPathContextPtr ctxt;
+  int depth; /* of the element being read; the root is 1 */
+  int active; /* the root is rootname */
+  long elements; /* handed over so far */
+  int stopped; /* element_cb asked to stop */
+  int failed; /* a callback failed, and set the error */
+};
+
+struct xml_stream *xml_stream_new(const char *rootname,
+				  int (*list_cb)(xmlNodePtr cur,
+						 xmlXPathContextPtr ctxt,
+						 void **data),
+				  void (*free_all)(void *list));
+struct xml_stream *xml_stream_new_visit(const char *rootname,
+					int (*element_cb)(xmlNodePtr cur,
+							  xmlXPathContextPtr ctxt,
+							  void *data),
+					void *data);
+xmlParserCtxtPtr xml_stream_parser(struct xml_stream *stream,
+				   const char *name);
+void *xml_stream_take(struct xml_stream *stream);
+void xml_stream_free(struct xml_stream *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
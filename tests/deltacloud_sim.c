@@ -0,0 +1,1421 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+/*
+ * deltacloud_sim is a small, self-contained HTTP server that speaks enough
+ * of the deltacloud XML API for the programs in this directory to run
+ * against it: the API entry point, instances, images, realms, hardware
+ * profiles, instance states, buckets, blobs and metrics.  Each collection
+ * is synthesized from an index, so an inventory of any size costs almost
+ * nothing to set up; instances, buckets and blobs created through the API
+ * are kept in memory until they are destroyed or the server exits.
+ *
+ * The server prints the URL of its API entry point on stdout once it is
+ * listening, which lets a caller ask for port 0 and pick up whatever port
+ * the kernel handed out.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define SIM_MIN_OBJECTS 10
+#define SIM_MAX_OBJECTS 100000
+#define SIM_DEFAULT_OBJECTS 100
+
+/* requests larger than this are refused rather than buffered */
+#define SIM_MAX_REQUEST (16 * 1024 * 1024)
+
+struct sim_buf {
+  char *data;
+  size_t len;
+  size_t size;
+};
+
+struct sim_meta {
+  char *key;
+  char *value;
+  struct sim_meta *next;
+};
+
+struct sim_blob {
+  char *id;
+  char *content;
+  size_t length;
+  struct sim_meta *meta;
+  struct sim_blob *next;
+};
+
+struct sim_bucket {
+  char *id;
+  struct sim_blob *blobs;
+  struct sim_bucket *next;
+};
+
+struct sim_instance {
+  char *id;
+  char *name;
+  char *image_id;
+  const char *state;
+  struct sim_instance *next;
+};
+
+struct sim_request {
+  char *method;
+  char *path;
+  char *host;
+  char *content_type;
+  char *body;
+  long length;
+  int close;
+  int expect; /* the client waits for 100 Continue before the body */
+  struct sim_meta *meta; /* X-Deltacloud-Blobmeta-* request headers */
+};
+
+struct sim_response {
+  int status;
+  struct sim_buf headers; /* extra headers, each ending in \r\n */
+  struct sim_buf body;
+  const char *content_type;
+};
+
+/* everything there is to know about a synthesized collection */
+struct sim_collection {
+  const char *name; /* the link rel, path component and list root */
+  const char *prefix; /* synthesized ids are the prefix and an index */
+  void (*one)(struct sim_buf *buf, const char *base, long i);
+};
+
+static long count = SIM_DEFAULT_OBJECTS;
+static long latency_ms;
+static long jitter_ms;
+
+/* the objects created through the API; state_lock covers all of them */
+static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_instance *instances;
+static struct sim_bucket *buckets;
+static unsigned long next_instance;
+
+/*************************** BUFFER HELPERS ********************************/
+static void die(const char *msg)
+{
+  fprintf(stderr, "deltacloud_sim: %s\n", msg);
+  exit(1);
+}
+
+static void buf_reserve(struct sim_buf *buf, size_t extra)
+{
+  size_t size;
+
+  if (buf->len + extra + 1 <= buf->size)
+    return;
+
+  size = buf->size ? buf->size : 256;
+  while (size < buf->len + extra + 1)
+    size *= 2;
+
+  buf->data = realloc(buf->data, size);
+  if (buf->data == NULL)
+    die("out of memory");
+  buf->size = size;
+}
+
+static void buf_append(struct sim_buf *buf, const char *data, size_t len)
+{
+  buf_reserve(buf, len);
+  memcpy(buf->data + buf->len, data, len);
+  buf->len += len;
+  buf->data[buf->len] = '\0';
+}
+
+#define buf_literal(buf, s) buf_append(buf, s, sizeof(s) - 1)
+
+static void buf_printf(struct sim_buf *buf, const char *fmt, ...)
+  __attribute__((format(printf, 2, 3)));
+
+static void buf_printf(struct sim_buf *buf, const char *fmt, ...)
+{
+  va_list ap;
+  int len;
+
+  va_start(ap, fmt);
+  len = vsnprintf(NULL, 0, fmt, ap);
+  va_end(ap);
+
+  buf_reserve(buf, len);
+  va_start(ap, fmt);
+  vsnprintf(buf->data + buf->len, len + 1, fmt, ap);
+  va_end(ap);
+  buf->len += len;
+}
+
+/* append s with the characters that are special to XML escaped */
+static void buf_escape(struct sim_buf *buf, const char *s)
+{
+  for (; *s != '\0'; s++) {
+    switch (*s) {
+    case '<':
+      buf_literal(buf, "&lt;");
+      break;
+    case '>':
+      buf_literal(buf, "&gt;");
+      break;
+    case '&':
+      buf_literal(buf, "&amp;");
+      break;
+    case '"':
+      buf_literal(buf, "&quot;");
+      break;
+    default:
+      buf_append(buf, s, 1);
+    }
+  }
+}
+
+static char *xstrndup(const char *s, size_t len)
+{
+  char *ret;
+
+  ret = strndup(s, len);
+  if (ret == NULL)
+    die("out of memory");
+  return ret;
+}
+
+/* like xstrndup(), but for data that may contain nul bytes */
+static char *xmemdup(const char *data, size_t len)
+{
+  char *ret;
+
+  ret = malloc(len + 1);
+  if (ret == NULL)
+    die("out of memory");
+  memcpy(ret, data, len);
+  ret[len] = '\0';
+  return ret;
+}
+
+static void free_meta(struct sim_meta *meta)
+{
+  struct sim_meta *next;
+
+  while (meta != NULL) {
+    next = meta->next;
+    free(meta->key);
+    free(meta->value);
+    free(meta);
+    meta = next;
+  }
+}
+
+static void add_meta(struct sim_meta **meta, const char *key,
+		     const char *value)
+{
+  struct sim_meta *entry;
+
+  entry = calloc(1, sizeof(struct sim_meta));
+  if (entry == NULL)
+    die("out of memory");
+  entry->key = xstrndup(key, strlen(key));
+  entry->value = xstrndup(value, strlen(value));
+  entry->next = *meta;
+  *meta = entry;
+}
+
+/*************************** SYNTHESIZED OBJECTS ***************************/
+static void instance_xml(struct sim_buf *buf, const char *base, const char *id,
+			 const char *name, const char *image_id,
+			 const char *state, long i)
+{
+  buf_printf(buf, "<instance href=\"%s/instances/", base);
+  buf_escape(buf, id);
+  buf_literal(buf, "\" id=\"");
+  buf_escape(buf, id);
+  buf_literal(buf, "\"><name>");
+  buf_escape(buf, name);
+  buf_printf(buf, "</name><owner_id>simuser</owner_id>"
+	     "<image href=\"%s/images/", base);
+  buf_escape(buf, image_id);
+  buf_literal(buf, "\" id=\"");
+  buf_escape(buf, image_id);
+  buf_printf(buf, "\"/><realm href=\"%s/realms/realm%ld\" id=\"realm%ld\"/>"
+	     "<state>%s</state>"
+	     "<launch_time>2014-01-01T00:00:00Z</launch_time>"
+	     "<hardware_profile href=\"%s/hardware_profiles/hwp0\" id=\"hwp0\">"
+	     "<property kind=\"fixed\" name=\"cpu\" unit=\"count\" value=\"1\"/>"
+	     "<property kind=\"fixed\" name=\"memory\" unit=\"MB\" "
+	     "value=\"1024\"/></hardware_profile><actions>",
+	     base, i % count, i % count, state, base);
+  buf_printf(buf, "<link href=\"%s/instances/", base);
+  buf_escape(buf, id);
+  buf_literal(buf, "/stop\" method=\"post\" rel=\"stop\"/>");
+  buf_printf(buf, "<link href=\"%s/instances/", base);
+  buf_escape(buf, id);
+  buf_literal(buf, "/start\" method=\"post\" rel=\"start\"/>");
+  buf_printf(buf, "<link href=\"%s/instances/", base);
+  buf_escape(buf, id);
+  buf_literal(buf, "/reboot\" method=\"post\" rel=\"reboot\"/>");
+  buf_printf(buf, "<link href=\"%s/instances/", base);
+  buf_escape(buf, id);
+  buf_literal(buf, "\" method=\"delete\" rel=\"destroy\"/>");
+  buf_printf(buf, "</actions><public_addresses><address>10.%ld.%ld.%ld</address>"
+	     "</public_addresses><private_addresses>"
+	     "<address>192.168.%ld.%ld</address></private_addresses>"
+	     "<authentication type=\"key\"><login><keyname>simkey</keyname>"
+	     "</login></authentication></instance>",
+	     (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff, (i >> 8) & 0xff,
+	     i & 0xff);
+}
+
+static void one_instance(struct sim_buf *buf, const char *base, long i)
+{
+  char id[32];
+  char name[32];
+  char image_id[32];
+
+  snprintf(id, sizeof(id), "inst%ld", i);
+  snprintf(name, sizeof(name), "instance%ld", i);
+  snprintf(image_id, sizeof(image_id), "img%ld", i % count);
+  instance_xml(buf, base, id, name, image_id, "RUNNING", i);
+}
+
+static void one_image(struct sim_buf *buf, const char *base, long i)
+{
+  buf_printf(buf, "<image href=\"%s/images/img%ld\" id=\"img%ld\">"
+	     "<name>image%ld</name><owner_id>simuser</owner_id>"
+	     "<description>Simulated image %ld</description>"
+	     "<architecture>%s</architecture><state>AVAILABLE</state>"
+	     "</image>", base, i, i, i, i, i % 2 ? "i386" : "x86_64");
+}
+
+static void one_realm(struct sim_buf *buf, const char *base, long i)
+{
+  buf_printf(buf, "<realm href=\"%s/realms/realm%ld\" id=\"realm%ld\">"
+	     "<name>realm%ld</name><state>AVAILABLE</state><limit></limit>"
+	     "</realm>", base, i, i, i);
+}
+
+static void one_hwp(struct sim_buf *buf, const char *base, long i)
+{
+  buf_printf(buf, "<hardware_profile href=\"%s/hardware_profiles/hwp%ld\" "
+	     "id=\"hwp%ld\"><name>hwp%ld</name>"
+	     "<property kind=\"fixed\" name=\"cpu\" unit=\"count\" "
+	     "value=\"%ld\"/>"
+	     "<property kind=\"range\" name=\"memory\" unit=\"MB\" "
+	     "value=\"1024\"><param href=\"%s/instances\" method=\"post\" "
+	     "name=\"hwp_memory\" operation=\"create\"/>"
+	     "<range first=\"512\" last=\"%ld\"/></property>"
+	     "<property kind=\"enum\" name=\"storage\" unit=\"GB\" value=\"10\">"
+	     "<param href=\"%s/instances\" method=\"post\" name=\"hwp_storage\" "
+	     "operation=\"create\"/><enum><entry value=\"10\"/>"
+	     "<entry value=\"100\"/></enum></property></hardware_profile>",
+	     base, i, i, i, i % 8 + 1, base, 4096 + i, base);
+}
+
+static void one_bucket(struct sim_buf *buf, const char *base, long i)
+{
+  buf_printf(buf, "<bucket href=\"%s/buckets/bucket%ld\" id=\"bucket%ld\">"
+	     "<name>bucket%ld</name><size>1</size>"
+	     "<blob href=\"%s/buckets/bucket%ld/blob0\" id=\"blob0\"/>"
+	     "</bucket>", base, i, i, i, base, i);
+}
+
+static const struct sim_collection collections[] = {
+  { "instances", "inst", one_instance },
+  { "images", "img", one_image },
+  { "realms", "realm", one_realm },
+  { "hardware_profiles", "hwp", one_hwp },
+  { "buckets", "bucket", one_bucket },
+};
+#define SIM_NCOLLECTIONS (sizeof(collections) / sizeof(collections[0]))
+
+/* the synthesized part of each collection only depends on the base URL, so
+ * it is built once and copied into every response that needs it
+ */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+  char *base;
+  struct sim_buf body;
+} cache[SIM_NCOLLECTIONS];
+
+static void append_collection(struct sim_buf *buf, size_t which,
+			      const char *base)
+{
+  long i;
+
+  pthread_mutex_lock(&cache_lock);
+  if (cache[which].base == NULL || strcmp(cache[which].base, base) != 0) {
+    free(cache[which].base);
+    cache[which].base = xstrndup(base, strlen(base));
+    cache[which].body.len = 0;
+    for (i = 0; i < count; i++)
+      collections[which].one(&cache[which].body, base, i);
+  }
+  buf_append(buf, cache[which].body.data, cache[which].body.len);
+  pthread_mutex_unlock(&cache_lock);
+}
+
+/* returns the index of a synthesized object, or -1 if id does not name one */
+static long synthesized_index(const struct sim_collection *coll,
+			      const char *id)
+{
+  size_t len = strlen(coll->prefix);
+  char *end;
+  long i;
+
+  if (strncmp(id, coll->prefix, len) != 0 || id[len] < '0' || id[len] > '9')
+    return -1;
+  if (id[len] == '0' && id[len + 1] != '\0')
+    return -1;
+
+  i = strtol(id + len, &end, 10);
+  if (*end != '\0' || i >= count)
+    return -1;
+
+  return i;
+}
+
+static void blob_xml(struct sim_buf *buf, const char *base,
+		     const char *bucket_id, const char *id, size_t length,
+		     struct sim_meta *meta)
+{
+  buf_printf(buf, "<blob href=\"%s/buckets/", base);
+  buf_escape(buf, bucket_id);
+  buf_literal(buf, "/");
+  buf_escape(buf, id);
+  buf_literal(buf, "\" id=\"");
+  buf_escape(buf, id);
+  buf_literal(buf, "\"><bucket>");
+  buf_escape(buf, bucket_id);
+  buf_printf(buf, "</bucket><content_length>%zu</content_length>"
+	     "<content_type>application/octet-stream</content_type>"
+	     "<last_modified>Wed, 01 Jan 2014 00:00:00 GMT</last_modified>"
+	     "<user_metadata>", length);
+  for (; meta != NULL; meta = meta->next) {
+    buf_literal(buf, "<entry key=\"");
+    buf_escape(buf, meta->key);
+    buf_literal(buf, "\">");
+    buf_escape(buf, meta->value);
+    buf_literal(buf, "</entry>");
+  }
+  buf_printf(buf, "</user_metadata><content href=\"%s/buckets/", base);
+  buf_escape(buf, bucket_id);
+  buf_literal(buf, "/");
+  buf_escape(buf, id);
+  buf_literal(buf, "/content\" rel=\"blob_content\"/></blob>");
+}
+
+static void bucket_xml(struct sim_buf *buf, const char *base,
+		       struct sim_bucket *bucket)
+{
+  struct sim_blob *blob;
+  size_t size = 0;
+
+  for (blob = bucket->blobs; blob != NULL; blob = blob->next)
+    size++;
+
+  buf_printf(buf, "<bucket href=\"%s/buckets/", base);
+  buf_escape(buf, bucket->id);
+  buf_literal(buf, "\" id=\"");
+  buf_escape(buf, bucket->id);
+  buf_literal(buf, "\"><name>");
+  buf_escape(buf, bucket->id);
+  buf_printf(buf, "</name><size>%zu</size>", size);
+  for (blob = bucket->blobs; blob != NULL; blob = blob->next) {
+    buf_printf(buf, "<blob href=\"%s/buckets/", base);
+    buf_escape(buf, bucket->id);
+    buf_literal(buf, "/");
+    buf_escape(buf, blob->id);
+    buf_literal(buf, "\" id=\"");
+    buf_escape(buf, blob->id);
+    buf_literal(buf, "\"/>");
+  }
+  buf_literal(buf, "</bucket>");
+}
+
+static void metric_xml(struct sim_buf *buf, const char *base, const char *id,
+		       long i)
+{
+  static const char *names[] = { "cpuUtilization", "diskReadBytes",
+				 "networkIn" };
+  static const char *units[] = { "Percent", "Bytes", "Bytes" };
+  size_t m;
+  int s;
+
+  /* the metric parser walks the children by position, so the whitespace
+   * between the elements is significant here
+   */
+  buf_printf(buf, "<metric href=\"%s/metrics/", base);
+  buf_escape(buf, id);
+  buf_literal(buf, "\" id=\"");
+  buf_escape(buf, id);
+  buf_printf(buf, "\">\n  <instance href=\"%s/instances/", base);
+  buf_escape(buf, id);
+  buf_literal(buf, "\" id=\"");
+  buf_escape(buf, id);
+  buf_literal(buf, "\"/>\n  <properties>");
+  for (m = 0; m < sizeof(names) / sizeof(names[0]); m++) {
+    buf_printf(buf, "\n    <%s>", names[m]);
+    for (s = 0; s < 3; s++)
+      buf_printf(buf, "\n      <sample>"
+		 "<property name=\"unit\" value=\"%s\"/>"
+		 "<property name=\"minimum\" value=\"%ld\"/>"
+		 "<property name=\"maximum\" value=\"%ld\"/>"
+		 "<property name=\"samples\" value=\"60\"/>"
+		 "<property name=\"average\" value=\"%ld\"/></sample>",
+		 units[m], (i + s) % 10, (i + s) % 10 + 90, (i + s) % 10 + 45);
+    buf_printf(buf, "\n    </%s>", names[m]);
+  }
+  buf_literal(buf, "\n  </properties>\n</metric>");
+}
+
+/*************************** REQUEST HANDLING ******************************/
+static void respond(struct sim_response *resp, int status, const char *fmt,
+		    ...) __attribute__((format(printf, 3, 4)));
+
+static void respond(struct sim_response *resp, int status, const char *fmt,
+		    ...)
+{
+  va_list ap;
+  int len;
+
+  resp->status = status;
+  if (fmt == NULL)
+    return;
+
+  va_start(ap, fmt);
+  len = vsnprintf(NULL, 0, fmt, ap);
+  va_end(ap);
+
+  buf_reserve(&resp->body, len);
+  va_start(ap, fmt);
+  vsnprintf(resp->body.data + resp->body.len, len + 1, fmt, ap);
+  va_end(ap);
+  resp->body.len += len;
+}
+
+static void respond_error(struct sim_response *resp, int status,
+			  const char *path, const char *message)
+{
+  resp->status = status;
+  resp->body.len = 0;
+  buf_printf(&resp->body, "<error status=\"%d\" url=\"", status);
+  buf_escape(&resp->body, path);
+  buf_printf(&resp->body, "\"><message>%s</message></error>", message);
+}
+
+static void respond_created(struct sim_response *resp, const char *base,
+			    const char *collection, const char *id)
+{
+  resp->status = 201;
+  buf_printf(&resp->headers, "Location: %s/%s/%s\r\n", base, collection, id);
+}
+
+/* decode one application/x-www-form-urlencoded value in place */
+static void url_decode(char *s)
+{
+  char *out = s;
+  char hex[3] = { 0, 0, 0 };
+
+  for (; *s != '\0'; s++) {
+    if (*s == '+')
+      *out++ = ' ';
+    else if (*s == '%' && s[1] != '\0' && s[2] != '\0') {
+      hex[0] = s[1];
+      hex[1] = s[2];
+      *out++ = (char)strtol(hex, NULL, 16);
+      s += 2;
+    }
+    else
+      *out++ = *s;
+  }
+  *out = '\0';
+}
+
+/* returns a newly allocated copy of the form field name in body, or NULL */
+static char *form_value(const char *body, const char *name)
+{
+  size_t len = strlen(name);
+  const char *p = body;
+  const char *end;
+  char *value;
+
+  while (p != NULL && *p != '\0') {
+    end = strchr(p, '&');
+    if (strncmp(p, name, len) == 0 && p[len] == '=') {
+      p += len + 1;
+      value = xstrndup(p, end ? (size_t)(end - p) : strlen(p));
+      url_decode(value);
+      return value;
+    }
+    p = end ? end + 1 : NULL;
+  }
+
+  return NULL;
+}
+
+/* returns the contents of the multipart/form-data field name, which need
+ * not be a string
+ */
+static char *multipart_value(struct sim_request *req, const char *boundary,
+			     const char *name, size_t *length)
+{
+  char marker[256];
+  char *part;
+  char *data;
+  char *end;
+  char *bodyend = req->body + req->length;
+
+  snprintf(marker, sizeof(marker), "name=\"%s\"", name);
+  part = memmem(req->body, req->length, marker, strlen(marker));
+  if (part == NULL)
+    return NULL;
+
+  data = memmem(part, bodyend - part, "\r\n\r\n", 4);
+  if (data == NULL)
+    return NULL;
+  data += 4;
+
+  snprintf(marker, sizeof(marker), "\r\n--%s", boundary);
+  end = memmem(data, bodyend - data, marker, strlen(marker));
+  if (end == NULL)
+    return NULL;
+
+  *length = end - data;
+  return xmemdup(data, end - data);
+}
+
+static struct sim_instance *find_instance(const char *id)
+{
+  struct sim_instance *inst;
+
+  for (inst = instances; inst != NULL; inst = inst->next)
+    if (strcmp(inst->id, id) == 0)
+      return inst;
+  return NULL;
+}
+
+static struct sim_bucket *find_bucket(const char *id)
+{
+  struct sim_bucket *bucket;
+
+  for (bucket = buckets; bucket != NULL; bucket = bucket->next)
+    if (strcmp(bucket->id, id) == 0)
+      return bucket;
+  return NULL;
+}
+
+static struct sim_blob *find_blob(struct sim_bucket *bucket, const char *id)
+{
+  struct sim_blob *blob;
+
+  for (blob = bucket->blobs; blob != NULL; blob = blob->next)
+    if (strcmp(blob->id, id) == 0)
+      return blob;
+  return NULL;
+}
+
+static void free_blob(struct sim_blob *blob)
+{
+  free(blob->id);
+  free(blob->content);
+  free_meta(blob->meta);
+  free(blob);
+}
+
+static void handle_root(struct sim_response *resp, const char *base)
+{
+  size_t i;
+
+  respond(resp, 200, "<api driver=\"mock\" version=\"1.0.0\">");
+  for (i = 0; i < SIM_NCOLLECTIONS; i++)
+    buf_printf(&resp->body, "<link href=\"%s/%s\" rel=\"%s\"></link>", base,
+	       collections[i].name, collections[i].name);
+  buf_printf(&resp->body, "<link href=\"%s/instance_states\" "
+	     "rel=\"instance_states\"></link>"
+	     "<link href=\"%s/metrics\" rel=\"metrics\"></link></api>",
+	     base, base);
+}
+
+static void handle_instances(struct sim_request *req,
+			     struct sim_response *resp, const char *base,
+			     char **parts, int nparts)
+{
+  struct sim_instance *inst;
+  struct sim_instance **prev;
+  const char *state = "RUNNING";
+  char *image_id;
+  char id[32];
+  long i;
+
+  if (nparts == 1 && strcmp(req->method, "POST") == 0) {
+    image_id = form_value(req->body, "image_id");
+    if (image_id == NULL) {
+      respond_error(resp, 400, req->path, "image_id is required");
+      return;
+    }
+
+    inst = calloc(1, sizeof(struct sim_instance));
+    if (inst == NULL)
+      die("out of memory");
+
+    pthread_mutex_lock(&state_lock);
+    snprintf(id, sizeof(id), "created%lu", next_instance++);
+    inst->id = xstrndup(id, strlen(id));
+    inst->name = form_value(req->body, "name");
+    if (inst->name == NULL)
+      inst->name = xstrndup(id, strlen(id));
+    inst->image_id = image_id;
+    inst->state = "RUNNING";
+    inst->next = instances;
+    instances = inst;
+    respond_created(resp, base, "instances", inst->id);
+    instance_xml(&resp->body, base, inst->id, inst->name, inst->image_id,
+		 inst->state, count + next_instance);
+    pthread_mutex_unlock(&state_lock);
+    return;
+  }
+
+  if (nparts == 1) {
+    respond(resp, 200, "<instances>");
+    append_collection(&resp->body, 0, base);
+    pthread_mutex_lock(&state_lock);
+    for (inst = instances, i = count; inst != NULL; inst = inst->next, i++)
+      instance_xml(&resp->body, base, inst->id, inst->name, inst->image_id,
+		   inst->state, i);
+    pthread_mutex_unlock(&state_lock);
+    buf_literal(&resp->body, "</instances>");
+    return;
+  }
+
+  if (nparts == 3) {
+    if (strcmp(req->method, "POST") != 0) {
+      respond_error(resp, 405, req->path, "Method not allowed");
+      return;
+    }
+    if (strcmp(parts[2], "stop") == 0)
+      state = "STOPPED";
+    else if (strcmp(parts[2], "start") != 0 &&
+	     strcmp(parts[2], "reboot") != 0) {
+      respond_error(resp, 404, req->path, "No such action");
+      return;
+    }
+  }
+
+  i = synthesized_index(&collections[0], parts[1]);
+  if (i >= 0) {
+    if (strcmp(req->method, "DELETE") == 0)
+      /* the synthesized inventory never changes */
+      respond(resp, 204, NULL);
+    else {
+      respond(resp, 200, NULL);
+      one_instance(&resp->body, base, i);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&state_lock);
+  for (prev = &instances; *prev != NULL; prev = &(*prev)->next)
+    if (strcmp((*prev)->id, parts[1]) == 0)
+      break;
+  inst = *prev;
+  if (inst == NULL)
+    respond_error(resp, 404, req->path, "Instance not found");
+  else if (strcmp(req->method, "DELETE") == 0) {
+    *prev = inst->next;
+    free(inst->id);
+    free(inst->name);
+    free(inst->image_id);
+    free(inst);
+    respond(resp, 204, NULL);
+  }
+  else {
+    if (nparts == 3)
+      inst->state = state;
+    respond(resp, 200, NULL);
+    instance_xml(&resp->body, base, inst->id, inst->name, inst->image_id,
+		 inst->state, count);
+  }
+  pthread_mutex_unlock(&state_lock);
+}
+
+static void handle_blob(struct sim_request *req, struct sim_response *resp,
+			const char *base, char **parts, int nparts)
+{
+  struct sim_bucket *bucket;
+  struct sim_blob *blob;
+  struct sim_blob **prev;
+  struct sim_meta *meta;
+  struct sim_meta origin = { (char *)"origin", (char *)"sim", NULL };
+  char content[64];
+  long i;
+
+  i = synthesized_index(&collections[4], parts[1]);
+  if (i >= 0) {
+    if (strcmp(parts[2], "blob0") != 0)
+      respond_error(resp, 404, req->path, "Blob not found");
+    else if (strcmp(req->method, "POST") == 0 ||
+	     strcmp(req->method, "DELETE") == 0)
+      respond(resp, 204, NULL);
+    else if (nparts == 4) {
+      resp->content_type = "application/octet-stream";
+      respond(resp, 200, "simulated blob %ld\n", i);
+    }
+    else {
+      snprintf(content, sizeof(content), "simulated blob %ld\n", i);
+      buf_literal(&resp->headers, "X-Deltacloud-Blobmeta-origin: sim\r\n");
+      respond(resp, 200, NULL);
+      blob_xml(&resp->body, base, parts[1], "blob0", strlen(content),
+	       &origin);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&state_lock);
+  bucket = find_bucket(parts[1]);
+  blob = NULL;
+  prev = NULL;
+  if (bucket != NULL)
+    for (prev = &bucket->blobs; *prev != NULL; prev = &(*prev)->next)
+      if (strcmp((*prev)->id, parts[2]) == 0) {
+	blob = *prev;
+	break;
+      }
+
+  if (blob == NULL)
+    respond_error(resp, 404, req->path, "Blob not found");
+  else if (nparts == 4) {
+    resp->content_type = "application/octet-stream";
+    respond(resp, 200, NULL);
+    buf_append(&resp->body, blob->content, blob->length);
+  }
+  else if (strcmp(req->method, "DELETE") == 0) {
+    *prev = blob->next;
+    free_blob(blob);
+    respond(resp, 204, NULL);
+  }
+  else if (strcmp(req->method, "POST") == 0) {
+    /* updating the metadata replaces all of it */
+    free_meta(blob->meta);
+    blob->meta = req->meta;
+    req->meta = NULL;
+    respond(resp, 204, NULL);
+  }
+  else {
+    for (meta = blob->meta; meta != NULL; meta = meta->next)
+      buf_printf(&resp->headers, "X-Deltacloud-Blobmeta-%s: %s\r\n",
+		 meta->key, meta->value);
+    respond(resp, 200, NULL);
+    blob_xml(&resp->body, base, bucket->id, blob->id, blob->length,
+	     blob->meta);
+  }
+  pthread_mutex_unlock(&state_lock);
+}
+
+static void create_blob(struct sim_request *req, struct sim_response *resp,
+			const char *base, const char *bucket_id)
+{
+  struct sim_bucket *bucket;
+  struct sim_blob *blob;
+  const char *boundary;
+  char *value;
+  char *name;
+  char field[32];
+  size_t len;
+  long nmeta;
+  long i;
+
+  boundary = req->content_type ? strstr(req->content_type, "boundary=") : NULL;
+  if (boundary == NULL) {
+    respond_error(resp, 400, req->path, "Expected multipart/form-data");
+    return;
+  }
+  boundary += strlen("boundary=");
+
+  blob = calloc(1, sizeof(struct sim_blob));
+  if (blob == NULL)
+    die("out of memory");
+  blob->id = multipart_value(req, boundary, "blob_id", &len);
+  blob->content = multipart_value(req, boundary, "blob_data", &blob->length);
+  if (blob->id == NULL || blob->content == NULL) {
+    free_blob(blob);
+    respond_error(resp, 400, req->path, "blob_id and blob_data are required");
+    return;
+  }
+
+  value = multipart_value(req, boundary, "meta_params", &len);
+  nmeta = value ? strtol(value, NULL, 10) : 0;
+  free(value);
+  for (i = 1; i <= nmeta; i++) {
+    snprintf(field, sizeof(field), "meta_name%ld", i);
+    name = multipart_value(req, boundary, field, &len);
+    snprintf(field, sizeof(field), "meta_value%ld", i);
+    value = multipart_value(req, boundary, field, &len);
+    if (name != NULL && value != NULL)
+      add_meta(&blob->meta, name, value);
+    free(name);
+    free(value);
+  }
+
+  pthread_mutex_lock(&state_lock);
+  bucket = find_bucket(bucket_id);
+  if (bucket == NULL) {
+    free_blob(blob);
+    respond_error(resp, 404, req->path, "Bucket not found");
+  }
+  else if (find_blob(bucket, blob->id) != NULL) {
+    free_blob(blob);
+    respond_error(resp, 409, req->path, "Blob already exists");
+  }
+  else {
+    blob->next = bucket->blobs;
+    bucket->blobs = blob;
+    respond(resp, 200, NULL);
+    blob_xml(&resp->body, base, bucket->id, blob->id, blob->length,
+	     blob->meta);
+  }
+  pthread_mutex_unlock(&state_lock);
+}
+
+static void handle_buckets(struct sim_request *req, struct sim_response *resp,
+			   const char *base, char **parts, int nparts)
+{
+  struct sim_bucket *bucket;
+  struct sim_bucket **prev;
+  char *name;
+  long i;
+
+  if (nparts >= 3) {
+    handle_blob(req, resp, base, parts, nparts);
+    return;
+  }
+
+  if (nparts == 1 && strcmp(req->method, "POST") == 0) {
+    name = form_value(req->body, "name");
+    if (name == NULL || *name == '\0' || strchr(name, '/') != NULL ||
+	synthesized_index(&collections[4], name) >= 0) {
+      free(name);
+      respond_error(resp, 400, req->path, "Invalid bucket name");
+      return;
+    }
+
+    pthread_mutex_lock(&state_lock);
+    if (find_bucket(name) != NULL) {
+      free(name);
+      respond_error(resp, 409, req->path, "Bucket already exists");
+    }
+    else {
+      bucket = calloc(1, sizeof(struct sim_bucket));
+      if (bucket == NULL)
+	die("out of memory");
+      bucket->id = name;
+      bucket->next = buckets;
+      buckets = bucket;
+      respond_created(resp, base, "buckets", bucket->id);
+      bucket_xml(&resp->body, base, bucket);
+    }
+    pthread_mutex_unlock(&state_lock);
+    return;
+  }
+
+  if (nparts == 1) {
+    respond(resp, 200, "<buckets>");
+    append_collection(&resp->body, 4, base);
+    pthread_mutex_lock(&state_lock);
+    for (bucket = buckets; bucket != NULL; bucket = bucket->next)
+      bucket_xml(&resp->body, base, bucket);
+    pthread_mutex_unlock(&state_lock);
+    buf_literal(&resp->body, "</buckets>");
+    return;
+  }
+
+  if (strcmp(req->method, "POST") == 0) {
+    create_blob(req, resp, base, parts[1]);
+    return;
+  }
+
+  i = synthesized_index(&collections[4], parts[1]);
+  if (i >= 0) {
+    if (strcmp(req->method, "DELETE") == 0)
+      respond(resp, 204, NULL);
+    else {
+      respond(resp, 200, NULL);
+      one_bucket(&resp->body, base, i);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&state_lock);
+  for (prev = &buckets; *prev != NULL; prev = &(*prev)->next)
+    if (strcmp((*prev)->id, parts[1]) == 0)
+      break;
+  bucket = *prev;
+  if (bucket == NULL)
+    respond_error(resp, 404, req->path, "Bucket not found");
+  else if (strcmp(req->method, "DELETE") == 0) {
+    if (bucket->blobs != NULL)
+      respond_error(resp, 409, req->path, "Bucket is not empty");
+    else {
+      *prev = bucket->next;
+      free(bucket->id);
+      free(bucket);
+      respond(resp, 204, NULL);
+    }
+  }
+  else {
+    respond(resp, 200, NULL);
+    bucket_xml(&resp->body, base, bucket);
+  }
+  pthread_mutex_unlock(&state_lock);
+}
+
+static void handle_metrics(struct sim_request *req, struct sim_response *resp,
+			   const char *base, char **parts, int nparts)
+{
+  long i;
+
+  if (nparts != 2) {
+    respond_error(resp, 404, req->path, "Not found");
+    return;
+  }
+
+  i = synthesized_index(&collections[0], parts[1]);
+  if (i < 0) {
+    pthread_mutex_lock(&state_lock);
+    i = find_instance(parts[1]) ? count : -1;
+    pthread_mutex_unlock(&state_lock);
+  }
+
+  if (i < 0)
+    respond_error(resp, 404, req->path, "Instance not found");
+  else {
+    respond(resp, 200, NULL);
+    metric_xml(&resp->body, base, parts[1], i);
+  }
+}
+
+static void handle_request(struct sim_request *req, struct sim_response *resp)
+{
+  struct sim_buf base = { NULL, 0, 0 };
+  char *parts[8];
+  int nparts = 0;
+  char *path;
+  char *save;
+  char *tok;
+  size_t i;
+  long idx;
+
+  buf_printf(&base, "http://%s/api", req->host ? req->host : "localhost");
+
+  path = xstrndup(req->path, strcspn(req->path, "?"));
+  for (tok = strtok_r(path, "/", &save); tok != NULL && nparts < 8;
+       tok = strtok_r(NULL, "/", &save))
+    parts[nparts++] = tok;
+
+  if (nparts == 0 || strcmp(parts[0], "api") != 0) {
+    respond_error(resp, 404, req->path, "Not found");
+    goto cleanup;
+  }
+
+  /* the rest of the routing works on the path below /api */
+  for (i = 1; i < (size_t)nparts; i++)
+    url_decode(parts[i]);
+
+  if (nparts == 1) {
+    handle_root(resp, base.data);
+    goto cleanup;
+  }
+
+  if (strcmp(parts[1], "instances") == 0 && nparts <= 4) {
+    handle_instances(req, resp, base.data, parts + 1, nparts - 1);
+    goto cleanup;
+  }
+  if (strcmp(parts[1], "buckets") == 0 && nparts <= 5) {
+    handle_buckets(req, resp, base.data, parts + 1, nparts - 1);
+    goto cleanup;
+  }
+  if (strcmp(parts[1], "metrics") == 0) {
+    handle_metrics(req, resp, base.data, parts + 1, nparts - 1);
+    goto cleanup;
+  }
+  if (strcmp(parts[1], "instance_states") == 0 && nparts == 2) {
+    respond(resp, 200, "<states><state name=\"start\">"
+	    "<transition action=\"create\" to=\"pending\"/></state>"
+	    "<state name=\"pending\"><transition auto=\"true\" to=\"running\"/>"
+	    "</state><state name=\"running\">"
+	    "<transition action=\"reboot\" to=\"running\"/>"
+	    "<transition action=\"stop\" to=\"stopped\"/></state>"
+	    "<state name=\"stopped\"><transition action=\"start\" "
+	    "to=\"running\"/><transition action=\"destroy\" to=\"finish\"/>"
+	    "</state><state name=\"finish\"></state></states>");
+    goto cleanup;
+  }
+
+  for (i = 1; i < SIM_NCOLLECTIONS; i++) {
+    if (strcmp(parts[1], collections[i].name) != 0)
+      continue;
+
+    if (strcmp(req->method, "GET") != 0 && strcmp(req->method, "HEAD") != 0)
+      respond_error(resp, 405, req->path, "Method not allowed");
+    else if (nparts == 2) {
+      respond(resp, 200, "<%s>", collections[i].name);
+      append_collection(&resp->body, i, base.data);
+      buf_printf(&resp->body, "</%s>", collections[i].name);
+    }
+    else if (nparts == 3 &&
+	     (idx = synthesized_index(&collections[i], parts[2])) >= 0) {
+      respond(resp, 200, NULL);
+      collections[i].one(&resp->body, base.data, idx);
+    }
+    else
+      respond_error(resp, 404, req->path, "Not found");
+    goto cleanup;
+  }
+
+  respond_error(resp, 404, req->path, "Not found");
+
+ cleanup:
+  free(path);
+  free(base.data);
+}
+
+/*************************** CONNECTIONS ***********************************/
+static int write_all(int fd, const char *data, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(fd, data, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    data += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+static const char *status_text(int status)
+{
+  switch (status) {
+  case 100: return "Continue";
+  case 200: return "OK";
+  case 201: return "Created";
+  case 204: return "No Content";
+  case 400: return "Bad Request";
+  case 404: return "Not Found";
+  case 405: return "Method Not Allowed";
+  case 409: return "Conflict";
+  case 413: return "Request Entity Too Large";
+  default: return "Internal Server Error";
+  }
+}
+
+static void simulate_latency(unsigned int *seed)
+{
+  struct timespec ts;
+  long ms = latency_ms;
+
+  if (jitter_ms > 0)
+    ms += rand_r(seed) % (jitter_ms + 1);
+  if (ms <= 0)
+    return;
+
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000;
+  while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+    ;
+}
+
+static int send_response(int fd, struct sim_request *req,
+			 struct sim_response *resp)
+{
+  struct sim_buf head = { NULL, 0, 0 };
+  int ret;
+
+  buf_printf(&head, "HTTP/1.1 %d %s\r\nContent-Type: %s\r\n"
+	     "Content-Length: %zu\r\n%s%s\r\n", resp->status,
+	     status_text(resp->status),
+	     resp->content_type ? resp->content_type : "application/xml",
+	     resp->body.len, resp->headers.data ? resp->headers.data : "",
+	     req->close ? "Connection: close\r\n" : "");
+
+  ret = write_all(fd, head.data, head.len);
+  if (ret == 0 && strcmp(req->method, "HEAD") != 0)
+    ret = write_all(fd, resp->body.data ? resp->body.data : "",
+		    resp->body.len);
+
+  free(head.data);
+  return ret;
+}
+
+/* parses the request line and headers in head, which is nul terminated and
+ * modified in place
+ */
+static int parse_head(char *head, struct sim_request *req)
+{
+  char *save;
+  char *linesave;
+  char *line;
+  char *value;
+  char *version;
+
+  line = strtok_r(head, "\r\n", &save);
+  if (line == NULL)
+    return -1;
+
+  req->method = strtok_r(line, " ", &linesave);
+  req->path = strtok_r(NULL, " ", &linesave);
+  version = strtok_r(NULL, " ", &linesave);
+  if (req->method == NULL || req->path == NULL || version == NULL)
+    return -1;
+  req->close = strcmp(version, "HTTP/1.0") == 0;
+
+  while ((line = strtok_r(NULL, "\r\n", &save)) != NULL) {
+    value = strchr(line, ':');
+    if (value == NULL)
+      continue;
+    *value++ = '\0';
+    value += strspn(value, " \t");
+
+    if (strcasecmp(line, "Host") == 0)
+      req->host = value;
+    else if (strcasecmp(line, "Content-Length") == 0)
+      req->length = strtol(value, NULL, 10);
+    else if (strcasecmp(line, "Content-Type") == 0)
+      req->content_type = value;
+    else if (strcasecmp(line, "Expect") == 0)
+      req->expect = strcasecmp(value, "100-continue") == 0;
+    else if (strcasecmp(line, "Connection") == 0)
+      req->close = strcasecmp(value, "close") == 0;
+    else if (strncasecmp(line, "X-Deltacloud-Blobmeta-", 22) == 0)
+      add_meta(&req->meta, line + 22, value);
+  }
+
+  return 0;
+}
+
+static void *connection_thread(void *arg)
+{
+  int fd = (int)(long)arg;
+  struct sim_buf in = { NULL, 0, 0 };
+  struct sim_request req;
+  struct sim_response resp;
+  unsigned int seed = (unsigned int)fd ^ (unsigned int)time(NULL);
+  char *end;
+  char *head;
+  size_t headlen;
+  size_t need;
+  int continued;
+  ssize_t n;
+
+  while (1) {
+    /* read until there is a complete request head in the buffer */
+    while ((end = memmem(in.data ? in.data : "", in.len, "\r\n\r\n",
+			 4)) == NULL) {
+      buf_reserve(&in, 16384);
+      n = read(fd, in.data + in.len, in.size - in.len - 1);
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n <= 0 || in.len > SIM_MAX_REQUEST)
+	goto out;
+      in.len += n;
+      in.data[in.len] = '\0';
+    }
+
+    memset(&req, 0, sizeof(req));
+    memset(&resp, 0, sizeof(resp));
+    headlen = end - in.data + 4;
+    head = xstrndup(in.data, headlen);
+    if (parse_head(head, &req) < 0) {
+      free(head);
+      goto out;
+    }
+
+    need = headlen + (req.length > 0 ? req.length : 0);
+    if (req.length < 0 || need > SIM_MAX_REQUEST) {
+      req.close = 1;
+      respond_error(&resp, 413, req.path, "Request too large");
+      send_response(fd, &req, &resp);
+      free(head);
+      free_meta(req.meta);
+      free(resp.body.data);
+      goto out;
+    }
+
+    /* libcurl holds back large bodies until it is told to go ahead */
+    continued = 0;
+    while (in.len < need) {
+      if (req.expect && !continued && write_all(fd, "HTTP/1.1 100 Continue\r\n\r\n", 25) < 0)
+	break;
+      continued = 1;
+      buf_reserve(&in, need - in.len);
+      n = read(fd, in.data + in.len, need - in.len);
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n <= 0)
+	break;
+      in.len += n;
+      in.data[in.len] = '\0';
+    }
+    if (in.len < need) {
+      free(head);
+      free_meta(req.meta);
+      goto out;
+    }
+
+    req.body = xmemdup(in.data + headlen, need - headlen);
+
+    simulate_latency(&seed);
+    handle_request(&req, &resp);
+    n = send_response(fd, &req, &resp);
+
+    free(req.body);
+    free_meta(req.meta);
+    free(resp.headers.data);
+    free(resp.body.data);
+    free(head);
+
+    if (n < 0 || req.close)
+      break;
+
+    /* keep whatever the client pipelined after this request */
+    memmove(in.data, in.data + need, in.len - need);
+    in.len -= need;
+    in.data[in.len] = '\0';
+  }
+
+ out:
+  free(in.data);
+  close(fd);
+  return NULL;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-p <port>] [-n <objects>] [-l <latency_ms>] "
+	  "[-j <jitter_ms>]\n", prog);
+  fprintf(stderr, "  -p  port to listen on; 0, the default, picks a free one\n");
+  fprintf(stderr, "  -n  objects in each collection, %d to %d (default %d)\n",
+	  SIM_MIN_OBJECTS, SIM_MAX_OBJECTS, SIM_DEFAULT_OBJECTS);
+  fprintf(stderr, "  -l  delay before every response, in milliseconds\n");
+  fprintf(stderr, "  -j  random extra delay of up to this many milliseconds\n");
+}
+
+int main(int argc, char *argv[])
+{
+  struct sockaddr_in addr;
+  socklen_t addrlen;
+  pthread_attr_t attr;
+  pthread_t thread;
+  int port = 0;
+  int one = 1;
+  int listenfd;
+  int fd;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "p:n:l:j:h")) != -1) {
+    switch (opt) {
+    case 'p':
+      port = atoi(optarg);
+      break;
+    case 'n':
+      count = strtol(optarg, NULL, 10);
+      break;
+    case 'l':
+      latency_ms = strtol(optarg, NULL, 10);
+      break;
+    case 'j':
+      jitter_ms = strtol(optarg, NULL, 10);
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind != argc || port < 0 || port > 65535 || count < SIM_MIN_OBJECTS ||
+      count > SIM_MAX_OBJECTS || latency_ms < 0 || jitter_ms < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  listenfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenfd < 0) {
+    perror("socket");
+    return 1;
+  }
+  setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listenfd, 128) < 0) {
+    perror("bind");
+    return 1;
+  }
+
+  addrlen = sizeof(addr);
+  if (getsockname(listenfd, (struct sockaddr *)&addr, &addrlen) < 0) {
+    perror("getsockname");
+    return 1;
+  }
+  printf("http://127.0.0.1:%d/api\n", ntohs(addr.sin_port));
+  fflush(stdout);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  while (1) {
+    fd = accept(listenfd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+	continue;
+      perror("accept");
+      return 1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (pthread_create(&thread, &attr, connection_thread,
+		       (void *)(long)fd) != 0) {
+      fprintf(stderr, "deltacloud_sim: failed to start a connection thread\n");
+      close(fd);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+#!/bin/sh
+#
+# Runs every test program against a private deltacloud_sim, so that
+# "make check" needs neither a network nor a deltacloud server.  The size
+# of the inventory and the latency of the simulator can be changed with:
+#
+#   SIM_OBJECTS      objects per collection for the functional tests (50)
+#   SIM_SCALE_OBJECTS  objects per collection for test_scale (10000)
+#   SIM_LATENCY      milliseconds added to every response (0)
+#   SIM_JITTER       random extra milliseconds per response (0)
+#
+# To run a single test by hand, start ./deltacloud_sim and pass the URL it
+# prints to the test, along with any user and password.
+
+tests="test_api test_async test_batch test_bucket test_driver test_firewall
+       test_hwp test_image test_instance test_instance_state test_key
+       test_loadbalancer test_param test_realm test_storage_snapshot
+       test_storage_volume test_transfer"
+
+workdir=`mktemp -d ${TMPDIR:-/tmp}/deltacloud_sim.XXXXXX` || exit 99
+simpid=
+
+stop_sim()
+{
+    if test -n "$simpid"; then
+	kill $simpid 2>/dev/null
+	wait $simpid 2>/dev/null
+	simpid=
+    fi
+}
+
+trap 'stop_sim; rm -rf "$workdir"' 0
+trap 'exit 99' 1 2 13 15
+
+# start_sim <objects>: starts the simulator and sets url to its entry point
+start_sim()
+{
+    # the URL of the previous simulator must not be mistaken for this one's
+    rm -f "$workdir/url"
+    ./deltacloud_sim -n $1 -l ${SIM_LATENCY:-0} -j ${SIM_JITTER:-0} \
+	> "$workdir/url" &
+    simpid=$!
+
+    tries=0
+    while test ! -s "$workdir/url"; do
+	tries=`expr $tries + 1`
+	if test $tries -gt 50 || ! kill -0 $simpid 2>/dev/null; then
+	    echo "deltacloud_sim did not start" >&2
+	    exit 99
+	fi
+	sleep 0.1
+    done
+    url=`head -n 1 "$workdir/url"`
+}
+
+testdir=`pwd`
+status=0
+
+start_sim ${SIM_OBJECTS:-50}
+for t in $tests; do
+    # test_bucket writes its scratch file to the current directory
+    if (cd "$workdir" && "$testdir/$t" "$url" mockuser mockpassword) \
+	> "$workdir/$t.log" 2>&1; then
+	echo "PASS: $t"
+    else
+	echo "FAIL: $t"
+	cat "$workdir/$t.log"
+	status=1
+    fi
+done
+
+# test_trace records a run against the simulator, and must then get the
+# same answers out of the trace with the simulator gone
+trace="$workdir/test_trace.trace"
+./test_trace "$url" mockuser mockpassword "$trace" record \
+    > "$workdir/test_trace.log" 2>&1
+recorded=$?
+stop_sim
+if test $recorded -eq 0 && ./test_trace "$url" mockuser mockpassword \
+    "$trace" replay >> "$workdir/test_trace.log" 2>&1; then
+    echo "PASS: test_trace"
+else
+    echo "FAIL: test_trace"
+    cat "$workdir/test_trace.log"
+    status=1
+fi
+
+start_sim ${SIM_SCALE_OBJECTS:-10000}
+if ./test_scale "$url" mockuser mockpassword ${SIM_SCALE_OBJECTS:-10000}; then
+    echo "PASS: test_scale"
+else
+    echo "FAIL: test_scale"
+    status=1
+fi
+stop_sim
+
+exit $status
@@ -38,37 +38,50 @@ int main(int argc, char *argv[])
   struct deltacloud_api zeroapi;
   int ret = 3;
 
-  if (argc != 4) {
-    fprintf(stderr, "Usage: %s <url> <user> <password>\n", argv[0]);
+  if (argc < 4 || argc > 6) {
+    fprintf(stderr, "Usage: %s <url> <user> <password> [<driver> [<provider>]]\n",
+	    argv[0]);
     return 1;
   }
 
-  if (deltacloud_initialize(NULL, argv[1], argv[2], argv[3]) == 0) {
+  if (deltacloud_initialize(NULL, argv[1], argv[2], argv[3],
+			    test_driver(argc, argv),
+			    test_provider(argc, argv)) == 0) {
     fprintf(stderr, "Expected deltacloud_initialize to fail with NULL api, but succeeded\n");
     return 2;
   }
 
-  if (deltacloud_initialize(&api, NULL, argv[2], argv[3]) == 0) {
+  if (deltacloud_initialize(&api, NULL, argv[2], argv[3],
+			    test_driver(argc, argv),
+			    test_provider(argc, argv)) == 0) {
     fprintf(stderr, "Expected deltacloud_initialize to fail with NULL url, but succeeded\n");
     return 2;
   }
 
-  if (deltacloud_initialize(&api, argv[1], NULL, argv[3]) == 0) {
+  if (deltacloud_initialize(&api, argv[1], NULL, argv[3],
+			    test_driver(argc, argv),
+			    test_provider(argc, argv)) == 0) {
     fprintf(stderr, "Expected deltacloud_initialize to fail with NULL user, but succeeded\n");
     return 2;
   }
 
-  if (deltacloud_initialize(&api, argv[1], argv[2], NULL) == 0) {
+  if (deltacloud_initialize(&api, argv[1], argv[2], NULL,
+			    test_driver(argc, argv),
+			    test_provider(argc, argv)) == 0) {
     fprintf(stderr, "Expected deltacloud_initialize to fail with NULL password, but succeeded\n");
     return 2;
   }
 
-  if (deltacloud_initialize(&api, "http://localhost:80", argv[2], argv[3]) == 0) {
+  if (deltacloud_initialize(&api, "http://localhost:80", argv[2], argv[3],
+			    test_driver(argc, argv),
+			    test_provider(argc, argv)) == 0) {
     fprintf(stderr, "Expected deltacloud_initialize to fail with bogus URL, but succeeded\n");
     return 2;
   }
 
-  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3]) < 0) {
+  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3],
+			    test_driver(argc, argv),
+			    test_provider(argc, argv)) < 0) {
     fprintf(stderr, "Failed to find links for the API: %s\n",
 	    deltacloud_get_last_error_string());
     return 2;
@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include "libdeltacloud.h"
+#include "test_common.h"
+
+/* Starts a handful of asynchronous requests at once, some GETs and an
+ * action, drives them first with deltacloud_async_perform() and then with
+ * poll() through the deltacloud_loop_* functions, and checks that every
+ * callback ran once with the status and result expected of it.
+ */
+
+#define MAX_FDS 16
+
+struct expect {
+  const char *what;
+  int status; /* the status the callback should see */
+  const char *id; /* for by-id requests, the id it should have filled in */
+  long count; /* for lists, the number of elements, or -1 */
+  int calls; /* how often the callback ran */
+  int ok; /* whether it saw what it should have */
+};
+
+static void check_status(struct expect *exp, int status)
+{
+  exp->calls++;
+  exp->ok = status == exp->status;
+  if (!exp->ok)
+    fprintf(stderr, "%s: expected status %d, got %d (%s)\n", exp->what,
+	    exp->status, status,
+	    status < 0 ? deltacloud_get_last_error_string() : "no error");
+}
+
+static void check_count(struct expect *exp, long count)
+{
+  if (exp->ok && count != exp->count) {
+    fprintf(stderr, "%s: expected %ld elements, got %ld\n", exp->what,
+	    exp->count, count);
+    exp->ok = 0;
+  }
+}
+
+static void check_id(struct expect *exp, const char *id)
+{
+  if (exp->ok && (id == NULL || strcmp(id, exp->id) != 0)) {
+    fprintf(stderr, "%s: expected id %s, got %s\n", exp->what, exp->id,
+	    id != NULL ? id : "(null)");
+    exp->ok = 0;
+  }
+}
+
+static void instances_done(struct deltacloud_api *api, int status,
+			   void *result, void *userdata)
+{
+  struct deltacloud_instance *instances = result;
+  struct deltacloud_instance *instance;
+  long count = 0;
+
+  check_status(userdata, status);
+  deltacloud_for_each(instance, instances)
+    count++;
+  check_count(userdata, count);
+  deltacloud_free_instance_list(&instances);
+}
+
+static void images_done(struct deltacloud_api *api, int status,
+			void *result, void *userdata)
+{
+  struct deltacloud_image *images = result;
+  struct deltacloud_image *image;
+  long count = 0;
+
+  check_status(userdata, status);
+  deltacloud_for_each(image, images)
+    count++;
+  check_count(userdata, count);
+  deltacloud_free_image_list(&images);
+}
+
+static void realms_done(struct deltacloud_api *api, int status,
+			void *result, void *userdata)
+{
+  struct deltacloud_realm *realms = result;
+  struct deltacloud_realm *realm;
+  long count = 0;
+
+  check_status(userdata, status);
+  deltacloud_for_each(realm, realms)
+    count++;
+  check_count(userdata, count);
+  deltacloud_free_realm_list(&realms);
+}
+
+static void instance_done(struct deltacloud_api *api, int status,
+			  void *result, void *userdata)
+{
+  struct deltacloud_instance *instance = result;
+
+  check_status(userdata, status);
+  check_id(userdata, instance->id);
+}
+
+static void realm_done(struct deltacloud_api *api, int status,
+		       void *result, void *userdata)
+{
+  check_status(userdata, status);
+}
+
+static void action_done(struct deltacloud_api *api, int status,
+			void *result, void *userdata)
+{
+  struct expect *exp = userdata;
+
+  check_status(exp, status);
+  if (exp->ok && result != NULL) {
+    fprintf(stderr, "%s: expected no result for an action\n", exp->what);
+    exp->ok = 0;
+  }
+}
+
+/* what the synchronous API says the collections hold */
+struct inventory {
+  long instances;
+  long images;
+  long realms;
+  struct deltacloud_instance instance; /* the first one, for by-id */
+};
+
+static int take_inventory(struct deltacloud_api *api, struct inventory *inv)
+{
+  struct deltacloud_instance *instances = NULL;
+  struct deltacloud_image *images = NULL;
+  struct deltacloud_realm *realms = NULL;
+  struct deltacloud_instance *instance;
+  struct deltacloud_image *image;
+  struct deltacloud_realm *realm;
+  int ret = -1;
+
+  memset(inv, 0, sizeof(struct inventory));
+
+  if (deltacloud_get_instances(api, &instances) < 0 ||
+      deltacloud_get_images(api, &images) < 0 ||
+      deltacloud_get_realms(api, &realms) < 0) {
+    fprintf(stderr, "Failed to take the inventory: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+  if (instances == NULL) {
+    fprintf(stderr, "Expected at least one instance\n");
+    goto cleanup;
+  }
+
+  deltacloud_for_each(instance, instances)
+    inv->instances++;
+  deltacloud_for_each(image, images)
+    inv->images++;
+  deltacloud_for_each(realm, realms)
+    inv->realms++;
+
+  if (deltacloud_get_instance_by_id(api, instances->id, &inv->instance) < 0) {
+    fprintf(stderr, "Failed to get instance %s: %s\n", instances->id,
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  ret = 0;
+
+ cleanup:
+  deltacloud_free_instance_list(&instances);
+  deltacloud_free_image_list(&images);
+  deltacloud_free_realm_list(&realms);
+
+  return ret;
+}
+
+#define NEXPECT 6
+
+/* starts one of each kind of request; the structures they fill in must
+ * outlive the requests
+ */
+static int start_requests(struct deltacloud_api *api, struct inventory *inv,
+			  struct expect *exp, struct deltacloud_instance *out,
+			  struct deltacloud_realm *realm)
+{
+  const struct expect template[NEXPECT] = {
+    { "instances", 0, NULL, inv->instances },
+    { "images", 0, NULL, inv->images },
+    { "realms", 0, NULL, inv->realms },
+    { "instance by id", 0, inv->instance.id, -1 },
+    { "bogus realm by id", -1, NULL, -1 },
+    { "instance stop", 0, NULL, -1 },
+  };
+
+  memcpy(exp, template, sizeof(template));
+
+  if (deltacloud_async_get_instances(api, instances_done, &exp[0]) < 0 ||
+      deltacloud_async_get_images(api, images_done, &exp[1]) < 0 ||
+      deltacloud_async_get_realms(api, realms_done, &exp[2]) < 0 ||
+      deltacloud_async_get_instance_by_id(api, inv->instance.id, out,
+					  instance_done, &exp[3]) < 0 ||
+      deltacloud_async_get_realm_by_id(api, "bogus_id", realm, realm_done,
+				       &exp[4]) < 0 ||
+      deltacloud_async_instance_stop(api, &inv->instance, action_done,
+				     &exp[5]) < 0) {
+    fprintf(stderr, "Failed to start an asynchronous request: %s\n",
+	    deltacloud_get_last_error_string());
+    return -1;
+  }
+
+  if (deltacloud_async_pending(api) != NEXPECT) {
+    fprintf(stderr, "Expected %d pending requests, got %d\n", NEXPECT,
+	    deltacloud_async_pending(api));
+    return -1;
+  }
+
+  return 0;
+}
+
+static int check_requests(const char *how, struct expect *exp)
+{
+  int i;
+
+  for (i = 0; i < NEXPECT; i++) {
+    if (exp[i].calls != 1) {
+      fprintf(stderr, "%s: %s callback ran %d times\n", how, exp[i].what,
+	      exp[i].calls);
+      return -1;
+    }
+    if (!exp[i].ok)
+      return -1;
+  }
+
+  return 0;
+}
+
+static int drive_with_perform(struct deltacloud_api *api)
+{
+  int pending;
+  int rounds = 0;
+
+  do {
+    pending = deltacloud_async_perform(api, 100);
+    if (pending < 0) {
+      fprintf(stderr, "deltacloud_async_perform failed: %s\n",
+	      deltacloud_get_last_error_string());
+      return -1;
+    }
+    if (++rounds > 600) {
+      fprintf(stderr, "Requests did not complete\n");
+      return -1;
+    }
+  } while (pending > 0);
+
+  return 0;
+}
+
+static int drive_with_loop(struct deltacloud_api *api)
+{
+  struct deltacloud_loop_fd fds[MAX_FDS];
+  struct pollfd pfds[MAX_FDS];
+  long timeout_ms;
+  int pending;
+  int rounds = 0;
+  int nfds;
+  int ready;
+  int i;
+
+  pending = deltacloud_async_pending(api);
+  while (pending > 0) {
+    if (++rounds > 10000) {
+      fprintf(stderr, "Requests did not complete\n");
+      return -1;
+    }
+
+    nfds = deltacloud_loop_get_fds(api, fds, MAX_FDS, &timeout_ms);
+    if (nfds < 0 || nfds > MAX_FDS) {
+      fprintf(stderr, "deltacloud_loop_get_fds returned %d\n", nfds);
+      return -1;
+    }
+
+    for (i = 0; i < nfds; i++) {
+      pfds[i].fd = fds[i].fd;
+      pfds[i].events = 0;
+      if (fds[i].events & DELTACLOUD_LOOP_IN)
+	pfds[i].events |= POLLIN;
+      if (fds[i].events & DELTACLOUD_LOOP_OUT)
+	pfds[i].events |= POLLOUT;
+      pfds[i].revents = 0;
+    }
+
+    /* with nothing to wait for yet, the engine must at least want a timer */
+    if (nfds == 0 && timeout_ms < 0) {
+      fprintf(stderr, "Requests pending with nothing to wait for\n");
+      return -1;
+    }
+    if (timeout_ms < 0 || timeout_ms > 1000)
+      timeout_ms = 1000;
+
+    ready = poll(pfds, nfds, timeout_ms);
+    if (ready < 0) {
+      perror("poll");
+      return -1;
+    }
+
+    if (ready == 0)
+      pending = deltacloud_loop_on_timeout(api);
+    for (i = 0; i < nfds && ready > 0 && pending >= 0; i++) {
+      if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+	pending = deltacloud_loop_on_readable(api, pfds[i].fd);
+      if (pending >= 0 && pfds[i].revents & POLLOUT)
+	pending = deltacloud_loop_on_writable(api, pfds[i].fd);
+    }
+
+    if (pending < 0) {
+      fprintf(stderr, "Driving the loop failed: %s\n",
+	      deltacloud_get_last_error_string());
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  struct deltacloud_api api;
+  struct inventory inv;
+  struct expect exp[NEXPECT];
+  struct deltacloud_instance instance;
+  struct deltacloud_realm realm;
+  int ret = 3;
+
+  if (argc < 4 || argc > 6) {
+    fprintf(stderr, "Usage: %s <url> <user> <password> [<driver> [<provider>]]\n",
+	    argv[0]);
+    return 1;
+  }
+
+  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3],
+			    test_driver(argc, argv),
+			    test_provider(argc, argv)) < 0) {
+    fprintf(stderr, "Failed to find links for the API: %s\n",
+	    deltacloud_get_last_error_string());
+    return 2;
+  }
+
+  memset(&instance, 0, sizeof(instance));
+  memset(&realm, 0, sizeof(realm));
+
+  if (take_inventory(&api, &inv) < 0)
+    goto cleanup;
+
+  if (deltacloud_async_perform(NULL, 0) >= 0) {
+    fprintf(stderr, "Expected deltacloud_async_perform to fail with NULL api, but succeeded\n");
+    goto cleanup;
+  }
+
+  if (deltacloud_async_perform(&api, -1) >= 0) {
+    fprintf(stderr, "Expected deltacloud_async_perform to fail with negative timeout, but succeeded\n");
+    goto cleanup;
+  }
+
+  if (deltacloud_async_pending(&api) != 0) {
+    fprintf(stderr, "Expected no pending requests before any were started\n");
+    goto cleanup;
+  }
+
+  /* first round: deltacloud_async_perform() */
+  if (start_requests(&api, &inv, exp, &instance, &realm) < 0)
+    goto cleanup;
+  if (drive_with_perform(&api) < 0 ||
+      check_requests("deltacloud_async_perform", exp) < 0)
+    goto cleanup;
+  deltacloud_free_instance(&instance);
+  deltacloud_free_realm(&realm);
+
+  /* second round: an external loop built on poll() */
+  if (start_requests(&api, &inv, exp, &instance, &realm) < 0)
+    goto cleanup;
+  if (drive_with_loop(&api) < 0 ||
+      check_requests("deltacloud_loop", exp) < 0)
+    goto cleanup;
+
+  if (deltacloud_async_pending(&api) != 0) {
+    fprintf(stderr, "Expected no pending requests after the loop\n");
+    goto cleanup;
+  }
+
+  ret = 0;
+
+ cleanup:
+  deltacloud_free_instance(&instance);
+  deltacloud_free_realm(&realm);
+  deltacloud_free_instance(&inv.instance);
+  deltacloud_free(&api);
+
+  return ret;
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libdeltacloud.h"
+#include "test_common.h"
+
+/* Looks up several instances by id at once, first through a window of
+ * concurrent GETs and then, once the planner has something to compare
+ * against, through a single GET of the whole collection.  Either way the
+ * results have to come back in the order of the ids, with duplicates
+ * filled in each time and a bogus id failing on its own.
+ */
+
+#define NIDS 6
+#define WINDOW 2
+
+static const char *ids[NIDS] = {
+  "inst3", "inst1", "bogus_id", "inst2", "inst1", "inst0"
+};
+
+static unsigned long long wire_bytes(struct deltacloud_api *api)
+{
+  struct deltacloud_transfer_stats stats;
+
+  if (deltacloud_get_transfer_stats(api, &stats) < 0)
+    return 0;
+
+  return stats.wire_bytes;
+}
+
+static int check_batch(const char *how, struct deltacloud_instance *instances,
+		       int *errors)
+{
+  int i;
+
+  for (i = 0; i < NIDS; i++) {
+    if (strcmp(ids[i], "bogus_id") == 0) {
+      if (errors[i] == 0 || instances[i].id != NULL) {
+	fprintf(stderr, "%s: expected %s to fail on its own\n", how, ids[i]);
+	return -1;
+      }
+      continue;
+    }
+
+    if (errors[i] != 0) {
+      fprintf(stderr, "%s: expected %s to be found, got error %d\n", how,
+	      ids[i], errors[i]);
+      return -1;
+    }
+    if (instances[i].id == NULL || strcmp(instances[i].id, ids[i]) != 0) {
+      fprintf(stderr, "%s: expected entry %d to be %s, got %s\n", how, i,
+	      ids[i], instances[i].id != NULL ? instances[i].id : "(null)");
+      return -1;
+    }
+    if (instances[i].name == NULL) {
+      fprintf(stderr, "%s: entry %d was not parsed\n", how, i);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void free_batch(struct deltacloud_instance *instances)
+{
+  int i;
+
+  for (i = 0; i < NIDS; i++)
+    deltacloud_free_instance(&instances[i]);
+}
+
+int main(int argc, char *argv[])
+{
+  struct deltacloud_api api;
+  struct deltacloud_instance instances[NIDS];
+  struct deltacloud_instance *list = NULL;
+  int errors[NIDS];
+  unsigned long long collection_bytes, fanout_bytes, planned_bytes;
+  int ret = 3;
+
+  if (argc < 4 || argc > 6) {
+    fprintf(stderr, "Usage: %s <url> <user> <password> [<driver> [<provider>]]\n",
+	    argv[0]);
+    return 1;
+  }
+
+  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3],
+			    test_driver(argc, argv),
+			    test_provider(argc, argv)) < 0) {
+    fprintf(stderr, "Failed to find links for the API: %s\n",
+	    deltacloud_get_last_error_string());
+    return 2;
+  }
+
+  memset(instances, 0, sizeof(instances));
+
+  if (deltacloud_get_instances_by_ids(NULL, ids, NIDS, instances,
+				      errors) >= 0) {
+    fprintf(stderr, "Expected deltacloud_get_instances_by_ids to fail with NULL api, but succeeded\n");
+    goto cleanup;
+  }
+
+  if (deltacloud_get_instances_by_ids(&api, NULL, NIDS, instances,
+				      errors) >= 0) {
+    fprintf(stderr, "Expected deltacloud_get_instances_by_ids to fail with NULL ids, but succeeded\n");
+    goto cleanup;
+  }
+
+  if (deltacloud_get_instances_by_ids(&api, ids, -1, instances,
+				      errors) >= 0) {
+    fprintf(stderr, "Expected deltacloud_get_instances_by_ids to fail with negative n, but succeeded\n");
+    goto cleanup;
+  }
+
+  if (deltacloud_get_instances_by_ids(&api, NULL, 0, instances, NULL) < 0) {
+    fprintf(stderr, "Expected deltacloud_get_instances_by_ids to succeed with no ids: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  /* the size of the whole collection, to tell the two plans apart */
+  deltacloud_reset_transfer_stats(&api);
+  if (deltacloud_get_instances(&api, &list) < 0) {
+    fprintf(stderr, "Failed to get instances: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+  collection_bytes = wire_bytes(&api);
+
+  if (deltacloud_set_batch_window(&api, WINDOW) < 0) {
+    fprintf(stderr, "Failed to set the batch window: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  /* with nothing known about the collection yet, this is a fan-out */
+  deltacloud_reset_transfer_stats(&api);
+  if (deltacloud_get_instances_by_ids(&api, ids, NIDS, instances,
+				      errors) >= 0) {
+    fprintf(stderr, "Expected deltacloud_get_instances_by_ids to fail with a bogus id, but succeeded\n");
+    goto cleanup;
+  }
+  fanout_bytes = wire_bytes(&api);
+  if (check_batch("fan-out", instances, errors) < 0)
+    goto cleanup;
+  free_batch(instances);
+
+  if (fanout_bytes >= collection_bytes) {
+    fprintf(stderr, "Expected the fan-out to cost less than the collection (%llu >= %llu bytes)\n",
+	    fanout_bytes, collection_bytes);
+    goto cleanup;
+  }
+
+  /* more ids than fit in one window: the planner tries the collection */
+  deltacloud_reset_transfer_stats(&api);
+  if (deltacloud_get_instances_by_ids(&api, ids, NIDS, instances,
+				      errors) >= 0) {
+    fprintf(stderr, "Expected deltacloud_get_instances_by_ids to fail with a bogus id, but succeeded\n");
+    goto cleanup;
+  }
+  planned_bytes = wire_bytes(&api);
+  if (check_batch("collection", instances, errors) < 0)
+    goto cleanup;
+
+  if (planned_bytes < collection_bytes) {
+    fprintf(stderr, "Expected the second batch to fetch the collection (%llu < %llu bytes)\n",
+	    planned_bytes, collection_bytes);
+    goto cleanup;
+  }
+
+  ret = 0;
+
+ cleanup:
+  free_batch(instances);
+  deltacloud_free_instance_list(&list);
+  deltacloud_free(&api);
+
+  return ret;
+}
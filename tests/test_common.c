@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include "test_common.h"
 
 int wait_for_instance_boot(struct deltacloud_api *api, const char *instid,
@@ -118,3 +119,25 @@ void print_action_list(struct deltacloud_action *actions)
   }
 }
 
+
+/* the driver and provider are optional on the command line of every test;
+ * these are what deltacloud_sim and a stock mock server answer to
+ */
+char *test_driver(int argc, char *argv[])
+{
+  return argc > 4 ? argv[4] : "mock";
+}
+
+char *test_provider(int argc, char *argv[])
+{
+  return argc > 5 ? argv[5] : "default";
+}
+
+/* a monotonic clock in milliseconds, for timing calls */
+double now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
@@ -10,5 +10,8 @@ void print_hwp(struct deltacloud_hardware_profile *hwp);
 void print_address_list(const char *header,
 			struct deltacloud_address *addresses);
 void print_action_list(struct deltacloud_action *actions);
+char *test_driver(int argc, char *argv[]);
+char *test_provider(int argc, char *argv[]);
+double now_ms(void);
 
 #endif
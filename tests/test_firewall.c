@@ -23,6 +23,7 @@
 #include <string.h>
 #include <unistd.h>
 #include "libdeltacloud.h"
+#include "test_common.h"
 
 static void print_firewall(struct deltacloud_firewall *firewall)
 {
@@ -70,12 +71,15 @@ int main(int argc, char *argv[])
   struct deltacloud_firewall_rule *rule;
   int ret = 3;
 
-  if (argc != 4) {
-    fprintf(stderr, "Usage: %s <url> <user> <password>\n", argv[0]);
+  if (argc < 4 || argc > 6) {
+    fprintf(stderr, "Usage: %s <url> <user> <password> [<driver> [<provider>]]\n",
+	    argv[0]);
     return 1;
   }
 
-  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3]) < 0) {
+  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3],
+			    test_driver(argc, argv),
+			    test_provider(argc, argv)) < 0) {
     fprintf(stderr, "Failed to initialize deltacloud: %s\n",
 	    deltacloud_get_last_error_string());
     return 2;
@@ -40,14 +40,17 @@ int main(int argc, char *argv[])
   struct deltacloud_hardware_profile *profiles = NULL;
   int ret = 3;
 
-  if (argc != 4) {
-    fprintf(stderr, "Usage: %s <url> <user> <password>\n", argv[0]);
+  if (argc < 4 || argc > 6) {
+    fprintf(stderr, "Usage: %s <url> <user> <password> [<driver> [<provider>]]\n",
+	    argv[0]);
     return 1;
   }
 
   memset(&zeroapi, 0, sizeof(struct deltacloud_api));
 
-  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3]) < 0) {
+  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3],
+			    test_driver(argc, argv),
+			    test_provider(argc, argv)) < 0) {
     fprintf(stderr, "Failed to find links for the API: %s\n",
 	    deltacloud_get_last_error_string());
     return 2;
@@ -43,26 +43,55 @@ static void print_image_list(struct deltacloud_image *images)
     print_image(image);
 }
 
+/* what deltacloud_foreach_image has handed to visit_image so far */
+struct visit {
+  struct deltacloud_image *expected; /* the next image it should hand over */
+  int count;
+  int stop_after; /* stop once this many were visited; 0 visits them all */
+  int mismatched;
+};
+
+static int visit_image(const void *element, void *userdata)
+{
+  const struct deltacloud_image *image = element;
+  struct visit *visit = userdata;
+
+  if (visit->expected == NULL || strcmp(image->id, visit->expected->id) != 0)
+    visit->mismatched = 1;
+  else
+    visit->expected = visit->expected->next;
+  visit->count++;
+
+  return visit->stop_after > 0 && visit->count == visit->stop_after;
+}
+
 int main(int argc, char *argv[])
 {
   struct deltacloud_api api;
   struct deltacloud_api zeroapi;
   struct deltacloud_image image;
   struct deltacloud_image *images = NULL;
+  struct deltacloud_image *curr;
+  struct deltacloud_image *last;
+  struct visit visit;
+  int count;
   //struct deltacloud_instance instance;
   //char *instid;
   //char *imgid;
   //int timeout;
   int ret = 3;
 
-  if (argc != 4) {
-    fprintf(stderr, "Usage: %s <url> <user> <password>\n", argv[0]);
+  if (argc < 4 || argc > 6) {
+    fprintf(stderr, "Usage: %s <url> <user> <password> [<driver> [<provider>]]\n",
+	    argv[0]);
     return 1;
   }
 
   memset(&zeroapi, 0, sizeof(struct deltacloud_api));
 
-  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3]) < 0) {
+  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3],
+			    test_driver(argc, argv),
+			    test_provider(argc, argv)) < 0) {
     fprintf(stderr, "Failed to find links for the API: %s\n",
 	    deltacloud_get_last_error_string());
     return 2;
@@ -104,6 +133,59 @@ int main(int argc, char *argv[])
     }
     print_image_list(images);
 
+    count = 0;
+    last = NULL;
+    deltacloud_for_each(curr, images) {
+      count++;
+      last = curr;
+    }
+
+    /* test out deltacloud_foreach_image */
+    memset(&visit, 0, sizeof(struct visit));
+    if (deltacloud_foreach_image(NULL, visit_image, &visit) >= 0) {
+      fprintf(stderr, "Expected deltacloud_foreach_image to fail with NULL api, but succeeded\n");
+      goto cleanup;
+    }
+
+    if (deltacloud_foreach_image(&api, NULL, &visit) >= 0) {
+      fprintf(stderr, "Expected deltacloud_foreach_image to fail with NULL visitor, but succeeded\n");
+      goto cleanup;
+    }
+
+    if (deltacloud_foreach_image(&zeroapi, visit_image, &visit) >= 0) {
+      fprintf(stderr, "Expected deltacloud_foreach_image to fail with unintialized api, but succeeded\n");
+      goto cleanup;
+    }
+
+    visit.expected = images;
+    if (deltacloud_foreach_image(&api, visit_image, &visit) < 0) {
+      fprintf(stderr, "Failed to visit images: %s\n",
+	      deltacloud_get_last_error_string());
+      goto cleanup;
+    }
+    if (visit.count != count || visit.mismatched) {
+      fprintf(stderr, "Expected deltacloud_foreach_image to visit the %d images of the list in order, but it visited %d%s\n",
+	      count, visit.count, visit.mismatched ? " others" : "");
+      goto cleanup;
+    }
+
+    /* a visitor that returns non-zero stops the iteration */
+    if (count > 2) {
+      memset(&visit, 0, sizeof(struct visit));
+      visit.expected = images;
+      visit.stop_after = 2;
+      if (deltacloud_foreach_image(&api, visit_image, &visit) < 0) {
+	fprintf(stderr, "Failed to visit images: %s\n",
+		deltacloud_get_last_error_string());
+	goto cleanup;
+      }
+      if (visit.count != 2 || visit.mismatched) {
+	fprintf(stderr, "Expected deltacloud_foreach_image to stop after 2 images, but it visited %d\n",
+		visit.count);
+	goto cleanup;
+      }
+    }
+
     if (images != NULL) {
 
       /* test out deltacloud_get_image_by_id */
@@ -140,6 +222,55 @@ int main(int argc, char *argv[])
       }
       print_image(&image);
       deltacloud_free_image(&image);
+
+      /* test out deltacloud_get_image_by_name */
+      if (deltacloud_get_image_by_name(NULL, last->name, &image) >= 0) {
+	fprintf(stderr, "Expected deltacloud_get_image_by_name to fail with NULL api, but succeeded\n");
+	goto cleanup;
+      }
+
+      if (deltacloud_get_image_by_name(&api, NULL, &image) >= 0) {
+	fprintf(stderr, "Expected deltacloud_get_image_by_name to fail with NULL name, but succeeded\n");
+	goto cleanup;
+      }
+
+      if (deltacloud_get_image_by_name(&api, last->name, NULL) >= 0) {
+	fprintf(stderr, "Expected deltacloud_get_image_by_name to fail with NULL image, but succeeded\n");
+	goto cleanup;
+      }
+
+      if (deltacloud_get_image_by_name(&zeroapi, last->name, &image) >= 0) {
+	fprintf(stderr, "Expected deltacloud_get_image_by_name to fail with unintialized api, but succeeded\n");
+	goto cleanup;
+      }
+
+      if (deltacloud_get_image_by_name(&api, "bogus_name", &image) >= 0) {
+	fprintf(stderr, "Expected deltacloud_get_image_by_name to fail with bogus name, but succeeded\n");
+	goto cleanup;
+      }
+      if (deltacloud_get_last_error()->error_num !=
+	  DELTACLOUD_NAME_NOT_FOUND_ERROR) {
+	fprintf(stderr, "Expected deltacloud_get_image_by_name to fail with DELTACLOUD_NAME_NOT_FOUND_ERROR for bogus name, but got %d\n",
+		deltacloud_get_last_error()->error_num);
+	goto cleanup;
+      }
+
+      /* the last image from the list above, so that the whole collection
+       * has to be searched
+       */
+      if (deltacloud_get_image_by_name(&api, last->name, &image) < 0) {
+	fprintf(stderr, "Failed to get image by name: %s\n",
+		deltacloud_get_last_error_string());
+	goto cleanup;
+      }
+      if (strcmp(image.id, last->id) != 0) {
+	fprintf(stderr, "Expected deltacloud_get_image_by_name to find image %s, but found %s\n",
+		last->id, image.id);
+	deltacloud_free_image(&image);
+	goto cleanup;
+      }
+      print_image(&image);
+      deltacloud_free_image(&image);
     }
 
 
@@ -50,26 +50,56 @@ static void print_instance_list(struct deltacloud_instance *instances)
     print_instance(instance);
 }
 
+/* what deltacloud_foreach_instance has handed to visit_instance so far */
+struct visit {
+  struct deltacloud_instance *expected; /* the next one it should hand over */
+  int count;
+  int stop_after; /* stop once this many were visited; 0 visits them all */
+  int mismatched;
+};
+
+static int visit_instance(const void *element, void *userdata)
+{
+  const struct deltacloud_instance *instance = element;
+  struct visit *visit = userdata;
+
+  if (visit->expected == NULL ||
+      strcmp(instance->id, visit->expected->id) != 0)
+    visit->mismatched = 1;
+  else
+    visit->expected = visit->expected->next;
+  visit->count++;
+
+  return visit->stop_after > 0 && visit->count == visit->stop_after;
+}
+
 int main(int argc, char *argv[])
 {
   struct deltacloud_api api;
   struct deltacloud_api zeroapi;
   struct deltacloud_instance *instances = NULL;
+  struct deltacloud_instance *curr;
+  struct deltacloud_instance *last;
   struct deltacloud_instance instance;
   struct deltacloud_image *images = NULL;
   struct deltacloud_create_parameter stackparams[2];
+  struct visit visit;
   char *instid;
+  int count;
   int ret = 3;
   int rc;
 
-  if (argc != 4) {
-    fprintf(stderr, "Usage: %s <url> <user> <password>\n", argv[0]);
+  if (argc < 4 || argc > 6) {
+    fprintf(stderr, "Usage: %s <url> <user> <password> [<driver> [<provider>]]\n",
+	    argv[0]);
     return 1;
   }
 
   memset(&zeroapi, 0, sizeof(struct deltacloud_api));
 
-  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3]) < 0) {
+  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3],
+			    test_driver(argc, argv),
+			    test_provider(argc, argv)) < 0) {
     fprintf(stderr, "Failed to find links for the API: %s\n",
 	    deltacloud_get_last_error_string());
     return 2;
@@ -111,6 +141,59 @@ int main(int argc, char *argv[])
     }
     print_instance_list(instances);
 
+    count = 0;
+    last = NULL;
+    deltacloud_for_each(curr, instances) {
+      count++;
+      last = curr;
+    }
+
+    /* test out deltacloud_foreach_instance */
+    memset(&visit, 0, sizeof(struct visit));
+    if (deltacloud_foreach_instance(NULL, visit_instance, &visit) >= 0) {
+      fprintf(stderr, "Expected deltacloud_foreach_instance to fail with NULL api, but succeeded\n");
+      goto cleanup;
+    }
+
+    if (deltacloud_foreach_instance(&api, NULL, &visit) >= 0) {
+      fprintf(stderr, "Expected deltacloud_foreach_instance to fail with NULL visitor, but succeeded\n");
+      goto cleanup;
+    }
+
+    if (deltacloud_foreach_instance(&zeroapi, visit_instance, &visit) >= 0) {
+      fprintf(stderr, "Expected deltacloud_foreach_instance to fail with unintialized api, but succeeded\n");
+      goto cleanup;
+    }
+
+    visit.expected = instances;
+    if (deltacloud_foreach_instance(&api, visit_instance, &visit) < 0) {
+      fprintf(stderr, "Failed to visit instances: %s\n",
+	      deltacloud_get_last_error_string());
+      goto cleanup;
+    }
+    if (visit.count != count || visit.mismatched) {
+      fprintf(stderr, "Expected deltacloud_foreach_instance to visit the %d instances of the list in order, but it visited %d%s\n",
+	      count, visit.count, visit.mismatched ? " others" : "");
+      goto cleanup;
+    }
+
+    /* a visitor that returns non-zero stops the iteration */
+    if (count > 2) {
+      memset(&visit, 0, sizeof(struct visit));
+      visit.expected = instances;
+      visit.stop_after = 2;
+      if (deltacloud_foreach_instance(&api, visit_instance, &visit) < 0) {
+	fprintf(stderr, "Failed to visit instances: %s\n",
+		deltacloud_get_last_error_string());
+	goto cleanup;
+      }
+      if (visit.count != 2 || visit.mismatched) {
+	fprintf(stderr, "Expected deltacloud_foreach_instance to stop after 2 instances, but it visited %d\n",
+		visit.count);
+	goto cleanup;
+      }
+    }
+
     if (instances != NULL) {
 
       /* test out deltacloud_get_instance_by_id */
@@ -170,6 +253,12 @@ int main(int argc, char *argv[])
 	fprintf(stderr, "Expected deltacloud_get_instance_by_name to fail with bogus id, but succeeded\n");
 	goto cleanup;
       }
+      if (deltacloud_get_last_error()->error_num !=
+	  DELTACLOUD_NAME_NOT_FOUND_ERROR) {
+	fprintf(stderr, "Expected deltacloud_get_instance_by_name to fail with DELTACLOUD_NAME_NOT_FOUND_ERROR for bogus id, but got %d\n",
+		deltacloud_get_last_error()->error_num);
+	goto cleanup;
+      }
 
       if (deltacloud_get_instance_by_name(&zeroapi, instances->name,
 					  &instance) >= 0) {
@@ -186,6 +275,21 @@ int main(int argc, char *argv[])
       }
       print_instance(&instance);
       deltacloud_free_instance(&instance);
+
+      /* and the last one, so that the whole collection has to be searched */
+      if (deltacloud_get_instance_by_name(&api, last->name, &instance) < 0) {
+	fprintf(stderr, "Failed to get instance by name: %s\n",
+		deltacloud_get_last_error_string());
+	goto cleanup;
+      }
+      if (strcmp(instance.id, last->id) != 0) {
+	fprintf(stderr, "Expected deltacloud_get_instance_by_name to find instance %s, but found %s\n",
+		last->id, instance.id);
+	deltacloud_free_instance(&instance);
+	goto cleanup;
+      }
+      print_instance(&instance);
+      deltacloud_free_instance(&instance);
     }
 
     /* in order to create an instance, we need to find an image to use */
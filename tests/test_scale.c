@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libdeltacloud.h"
+#include "test_common.h"
+
+/* Fetches every collection of a server with a known inventory, such as
+ * deltacloud_sim, a number of times, checks that nothing was lost on the
+ * way and reports how long each round took.
+ */
+
+#define SCALE_LIST(type, getter, freer)					\
+  static int scale_##type(struct deltacloud_api *api, long *n)		\
+  {									\
+    struct deltacloud_##type *list = NULL;				\
+    struct deltacloud_##type *item;					\
+									\
+    if (getter(api, &list) < 0)						\
+      return -1;							\
+    *n = 0;								\
+    deltacloud_for_each(item, list)					\
+      (*n)++;								\
+    freer(&list);							\
+    return 0;								\
+  }
+
+SCALE_LIST(instance, deltacloud_get_instances, deltacloud_free_instance_list)
+SCALE_LIST(image, deltacloud_get_images, deltacloud_free_image_list)
+SCALE_LIST(realm, deltacloud_get_realms, deltacloud_free_realm_list)
+SCALE_LIST(hardware_profile, deltacloud_get_hardware_profiles,
+	   deltacloud_free_hardware_profile_list)
+SCALE_LIST(bucket, deltacloud_get_buckets, deltacloud_free_bucket_list)
+
+static const struct {
+  const char *name;
+  int (*list)(struct deltacloud_api *api, long *n);
+} scales[] = {
+  { "instances", scale_instance },
+  { "images", scale_image },
+  { "realms", scale_realm },
+  { "hardware_profiles", scale_hardware_profile },
+  { "buckets", scale_bucket },
+};
+
+int main(int argc, char *argv[])
+{
+  struct deltacloud_api api;
+  double start, elapsed, best;
+  long expected;
+  long n;
+  int iterations = 3;
+  int ret = 3;
+  size_t i;
+  int j;
+
+  if (argc < 5 || argc > 6) {
+    fprintf(stderr, "Usage: %s <url> <user> <password> <objects> [<iterations>]\n",
+	    argv[0]);
+    return 1;
+  }
+
+  expected = strtol(argv[4], NULL, 10);
+  if (argc > 5)
+    iterations = atoi(argv[5]);
+  if (expected <= 0 || iterations <= 0) {
+    fprintf(stderr, "objects and iterations must be positive\n");
+    return 1;
+  }
+
+  if (deltacloud_initialize(&api, argv[1], argv[2], argv[3],
+			    test_driver(0, argv), test_provider(0, argv)) < 0) {
+    fprintf(stderr, "Failed to find links for the API: %s\n",
+	    deltacloud_get_last_error_string());
+    return 2;
+  }
+
+  for (i = 0; i < sizeof(scales) / sizeof(scales[0]); i++) {
+    if (!deltacloud_has_link(&api, scales[i].name)) {
+      fprintf(stderr, "%s are not supported\n", scales[i].name);
+      continue;
+    }
+
+    best = 0;
+    elapsed = 0;
+    for (j = 0; j < iterations; j++) {
+      start = now_ms();
+      if (scales[i].list(&api, &n) < 0) {
+	fprintf(stderr, "Failed to get %s: %s\n", scales[i].name,
+		deltacloud_get_last_error_string());
+	goto cleanup;
+      }
+      start = now_ms() - start;
+      elapsed += start;
+      if (j == 0 || start < best)
+	best = start;
+
+      if (n != expected) {
+	fprintf(stderr, "Expected %ld %s, got %ld\n", expected,
+		scales[i].name, n);
+	goto cleanup;
+      }
+    }
+
+    printf("%-18s %8ld objects  best %9.2f ms  mean %9.2f ms\n",
+	   scales[i].name, n, best, elapsed / iterations);
+  }
+
+  ret = 0;
+
+ cleanup:
+  deltacloud_free(&api);
+
+  return ret;
+}
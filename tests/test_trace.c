@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libdeltacloud.h"
+#include "test_common.h"
+
+/* Records the realms and images of a simulator into a trace, and then, with
+ * the simulator gone, replays the trace and checks that the replay gives
+ * the same answers.  run_sim.sh runs it twice:
+ *
+ *   test_trace <url> <user> <password> <trace> record
+ *   test_trace <url> <user> <password> <trace> replay
+ *
+ * The record run writes what it saw next to the trace, in <trace>.expected.
+ */
+
+static const char *str(const char *s)
+{
+  return s != NULL ? s : "(null)";
+}
+
+/* write what the api says about its realms and images to fp; returns -1 if
+ * any of the lookups failed when it should not have
+ */
+static int summarize(struct deltacloud_api *api, FILE *fp)
+{
+  struct deltacloud_realm *realms = NULL;
+  struct deltacloud_realm *realm;
+  struct deltacloud_realm onerealm;
+  struct deltacloud_image *images = NULL;
+  struct deltacloud_image *image;
+  struct deltacloud_image oneimage;
+  int ret = -1;
+
+  if (deltacloud_get_realms(api, &realms) < 0) {
+    fprintf(stderr, "Failed to get realms: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+  deltacloud_for_each(realm, realms) {
+    fprintf(fp, "realm %s %s %s %s\n", str(realm->id), str(realm->name),
+	    str(realm->state), str(realm->limit));
+
+    if (deltacloud_get_realm_by_id(api, realm->id, &onerealm) < 0) {
+      fprintf(stderr, "Failed to get realm %s: %s\n", realm->id,
+	      deltacloud_get_last_error_string());
+      goto cleanup;
+    }
+    fprintf(fp, "realm by id %s %s\n", str(onerealm.id), str(onerealm.name));
+    deltacloud_free_realm(&onerealm);
+  }
+
+  if (deltacloud_get_images(api, &images) < 0) {
+    fprintf(stderr, "Failed to get images: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+  deltacloud_for_each(image, images)
+    fprintf(fp, "image %s %s %s %s %s\n", str(image->id), str(image->name),
+	    str(image->owner_id), str(image->architecture), str(image->state));
+
+  if (images != NULL) {
+    if (deltacloud_get_image_by_id(api, images->id, &oneimage) < 0) {
+      fprintf(stderr, "Failed to get image %s: %s\n", images->id,
+	      deltacloud_get_last_error_string());
+      goto cleanup;
+    }
+    fprintf(fp, "image by id %s %s\n", str(oneimage.id), str(oneimage.name));
+    deltacloud_free_image(&oneimage);
+  }
+
+  /* a failed lookup is part of the recording too */
+  if (deltacloud_get_realm_by_id(api, "bogus_id", &onerealm) >= 0) {
+    fprintf(stderr, "Expected deltacloud_get_realm_by_id to fail with bogus id, but succeeded\n");
+    deltacloud_free_realm(&onerealm);
+    goto cleanup;
+  }
+  fprintf(fp, "bogus realm error %d\n", deltacloud_get_last_error()->error_num);
+
+  ret = 0;
+
+ cleanup:
+  deltacloud_free_realm_list(&realms);
+  deltacloud_free_image_list(&images);
+
+  return ret;
+}
+
+static int record(char *url, char *user, char *password, const char *trace,
+		  const char *expected)
+{
+  struct deltacloud_api api;
+  FILE *fp;
+  int ret = 3;
+
+  if (deltacloud_initialize(&api, url, user, password, "mock",
+			    "default") < 0) {
+    fprintf(stderr, "Failed to find links for the API: %s\n",
+	    deltacloud_get_last_error_string());
+    return 2;
+  }
+
+  fp = fopen(expected, "w");
+  if (fp == NULL) {
+    fprintf(stderr, "Failed to open %s\n", expected);
+    goto cleanup;
+  }
+
+  if (deltacloud_trace_record(&api, trace) < 0) {
+    fprintf(stderr, "Failed to start recording: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  if (summarize(&api, fp) < 0)
+    goto cleanup;
+
+  if (deltacloud_trace_record(&api, NULL) < 0) {
+    fprintf(stderr, "Failed to stop recording: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  ret = 0;
+
+ cleanup:
+  if (fp != NULL)
+    fclose(fp);
+  deltacloud_free(&api);
+
+  return ret;
+}
+
+static char *read_file(const char *filename)
+{
+  char *data = NULL;
+  size_t size = 0;
+  FILE *fp;
+  FILE *out;
+  int c;
+
+  fp = fopen(filename, "r");
+  if (fp == NULL)
+    return NULL;
+  out = open_memstream(&data, &size);
+  if (out != NULL) {
+    while ((c = fgetc(fp)) != EOF)
+      fputc(c, out);
+    fclose(out);
+  }
+  fclose(fp);
+
+  return data;
+}
+
+static int replay(char *url, char *user, char *password, const char *trace,
+		  const char *expected)
+{
+  struct deltacloud_replay *replay = NULL;
+  struct deltacloud_api api;
+  char *want = NULL;
+  char *got = NULL;
+  size_t size = 0;
+  FILE *fp;
+  int i;
+  int ret = 3;
+
+  want = read_file(expected);
+  if (want == NULL) {
+    fprintf(stderr, "Failed to read %s\n", expected);
+    return 3;
+  }
+
+  if (deltacloud_replay_open(trace, 0, &replay) < 0) {
+    fprintf(stderr, "Failed to load the trace: %s\n",
+	    deltacloud_get_last_error_string());
+    free(want);
+    return 3;
+  }
+
+  if (deltacloud_initialize_transport(&api, url, user, password, "mock",
+				      "default", deltacloud_replay_transport(),
+				      replay) < 0) {
+    fprintf(stderr, "Failed to find links for the API in the trace: %s\n",
+	    deltacloud_get_last_error_string());
+    deltacloud_replay_close(replay);
+    free(want);
+    return 2;
+  }
+
+  /* a trace of one run can be replayed any number of times */
+  for (i = 0; i < 2; i++) {
+    fp = open_memstream(&got, &size);
+    if (fp == NULL) {
+      fprintf(stderr, "Failed to open memory stream\n");
+      goto cleanup;
+    }
+    if (summarize(&api, fp) < 0) {
+      fclose(fp);
+      goto cleanup;
+    }
+    fclose(fp);
+
+    if (strcmp(got, want) != 0) {
+      fprintf(stderr, "Expected the replay to give\n%s\nbut it gave\n%s\n",
+	      want, got);
+      goto cleanup;
+    }
+    free(got);
+    got = NULL;
+  }
+
+  ret = 0;
+
+ cleanup:
+  free(got);
+  free(want);
+  deltacloud_free(&api);
+  deltacloud_replay_close(replay);
+
+  return ret;
+}
+
+int main(int argc, char *argv[])
+{
+  char *expected;
+  int ret;
+
+  if (argc != 6 || (strcmp(argv[5], "record") != 0 &&
+		    strcmp(argv[5], "replay") != 0)) {
+    fprintf(stderr, "Usage: %s <url> <user> <password> <trace> record|replay\n",
+	    argv[0]);
+    return 1;
+  }
+
+  if (asprintf(&expected, "%s.expected", argv[4]) < 0) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return 3;
+  }
+
+  if (strcmp(argv[5], "record") == 0)
+    ret = record(argv[1], argv[2], argv[3], argv[4], expected);
+  else
+    ret = replay(argv[1], argv[2], argv[3], argv[4], expected);
+
+  free(expected);
+
+  return ret;
+}
@@ -0,0 +1,437 @@
+/*
+ * Copyright (C) 2014 Daisuke Ikeda
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "libdeltacloud.h"
+#include "test_common.h"
+
+/* Checks the policies that sit between the API calls and the wire: the
+ * TTL cache and its stale-while-revalidate period, retries, hedging and
+ * fault injection.  Each of them shows up in the transfer statistics or in
+ * how long a call takes, so the simulator is all they need.  The faults
+ * are drawn at random, so the retry and hedge checks keep going until the
+ * event they look for has happened, with a cap that a working library
+ * should never get near.
+ */
+
+static char *url, *user, *password, *driver, *provider;
+
+static int init_api(struct deltacloud_api *api)
+{
+  if (deltacloud_initialize(api, url, user, password, driver,
+			    provider) < 0) {
+    fprintf(stderr, "Failed to find links for the API: %s\n",
+	    deltacloud_get_last_error_string());
+    return -1;
+  }
+
+  return 0;
+}
+
+static int get_stats(struct deltacloud_api *api,
+		     struct deltacloud_transfer_stats *stats)
+{
+  if (deltacloud_get_transfer_stats(api, stats) < 0) {
+    fprintf(stderr, "Failed to get transfer stats: %s\n",
+	    deltacloud_get_last_error_string());
+    return -1;
+  }
+
+  return 0;
+}
+
+/* lists the realms and returns how many bytes that took on the wire */
+static long long realms_bytes(struct deltacloud_api *api)
+{
+  struct deltacloud_transfer_stats stats;
+  struct deltacloud_realm *realms;
+
+  deltacloud_reset_transfer_stats(api);
+  if (deltacloud_get_realms(api, &realms) < 0) {
+    fprintf(stderr, "Failed to get realms: %s\n",
+	    deltacloud_get_last_error_string());
+    return -1;
+  }
+  if (realms == NULL) {
+    fprintf(stderr, "Expected at least one realm\n");
+    return -1;
+  }
+  deltacloud_free_realm_list(&realms);
+
+  if (get_stats(api, &stats) < 0)
+    return -1;
+
+  return stats.wire_bytes;
+}
+
+static int get_realm(struct deltacloud_api *api, const char *id)
+{
+  struct deltacloud_realm realm;
+
+  if (deltacloud_get_realm_by_id(api, id, &realm) < 0) {
+    fprintf(stderr, "Failed to get realm %s: %s\n", id,
+	    deltacloud_get_last_error_string());
+    return -1;
+  }
+  deltacloud_free_realm(&realm);
+
+  return 0;
+}
+
+static int test_ttl(void)
+{
+  struct deltacloud_api api;
+  long long bytes;
+  int ret = -1;
+
+  if (init_api(&api) < 0)
+    return -1;
+
+  if (deltacloud_set_cache_ttl(&api, "realms", 60) < 0) {
+    fprintf(stderr, "Failed to set the realms TTL: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  bytes = realms_bytes(&api);
+  if (bytes <= 0) {
+    fprintf(stderr, "Expected the first realms list to come from the server\n");
+    goto cleanup;
+  }
+
+  bytes = realms_bytes(&api);
+  if (bytes != 0) {
+    fprintf(stderr, "Expected realms within the TTL to cost nothing, took %lld bytes\n",
+	    bytes);
+    goto cleanup;
+  }
+
+  if (deltacloud_invalidate_cache(&api, "realms") < 0) {
+    fprintf(stderr, "Failed to invalidate realms: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  bytes = realms_bytes(&api);
+  if (bytes <= 0) {
+    fprintf(stderr, "Expected realms to be fetched again after invalidation\n");
+    goto cleanup;
+  }
+
+  ret = 0;
+
+ cleanup:
+  deltacloud_free(&api);
+
+  return ret;
+}
+
+#define STALE_LATENCY_MS 500
+
+static int test_stale(void)
+{
+  struct deltacloud_api api;
+  struct deltacloud_fault fault;
+  struct deltacloud_transfer_stats stats;
+  double start;
+  long long bytes;
+  int tries;
+  int ret = -1;
+
+  if (init_api(&api) < 0)
+    return -1;
+
+  if (deltacloud_set_cache_ttl(&api, "realms", 1) < 0 ||
+      deltacloud_set_cache_stale(&api, "realms", 60) < 0) {
+    fprintf(stderr, "Failed to set the realms cache periods: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  if (realms_bytes(&api) <= 0)
+    goto cleanup;
+
+  /* from now on the server is slow, which the stale copy hides */
+  memset(&fault, 0, sizeof(fault));
+  fault.pattern = "*/realms";
+  fault.probability = 1;
+  fault.latency_ms = STALE_LATENCY_MS;
+  if (deltacloud_add_fault(&api, &fault) < 0) {
+    fprintf(stderr, "Failed to add a fault: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  sleep(2);
+
+  start = now_ms();
+  bytes = realms_bytes(&api);
+  if (bytes < 0)
+    goto cleanup;
+  if (now_ms() - start >= STALE_LATENCY_MS) {
+    fprintf(stderr, "Expected the stale realms right away, took %.0f ms\n",
+	    now_ms() - start);
+    goto cleanup;
+  }
+
+  /* the refresh goes on in the background */
+  for (tries = 0; tries < 50; tries++) {
+    if (get_stats(&api, &stats) < 0)
+      goto cleanup;
+    if (stats.wire_bytes > 0)
+      break;
+    usleep(100000);
+  }
+  if (stats.wire_bytes == 0) {
+    fprintf(stderr, "Expected the stale realms to be refreshed\n");
+    goto cleanup;
+  }
+
+  ret = 0;
+
+ cleanup:
+  deltacloud_free(&api);
+
+  return ret;
+}
+
+#define MAX_ATTEMPTS 200
+
+static int test_retry(void)
+{
+  struct deltacloud_api api;
+  struct deltacloud_fault fault;
+  struct deltacloud_transfer_stats stats;
+  int i;
+  int ret = -1;
+
+  if (init_api(&api) < 0)
+    return -1;
+
+  if (deltacloud_set_retries(&api, 30, 1, 2) < 0 ||
+      deltacloud_set_retry_budget(&api, 100, 100) < 0) {
+    fprintf(stderr, "Failed to set the retry policy: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  memset(&fault, 0, sizeof(fault));
+  fault.pattern = "*/realms/*";
+  fault.probability = 0.5;
+  fault.status = 503;
+  if (deltacloud_add_fault(&api, &fault) < 0) {
+    fprintf(stderr, "Failed to add a fault: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  /* every GET has to get through in the end, some of them only on a retry */
+  for (i = 0; i < MAX_ATTEMPTS; i++) {
+    if (get_realm(&api, "realm0") < 0 || get_stats(&api, &stats) < 0)
+      goto cleanup;
+    if (stats.retries > 0)
+      break;
+  }
+  if (stats.retries == 0) {
+    fprintf(stderr, "Expected an injected 503 to be retried\n");
+    goto cleanup;
+  }
+
+  ret = 0;
+
+ cleanup:
+  deltacloud_free(&api);
+
+  return ret;
+}
+
+#define HEDGE_WARMUP 40
+#define HEDGE_LATENCY_MS 100
+
+static int test_hedge(void)
+{
+  struct deltacloud_api api;
+  struct deltacloud_fault fault;
+  struct deltacloud_transfer_stats stats;
+  int i;
+  int ret = -1;
+
+  if (init_api(&api) < 0)
+    return -1;
+
+  if (deltacloud_set_hedging(&api, 50, 20) < 0) {
+    fprintf(stderr, "Failed to turn hedging on: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  /* hedging needs some latencies to go by first */
+  for (i = 0; i < HEDGE_WARMUP; i++) {
+    if (get_realm(&api, "realm0") < 0)
+      goto cleanup;
+  }
+
+  if (get_stats(&api, &stats) < 0)
+    goto cleanup;
+  if (stats.hedges != 0) {
+    fprintf(stderr, "Expected no hedges against a fast server, got %llu\n",
+	    stats.hedges);
+    goto cleanup;
+  }
+
+  /* half the GETs now get stuck, the hedge of one of them likely not */
+  memset(&fault, 0, sizeof(fault));
+  fault.pattern = "*/realms/*";
+  fault.probability = 0.5;
+  fault.latency_ms = HEDGE_LATENCY_MS;
+  if (deltacloud_add_fault(&api, &fault) < 0) {
+    fprintf(stderr, "Failed to add a fault: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  for (i = 0; i < MAX_ATTEMPTS; i++) {
+    if (get_realm(&api, "realm0") < 0 || get_stats(&api, &stats) < 0)
+      goto cleanup;
+    if (stats.hedges_won > 0)
+      break;
+  }
+  if (stats.hedges == 0 || stats.hedges_won == 0) {
+    fprintf(stderr, "Expected slow GETs to be hedged, got %llu hedges, %llu won\n",
+	    stats.hedges, stats.hedges_won);
+    goto cleanup;
+  }
+
+  ret = 0;
+
+ cleanup:
+  deltacloud_free(&api);
+
+  return ret;
+}
+
+#define FAULT_LATENCY_MS 200
+
+static int test_fault(void)
+{
+  struct deltacloud_api api;
+  struct deltacloud_fault fault;
+  struct deltacloud_realm realm;
+  double start;
+  int ret = -1;
+
+  if (init_api(&api) < 0)
+    return -1;
+
+  memset(&fault, 0, sizeof(fault));
+  fault.pattern = "*/realms/realm1";
+  fault.probability = 1;
+  fault.status = 500;
+  if (deltacloud_add_fault(&api, &fault) < 0) {
+    fprintf(stderr, "Failed to add a fault: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  memset(&fault, 0, sizeof(fault));
+  fault.pattern = "*/realms/realm2";
+  fault.probability = 1;
+  fault.latency_ms = FAULT_LATENCY_MS;
+  if (deltacloud_add_fault(&api, &fault) < 0) {
+    fprintf(stderr, "Failed to add a fault: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  if (deltacloud_get_realm_by_id(&api, "realm1", &realm) >= 0) {
+    fprintf(stderr, "Expected an injected 500 to fail the GET, but it succeeded\n");
+    deltacloud_free_realm(&realm);
+    goto cleanup;
+  }
+
+  start = now_ms();
+  if (get_realm(&api, "realm2") < 0)
+    goto cleanup;
+  if (now_ms() - start < FAULT_LATENCY_MS) {
+    fprintf(stderr, "Expected the GET to take at least %d ms, took %.0f ms\n",
+	    FAULT_LATENCY_MS, now_ms() - start);
+    goto cleanup;
+  }
+
+  /* other URLs are left alone, and so is everything once cleared */
+  if (get_realm(&api, "realm0") < 0)
+    goto cleanup;
+
+  if (deltacloud_clear_faults(&api) < 0) {
+    fprintf(stderr, "Failed to clear faults: %s\n",
+	    deltacloud_get_last_error_string());
+    goto cleanup;
+  }
+
+  if (get_realm(&api, "realm1") < 0)
+    goto cleanup;
+
+  ret = 0;
+
+ cleanup:
+  deltacloud_free(&api);
+
+  return ret;
+}
+
+static const struct {
+  const char *name;
+  int (*run)(void);
+} checks[] = {
+  { "fault injection", test_fault },
+  { "TTL cache", test_ttl },
+  { "stale-while-revalidate", test_stale },
+  { "retries", test_retry },
+  { "hedging", test_hedge },
+};
+
+int main(int argc, char *argv[])
+{
+  size_t i;
+  int ret = 0;
+
+  if (argc < 4 || argc > 6) {
+    fprintf(stderr, "Usage: %s <url> <user> <password> [<driver> [<provider>]]\n",
+	    argv[0]);
+    return 1;
+  }
+
+  url = argv[1];
+  user = argv[2];
+  password = argv[3];
+  driver = test_driver(argc, argv);
+  provider = test_provider(argc, argv);
+
+  for (i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+    if (checks[i].run() < 0) {
+      fprintf(stderr, "FAILED: %s\n", checks[i].name);
+      ret = 3;
+    }
+  }
+
+  return ret;
+}